@@ -38,12 +38,84 @@ struct Node node_constructor(void *data, unsigned long size)
     // Initialize the pointers.
     node.next = NULL;
     node.previous = NULL;
+    node.pool = NULL;
+    node.inline_data = 0;
     return node;
 }
 
+// The pooled constructor allocates the node header and, when possible, the data in a single pooled block.
+struct Node * node_constructor_pooled(struct Pool *pool, void *data, unsigned long size)
+{
+    if (size < 1)
+    {
+        printf("Invalid data size for node...\n");
+        exit(1);
+    }
+    struct Node *node = pool->allocate(pool);
+    if (!node)
+    {
+        return NULL;
+    }
+    node->next = NULL;
+    node->previous = NULL;
+    node->pool = pool;
+    if (NODE_PAYLOAD_OFFSET + size <= pool->block_size)
+    {
+        // The payload fits in the block - store it right after the header.
+        node->data = (char *)node + NODE_PAYLOAD_OFFSET;
+        node->inline_data = 1;
+    }
+    else
+    {
+        // Oversized payloads fall back to a separate heap allocation.
+        node->data = malloc(size);
+        node->inline_data = 0;
+        if (!node->data)
+        {
+            pool->release(pool, node);
+            return NULL;
+        }
+    }
+    memcpy(node->data, data, size);
+    return node;
+}
+
+// The owning constructor wraps data the caller already allocated on the heap.
+struct Node * node_constructor_owned(struct Pool *pool, void *data)
+{
+    struct Node *node = pool ? pool->allocate(pool) : malloc(sizeof(struct Node));
+    if (!node)
+    {
+        return NULL;
+    }
+    node->data = data;
+    node->next = NULL;
+    node->previous = NULL;
+    node->pool = pool;
+    node->inline_data = 0;
+    return node;
+}
+
+// The block size function reports how large a pool's blocks must be to hold a payload inline.
+unsigned long node_block_size(unsigned long size)
+{
+    return NODE_PAYLOAD_OFFSET + size;
+}
+
 // The destructor removes a node by freeing the node's data and its node.
 void node_destructor(struct Node *node)
 {
-    free(node->data);
-    free(node);
+    // Inline data goes away with the block itself.
+    if (!node->inline_data)
+    {
+        free(node->data);
+    }
+    if (node->pool)
+    {
+        node->pool->release(node->pool, node);
+    }
+    else
+    {
+        free(node);
+    }
 }
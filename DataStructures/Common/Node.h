@@ -24,11 +24,16 @@
  however, custom data types (those not included in the enumeration) need to be allocated manually and the data type Special should be used.
  
  In order to destroy a node, the node destructor is recommended as it will free both the stored data and the node itself automatically.
+ 
+ Nodes may also be carved from a Pool.  A pooled node stores small payloads inline, directly after the node header in the same cache-aligned block,
+ so creating it costs a single free-list pop instead of two mallocs.  The destructor knows how each node was created and releases it accordingly.
  */
 
 #ifndef Node_h
 #define Node_h
 
+#include "Pool.h"
+
 // MARK: DATA TYPES
 
 // Nodes are used to store data of any type in a list.  
@@ -40,13 +45,28 @@ struct Node
     // A pointer to the next node in the chain.
     struct Node *next;
     struct Node *previous;
+    
+    /* PRIVATE MEMBER VARIABLES */
+    // The pool the node was carved from, or NULL if the node was allocated with malloc.
+    struct Pool *pool;
+    // Set when the data lives inside the node's own block and must not be freed separately.
+    short inline_data;
 };
 
+// Inline payloads start at the first 16 byte boundary after the node header.
+#define NODE_PAYLOAD_OFFSET ((sizeof(struct Node) + 15) & ~(unsigned long)15)
+
 
 // MARK: CONSTRUCTORS
 
 // The constructor should be used to create nodes.
 struct Node node_constructor(void *data, unsigned long size);
+// The pooled constructor carves a node from the pool, copying the data inline when it fits in the block.
+struct Node * node_constructor_pooled(struct Pool *pool, void *data, unsigned long size);
+// The owning constructor adopts heap-allocated data without copying it - the node frees it on destruction.
+struct Node * node_constructor_owned(struct Pool *pool, void *data);
+// The block size a pool needs to store a payload of the given size inline.
+unsigned long node_block_size(unsigned long size);
 // The destructor should be used to destroy nodes.
 void node_destructor(struct Node *node);
 
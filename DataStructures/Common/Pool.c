@@ -0,0 +1,147 @@
+//
+// ==================================
+// libeom
+//
+// an open source c library.
+// ==================================
+//
+// Pool.c
+//
+//
+
+
+#include "Pool.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+
+// MARK: DATA TYPES
+
+// Each slab begins with a header linking it to the previous slab.
+// The header occupies one full alignment unit so the first block stays aligned.
+struct PoolSlab
+{
+    struct PoolSlab *next;
+};
+
+// Free blocks store the link to the next free block in their first bytes.
+struct PoolFreeBlock
+{
+    struct PoolFreeBlock *next;
+};
+
+
+// MARK: FUNCTION PROTOTYPES
+
+// MARK: Private Member Methods
+
+int grow_pool(struct Pool *pool);
+
+
+// MARK: Public Member Methods
+
+void * allocate_pool(struct Pool *pool);
+void release_pool(struct Pool *pool, void *block);
+
+
+// MARK: CONSTRUCTORS
+
+struct Pool pool_constructor(unsigned long block_size, unsigned long blocks_per_slab)
+{
+    if (block_size < 1 || blocks_per_slab < 1)
+    {
+        // Confirm the pool can hold something, otherwise exit with an error message.
+        printf("Invalid block size for pool...\n");
+        exit(1);
+    }
+    struct Pool pool;
+    // Round the block size up so every block starts on its own cache line.
+    pool.block_size = (block_size + POOL_ALIGNMENT - 1) / POOL_ALIGNMENT * POOL_ALIGNMENT;
+    pool.blocks_per_slab = blocks_per_slab;
+    pool.in_use = 0;
+    pool.slab_count = 0;
+    pool.free_list = NULL;
+    pool.slabs = NULL;
+
+    pool.allocate = allocate_pool;
+    pool.release = release_pool;
+
+    return pool;
+}
+
+void pool_destructor(struct Pool *pool)
+{
+    // Walk the slab list and hand each slab back to the system.
+    struct PoolSlab *slab = pool->slabs;
+    while (slab)
+    {
+        struct PoolSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->in_use = 0;
+    pool->slab_count = 0;
+}
+
+
+
+// MARK: PRIVATE METHODS
+
+// The grow function requests a new slab and threads all of its blocks onto the free list.
+int grow_pool(struct Pool *pool)
+{
+    void *memory = NULL;
+    // The slab header takes one alignment unit, followed by the blocks.
+    unsigned long slab_size = POOL_ALIGNMENT + pool->block_size * pool->blocks_per_slab;
+    if (posix_memalign(&memory, POOL_ALIGNMENT, slab_size) != 0)
+    {
+        return 0;
+    }
+    // Link the slab so it can be freed later.
+    struct PoolSlab *slab = memory;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count += 1;
+    // Push the blocks in reverse so they are handed out in address order.
+    char *first_block = (char *)memory + POOL_ALIGNMENT;
+    for (unsigned long i = pool->blocks_per_slab; i > 0; i--)
+    {
+        struct PoolFreeBlock *block = (struct PoolFreeBlock *)(first_block + (i - 1) * pool->block_size);
+        block->next = pool->free_list;
+        pool->free_list = block;
+    }
+    return 1;
+}
+
+
+
+// MARK: PUBLIC METHODS
+
+// The allocate function pops a block from the free list, growing the pool if it is empty.
+void * allocate_pool(struct Pool *pool)
+{
+    if (!pool->free_list && !grow_pool(pool))
+    {
+        return NULL;
+    }
+    struct PoolFreeBlock *block = pool->free_list;
+    pool->free_list = block->next;
+    pool->in_use += 1;
+    return block;
+}
+
+// The release function pushes a block back onto the free list.
+void release_pool(struct Pool *pool, void *block)
+{
+    if (!block)
+    {
+        return;
+    }
+    struct PoolFreeBlock *free_block = block;
+    free_block->next = pool->free_list;
+    pool->free_list = free_block;
+    pool->in_use -= 1;
+}
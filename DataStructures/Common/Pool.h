@@ -0,0 +1,65 @@
+//
+// ==================================
+// libeom
+//
+// an open source c library.
+// ==================================
+//
+// Pool.h
+//
+//
+
+/*
+ The Pool struct is a slab allocator for fixed-size blocks.
+ Rather than asking malloc for every small object, the pool requests large, cache-aligned slabs and carves them into equally sized blocks.
+ Released blocks are kept on a free list and handed back out on the next allocation, so steady-state churn never touches the heap.
+
+ Every block is aligned to POOL_ALIGNMENT bytes and its size is rounded up to a multiple of it, so two blocks never share a cache line.
+
+ Memory is only returned to the system when the pool is destroyed, at which point every block it handed out becomes invalid.
+ A pool is not thread safe - guard it externally if it is shared between threads.
+ */
+
+#ifndef Pool_h
+#define Pool_h
+
+// The alignment (and size granularity) of every block - one cache line.
+#define POOL_ALIGNMENT 64
+
+// MARK: DATA TYPES
+
+// Pools hand out fixed-size blocks carved from larger slabs.
+struct Pool
+{
+    /* PUBLIC MEMBER VARIABLES */
+    // The usable size of every block, rounded up to a multiple of POOL_ALIGNMENT.
+    unsigned long block_size;
+    // The number of blocks carved from each slab.
+    unsigned long blocks_per_slab;
+    // The number of blocks currently handed out.
+    unsigned long in_use;
+    // The number of slabs requested from the system.
+    unsigned long slab_count;
+
+    /* PRIVATE MEMBER VARIABLES */
+    // The head of the free block list - the link is stored inside the free block itself.
+    void *free_list;
+    // The head of the slab list, used to release memory in the destructor.
+    void *slabs;
+
+    /* PUBLIC MEMBER METHODS */
+    // Allocate returns a block of block_size bytes, or NULL if the system is out of memory.
+    void * (*allocate)(struct Pool *pool);
+    // Release returns a block to the pool so it can be reused.
+    void (*release)(struct Pool *pool, void *block);
+};
+
+
+// MARK: CONSTRUCTORS
+
+// The constructor should be used to create pools - no memory is requested until the first allocation.
+struct Pool pool_constructor(unsigned long block_size, unsigned long blocks_per_slab);
+// The destructor frees every slab, invalidating all blocks handed out by the pool.
+void pool_destructor(struct Pool *pool);
+
+#endif /* Pool_h */
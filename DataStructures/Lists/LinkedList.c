@@ -23,17 +23,21 @@
 
 // MARK: Private Member Methods
 
-struct Node * create_node_ll(void *data, unsigned long size);
+struct Node * create_node_ll(struct LinkedList *linked_list, void *data, unsigned long size);
 void destroy_node_ll(struct Node *node_to_destroy);
+void link_node_ll(struct LinkedList *linked_list, int index, struct Node *node_to_insert);
+struct Node * merge_ll(struct Node *left, struct Node *right, int (*compare)(void *a, void *b));
 
 
 // MARK: Public Member Methods
 
 struct Node * iterate_ll(struct LinkedList *linked_list, int index);
 void insert_ll(struct LinkedList *linked_list, int index, void *data, unsigned long size);
+void insert_owned_ll(struct LinkedList *linked_list, int index, void *data);
+void append_ll(struct LinkedList *linked_list, void *data, unsigned long size);
 void remove_node_ll(struct LinkedList *linked_list, int index);
 void * retrieve_ll(struct LinkedList *linked_list, int index);
-void bubble_sort_ll(struct LinkedList *linked_list, int (*compare)(void *a, void *b));
+void merge_sort_ll(struct LinkedList *linked_list, int (*compare)(void *a, void *b));
 short binary_search_ll(struct LinkedList *linked_list, void *query, int (*compare)(void *a, void *b));
 
 // MARK: CONSTRUCTORS
@@ -42,12 +46,16 @@ struct LinkedList linked_list_constructor()
 {
     struct LinkedList new_list;
     new_list.head = NULL;
+    new_list.tail = NULL;
     new_list.length = 0;
+    new_list.pool = NULL;
     
     new_list.insert = insert_ll;
+    new_list.insert_owned = insert_owned_ll;
+    new_list.append = append_ll;
     new_list.remove = remove_node_ll;
     new_list.retrieve = retrieve_ll;
-    new_list.sort = bubble_sort_ll;
+    new_list.sort = merge_sort_ll;
     new_list.search = binary_search_ll;
     
     return new_list;
@@ -55,7 +63,8 @@ struct LinkedList linked_list_constructor()
 
 void linked_list_destructor(struct LinkedList *linked_list)
 {
-    for (int i = 0; i < linked_list->length; i++)
+    // Remove from the front until empty - remove decrements the length as it goes.
+    while (linked_list->length > 0)
     {
         linked_list->remove(linked_list, 0);
     }
@@ -66,8 +75,13 @@ void linked_list_destructor(struct LinkedList *linked_list)
 // MARK: PRIVATE METHODS
 
 // The create_node function creates a new node to add to the chain by allocating space on the heap and calling the node constructor.
-struct Node * create_node_ll(void *data, unsigned long size)
+// Lists with a pool carve the node (and small payloads) from it instead.
+struct Node * create_node_ll(struct LinkedList *linked_list, void *data, unsigned long size)
 {
+    if (linked_list->pool)
+    {
+        return node_constructor_pooled(linked_list->pool, data, size);
+    }
     // Allocate space.
     struct Node *new_node = (struct Node *)malloc(sizeof(struct Node));
     // Call the constructor.
@@ -81,7 +95,7 @@ void destroy_node_ll(struct Node *node_to_destroy)
     node_destructor(node_to_destroy);
 }
 
-// The iterate function traverses the list from beginning to end.
+// The iterate function traverses the list from whichever end is closer to the index.
 struct Node * iterate_ll(struct LinkedList *linked_list, int index)
 {
     // Confirm the user has specified a valid index.
@@ -89,6 +103,16 @@ struct Node * iterate_ll(struct LinkedList *linked_list, int index)
     {
         return NULL;
     }
+    // Indices in the back half are reached faster by walking backwards from the tail.
+    if (index > linked_list->length / 2)
+    {
+        struct Node *cursor = linked_list->tail;
+        for (int i = linked_list->length - 1; i > index; i--)
+        {
+            cursor = cursor->previous;
+        }
+        return cursor;
+    }
     // Create a cursor node for iteration.
     struct Node *cursor = linked_list->head;
     // Step through the list until the desired index is reached.
@@ -99,37 +123,80 @@ struct Node * iterate_ll(struct LinkedList *linked_list, int index)
     return cursor;
 }
 
-
-
-// MARK: PUBLIC METHODS
-
-// The insert function puts a new node in the chain.
-void insert_ll(struct LinkedList *linked_list, int index, void *data, unsigned long size)
+// The link function splices an already constructed node into the chain.
+void link_node_ll(struct LinkedList *linked_list, int index, struct Node *node_to_insert)
 {
-    // Create a new node to be inserted.
-    struct Node *node_to_insert = create_node_ll(data, size);
     // Check if this node will be the new head of the list.
     if (index == 0)
     {
         // Define the Node's next.
         node_to_insert->next = linked_list->head;
+        if (linked_list->head)
+        {
+            linked_list->head->previous = node_to_insert;
+        }
+        else
+        {
+            // The list was empty, so the node is also the tail.
+            linked_list->tail = node_to_insert;
+        }
         // Re-define the List's head.
         linked_list->head = node_to_insert;
     }
+    else if (index == linked_list->length)
+    {
+        // Appending goes straight to the tail without walking the chain.
+        node_to_insert->previous = linked_list->tail;
+        linked_list->tail->next = node_to_insert;
+        linked_list->tail = node_to_insert;
+    }
     else
     {
         // Find the item in the list immediately before the desired index.
         struct Node *cursor = iterate_ll(linked_list, index - 1);
-        // Set the Node's next.
+        // Set the Node's next and previous.
         node_to_insert->next = cursor->next;
+        node_to_insert->previous = cursor;
+        cursor->next->previous = node_to_insert;
         // Set the cursor's next to the new node.
         cursor->next = node_to_insert;
-        
     }
     // Increment the list length.
     linked_list->length += 1;
 }
 
+
+
+// MARK: PUBLIC METHODS
+
+// The insert function puts a new node in the chain.
+void insert_ll(struct LinkedList *linked_list, int index, void *data, unsigned long size)
+{
+    // Create a new node to be inserted.
+    struct Node *node_to_insert = create_node_ll(linked_list, data, size);
+    if (node_to_insert)
+    {
+        link_node_ll(linked_list, index, node_to_insert);
+    }
+}
+
+// The insert_owned function puts caller-allocated heap data in the chain without copying it.
+// The list takes ownership - the data is freed when its node is removed.
+void insert_owned_ll(struct LinkedList *linked_list, int index, void *data)
+{
+    struct Node *node_to_insert = node_constructor_owned(linked_list->pool, data);
+    if (node_to_insert)
+    {
+        link_node_ll(linked_list, index, node_to_insert);
+    }
+}
+
+// The append function adds a node to the end of the chain in constant time.
+void append_ll(struct LinkedList *linked_list, void *data, unsigned long size)
+{
+    insert_ll(linked_list, linked_list->length, data, size);
+}
+
 // The remove function removes a node from the linked list.
 void remove_node_ll(struct LinkedList *linked_list, int index)
 {
@@ -142,18 +209,33 @@ void remove_node_ll(struct LinkedList *linked_list, int index)
         if (node_to_remove)
         {
             linked_list->head = node_to_remove->next;
+            if (linked_list->head)
+            {
+                linked_list->head->previous = NULL;
+            }
+            else
+            {
+                linked_list->tail = NULL;
+            }
             // Remove the desired node.
             destroy_node_ll(node_to_remove);
         }
     }
     else
     {
-        // Find the item in the list before the one that is going to be removed.
-        struct Node *cursor = iterate_ll(linked_list, index - 1);
-        // Use the cursor to define the node to be removed.
-        struct Node *node_to_remove = cursor->next;
+        // Find the node to be removed - the tail is found without walking the chain.
+        struct Node *node_to_remove = iterate_ll(linked_list, index);
+        struct Node *cursor = node_to_remove->previous;
         // Update the cursor's next to skip the node to be removed.
         cursor->next = node_to_remove->next;
+        if (node_to_remove->next)
+        {
+            node_to_remove->next->previous = cursor;
+        }
+        else
+        {
+            linked_list->tail = cursor;
+        }
         // Remove the node.
         destroy_node_ll(node_to_remove);
     }
@@ -176,62 +258,124 @@ void * retrieve_ll(struct LinkedList *linked_list, int index)
     }
 }
 
-// The sort function is used to sort data in the list.
-// Note that this is a permanent change and items added after sorting will not themselves be sorted.
-// Bubble sort.
-void bubble_sort_ll(struct LinkedList *linked_list, int (*compare)(void *a, void *b))
+// The merge function combines two sorted chains into one, keeping equal items in their original order.
+struct Node * merge_ll(struct Node *left, struct Node *right, int (*compare)(void *a, void *b))
 {
-    for (struct Node *i = linked_list->retrieve(linked_list, 0); i; i = i->next)
+    struct Node merged;
+    struct Node *cursor = &merged;
+    while (left && right)
     {
-        for (struct Node *n = i->next; n; n = n->next)
+        if (compare(left->data, right->data) <= 0)
         {
-            if (compare(i->data, n->data) > 0)
-            {
-               // Swap them.
-                void *temporary = n->data;
-                n->data = i->data;
-                i->data = temporary;
-            }
+            cursor->next = left;
+            left = left->next;
         }
+        else
+        {
+            cursor->next = right;
+            right = right->next;
+        }
+        cursor = cursor->next;
     }
+    cursor->next = left ? left : right;
+    return merged.next;
 }
 
-short binary_search_ll(struct LinkedList *linked_list, void *query, int (*compare)(void *a, void *b))
+// The sort function is used to sort data in the list.
+// Note that this is a permanent change and items added after sorting will not themselves be sorted.
+// Bottom-up merge sort: O(N log N) comparisons, no extra memory, and nodes are relinked rather than copied.
+void merge_sort_ll(struct LinkedList *linked_list, int (*compare)(void *a, void *b))
 {
-    int position = linked_list->length/2;
-    int min_checked = 0;
-    int max_checked = linked_list->length;
-    while (max_checked > min_checked)
+    if (linked_list->length < 2)
+    {
+        return;
+    }
+    struct Node *head = linked_list->head;
+    // Merge runs of width 1, 2, 4, ... until a single run covers the list.
+    for (int width = 1; width < linked_list->length; width *= 2)
     {
-        void *data = linked_list->retrieve(linked_list, position);
-        if (compare(data, query) == 1)
+        struct Node *remaining = head;
+        struct Node *merged_tail = NULL;
+        head = NULL;
+        while (remaining)
         {
-            max_checked = position;
-            if (position != (min_checked + position) / 2)
+            // Split off the left run.
+            struct Node *left = remaining;
+            for (int i = 1; i < width && remaining->next; i++)
             {
-                position = (min_checked + position) / 2;
+                remaining = remaining->next;
             }
-            else
+            struct Node *right = remaining->next;
+            remaining->next = NULL;
+            // Split off the right run.
+            remaining = right;
+            for (int i = 1; i < width && remaining; i++)
             {
-                break;
+                remaining = remaining->next;
             }
-        }
-        else if (compare(data, query) == -1)
-        {
-            min_checked = position;
-            if (position != (max_checked + position) / 2)
+            if (remaining)
+            {
+                struct Node *next_run = remaining->next;
+                remaining->next = NULL;
+                remaining = next_run;
+            }
+            // Merge the pair and attach it to the output chain.
+            struct Node *pair = merge_ll(left, right, compare);
+            if (merged_tail)
             {
-                position = (max_checked + position) / 2;
+                merged_tail->next = pair;
             }
             else
             {
-                break;
+                head = pair;
+            }
+            merged_tail = pair;
+            while (merged_tail->next)
+            {
+                merged_tail = merged_tail->next;
             }
         }
-        else
+    }
+    // Rebuild the previous links and the tail in a single pass.
+    struct Node *previous = NULL;
+    for (struct Node *cursor = head; cursor; cursor = cursor->next)
+    {
+        cursor->previous = previous;
+        previous = cursor;
+    }
+    linked_list->head = head;
+    linked_list->tail = previous;
+}
+
+// The search function looks for the query in a sorted list.
+// Each probe walks forward from the lower bound rather than from the head, so the whole search visits at most N nodes.
+short binary_search_ll(struct LinkedList *linked_list, void *query, int (*compare)(void *a, void *b))
+{
+    int low = 0;
+    int high = linked_list->length;
+    struct Node *low_node = linked_list->head;
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        struct Node *cursor = low_node;
+        for (int i = low; i < middle; i++)
+        {
+            cursor = cursor->next;
+        }
+        int result = compare(cursor->data, query);
+        if (result == 0)
         {
             return 1;
         }
+        else if (result < 0)
+        {
+            low = middle + 1;
+            low_node = cursor->next;
+        }
+        else
+        {
+            high = middle;
+        }
     }
     return 0;
 }
@@ -21,6 +21,12 @@
  
  The constructor and destructor should be used to create and destroy instances of the LinkedList struct.
  
+ By default every insert makes two heap allocations (the node and a copy of the data).
+ Assigning a Pool to the list's pool member before inserting makes nodes and small payloads share one pooled block instead.
+ Data that is already on the heap can be handed over with insert_owned, which adopts the pointer rather than copying it.
+ 
+ The list tracks its tail and links nodes in both directions, so appending (and removing the last item) takes constant time.
+ 
  Note that a reference to the LinkedList instance must be passed to the member functions.
  This is similar to passing "self" to class member functions in Python.
  */
@@ -40,17 +46,25 @@ struct LinkedList
     /* PUBLIC MEMBER VARIABLES */
     // Head points to the first node in the chain.
     struct Node *head;
+    // Tail points to the last node in the chain.
+    struct Node *tail;
     // Length refers to the number of nodes in the chain.
     int length;
+    // An optional pool the nodes are carved from (NULL to use malloc).  It must outlive the list.
+    struct Pool *pool;
     
     /* PUBLIC MEMBER METHODS */
     // Insert adds new items to the chain at a specified location - this function creates the new nodes.
     void (*insert)(struct LinkedList *linked_list, int index, void *data, unsigned long size);
+    // Insert_owned adds heap-allocated data without copying it - the list frees it when the node is removed.
+    void (*insert_owned)(struct LinkedList *linked_list, int index, void *data);
+    // Append adds a new item to the end of the chain in constant time.
+    void (*append)(struct LinkedList *linked_list, void *data, unsigned long size);
     // Remove deletes an item from the chain and handles the deallocation of memory.
     void (*remove)(struct LinkedList *linked_list, int index);
     // Retrieve allows data in the chain to be accessed
     void * (*retrieve)(struct LinkedList *linked_list, int index);
-    // Sorting and searching the list (bubble sort).
+    // Sorting and searching the list (merge sort).
     void (*sort)(struct LinkedList *linked_list, int (*compare)(void *a, void *b));
     // Binary search (requires the list be sorted).
     short (*search)(struct LinkedList *linked_list, void *query, int (*compare)(void *a, void *b));
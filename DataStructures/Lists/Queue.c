@@ -51,8 +51,8 @@ void queue_destructor(struct Queue *queue)
 // The push method adds an item to the end of the list.
 void push(struct Queue *queue, void *data, unsigned long size)
 {
-    // Utilize insert from LinkedList with enforced parameters.
-    queue->list.insert(&queue->list, queue->list.length, data, size);
+    // Utilize append from LinkedList, which goes straight to the tail.
+    queue->list.append(&queue->list, data, size);
 }
 
 // The peek function returns the data from the first item in the chain.
@@ -16,6 +16,8 @@
  The Queue struct is a version of the LinkedList the enforces rules on how items are added and accessed.
  In short, items are always added to the end and removed from the front.
  Largely, the methods defined here simply utilize those from LinkedList in a predefined way.
+ 
+ The Queue is not thread safe.  To hand data between threads, use the bounded, lock-free RingQueue instead.
  */
 
 
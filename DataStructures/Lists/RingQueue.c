@@ -0,0 +1,363 @@
+//
+// ==================================
+// libeom
+//
+// an open source c library.
+// ==================================
+//
+// RingQueue.c
+//
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+
+#include "RingQueue.h"
+
+// The number of attempts a blocking call makes before it parks the thread.
+#define RING_QUEUE_SPIN_LIMIT 128
+
+
+// MARK: DATA TYPES
+
+// Each cell starts with its sequence number; the element follows at a fixed offset.
+struct RingQueueCell
+{
+    atomic_ulong sequence;
+};
+
+#define RING_QUEUE_CELL_HEADER ((sizeof(struct RingQueueCell) + 7) & ~(unsigned long)7)
+
+
+// MARK: FUNCTION PROTOTYPES
+
+// MARK: Private Member Methods
+
+struct RingQueueCell * cell_rq(struct RingQueue *ring_queue, unsigned long position);
+int enqueue_rq(struct RingQueue *ring_queue, void *element);
+int dequeue_rq(struct RingQueue *ring_queue, void *element);
+void wake_rq(atomic_int *waiting, pthread_mutex_t *lock, pthread_cond_t *condition);
+void relax_rq(void);
+
+
+// MARK: Public Member Methods
+
+int try_push_rq(struct RingQueue *ring_queue, void *element);
+int try_pop_rq(struct RingQueue *ring_queue, void *element);
+void push_rq(struct RingQueue *ring_queue, void *element);
+void pop_rq(struct RingQueue *ring_queue, void *element);
+int timed_pop_rq(struct RingQueue *ring_queue, void *element, long timeout_ms);
+unsigned long push_batch_rq(struct RingQueue *ring_queue, void *elements, unsigned long count);
+unsigned long pop_batch_rq(struct RingQueue *ring_queue, void *elements, unsigned long count);
+unsigned long size_rq(struct RingQueue *ring_queue);
+
+
+// MARK: CONSTRUCTORS
+
+struct RingQueue ring_queue_constructor(unsigned long capacity, unsigned long element_size)
+{
+    if (capacity < 2 || element_size < 1)
+    {
+        // Confirm the queue can hold something, otherwise exit with an error message.
+        printf("Invalid capacity or element size for ring queue...\n");
+        exit(1);
+    }
+    struct RingQueue ring_queue;
+    // Round the capacity up to a power of two so positions map to cells with a mask.
+    unsigned long rounded = 2;
+    while (rounded < capacity)
+    {
+        rounded *= 2;
+    }
+    ring_queue.capacity = rounded;
+    ring_queue.element_size = element_size;
+    ring_queue.cell_size = (RING_QUEUE_CELL_HEADER + element_size + 7) & ~(unsigned long)7;
+    if (posix_memalign(&ring_queue.cells, 64, ring_queue.cell_size * rounded) != 0)
+    {
+        printf("Unable to allocate ring queue...\n");
+        exit(1);
+    }
+    // Each cell starts out expecting the producer for its own position.
+    for (unsigned long i = 0; i < rounded; i++)
+    {
+        atomic_init(&cell_rq(&ring_queue, i)->sequence, i);
+    }
+    atomic_init(&ring_queue.enqueue_position, 0);
+    atomic_init(&ring_queue.dequeue_position, 0);
+    atomic_init(&ring_queue.waiting_producers, 0);
+    atomic_init(&ring_queue.waiting_consumers, 0);
+    ring_queue.lock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+    ring_queue.not_full = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+    ring_queue.not_empty = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+
+    ring_queue.try_push = try_push_rq;
+    ring_queue.try_pop = try_pop_rq;
+    ring_queue.push = push_rq;
+    ring_queue.pop = pop_rq;
+    ring_queue.timed_pop = timed_pop_rq;
+    ring_queue.push_batch = push_batch_rq;
+    ring_queue.pop_batch = pop_batch_rq;
+    ring_queue.size = size_rq;
+
+    return ring_queue;
+}
+
+void ring_queue_destructor(struct RingQueue *ring_queue)
+{
+    free(ring_queue->cells);
+    ring_queue->cells = NULL;
+    pthread_mutex_destroy(&ring_queue->lock);
+    pthread_cond_destroy(&ring_queue->not_full);
+    pthread_cond_destroy(&ring_queue->not_empty);
+}
+
+
+
+// MARK: PRIVATE METHODS
+
+// The cell function maps a position onto its cell.
+struct RingQueueCell * cell_rq(struct RingQueue *ring_queue, unsigned long position)
+{
+    return (struct RingQueueCell *)((char *)ring_queue->cells + (position & (ring_queue->capacity - 1)) * ring_queue->cell_size);
+}
+
+// The enqueue function claims the next producer position and publishes the element into its cell.
+int enqueue_rq(struct RingQueue *ring_queue, void *element)
+{
+    unsigned long position = atomic_load_explicit(&ring_queue->enqueue_position, memory_order_relaxed);
+    struct RingQueueCell *cell;
+    while (1)
+    {
+        cell = cell_rq(ring_queue, position);
+        unsigned long sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0)
+        {
+            // The cell is free for this position - try to claim it.
+            if (atomic_compare_exchange_weak_explicit(&ring_queue->enqueue_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // The consumer a full lap behind has not freed the cell yet - the queue is full.
+            return 0;
+        }
+        else
+        {
+            // Another producer claimed this position first.
+            position = atomic_load_explicit(&ring_queue->enqueue_position, memory_order_relaxed);
+        }
+    }
+    memcpy((char *)cell + RING_QUEUE_CELL_HEADER, element, ring_queue->element_size);
+    // Hand the cell to the consumer of this position.
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+    return 1;
+}
+
+// The dequeue function claims the next consumer position and copies its element out.
+int dequeue_rq(struct RingQueue *ring_queue, void *element)
+{
+    unsigned long position = atomic_load_explicit(&ring_queue->dequeue_position, memory_order_relaxed);
+    struct RingQueueCell *cell;
+    while (1)
+    {
+        cell = cell_rq(ring_queue, position);
+        unsigned long sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (difference == 0)
+        {
+            // The cell holds the element for this position - try to claim it.
+            if (atomic_compare_exchange_weak_explicit(&ring_queue->dequeue_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // The producer has not published this position yet - the queue is empty.
+            return 0;
+        }
+        else
+        {
+            // Another consumer claimed this position first.
+            position = atomic_load_explicit(&ring_queue->dequeue_position, memory_order_relaxed);
+        }
+    }
+    memcpy(element, (char *)cell + RING_QUEUE_CELL_HEADER, ring_queue->element_size);
+    // Hand the cell to the producer one lap ahead.
+    atomic_store_explicit(&cell->sequence, position + ring_queue->capacity, memory_order_release);
+    return 1;
+}
+
+// The wake function signals parked threads, taking the lock only when someone is actually waiting.
+void wake_rq(atomic_int *waiting, pthread_mutex_t *lock, pthread_cond_t *condition)
+{
+    // Pairs with the fence a parking thread issues after announcing itself.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiting, memory_order_relaxed) > 0)
+    {
+        pthread_mutex_lock(lock);
+        pthread_cond_broadcast(condition);
+        pthread_mutex_unlock(lock);
+    }
+}
+
+// The relax function eases off the memory bus while spinning.
+void relax_rq(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+
+
+// MARK: PUBLIC METHODS
+
+// The try_push function adds an element if there is room.
+int try_push_rq(struct RingQueue *ring_queue, void *element)
+{
+    if (!enqueue_rq(ring_queue, element))
+    {
+        return 0;
+    }
+    wake_rq(&ring_queue->waiting_consumers, &ring_queue->lock, &ring_queue->not_empty);
+    return 1;
+}
+
+// The try_pop function removes the oldest element if there is one.
+int try_pop_rq(struct RingQueue *ring_queue, void *element)
+{
+    if (!dequeue_rq(ring_queue, element))
+    {
+        return 0;
+    }
+    wake_rq(&ring_queue->waiting_producers, &ring_queue->lock, &ring_queue->not_full);
+    return 1;
+}
+
+// The push function spins, then parks until the element fits.
+void push_rq(struct RingQueue *ring_queue, void *element)
+{
+    for (int i = 0; i < RING_QUEUE_SPIN_LIMIT; i++)
+    {
+        if (try_push_rq(ring_queue, element))
+        {
+            return;
+        }
+        relax_rq();
+    }
+    pthread_mutex_lock(&ring_queue->lock);
+    atomic_fetch_add(&ring_queue->waiting_producers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    // Consumers signal under the lock, so a slot freed after this check cannot be missed.
+    while (!enqueue_rq(ring_queue, element))
+    {
+        pthread_cond_wait(&ring_queue->not_full, &ring_queue->lock);
+    }
+    atomic_fetch_sub(&ring_queue->waiting_producers, 1);
+    pthread_mutex_unlock(&ring_queue->lock);
+    wake_rq(&ring_queue->waiting_consumers, &ring_queue->lock, &ring_queue->not_empty);
+}
+
+// The pop function spins, then parks until an element arrives.
+void pop_rq(struct RingQueue *ring_queue, void *element)
+{
+    timed_pop_rq(ring_queue, element, -1);
+}
+
+// The timed_pop function is pop with an upper bound on the wait (a negative timeout waits forever).
+int timed_pop_rq(struct RingQueue *ring_queue, void *element, long timeout_ms)
+{
+    for (int i = 0; i < RING_QUEUE_SPIN_LIMIT; i++)
+    {
+        if (try_pop_rq(ring_queue, element))
+        {
+            return 1;
+        }
+        relax_rq();
+    }
+    struct timespec deadline;
+    if (timeout_ms >= 0)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    int popped = 0;
+    pthread_mutex_lock(&ring_queue->lock);
+    atomic_fetch_add(&ring_queue->waiting_consumers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    // Producers signal under the lock, so an element published after this check cannot be missed.
+    while (!(popped = dequeue_rq(ring_queue, element)))
+    {
+        if (timeout_ms < 0)
+        {
+            pthread_cond_wait(&ring_queue->not_empty, &ring_queue->lock);
+        }
+        else if (pthread_cond_timedwait(&ring_queue->not_empty, &ring_queue->lock, &deadline) == ETIMEDOUT)
+        {
+            popped = dequeue_rq(ring_queue, element);
+            break;
+        }
+    }
+    atomic_fetch_sub(&ring_queue->waiting_consumers, 1);
+    pthread_mutex_unlock(&ring_queue->lock);
+    if (popped)
+    {
+        wake_rq(&ring_queue->waiting_producers, &ring_queue->lock, &ring_queue->not_full);
+    }
+    return popped;
+}
+
+// The push_batch function adds as many elements as fit, waking consumers once for the whole batch.
+unsigned long push_batch_rq(struct RingQueue *ring_queue, void *elements, unsigned long count)
+{
+    unsigned long pushed = 0;
+    while (pushed < count && enqueue_rq(ring_queue, (char *)elements + pushed * ring_queue->element_size))
+    {
+        pushed++;
+    }
+    if (pushed > 0)
+    {
+        wake_rq(&ring_queue->waiting_consumers, &ring_queue->lock, &ring_queue->not_empty);
+    }
+    return pushed;
+}
+
+// The pop_batch function removes as many elements as are available, waking producers once for the whole batch.
+unsigned long pop_batch_rq(struct RingQueue *ring_queue, void *elements, unsigned long count)
+{
+    unsigned long popped = 0;
+    while (popped < count && dequeue_rq(ring_queue, (char *)elements + popped * ring_queue->element_size))
+    {
+        popped++;
+    }
+    if (popped > 0)
+    {
+        wake_rq(&ring_queue->waiting_producers, &ring_queue->lock, &ring_queue->not_full);
+    }
+    return popped;
+}
+
+// The size function reports the distance between the consumer and producer positions.
+unsigned long size_rq(struct RingQueue *ring_queue)
+{
+    unsigned long dequeued = atomic_load_explicit(&ring_queue->dequeue_position, memory_order_relaxed);
+    unsigned long enqueued = atomic_load_explicit(&ring_queue->enqueue_position, memory_order_relaxed);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+}
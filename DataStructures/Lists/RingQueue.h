@@ -0,0 +1,87 @@
+//
+// ==================================
+// libeom
+//
+// an open source c library.
+// ==================================
+//
+// RingQueue.h
+//
+//
+
+/*
+ The RingQueue struct is a bounded, multi-producer / multi-consumer FIFO that is safe to share between threads.
+ It follows Dmitry Vyukov's bounded MPMC design: a power-of-two array of cells, each tagged with a sequence number,
+ and two cache-line separated counters that producers and consumers claim positions from with a single compare-and-swap.
+ No locks are taken and nothing is allocated once the queue is constructed - elements are copied into and out of the cells.
+
+ The try_ methods never block and report whether they succeeded.
+ The blocking methods spin briefly and then park the calling thread until the queue changes state.
+ Batch methods move as many elements as possible without blocking and return how many they moved.
+
+ Unlike Queue, the RingQueue stores elements of one fixed size; to queue larger records, queue pointers to them.
+ The constructor and destructor should be used to create and destroy instances of the RingQueue struct,
+ and the queue must not be moved or copied once it is in use.
+ */
+
+#ifndef RingQueue_h
+#define RingQueue_h
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+// MARK: DATA TYPES
+
+// RingQueues pass fixed-size elements between threads without locks.
+struct RingQueue
+{
+    /* PUBLIC MEMBER VARIABLES */
+    // The maximum number of elements held at once (a power of two).
+    unsigned long capacity;
+    // The size in bytes of every element.
+    unsigned long element_size;
+
+    /* PRIVATE MEMBER VARIABLES */
+    // The cell array - a sequence number followed by the element in each cell.
+    void *cells;
+    // The size of one cell.
+    unsigned long cell_size;
+    // The next position producers claim, on its own cache line.
+    _Alignas(64) atomic_ulong enqueue_position;
+    // The next position consumers claim, on its own cache line.
+    _Alignas(64) atomic_ulong dequeue_position;
+    // Threads parked in a blocking call - only touched once a thread gives up spinning.
+    _Alignas(64) atomic_int waiting_producers;
+    atomic_int waiting_consumers;
+    pthread_mutex_t lock;
+    pthread_cond_t not_full;
+    pthread_cond_t not_empty;
+
+    /* PUBLIC MEMBER METHODS */
+    // Try_push copies an element in, returning 0 if the queue is full.
+    int (*try_push)(struct RingQueue *ring_queue, void *element);
+    // Try_pop copies the oldest element out, returning 0 if the queue is empty.
+    int (*try_pop)(struct RingQueue *ring_queue, void *element);
+    // Push waits until there is room for the element.
+    void (*push)(struct RingQueue *ring_queue, void *element);
+    // Pop waits until there is an element to copy out.
+    void (*pop)(struct RingQueue *ring_queue, void *element);
+    // Timed_pop waits at most timeout_ms milliseconds for an element, returning 0 on timeout.
+    int (*timed_pop)(struct RingQueue *ring_queue, void *element, long timeout_ms);
+    // Push_batch copies up to count contiguous elements in and returns how many fit.
+    unsigned long (*push_batch)(struct RingQueue *ring_queue, void *elements, unsigned long count);
+    // Pop_batch copies up to count elements out into a contiguous array and returns how many were available.
+    unsigned long (*pop_batch)(struct RingQueue *ring_queue, void *elements, unsigned long count);
+    // Size returns an approximate element count (exact when no other thread is active).
+    unsigned long (*size)(struct RingQueue *ring_queue);
+};
+
+
+// MARK: CONSTRUCTORS
+
+// The constructor allocates every cell up front; the capacity is rounded up to a power of two.
+struct RingQueue ring_queue_constructor(unsigned long capacity, unsigned long element_size);
+// The destructor frees the cells - no thread may be using the queue.
+void ring_queue_destructor(struct RingQueue *ring_queue);
+
+#endif /* RingQueue_h */
@@ -0,0 +1,165 @@
+//
+// ==================================
+// libeom
+//
+// an open source c library.
+// ==================================
+//
+// SortedVector.c
+//
+//
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "SortedVector.h"
+
+
+// MARK: FUNCTION PROTOTYPES
+
+// MARK: Private Member Methods
+
+int grow_sv(struct SortedVector *sorted_vector);
+
+
+// MARK: Public Member Methods
+
+int insert_sv(struct SortedVector *sorted_vector, void *element);
+void remove_sv(struct SortedVector *sorted_vector, int index);
+void * retrieve_sv(struct SortedVector *sorted_vector, int index);
+int search_sv(struct SortedVector *sorted_vector, void *query);
+int lower_bound_sv(struct SortedVector *sorted_vector, void *query);
+
+
+// MARK: CONSTRUCTORS
+
+struct SortedVector sorted_vector_constructor(unsigned long element_size, int (*compare)(void *a, void *b))
+{
+    if (element_size < 1)
+    {
+        // Confirm the size of the elements is at least one, otherwise exit with an error message.
+        printf("Invalid element size for sorted vector...\n");
+        exit(1);
+    }
+    struct SortedVector sorted_vector;
+    sorted_vector.elements = NULL;
+    sorted_vector.element_size = element_size;
+    sorted_vector.length = 0;
+    sorted_vector.capacity = 0;
+    sorted_vector.compare = compare;
+
+    sorted_vector.insert = insert_sv;
+    sorted_vector.remove = remove_sv;
+    sorted_vector.retrieve = retrieve_sv;
+    sorted_vector.search = search_sv;
+    sorted_vector.lower_bound = lower_bound_sv;
+
+    return sorted_vector;
+}
+
+void sorted_vector_destructor(struct SortedVector *sorted_vector)
+{
+    free(sorted_vector->elements);
+    sorted_vector->elements = NULL;
+    sorted_vector->length = 0;
+    sorted_vector->capacity = 0;
+}
+
+
+
+// MARK: PRIVATE METHODS
+
+// The grow function doubles the storage so inserts stay amortized constant in allocations.
+int grow_sv(struct SortedVector *sorted_vector)
+{
+    int capacity = sorted_vector->capacity ? sorted_vector->capacity * 2 : 16;
+    void *elements = realloc(sorted_vector->elements, capacity * sorted_vector->element_size);
+    if (!elements)
+    {
+        return 0;
+    }
+    sorted_vector->elements = elements;
+    sorted_vector->capacity = capacity;
+    return 1;
+}
+
+
+
+// MARK: PUBLIC METHODS
+
+// The lower_bound function binary searches for the first element that is not less than the query.
+int lower_bound_sv(struct SortedVector *sorted_vector, void *query)
+{
+    int low = 0;
+    int high = sorted_vector->length;
+    char *elements = sorted_vector->elements;
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        if (sorted_vector->compare(elements + middle * sorted_vector->element_size, query) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// The search function reports where an equal element is stored.
+int search_sv(struct SortedVector *sorted_vector, void *query)
+{
+    int index = lower_bound_sv(sorted_vector, query);
+    if (index < sorted_vector->length && sorted_vector->compare(retrieve_sv(sorted_vector, index), query) == 0)
+    {
+        return index;
+    }
+    return -1;
+}
+
+// The insert function copies the element after any equal elements, keeping the order stable.
+int insert_sv(struct SortedVector *sorted_vector, void *element)
+{
+    if (sorted_vector->length == sorted_vector->capacity && !grow_sv(sorted_vector))
+    {
+        return -1;
+    }
+    // Find the first element greater than the new one.
+    int low = lower_bound_sv(sorted_vector, element);
+    while (low < sorted_vector->length && sorted_vector->compare(retrieve_sv(sorted_vector, low), element) == 0)
+    {
+        low++;
+    }
+    // Shift the tail up by one and copy the element into the gap.
+    char *position = (char *)sorted_vector->elements + low * sorted_vector->element_size;
+    memmove(position + sorted_vector->element_size, position, (sorted_vector->length - low) * sorted_vector->element_size);
+    memcpy(position, element, sorted_vector->element_size);
+    sorted_vector->length += 1;
+    return low;
+}
+
+// The remove function deletes an element by shifting the tail down over it.
+void remove_sv(struct SortedVector *sorted_vector, int index)
+{
+    if (index < 0 || index >= sorted_vector->length)
+    {
+        return;
+    }
+    char *position = (char *)sorted_vector->elements + index * sorted_vector->element_size;
+    memmove(position, position + sorted_vector->element_size, (sorted_vector->length - index - 1) * sorted_vector->element_size);
+    sorted_vector->length -= 1;
+}
+
+// The retrieve function returns a pointer into the storage - it is invalidated by the next insert.
+void * retrieve_sv(struct SortedVector *sorted_vector, int index)
+{
+    if (index < 0 || index >= sorted_vector->length)
+    {
+        return NULL;
+    }
+    return (char *)sorted_vector->elements + index * sorted_vector->element_size;
+}
@@ -0,0 +1,65 @@
+//
+// ==================================
+// libeom
+//
+// an open source c library.
+// ==================================
+//
+// SortedVector.h
+//
+//
+
+/*
+ The SortedVector struct keeps fixed-size elements ordered in one contiguous array.
+ Unlike the LinkedList, every element can be reached by index in constant time, so searching is a true O(log N) binary search.
+ Insertions and removals shift the elements after the affected position, which is a single memmove over contiguous memory.
+
+ Elements are copied into the vector, so they should be small - for large records store pointers and compare through them.
+ The comparison function is fixed at construction and follows the same contract as the LinkedList sort:
+ negative when a belongs before b, zero when they are equal, positive otherwise.
+
+ The constructor and destructor should be used to create and destroy instances of the SortedVector struct.
+ */
+
+#ifndef SortedVector_h
+#define SortedVector_h
+
+// MARK: DATA TYPES
+
+// SortedVectors store ordered elements in a contiguous, growable array.
+struct SortedVector
+{
+    /* PUBLIC MEMBER VARIABLES */
+    // The contiguous element storage.
+    void *elements;
+    // The size in bytes of every element.
+    unsigned long element_size;
+    // The number of elements currently stored.
+    int length;
+    // The number of elements the storage can hold before it grows.
+    int capacity;
+    // The comparison used to keep the elements in order.
+    int (*compare)(void *a, void *b);
+
+    /* PUBLIC MEMBER METHODS */
+    // Insert copies an element into its sorted position and returns that index (-1 if out of memory).
+    int (*insert)(struct SortedVector *sorted_vector, void *element);
+    // Remove deletes the element at an index, shifting the following elements down.
+    void (*remove)(struct SortedVector *sorted_vector, int index);
+    // Retrieve returns a pointer to the element at an index, or NULL if the index is out of range.
+    void * (*retrieve)(struct SortedVector *sorted_vector, int index);
+    // Search returns the index of an element equal to the query, or -1 if there is none.
+    int (*search)(struct SortedVector *sorted_vector, void *query);
+    // Lower_bound returns the index of the first element not less than the query (length if there is none).
+    int (*lower_bound)(struct SortedVector *sorted_vector, void *query);
+};
+
+
+// MARK: CONSTRUCTORS
+
+// The constructor should be used to create new SortedVector instances.
+struct SortedVector sorted_vector_constructor(unsigned long element_size, int (*compare)(void *a, void *b));
+// The destructor frees the element storage.
+void sorted_vector_destructor(struct SortedVector *sorted_vector);
+
+#endif /* SortedVector_h */
@@ -0,0 +1,285 @@
+// Admission control under a flood from one source.
+// Starts a node with low admission limits and a sender in this process,
+// both on loopback, so every frame and connection comes from one IP, then
+// floods it three ways:
+//
+//   frames       --count bulk messages as fast as the sender's window
+//                allows; frames over --frame-rate are shed, and the bytes
+//                they carried must be credited back, so the sender's
+//                window refills instead of shrinking with every shed frame
+//   rpc          --calls blocking RPC calls; requests over the frame limit
+//                must be answered P2P_RPC_BUSY rather than time out
+//   connections  --dials connections opened and closed at once; those over
+//                --connect-rate must be closed on accept
+//
+//   bench_admission [--address IP:PORT] [--count N] [--size BYTES] [--calls N]
+//                   [--dials N] [--frame-rate R] [--connect-rate R]
+//
+// Each line gives what was offered, what got through, what was shed and
+// how fast. Exits 1 if a check fails.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "p2p_network.h"
+#include "p2p_rpc.h"
+#include "p2p_metrics.h"
+#include "p2p_log.h"
+
+// How long to wait for shedding to settle and credit to come back
+#define DRAIN_TIMEOUT_MS 10000
+
+// Timeout of each RPC call
+#define CALL_TIMEOUT_MS 2000
+
+// Credit the node may hold back for good: just under a grant (a quarter
+// window) of handled bytes, and as much of shed ones
+#define HELD_BACK_MAX (P2P_WIRE_CREDIT_WINDOW / 2)
+
+typedef struct {
+    const char* address;
+    int count;
+    size_t size;
+    int calls;
+    int dials;
+    double frame_rate;
+    double connect_rate;
+} AdmissionBenchConfig;
+
+// Bulk messages the node has handled (handlers take no context)
+static atomic_int received;
+
+static int failures = 0;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void count_handler(P2PMessage* msg) {
+    (void)msg;
+    atomic_fetch_add(&received, 1);
+}
+
+static int echo_handler(P2PMessage* request, P2PRpcReply* reply) {
+    (void)request;
+    reply->len = 0;
+    return 0;
+}
+
+// Remove the peer files the nodes wrote
+static void remove_directory(const char* path) {
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    struct dirent* entry;
+    char file[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        unlink(file);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+// Port of an IP:PORT address (0 if there is none)
+static int address_port(const char* address) {
+    const char* colon = strrchr(address, ':');
+    return colon ? atoi(colon + 1) : 0;
+}
+
+static void check(int ok, const char* what) {
+    printf("  %-58s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) failures++;
+}
+
+// Wait until counter stops moving for a while: its last value
+static uint64_t wait_settled(P2PCounter counter) {
+    uint64_t last = p2p_metrics_counter(counter);
+    long long deadline = now_ns() + DRAIN_TIMEOUT_MS * 1000000LL;
+    long long quiet_until = now_ns() + 100 * 1000000LL;
+    while (now_ns() < quiet_until && now_ns() < deadline) {
+        usleep(1000);
+        uint64_t value = p2p_metrics_counter(counter);
+        if (value != last) {
+            last = value;
+            quiet_until = now_ns() + 100 * 1000000LL;
+        }
+    }
+    return last;
+}
+
+static void report(const char* flood, int offered, int admitted, uint64_t shed, int other, long long elapsed) {
+    printf("%-12s %8d %9d %8llu %8d %10.0f\n", flood, offered, admitted, (unsigned long long)shed, other,
+           offered / (elapsed / 1e9));
+    fflush(stdout);
+}
+
+static void run_frames(const AdmissionBenchConfig* config, P2PNetwork* sender, const char* payload) {
+    long window = p2p_network_send_capacity(sender, config->address);
+    uint64_t shed = p2p_metrics_counter(P2P_COUNTER_FRAMES_SHED);
+    atomic_store(&received, 0);
+    int failed = 0;
+    long long start = now_ns();
+    for (int i = 0; i < config->count; i++) {
+        if (p2p_network_send_bytes(sender, config->address, "ADMISSION_BENCH", payload, config->size) != 0) failed++;
+    }
+    long long elapsed = now_ns() - start;
+    shed = wait_settled(P2P_COUNTER_FRAMES_SHED) - shed;
+
+    // Every byte sent was either handled or shed, and both are credited
+    // back; without credit for shed bytes the window would be long gone
+    long capacity = p2p_network_send_capacity(sender, config->address);
+    long long deadline = now_ns() + DRAIN_TIMEOUT_MS * 1000000LL;
+    while (capacity <= window - HELD_BACK_MAX && now_ns() < deadline) {
+        usleep(1000);
+        capacity = p2p_network_send_capacity(sender, config->address);
+    }
+    report("frames", config->count, atomic_load(&received), shed, failed, elapsed);
+    check(shed > 0, "frames over the limit were shed");
+    check(failed == 0, "no send timed out waiting for credit");
+    check(capacity > window - HELD_BACK_MAX, "the sender's window refilled");
+}
+
+static void run_rpc(const AdmissionBenchConfig* config, P2PNetwork* sender) {
+    P2PRpcClient* client = p2p_rpc_connect(sender, config->address);
+    if (!client) {
+        printf("rpc: could not connect\n");
+        failures++;
+        return;
+    }
+    uint64_t shed = p2p_metrics_counter(P2P_COUNTER_FRAMES_SHED);
+    int ok = 0, busy = 0, other = 0;
+    long long start = now_ns();
+    for (int i = 0; i < config->calls; i++) {
+        size_t len;
+        int status = p2p_rpc_call(client, "ADMISSION_ECHO", "x", 1, NULL, 0, &len, CALL_TIMEOUT_MS);
+        if (status == 0) {
+            ok++;
+        } else if (status == P2P_RPC_BUSY) {
+            busy++;
+        } else {
+            other++;
+        }
+    }
+    long long elapsed = now_ns() - start;
+    shed = p2p_metrics_counter(P2P_COUNTER_FRAMES_SHED) - shed;
+    p2p_rpc_close(client);
+
+    report("rpc", config->calls, ok, shed, other, elapsed);
+    check(busy > 0, "requests over the limit were answered busy");
+    check(other == 0, "every call was answered or refused busy");
+    check((uint64_t)busy == shed, "each shed request got exactly one busy");
+}
+
+static void run_connections(const AdmissionBenchConfig* config) {
+    uint64_t shed = p2p_metrics_counter(P2P_COUNTER_CONNECTIONS_SHED);
+    int opened = 0;
+    long long start = now_ns();
+    for (int i = 0; i < config->dials; i++) {
+        int fd = p2p_network_dial(config->address);
+        if (fd < 0) continue;
+        opened++;
+        close(fd);
+    }
+    long long elapsed = now_ns() - start;
+    shed = wait_settled(P2P_COUNTER_CONNECTIONS_SHED) - shed;
+
+    report("connections", config->dials, opened - (int)shed, shed, config->dials - opened, elapsed);
+    check(shed > 0, "connections over the limit were closed");
+}
+
+int main(int argc, char* argv[]) {
+    AdmissionBenchConfig config = { "127.0.0.1:9740", 20000, 1024, 2000, 100, 1000.0, 10.0 };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--address") == 0 && i + 1 < argc) {
+            config.address = argv[++i];
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            config.count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            config.size = (size_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "--calls") == 0 && i + 1 < argc) {
+            config.calls = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dials") == 0 && i + 1 < argc) {
+            config.dials = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frame-rate") == 0 && i + 1 < argc) {
+            config.frame_rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--connect-rate") == 0 && i + 1 < argc) {
+            config.connect_rate = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--address IP:PORT] [--count N] [--size BYTES] [--calls N]\n"
+                    "       [--dials N] [--frame-rate R] [--connect-rate R]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (config.count < 1 || config.size < 1 || config.calls < 1 || config.dials < 1 ||
+        config.frame_rate <= 0 || config.connect_rate <= 0) {
+        fprintf(stderr, "Counts, size and rates must be positive\n");
+        return 1;
+    }
+    int port = address_port(config.address);
+    if (port <= 0) {
+        fprintf(stderr, "Address must be in format IP:PORT\n");
+        return 1;
+    }
+
+    // Nodes keep their peer lists in the working directory; start from none
+    char dir[] = "/tmp/bench_admission.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) < 0) {
+        fprintf(stderr, "Failed to create a working directory\n");
+        return 1;
+    }
+    // Every shed frame would otherwise be logged
+    p2p_log_set_level(P2P_LOG_ERROR);
+
+    P2PAdmissionConfig admission;
+    p2p_admission_defaults(&admission);
+    admission.frames.rate = config.frame_rate;
+    admission.frames.burst = config.frame_rate / 2;
+    admission.connections.rate = config.connect_rate;
+    admission.connections.burst = config.connect_rate * 2;
+
+    int status = 1;
+    char sender_address[64];
+    snprintf(sender_address, sizeof(sender_address), "127.0.0.1:%d", port + 1);
+    P2PNetwork* node = p2p_network_create(port, config.address, NULL);
+    P2PNetwork* sender = p2p_network_create(port + 1, sender_address, NULL);
+    char* payload = malloc(config.size);
+    if (!node || !sender || !payload) goto done;
+    memset(payload, 'x', config.size);
+
+    if (p2p_network_set_admission(node, &admission) < 0) goto done;
+    p2p_network_register_handler(node, "ADMISSION_BENCH", count_handler);
+    p2p_network_register_rpc_handler(node, "ADMISSION_ECHO", echo_handler);
+    if (p2p_network_start(node) < 0 || p2p_network_start(sender) < 0) {
+        fprintf(stderr, "Failed to start the nodes on %s and %s\n", config.address, sender_address);
+        goto done;
+    }
+
+    printf("Flooding %s from one source: %.0f frames/s, %.0f connections/s admitted\n", config.address,
+           config.frame_rate, config.connect_rate);
+    printf("%-12s %8s %9s %8s %8s %10s\n", "flood", "offered", "admitted", "shed", "failed", "offered/s");
+    run_frames(&config, sender, payload);
+    run_rpc(&config, sender);
+    run_connections(&config);
+    status = failures ? 1 : 0;
+    printf("%s\n", failures ? "FAILED" : "ok");
+
+done:
+    if (sender) {
+        p2p_network_stop(sender);
+        p2p_network_free(sender);
+    }
+    if (node) {
+        p2p_network_stop(node);
+        p2p_network_free(node);
+    }
+    free(payload);
+    remove_directory(dir);
+    return status;
+}
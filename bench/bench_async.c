@@ -0,0 +1,272 @@
+// Asynchronous send throughput from a single thread.
+// Starts one sending node and --peers receiving nodes in this process and
+// sends --count messages round robin across the peers three ways:
+//
+//   blocking  p2p_network_send_bytes, one message written at a time
+//   queue     p2p_network_send_async with completions collected in
+//             batches from p2p_network_poll_completions
+//   callback  p2p_network_send_async reporting to a callback
+//
+// The async paths keep up to --inflight sends outstanding, polling for
+// completions only when the links push back.
+//
+//   bench_async [--address IP:PORT] [--peers N] [--count N] [--size BYTES] [--inflight N]
+//
+// Each line gives messages/sec and MB/s until every receiver has the
+// messages, the most sends that were outstanding at once and how many
+// completed with an error.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "p2p_network.h"
+#include "p2p_log.h"
+
+// How long to wait for the last messages of a run
+#define DRAIN_TIMEOUT_MS 10000
+
+// Completions collected per poll
+#define COMPLETION_BATCH 256
+
+typedef struct {
+    const char* address;
+    int peers;
+    int count;
+    size_t size;
+    int inflight;
+} AsyncConfig;
+
+typedef struct {
+    int completed;
+    int failed;
+    int peak;
+} AsyncResult;
+
+// Messages the receiving nodes have seen (handlers take no context)
+static atomic_int received;
+
+// Outcomes reported to the callback path
+static atomic_int callback_completed;
+static atomic_int callback_failed;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void count_handler(P2PMessage* msg) {
+    (void)msg;
+    atomic_fetch_add(&received, 1);
+}
+
+static void count_completion(void* context, int status) {
+    (void)context;
+    if (status < 0) atomic_fetch_add(&callback_failed, 1);
+    atomic_fetch_add(&callback_completed, 1);
+}
+
+// Remove the peer files the nodes wrote
+static void remove_directory(const char* path) {
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    struct dirent* entry;
+    char file[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        unlink(file);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+// Port of an IP:PORT address (0 if there is none)
+static int address_port(const char* address) {
+    const char* colon = strrchr(address, ':');
+    return colon ? atoi(colon + 1) : 0;
+}
+
+// Wait until the receivers have every message sent since the run began
+static int wait_received(int count) {
+    long long deadline = now_ns() + DRAIN_TIMEOUT_MS * 1000000LL;
+    while (atomic_load(&received) < count && now_ns() < deadline) {
+        usleep(100);
+    }
+    return atomic_load(&received);
+}
+
+static void report(const char* path, const AsyncConfig* config, int delivered, long long elapsed,
+                   const AsyncResult* result) {
+    double seconds = elapsed / 1e9;
+    printf("%-9s %8d %7zu %10d %10.0f %8.2f %8d %7d\n", path, config->count, config->size, delivered,
+           delivered / seconds, delivered * (double)config->size / seconds / 1e6, result->peak, result->failed);
+    fflush(stdout);
+}
+
+static void run_blocking(const AsyncConfig* config, P2PNetwork* node, char (*peers)[64], const char* payload) {
+    AsyncResult result = { 0, 0, 1 };
+    atomic_store(&received, 0);
+    long long start = now_ns();
+    for (int i = 0; i < config->count; i++) {
+        if (p2p_network_send_bytes(node, peers[i % config->peers], "ASYNC_BENCH", payload, config->size) != 0) {
+            result.failed++;
+        }
+    }
+    int delivered = wait_received(config->count - result.failed);
+    report("blocking", config, delivered, now_ns() - start, &result);
+}
+
+static void run_queue(const AsyncConfig* config, P2PNetwork* node, char (*peers)[64], const char* payload) {
+    AsyncResult result = { 0, 0, 0 };
+    P2PSendCompletion completions[COMPLETION_BATCH];
+    atomic_store(&received, 0);
+    long long start = now_ns();
+    int sent = 0;
+    while (result.completed < config->count) {
+        // Submit until the window is full or a link pushes back
+        while (sent < config->count && sent - result.completed < config->inflight) {
+            int status = p2p_network_send_async(node, peers[sent % config->peers], "ASYNC_BENCH", payload,
+                                                config->size, 0, NULL, NULL);
+            if (status == P2P_SEND_BACKPRESSURE) break;
+            if (status < 0) {
+                result.failed++;
+                result.completed++;
+            }
+            sent++;
+        }
+        if (sent - result.completed > result.peak) result.peak = sent - result.completed;
+
+        int n = p2p_network_poll_completions(node, completions, COMPLETION_BATCH, DRAIN_TIMEOUT_MS);
+        if (n == 0) break;
+        for (int i = 0; i < n; i++) {
+            if (completions[i].status < 0) result.failed++;
+        }
+        result.completed += n;
+    }
+    int delivered = wait_received(config->count - result.failed);
+    report("queue", config, delivered, now_ns() - start, &result);
+}
+
+static void run_callback(const AsyncConfig* config, P2PNetwork* node, char (*peers)[64], const char* payload) {
+    AsyncResult result = { 0, 0, 0 };
+    atomic_store(&received, 0);
+    atomic_store(&callback_completed, 0);
+    atomic_store(&callback_failed, 0);
+    long long start = now_ns();
+    int sent = 0;
+    int refused = 0;
+    while (sent < config->count) {
+        int outstanding = sent - refused - atomic_load(&callback_completed);
+        if (outstanding > result.peak) result.peak = outstanding;
+        int status = outstanding < config->inflight
+            ? p2p_network_send_async(node, peers[sent % config->peers], "ASYNC_BENCH", payload, config->size,
+                                     0, count_completion, NULL)
+            : P2P_SEND_BACKPRESSURE;
+        if (status == P2P_SEND_BACKPRESSURE) {
+            usleep(50);
+            continue;
+        }
+        if (status < 0) refused++;
+        sent++;
+    }
+    long long deadline = now_ns() + DRAIN_TIMEOUT_MS * 1000000LL;
+    while (atomic_load(&callback_completed) < config->count - refused && now_ns() < deadline) {
+        usleep(100);
+    }
+    result.failed = refused + atomic_load(&callback_failed);
+    int delivered = wait_received(config->count - result.failed);
+    report("callback", config, delivered, now_ns() - start, &result);
+}
+
+int main(int argc, char* argv[]) {
+    AsyncConfig config = { "127.0.0.1:9720", 4, 200000, 64, 4096 };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--address") == 0 && i + 1 < argc) {
+            config.address = argv[++i];
+        } else if (strcmp(argv[i], "--peers") == 0 && i + 1 < argc) {
+            config.peers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            config.count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            config.size = (size_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "--inflight") == 0 && i + 1 < argc) {
+            config.inflight = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--address IP:PORT] [--peers N] [--count N] [--size BYTES] [--inflight N]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (config.peers < 1 || config.count < 1 || config.size < 1 || config.inflight < 1) {
+        fprintf(stderr, "Peers, count, size and inflight must be positive\n");
+        return 1;
+    }
+    int port = address_port(config.address);
+    if (port <= 0) {
+        fprintf(stderr, "Address must be in format IP:PORT\n");
+        return 1;
+    }
+
+    // Nodes keep their peer lists in the working directory; start from none
+    char dir[] = "/tmp/bench_async.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) < 0) {
+        fprintf(stderr, "Failed to create a working directory\n");
+        return 1;
+    }
+    // Per-message logging would dominate the measurement
+    p2p_log_set_level(P2P_LOG_WARN);
+
+    int status = 1;
+    P2PNetwork* node = p2p_network_create(port, config.address, NULL);
+    P2PNetwork** receivers = calloc(config.peers, sizeof(P2PNetwork*));
+    char (*peers)[64] = calloc(config.peers, sizeof(*peers));
+    char* payload = malloc(config.size);
+    if (!node || !receivers || !peers || !payload) goto done;
+    memset(payload, 'x', config.size);
+
+    if (p2p_network_start(node) < 0) {
+        fprintf(stderr, "Failed to start the node on %s\n", config.address);
+        goto done;
+    }
+    for (int i = 0; i < config.peers; i++) {
+        snprintf(peers[i], sizeof(peers[i]), "127.0.0.1:%d", port + 1 + i);
+        receivers[i] = p2p_network_create(port + 1 + i, peers[i], NULL);
+        if (!receivers[i]) goto done;
+        p2p_network_register_handler(receivers[i], "ASYNC_BENCH", count_handler);
+        if (p2p_network_start(receivers[i]) < 0) {
+            fprintf(stderr, "Failed to start a receiver on %s\n", peers[i]);
+            goto done;
+        }
+    }
+
+    printf("Sending from %s to %d peers, up to %d sends outstanding\n", config.address, config.peers,
+           config.inflight);
+    printf("%-9s %8s %7s %10s %10s %8s %8s %7s\n", "path", "count", "size", "delivered", "msg/s", "MB/s",
+           "inflight", "failed");
+    run_blocking(&config, node, peers, payload);
+    run_queue(&config, node, peers, payload);
+    run_callback(&config, node, peers, payload);
+    status = 0;
+
+done:
+    if (node) {
+        p2p_network_stop(node);
+        p2p_network_free(node);
+    }
+    for (int i = 0; receivers && i < config.peers; i++) {
+        if (receivers[i]) {
+            p2p_network_stop(receivers[i]);
+            p2p_network_free(receivers[i]);
+        }
+    }
+    free(receivers);
+    free(peers);
+    free(payload);
+    remove_directory(dir);
+    return status;
+}
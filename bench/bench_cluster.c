@@ -0,0 +1,449 @@
+// Cluster discovery benchmark.
+// Starts N nodes on loopback ports, spread over one or more processes,
+// bootstraps them in a chain, a star or a random tree, and measures how
+// long discovery takes to give every node the full membership, how many
+// discovery messages and bytes that took, and how many sockets were open
+// at the peak.
+//
+//   bench_cluster [--nodes N] [--topology chain|star|random|all]
+//                 [--procs P] [--port BASE] [--timeout SECONDS] [--seed S]
+//                 [--workers W]
+//
+// Every node ends up with a link to every other node, so a run needs
+// about 2 * N * N sockets in total: raise the open file limit or use
+// --procs for more than about 100 nodes. By default each node
+// runs its own reactor and worker; --workers W puts all the nodes of a
+// process on one shared runtime with W workers instead.
+//
+// --sim runs the same experiment in the deterministic simulator instead:
+// one thread, virtual time, and links shaped by --latency-ms, --jitter-ms,
+// --bandwidth (bytes per second) and --loss. Times are then virtual,
+// "sockets" counts the directed links used and "refused" counts frames
+// the simulated links lost.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "p2p_network.h"
+#include "p2p_metrics.h"
+#include "p2p_sim.h"
+
+// How often a process checks membership and samples the socket gauge
+#define SAMPLE_US 1000
+
+// Discovery traffic counts as finished after this long without any
+#define QUIET_MS 250
+
+// Virtual time the simulator advances between membership checks
+#define SIM_STEP_US 1000
+
+typedef enum { TOPOLOGY_CHAIN, TOPOLOGY_STAR, TOPOLOGY_RANDOM } Topology;
+
+static const char* topology_names[] = { "chain", "star", "random" };
+
+typedef struct {
+    int nodes;
+    int procs;
+    int base_port;
+    int timeout_s;
+    unsigned seed;
+    int workers;                // Shared runtime workers per process (0 for a runtime per node)
+    int sim;                    // Run in the simulator
+    P2PSimLinkConfig link;      // Simulated links
+} ClusterConfig;
+
+// What one process reports back to the coordinator
+typedef struct {
+    int converged;              // Nodes that saw every other node
+    long long converged_ns;     // When the last of them did (CLOCK_MONOTONIC)
+    long long settled_ns;       // When the last discovery message arrived
+    uint64_t discovery_received;
+    uint64_t discovery_forwarded;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t connect_failures;
+    long peak_sockets;
+    long long wall_ns;          // Real time from bootstrap to the report
+} ClusterResult;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// The node that node i bootstraps from (-1 for the first node)
+static int bootstrap_target(Topology topology, int i, unsigned seed) {
+    if (i == 0) return -1;
+    switch (topology) {
+    case TOPOLOGY_CHAIN:
+        return i - 1;
+    case TOPOLOGY_STAR:
+        return 0;
+    default: {
+        // Any earlier node, chosen the same way in every process
+        unsigned state = seed ^ (unsigned)i * 2654435761u;
+        return rand_r(&state) % i;
+    }
+    }
+}
+
+// Wait until a node's server accepts connections
+static int wait_listening(int port, int timeout_ms) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    for (int waited = 0; waited < timeout_ms; waited++) {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) return -1;
+        int ok = connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        close(sock);
+        if (ok) return 0;
+        usleep(1000);
+    }
+    return -1;
+}
+
+// Run nodes [first, last) of the cluster: signal ready, wait for go,
+// bootstrap, then report once they converge or time runs out
+static void run_process(const ClusterConfig* config, Topology topology, int first, int last,
+                        int ready_fd, int go_fd, int result_fd) {
+    // Nodes log every message they handle
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) {
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+    }
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    P2PRuntime* runtime = NULL;
+    if (config->workers > 0) {
+        runtime = p2p_runtime_create(config->workers);
+        if (!runtime) _exit(1);
+    }
+
+    int count = last - first;
+    P2PNetwork** networks = calloc(count, sizeof(P2PNetwork*));
+    char address[64];
+    for (int i = 0; i < count; i++) {
+        snprintf(address, sizeof(address), "127.0.0.1:%d", config->base_port + first + i);
+        networks[i] = p2p_network_create(config->base_port + first + i, address, NULL);
+        if (networks[i] && runtime) p2p_network_set_runtime(networks[i], runtime);
+        if (!networks[i] || p2p_network_start(networks[i]) < 0 ||
+            wait_listening(config->base_port + first + i, 5000) < 0) {
+            fprintf(stderr, "Failed to start node %s\n", address);
+            char failed = 1;
+            if (write(ready_fd, &failed, 1) != 1) _exit(1);
+            _exit(1);
+        }
+    }
+
+    char byte = 0;
+    if (write(ready_fd, &byte, 1) != 1 || read(go_fd, &byte, 1) != 1) _exit(1);
+
+    for (int i = 0; i < count; i++) {
+        int target = bootstrap_target(topology, first + i, config->seed);
+        if (target < 0) continue;
+        snprintf(address, sizeof(address), "127.0.0.1:%d", config->base_port + target);
+        p2p_network_connect(networks[i], address);
+    }
+
+    ClusterResult result;
+    memset(&result, 0, sizeof(result));
+    long long wall_start = now_ns();
+    long long deadline = wall_start + config->timeout_s * 1000000000LL;
+    char* done = calloc(count, 1);
+    while (result.converged < count && now_ns() < deadline) {
+        for (int i = 0; i < count; i++) {
+            if (!done[i] && p2p_peer_list_count(networks[i]->peer_list) >= config->nodes - 1) {
+                done[i] = 1;
+                result.converged++;
+                result.converged_ns = now_ns();
+            }
+        }
+        long sockets = p2p_metrics_gauge(P2P_GAUGE_SOCKETS);
+        if (sockets > result.peak_sockets) result.peak_sockets = sockets;
+        usleep(SAMPLE_US);
+    }
+
+    // Discovery keeps flowing after membership is complete: count it until
+    // no discovery has arrived for QUIET_MS, so the totals cover all of it
+    uint64_t received = p2p_metrics_counter(P2P_COUNTER_DISCOVERY_RECEIVED);
+    long long quiet_since = now_ns();
+    while (now_ns() - quiet_since < QUIET_MS * 1000000LL && now_ns() < deadline) {
+        long sockets = p2p_metrics_gauge(P2P_GAUGE_SOCKETS);
+        if (sockets > result.peak_sockets) result.peak_sockets = sockets;
+        uint64_t now_received = p2p_metrics_counter(P2P_COUNTER_DISCOVERY_RECEIVED);
+        if (now_received != received) {
+            received = now_received;
+            quiet_since = now_ns();
+        }
+        usleep(SAMPLE_US);
+    }
+    result.settled_ns = quiet_since;
+    result.discovery_received = p2p_metrics_counter(P2P_COUNTER_DISCOVERY_RECEIVED);
+    result.discovery_forwarded = p2p_metrics_counter(P2P_COUNTER_DISCOVERY_FORWARDED);
+    result.bytes_sent = p2p_metrics_counter(P2P_COUNTER_BYTES_SENT);
+    result.bytes_received = p2p_metrics_counter(P2P_COUNTER_BYTES_RECEIVED);
+    result.connect_failures = p2p_metrics_counter(P2P_COUNTER_CONNECT_FAILURES);
+    result.wall_ns = now_ns() - wall_start;
+
+    if (write(result_fd, &result, sizeof(result)) != sizeof(result)) _exit(1);
+    // The nodes have no shutdown path; the process exit closes their sockets
+    _exit(0);
+}
+
+// Run the whole cluster in the simulator, reporting virtual times from zero
+static void run_simulation(const ClusterConfig* config, Topology topology, int ready_fd, int go_fd, int result_fd) {
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) {
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+    }
+
+    P2PSim* sim = p2p_sim_create(config->seed, &config->link);
+    P2PNetwork** networks = calloc(config->nodes, sizeof(P2PNetwork*));
+    char address[64];
+    for (int i = 0; i < config->nodes; i++) {
+        snprintf(address, sizeof(address), "127.0.0.1:%d", config->base_port + i);
+        networks[i] = p2p_network_create(config->base_port + i, address, NULL);
+        if (!networks[i]) _exit(1);
+        p2p_sim_attach(sim, networks[i]);
+        if (p2p_network_start(networks[i]) < 0) _exit(1);
+    }
+
+    char byte = 0;
+    if (write(ready_fd, &byte, 1) != 1 || read(go_fd, &byte, 1) != 1) _exit(1);
+    long long wall_start = now_ns();
+
+    for (int i = 1; i < config->nodes; i++) {
+        snprintf(address, sizeof(address), "127.0.0.1:%d", config->base_port + bootstrap_target(topology, i, config->seed));
+        p2p_network_connect(networks[i], address);
+    }
+
+    // Step virtual time, checking membership between steps, until every
+    // node has converged and nothing is left in flight
+    ClusterResult result;
+    memset(&result, 0, sizeof(result));
+    char* done = calloc(config->nodes, 1);
+    long long deadline_us = config->timeout_s * 1000000LL;
+    while (p2p_sim_now_us(sim) < deadline_us) {
+        p2p_sim_run(sim, p2p_sim_now_us(sim) + SIM_STEP_US);
+        for (int i = 0; i < config->nodes; i++) {
+            if (!done[i] && p2p_peer_list_count(networks[i]->peer_list) >= config->nodes - 1) {
+                done[i] = 1;
+                result.converged++;
+                result.converged_ns = p2p_sim_now_us(sim) * 1000;
+            }
+        }
+        if (p2p_sim_stats(sim).pending == 0) break;
+    }
+    result.settled_ns = p2p_sim_now_us(sim) * 1000;
+
+    P2PSimStats stats = p2p_sim_stats(sim);
+    result.discovery_received = p2p_metrics_counter(P2P_COUNTER_DISCOVERY_RECEIVED);
+    result.discovery_forwarded = p2p_metrics_counter(P2P_COUNTER_DISCOVERY_FORWARDED);
+    result.bytes_sent = p2p_metrics_counter(P2P_COUNTER_BYTES_SENT);
+    result.bytes_received = stats.bytes_delivered;
+    result.connect_failures = stats.lost;
+    result.peak_sockets = (long)stats.links;
+    result.wall_ns = now_ns() - wall_start;
+
+    if (write(result_fd, &result, sizeof(result)) != sizeof(result)) _exit(1);
+    _exit(0);
+}
+
+// Remove the peer files the nodes wrote
+static void remove_directory(const char* path) {
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    struct dirent* entry;
+    char file[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        unlink(file);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+// Run one topology and print its row: 0 on success, -1 if it could not run
+static int run_cluster(const ClusterConfig* config, Topology topology) {
+    // Nodes keep their peer lists in the working directory; start from none
+    char dir[] = "/tmp/bench_cluster.XXXXXX";
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "Failed to create a working directory\n");
+        return -1;
+    }
+
+    int ready[2], go[2];
+    if (pipe(ready) < 0 || pipe(go) < 0) return -1;
+    int procs = config->procs;
+    pid_t* pids = calloc(procs, sizeof(pid_t));
+    int* results = calloc(procs, sizeof(int));
+
+    fflush(stdout);
+    for (int p = 0; p < procs; p++) {
+        int result_pipe[2];
+        if (pipe(result_pipe) < 0) return -1;
+        pids[p] = fork();
+        if (pids[p] == 0) {
+            close(result_pipe[0]);
+            if (chdir(dir) < 0) _exit(1);
+            if (config->sim) {
+                run_simulation(config, topology, ready[1], go[0], result_pipe[1]);
+            }
+            int first = (int)((long)config->nodes * p / procs);
+            int last = (int)((long)config->nodes * (p + 1) / procs);
+            run_process(config, topology, first, last, ready[1], go[0], result_pipe[1]);
+        }
+        close(result_pipe[1]);
+        results[p] = result_pipe[0];
+    }
+    close(ready[1]);
+    close(go[0]);
+
+    // Start the clock once every node is listening
+    int status = 0;
+    char byte;
+    for (int p = 0; p < procs; p++) {
+        if (read(ready[0], &byte, 1) != 1 || byte != 0) status = -1;
+    }
+    // Simulated runs report virtual times from zero
+    long long start = config->sim ? 0 : now_ns();
+    for (int p = 0; status == 0 && p < procs; p++) {
+        if (write(go[1], &byte, 1) != 1) status = -1;
+    }
+
+    ClusterResult total;
+    memset(&total, 0, sizeof(total));
+    long long converged_ns = start;
+    long long settled_ns = start;
+    for (int p = 0; status == 0 && p < procs; p++) {
+        ClusterResult result;
+        if (read(results[p], &result, sizeof(result)) != sizeof(result)) {
+            status = -1;
+            break;
+        }
+        total.converged += result.converged;
+        if (result.converged_ns > converged_ns) converged_ns = result.converged_ns;
+        if (result.settled_ns > settled_ns) settled_ns = result.settled_ns;
+        total.discovery_received += result.discovery_received;
+        total.discovery_forwarded += result.discovery_forwarded;
+        total.bytes_sent += result.bytes_sent;
+        total.bytes_received += result.bytes_received;
+        total.connect_failures += result.connect_failures;
+        total.peak_sockets += result.peak_sockets;
+        if (result.wall_ns > total.wall_ns) total.wall_ns = result.wall_ns;
+    }
+
+    for (int p = 0; p < procs; p++) {
+        kill(pids[p], SIGKILL);
+        waitpid(pids[p], NULL, 0);
+        close(results[p]);
+    }
+    close(ready[0]);
+    close(go[1]);
+    free(pids);
+    free(results);
+    remove_directory(dir);
+
+    if (status < 0) {
+        fprintf(stderr, "%s: a node process failed\n", topology_names[topology]);
+        return -1;
+    }
+    printf("%-8s %6d %6d %6d/%-6d %10.1f %10.1f %10llu %10llu %12llu %12llu %8llu %8ld %10.1f\n",
+           topology_names[topology], config->nodes, procs, total.converged, config->nodes,
+           (converged_ns - start) / 1e6, (settled_ns - start) / 1e6,
+           (unsigned long long)total.discovery_received, (unsigned long long)total.discovery_forwarded,
+           (unsigned long long)total.bytes_sent, (unsigned long long)total.bytes_received,
+           (unsigned long long)total.connect_failures, total.peak_sockets, total.wall_ns / 1e6);
+    fflush(stdout);
+    return total.converged == config->nodes ? 0 : -1;
+}
+
+int main(int argc, char* argv[]) {
+    ClusterConfig config = { 50, 1, 9400, 60, 1, 0, 0, { 1000, 0, 0, 0.0 } };
+    const char* topology = "all";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc) {
+            config.nodes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--topology") == 0 && i + 1 < argc) {
+            topology = argv[++i];
+        } else if (strcmp(argv[i], "--procs") == 0 && i + 1 < argc) {
+            config.procs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            config.base_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            config.timeout_s = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            config.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sim") == 0) {
+            config.sim = 1;
+        } else if (strcmp(argv[i], "--latency-ms") == 0 && i + 1 < argc) {
+            config.link.latency_us = (long)(atof(argv[++i]) * 1000);
+        } else if (strcmp(argv[i], "--jitter-ms") == 0 && i + 1 < argc) {
+            config.link.jitter_us = (long)(atof(argv[++i]) * 1000);
+        } else if (strcmp(argv[i], "--bandwidth") == 0 && i + 1 < argc) {
+            config.link.bandwidth = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+            config.link.loss = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--nodes N] [--topology chain|star|random|all] [--procs P]"
+                    " [--port BASE] [--timeout SECONDS] [--seed S] [--workers W]\n"
+                    "       [--sim [--latency-ms MS] [--jitter-ms MS] [--bandwidth BYTES] [--loss P]]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (config.nodes < 2 || config.procs < 1 || config.procs > config.nodes) {
+        fprintf(stderr, "Need at least 2 nodes and between 1 and N processes\n");
+        return 1;
+    }
+    if (strcmp(topology, "all") != 0 && strcmp(topology, "chain") != 0 &&
+        strcmp(topology, "star") != 0 && strcmp(topology, "random") != 0) {
+        fprintf(stderr, "Unknown topology %s\n", topology);
+        return 1;
+    }
+
+    if (config.sim) {
+        // One process holds the whole simulated cluster
+        config.procs = 1;
+        printf("Discovery convergence in the simulator (latency %.1f ms, jitter %.1f ms, bandwidth %ld B/s, loss %.3f)\n",
+               config.link.latency_us / 1000.0, config.link.jitter_us / 1000.0, config.link.bandwidth, config.link.loss);
+    } else {
+        printf("Discovery convergence on loopback (peak sockets counts both ends, %s)\n",
+               config.workers > 0 ? "shared runtime per process" : "runtime per node");
+    }
+    printf("%-8s %6s %6s %13s %10s %10s %10s %10s %12s %12s %8s %8s %10s\n", "topology", "nodes", "procs",
+           "converged", "time_ms", "settle_ms", "discovery", "forwarded", "bytes_sent", "bytes_recv", "refused",
+           "sockets", "wall_ms");
+
+    int failed = 0;
+    for (int t = TOPOLOGY_CHAIN; t <= TOPOLOGY_RANDOM; t++) {
+        if (strcmp(topology, "all") != 0 && strcmp(topology, topology_names[t]) != 0) continue;
+        // Each topology gets fresh ports so it never meets the previous one's sockets
+        ClusterConfig run = config;
+        run.base_port = config.base_port + t * config.nodes;
+        if (run_cluster(&run, (Topology)t) < 0) failed = 1;
+    }
+    return failed;
+}
@@ -0,0 +1,92 @@
+// CRC-32C benchmark.
+// Reports throughput of each implementation across buffer sizes, in
+// bytes per cycle (TSC cycles on x86) and GB/s, so the per-frame checksum
+// cost can be compared with the cost of encoding the frame.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "p2p_crc32c.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Bytes checksummed per measurement
+#define TOTAL_BYTES (256UL * 1024 * 1024)
+#define MAX_SIZE (64 * 1024)
+
+typedef uint32_t (*crc_fn)(uint32_t crc, const void* data, size_t len);
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long long now_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Keep the optimizer from discarding benchmark results
+static volatile uint32_t sink;
+
+static void bench_crc(const char* label, crc_fn fn, const uint8_t* buf, size_t size) {
+    size_t iterations = TOTAL_BYTES / size;
+    uint32_t crc = 0;
+
+    // Warm the tables and caches
+    for (size_t i = 0; i < iterations / 16 + 1; i++) {
+        crc = fn(crc, buf, size);
+    }
+
+    double start = now_ns();
+    unsigned long long start_cycles = now_cycles();
+    for (size_t i = 0; i < iterations; i++) {
+        crc = fn(crc, buf, size);
+    }
+    unsigned long long cycles = now_cycles() - start_cycles;
+    double elapsed = now_ns() - start;
+    sink += crc;
+
+    double bytes = (double)iterations * size;
+    if (cycles > 0) {
+        printf("%-14s %8zu %10.1f %10.2f %10.2f\n", label, size, elapsed / iterations,
+               bytes / elapsed, bytes / cycles);
+    } else {
+        printf("%-14s %8zu %10.1f %10.2f %10s\n", label, size, elapsed / iterations,
+               bytes / elapsed, "-");
+    }
+}
+
+int main(void) {
+    uint8_t* buf = malloc(MAX_SIZE);
+    for (size_t i = 0; i < MAX_SIZE; i++) {
+        buf[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    // Standard check value for "123456789"
+    uint32_t check = p2p_crc32c(0, "123456789", 9);
+    printf("CRC-32C using %s, check %08x (%s)\n\n", p2p_crc32c_implementation(), check,
+           check == 0xe3069283 ? "ok" : "WRONG");
+    if (p2p_crc32c_hw_available() &&
+        p2p_crc32c_hw(0, buf, MAX_SIZE - 3) != p2p_crc32c_sw(0, buf, MAX_SIZE - 3)) {
+        printf("hardware and software implementations disagree\n");
+        return 1;
+    }
+
+    printf("%-14s %8s %10s %10s %10s\n", "impl", "bytes", "ns/op", "GB/s", "bytes/cyc");
+    size_t sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench_crc("slicing-by-8", p2p_crc32c_sw, buf, sizes[i]);
+        if (p2p_crc32c_hw_available()) {
+            bench_crc(p2p_crc32c_implementation(), p2p_crc32c_hw, buf, sizes[i]);
+        }
+    }
+
+    free(buf);
+    return 0;
+}
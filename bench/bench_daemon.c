@@ -0,0 +1,212 @@
+// Daemon API throughput.
+// Starts a node behind a daemon socket and a second node to talk to, both
+// in this process, then measures two paths through the socket:
+//
+//   send     a client streams SEND requests to the daemon, which hands
+//            them to its network; counted when the other node has them
+//   deliver  the other node sends to the daemon's node and a subscribed
+//            client reads the MESSAGE frames back out of the socket
+//
+//   bench_daemon [--address IP:PORT] [--count N] [--size BYTES]
+//
+// Each line gives messages/sec and MB/s across the whole run. The deliver
+// line also counts messages the subscriber lost to a full queue.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "p2p_network.h"
+#include "p2p_daemon.h"
+#include "p2p_log.h"
+
+// How long to wait for the last messages of a run
+#define DRAIN_TIMEOUT_MS 10000
+
+typedef struct {
+    const char* address;
+    int count;
+    size_t size;
+} DaemonConfig;
+
+// Messages the receiving node has seen (handlers take no context)
+static atomic_int received;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void count_handler(P2PMessage* msg) {
+    (void)msg;
+    atomic_fetch_add(&received, 1);
+}
+
+// Remove the peer files the nodes wrote
+static void remove_directory(const char* path) {
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    struct dirent* entry;
+    char file[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        unlink(file);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+// Port of an IP:PORT address (0 if there is none)
+static int address_port(const char* address) {
+    const char* colon = strrchr(address, ':');
+    return colon ? atoi(colon + 1) : 0;
+}
+
+static void report(const char* path, const DaemonConfig* config, int delivered, long long elapsed,
+                   unsigned long long lost) {
+    double seconds = elapsed / 1e9;
+    printf("%-8s %8d %7zu %10d %10.0f %8.2f %8llu\n", path, config->count, config->size, delivered,
+           delivered / seconds, delivered * (double)config->size / seconds / 1e6, lost);
+    fflush(stdout);
+}
+
+// Client -> daemon -> peer
+static int run_send(const DaemonConfig* config, P2PDaemonClient* client, const char* peer, const char* payload) {
+    atomic_store(&received, 0);
+    long long start = now_ns();
+    for (int i = 0; i < config->count; i++) {
+        if (p2p_daemon_send(client, peer, "DAEMON_BENCH", payload, config->size) < 0) return -1;
+    }
+    P2PDaemonStats stats;
+    if (p2p_daemon_sync(client, &stats) < 0) return -1;
+
+    long long deadline = now_ns() + DRAIN_TIMEOUT_MS * 1000000LL;
+    while (atomic_load(&received) < config->count && now_ns() < deadline) {
+        usleep(100);
+    }
+    int delivered = atomic_load(&received);
+    report("send", config, delivered, now_ns() - start, (unsigned long long)stats.refused);
+    return 0;
+}
+
+// Peer -> node -> subscribed client
+static int run_deliver(const DaemonConfig* config, P2PDaemonClient* client, P2PNetwork* peer,
+                       const char* node, const char* payload) {
+    if (p2p_daemon_subscribe(client, "DAEMON_BENCH") < 0 || p2p_daemon_sync(client, NULL) < 0) return -1;
+
+    long long start = now_ns();
+    int delivered = 0;
+    int sent = 0;
+    while (delivered < config->count) {
+        // Keep the peer ahead of the reader without letting it run off
+        while (sent < config->count && sent - delivered < P2P_DAEMON_CLIENT_QUEUE / 2) {
+            if (p2p_network_send_bytes(peer, node, "DAEMON_BENCH", payload, config->size) != 0) break;
+            sent++;
+        }
+        P2PDaemonMessage* msg = p2p_daemon_receive(client, sent < config->count ? 0 : DRAIN_TIMEOUT_MS);
+        if (!msg) {
+            if (sent < config->count) continue;
+            break;
+        }
+        delivered++;
+        p2p_daemon_message_free(msg);
+        while ((msg = p2p_daemon_receive(client, 0)) != NULL) {
+            delivered++;
+            p2p_daemon_message_free(msg);
+        }
+    }
+    long long elapsed = now_ns() - start;
+    P2PDaemonStats stats;
+    if (p2p_daemon_sync(client, &stats) < 0) return -1;
+    report("deliver", config, delivered, elapsed, (unsigned long long)stats.dropped);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    DaemonConfig config = { "127.0.0.1:9700", 200000, 64 };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--address") == 0 && i + 1 < argc) {
+            config.address = argv[++i];
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            config.count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            config.size = (size_t)atol(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--address IP:PORT] [--count N] [--size BYTES]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (config.count < 1 || config.size < 1 || config.size > P2P_DAEMON_MAX_PAYLOAD) {
+        fprintf(stderr, "Need a positive count and a payload of 1 to %d bytes\n", P2P_DAEMON_MAX_PAYLOAD);
+        return 1;
+    }
+    int port = address_port(config.address);
+    if (port <= 0) {
+        fprintf(stderr, "Address must be in format IP:PORT\n");
+        return 1;
+    }
+
+    // Nodes keep their peer lists in the working directory; start from none
+    char dir[] = "/tmp/bench_daemon.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) < 0) {
+        fprintf(stderr, "Failed to create a working directory\n");
+        return 1;
+    }
+    // Per-message logging would dominate the measurement
+    p2p_log_set_level(P2P_LOG_WARN);
+
+    char peer_address[64];
+    snprintf(peer_address, sizeof(peer_address), "127.0.0.1:%d", port + 1);
+    char path[600];
+    snprintf(path, sizeof(path), "%s/daemon.sock", dir);
+
+    int status = 1;
+    P2PNetwork* node = p2p_network_create(port, config.address, NULL);
+    P2PNetwork* peer = p2p_network_create(port + 1, peer_address, NULL);
+    P2PDaemon* daemon = NULL;
+    P2PDaemonClient* client = NULL;
+    char* payload = malloc(config.size);
+    if (!node || !peer || !payload) goto done;
+    memset(payload, 'x', config.size);
+
+    // As p2p_main --daemon runs it
+    p2p_network_set_flow_policy(node, P2P_FLOW_QUEUE);
+    p2p_network_register_handler(peer, "DAEMON_BENCH", count_handler);
+    daemon = p2p_daemon_serve(node, path);
+    if (!daemon || p2p_network_start(node) < 0 || p2p_network_start(peer) < 0) {
+        fprintf(stderr, "Failed to start the nodes on %s and %s\n", config.address, peer_address);
+        goto done;
+    }
+    client = p2p_daemon_connect(path);
+    if (!client) {
+        fprintf(stderr, "Failed to connect to %s\n", path);
+        goto done;
+    }
+
+    printf("Daemon API on %s\n", path);
+    printf("%-8s %8s %7s %10s %10s %8s %8s\n", "path", "count", "size", "delivered", "msg/s", "MB/s", "lost");
+    if (run_send(&config, client, peer_address, payload) == 0 &&
+        run_deliver(&config, client, peer, config.address, payload) == 0) {
+        status = 0;
+    }
+
+done:
+    if (client) p2p_daemon_close(client);
+    if (daemon) p2p_daemon_free(daemon);
+    if (node) {
+        p2p_network_stop(node);
+        p2p_network_free(node);
+    }
+    if (peer) {
+        p2p_network_stop(peer);
+        p2p_network_free(peer);
+    }
+    free(payload);
+    remove_directory(dir);
+    return status;
+}
@@ -0,0 +1,405 @@
+// Load generator.
+// Drives LOAD_PING messages at a node from several sender threads, either
+// as fast as they go or at a fixed total rate, and reports the achieved
+// messages/sec and MB/s and the p50/p90/p99/p999 latency. The target
+// echoes each ping back as a LOAD_PONG carrying the same payload, which
+// starts with the time the ping was due on this process's clock, so the
+// latencies are round trips and need no clock agreement between hosts.
+//
+//   bench_load [--target IP:PORT] [--address IP:PORT] [--senders N]
+//              [--rate MSGS_PER_SEC] [--size BYTES] [--duration SECONDS]
+//              [--mode send|broadcast] [--connect-per-message]
+//
+// Without --target an echo node is started in this process. A running
+// p2p_main answers pings too; start it with --log-level warn so it does not
+// log every message, and with --no-admission to drive it past the per-host
+// limits it sheds at. --rate 0 (the default) sends as fast as possible. In
+// fixed-rate runs each ping is stamped with the time it was scheduled, so
+// a stalled sender shows up as latency rather than as fewer samples.
+// broadcast sends to every peer the generator knows, which is the target
+// and whatever discovery brings in. --connect-per-message opens a fresh
+// socket for each ping, the transport the links replaced, as a baseline;
+// it takes payloads of up to 255 bytes.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "p2p_network.h"
+#include "p2p_wire.h"
+#include "p2p_log.h"
+
+// How long to wait for the target to answer the first ping
+#define PRIME_TIMEOUT_MS 5000
+
+// How long to wait for stragglers once the senders stop
+#define DRAIN_TIMEOUT_MS 2000
+
+// Smallest payload: the hex timestamp
+#define STAMP_LEN 16
+
+typedef enum { MODE_SEND, MODE_BROADCAST } LoadMode;
+
+typedef struct {
+    const char* target;
+    const char* address;
+    int senders;
+    double rate;                // Messages per second across all senders (0 = unlimited)
+    size_t size;
+    double duration_s;
+    LoadMode mode;
+    int connect_per_message;
+} LoadConfig;
+
+// One sender thread
+typedef struct {
+    const LoadConfig* config;
+    P2PNetwork* network;
+    int index;
+    long long start_ns;
+    long long end_ns;
+    uint64_t sent;              // Pings handed to the network
+    uint64_t expected;          // Echoes they should bring back
+    uint64_t failed;
+} Sender;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(long long deadline_ns) {
+    struct timespec ts = { deadline_ns / 1000000000LL, deadline_ns % 1000000000LL };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+// Round trips seen by the LOAD_PONG handler. Handlers take no context, so
+// the generator keeps its state here.
+static pthread_mutex_t samples_lock = PTHREAD_MUTEX_INITIALIZER;
+static long long* samples;
+static size_t sample_count;
+static size_t sample_cap;
+static atomic_ullong echoed;
+static atomic_int measuring;
+
+// The in-process echo node
+static P2PNetwork* echo_network;
+
+// Answer a ping with the same payload
+static void load_ping_handler(P2PMessage* msg) {
+    p2p_network_send_bytes(echo_network, msg->sender, "LOAD_PONG", msg->payload, msg->data_len);
+}
+
+// Record the round trip a pong closes
+static void load_pong_handler(P2PMessage* msg) {
+    long long now = now_ns();
+    if (msg->data_len < STAMP_LEN) return;
+    char stamp[STAMP_LEN + 1];
+    memcpy(stamp, msg->payload, STAMP_LEN);
+    stamp[STAMP_LEN] = '\0';
+    long long sent = (long long)strtoull(stamp, NULL, 16);
+
+    atomic_fetch_add(&echoed, 1);
+    if (!atomic_load(&measuring)) return;
+    pthread_mutex_lock(&samples_lock);
+    if (sample_count == sample_cap) {
+        size_t cap = sample_cap ? sample_cap * 2 : 65536;
+        long long* grown = realloc(samples, cap * sizeof(long long));
+        if (!grown) {
+            pthread_mutex_unlock(&samples_lock);
+            return;
+        }
+        samples = grown;
+        sample_cap = cap;
+    }
+    samples[sample_count++] = now - sent;
+    pthread_mutex_unlock(&samples_lock);
+}
+
+// Fill payload with the stamp, padded to size and NUL terminated
+static void stamp_payload(char* payload, size_t size, long long stamp_ns) {
+    char stamp[STAMP_LEN + 1];
+    snprintf(stamp, sizeof(stamp), "%016llx", (unsigned long long)stamp_ns);
+    memcpy(payload, stamp, STAMP_LEN);
+    payload[size] = '\0';
+}
+
+// Send one ping on a socket of its own, as nodes did before links
+static int send_connect_per_message(Sender* sender, const char* payload) {
+    P2PMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    strncpy(msg.type, "LOAD_PING", sizeof(msg.type) - 1);
+    strncpy(msg.sender, sender->config->address, sizeof(msg.sender) - 1);
+    p2p_message_set_data(&msg, payload, sender->config->size);
+
+    uint8_t frame[P2P_WIRE_MAX_MESSAGE];
+    size_t len = p2p_wire_encode_message(&msg, frame, sizeof(frame));
+    if (len == 0) return -1;
+    int sock = p2p_network_dial(sender->config->target);
+    if (sock < 0) return -1;
+    int result = p2p_wire_write_all(sock, frame, len);
+    close(sock);
+    return result;
+}
+
+static void* sender_thread(void* arg) {
+    Sender* sender = (Sender*)arg;
+    const LoadConfig* config = sender->config;
+    char* payload = malloc(config->size + 1);
+    if (!payload) return NULL;
+    memset(payload, 'x', config->size);
+
+    // Senders take turns in the schedule so the total rate is even
+    long long interval = config->rate > 0 ? (long long)(1e9 * config->senders / config->rate) : 0;
+    long long due = sender->start_ns + (interval * sender->index) / config->senders;
+    while (1) {
+        long long stamp;
+        if (interval > 0) {
+            if (due >= sender->end_ns) break;
+            sleep_until(due);
+            stamp = due;
+            due += interval;
+        } else {
+            stamp = now_ns();
+            if (stamp >= sender->end_ns) break;
+        }
+        stamp_payload(payload, config->size, stamp);
+
+        int delivered;
+        if (config->connect_per_message) {
+            delivered = send_connect_per_message(sender, payload) == 0;
+        } else if (config->mode == MODE_BROADCAST) {
+            delivered = p2p_network_broadcast(sender->network, "LOAD_PING", payload);
+        } else {
+            delivered = p2p_network_send_bytes(sender->network, config->target, "LOAD_PING",
+                                               payload, config->size) == 0;
+        }
+        if (delivered > 0) {
+            sender->sent++;
+            sender->expected += delivered;
+        } else {
+            sender->failed++;
+        }
+    }
+    free(payload);
+    return NULL;
+}
+
+static int compare_samples(const void* a, const void* b) {
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+// Sample at quantile q of the sorted samples, in microseconds
+static double percentile_us(double q) {
+    if (sample_count == 0) return 0.0;
+    size_t index = (size_t)(q * (double)(sample_count - 1) + 0.5);
+    return samples[index] / 1e3;
+}
+
+// Remove the peer files the nodes wrote
+static void remove_directory(const char* path) {
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    struct dirent* entry;
+    char file[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        unlink(file);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+// Port of an IP:PORT address (0 if there is none)
+static int address_port(const char* address) {
+    const char* colon = strrchr(address, ':');
+    return colon ? atoi(colon + 1) : 0;
+}
+
+// Ping the target until it answers, so the links are up before timing starts
+static int prime(const LoadConfig* config, P2PNetwork* network) {
+    char payload[STAMP_LEN + 1];
+    stamp_payload(payload, STAMP_LEN, now_ns());
+    long long deadline = now_ns() + PRIME_TIMEOUT_MS * 1000000LL;
+    while (now_ns() < deadline) {
+        p2p_network_send_bytes(network, config->target, "LOAD_PING", payload, STAMP_LEN);
+        for (int waited = 0; waited < 100; waited++) {
+            if (atomic_load(&echoed) > 0) return 0;
+            usleep(1000);
+        }
+    }
+    return -1;
+}
+
+// Run the load and print the report: 0 on success, -1 if it could not run
+static int run_load(LoadConfig* config) {
+    char echo_address[64];
+    if (!config->target) {
+        snprintf(echo_address, sizeof(echo_address), "127.0.0.1:%d", address_port(config->address) + 1);
+        echo_network = p2p_network_create(address_port(echo_address), echo_address, NULL);
+        if (!echo_network) return -1;
+        p2p_network_register_handler(echo_network, "LOAD_PING", load_ping_handler);
+        if (p2p_network_start(echo_network) < 0) {
+            fprintf(stderr, "Failed to start the echo node on %s\n", echo_address);
+            p2p_network_free(echo_network);
+            return -1;
+        }
+        config->target = echo_address;
+    }
+
+    P2PNetwork* network = p2p_network_create(address_port(config->address), config->address, NULL);
+    if (!network) return -1;
+    p2p_network_register_handler(network, "LOAD_PONG", load_pong_handler);
+    if (p2p_network_start(network) < 0) {
+        fprintf(stderr, "Failed to listen on %s\n", config->address);
+        p2p_network_free(network);
+        return -1;
+    }
+    if (config->mode == MODE_BROADCAST) {
+        p2p_network_connect(network, config->target);
+    }
+
+    int status = -1;
+    if (prime(config, network) < 0) {
+        fprintf(stderr, "No echo from %s\n", config->target);
+        goto done;
+    }
+    // Give the priming pings time to come back before counting starts
+    usleep(100000);
+    atomic_store(&echoed, 0);
+    atomic_store(&measuring, 1);
+
+    Sender* senders = calloc(config->senders, sizeof(Sender));
+    pthread_t* threads = calloc(config->senders, sizeof(pthread_t));
+    long long start = now_ns() + 10000000LL;
+    long long end = start + (long long)(config->duration_s * 1e9);
+    int started = 0;
+    for (int i = 0; i < config->senders; i++) {
+        senders[i].config = config;
+        senders[i].network = network;
+        senders[i].index = i;
+        senders[i].start_ns = start;
+        senders[i].end_ns = end;
+        if (pthread_create(&threads[i], NULL, sender_thread, &senders[i]) != 0) break;
+        started++;
+    }
+    sleep_until(start);
+
+    uint64_t sent = 0, expected = 0, failed = 0;
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        sent += senders[i].sent;
+        expected += senders[i].expected;
+        failed += senders[i].failed;
+    }
+    long long elapsed = now_ns() - start;
+
+    // Collect the echoes still in flight
+    long long deadline = now_ns() + DRAIN_TIMEOUT_MS * 1000000LL;
+    while (atomic_load(&echoed) < expected && now_ns() < deadline) {
+        usleep(1000);
+    }
+    atomic_store(&measuring, 0);
+
+    pthread_mutex_lock(&samples_lock);
+    qsort(samples, sample_count, sizeof(long long), compare_samples);
+    double seconds = elapsed / 1e9;
+    unsigned long long got = (unsigned long long)atomic_load(&echoed);
+    printf("%-9s %-8s %7d %7zu %10.0f %10llu %10.0f %8.2f %10llu %8llu %8llu %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+           config->mode == MODE_BROADCAST ? "broadcast" : "send",
+           config->connect_per_message ? "connect" : "link", config->senders, config->size, config->rate,
+           (unsigned long long)sent, sent / seconds, sent * (double)config->size / seconds / 1e6,
+           got, (unsigned long long)(expected > got ? expected - got : 0), (unsigned long long)failed,
+           percentile_us(0.50), percentile_us(0.90), percentile_us(0.99), percentile_us(0.999),
+           sample_count ? samples[sample_count - 1] / 1e3 : 0.0);
+    pthread_mutex_unlock(&samples_lock);
+    fflush(stdout);
+    status = started == config->senders && sent > 0 ? 0 : -1;
+    free(senders);
+    free(threads);
+
+done:
+    p2p_network_stop(network);
+    p2p_network_free(network);
+    if (echo_network) {
+        p2p_network_stop(echo_network);
+        p2p_network_free(echo_network);
+    }
+    return status;
+}
+
+int main(int argc, char* argv[]) {
+    LoadConfig config = { NULL, "127.0.0.1:9500", 4, 0.0, 64, 10.0, MODE_SEND, 0 };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--target") == 0 && i + 1 < argc) {
+            config.target = argv[++i];
+        } else if (strcmp(argv[i], "--address") == 0 && i + 1 < argc) {
+            config.address = argv[++i];
+        } else if (strcmp(argv[i], "--senders") == 0 && i + 1 < argc) {
+            config.senders = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            config.rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            config.size = (size_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            config.duration_s = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "send") == 0) {
+                config.mode = MODE_SEND;
+            } else if (strcmp(mode, "broadcast") == 0) {
+                config.mode = MODE_BROADCAST;
+            } else {
+                fprintf(stderr, "Unknown mode %s\n", mode);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--connect-per-message") == 0) {
+            config.connect_per_message = 1;
+        } else {
+            fprintf(stderr, "usage: %s [--target IP:PORT] [--address IP:PORT] [--senders N]"
+                    " [--rate MSGS_PER_SEC] [--size BYTES]\n"
+                    "       [--duration SECONDS] [--mode send|broadcast] [--connect-per-message]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (config.senders < 1 || config.size < STAMP_LEN || config.duration_s <= 0 || config.rate < 0) {
+        fprintf(stderr, "Need at least one sender, a payload of at least %d bytes and a positive duration\n",
+                STAMP_LEN);
+        return 1;
+    }
+    if (config.connect_per_message && (config.mode != MODE_SEND || config.size > P2P_MESSAGE_DATA_MAX)) {
+        fprintf(stderr, "--connect-per-message sends single frames: use --mode send and at most %d bytes\n",
+                P2P_MESSAGE_DATA_MAX);
+        return 1;
+    }
+    if (address_port(config.address) <= 0) {
+        fprintf(stderr, "Address must be in format IP:PORT\n");
+        return 1;
+    }
+
+    // Nodes keep their peer lists in the working directory; start from none
+    char dir[] = "/tmp/bench_load.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) < 0) {
+        fprintf(stderr, "Failed to create a working directory\n");
+        return 1;
+    }
+    // Per-message logging would dominate the measurement
+    p2p_log_set_level(P2P_LOG_WARN);
+
+    printf("Load against %s (latency is round trip in us)\n", config.target ? config.target : "an in-process echo node");
+    printf("%-9s %-8s %7s %7s %10s %10s %10s %8s %10s %8s %8s %9s %9s %9s %9s %9s\n", "mode", "path",
+           "senders", "size", "rate", "sent", "msg/s", "MB/s", "echoed", "lost", "failed",
+           "p50", "p90", "p99", "p999", "max");
+    int status = run_load(&config);
+    remove_directory(dir);
+    return status < 0 ? 1 : 0;
+}
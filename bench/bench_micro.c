@@ -0,0 +1,461 @@
+// Microbenchmarks for the data structures and peer-list hot paths.
+// Each benchmark runs at list sizes from 10 to 100k: the batch size is
+// calibrated until one repetition takes at least MIN_REP_NS, a few warmup
+// repetitions follow, then every repetition's ns/op is recorded and
+// reported as percentiles. --csv writes the same rows in a stable format
+// for comparing runs release over release.
+//
+//   bench_micro [--sizes 10,100,...] [--reps N] [--filter SUBSTRING] [--csv PATH|-]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "DataStructures/Lists/LinkedList.h"
+#include "DataStructures/Lists/Queue.h"
+#include "p2p_peer.h"
+#include "p2p_utils.h"
+#include "p2p_wire.h"
+
+#define MAX_SIZES 16
+#define MIN_REP_NS 1000000.0
+#define WARMUP_REPS 3
+#define DEFAULT_REPS 30
+
+// Node id for the peer-list benchmarks (its peer file lives in a temp dir)
+#define NODE_ID "bench"
+
+typedef void (*op_fn)(void* ctx, int i);
+typedef void (*prepare_fn)(void* ctx, int batch);
+
+static FILE* out;           // Results (stdout is silenced: the peer list logs every add)
+static FILE* csv;
+static int reps = DEFAULT_REPS;
+static const char* filter;
+
+// Keep the optimizer from discarding benchmark results
+static volatile size_t sink;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// xorshift: the same sequence every run
+static unsigned long long rng_state = 88172645463325252ULL;
+static unsigned long long rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double* sorted, int n, double q) {
+    int rank = (int)(q * n + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    return sorted[rank - 1];
+}
+
+// Time op over batch calls, running prepare (untimed) first
+static double time_batch(op_fn op, prepare_fn prepare, void* ctx, int batch) {
+    if (prepare) prepare(ctx, batch);
+    double start = now_ns();
+    for (int i = 0; i < batch; i++) {
+        op(ctx, i);
+    }
+    return now_ns() - start;
+}
+
+// Calibrate, warm up and measure one benchmark at one size, then report it.
+// max_batch caps the calls per repetition for operations prepare has to undo.
+static void measure(const char* name, int size, op_fn op, prepare_fn prepare, void* ctx, int max_batch) {
+    int batch = 1;
+    while (time_batch(op, prepare, ctx, batch) < MIN_REP_NS && batch < max_batch) {
+        batch = batch * 2 < max_batch ? batch * 2 : max_batch;
+    }
+    for (int r = 0; r < WARMUP_REPS; r++) {
+        time_batch(op, prepare, ctx, batch);
+    }
+
+    double* samples = malloc(reps * sizeof(double));
+    double total = 0;
+    for (int r = 0; r < reps; r++) {
+        samples[r] = time_batch(op, prepare, ctx, batch) / batch;
+        total += samples[r];
+    }
+    qsort(samples, reps, sizeof(double), compare_double);
+    double p50 = percentile(samples, reps, 0.50), p90 = percentile(samples, reps, 0.90);
+    double p99 = percentile(samples, reps, 0.99);
+
+    fprintf(out, "%-24s %8d %6d %12.1f %12.1f %12.1f %12.1f %12.1f\n", name, size, batch,
+            samples[0], p50, p90, p99, samples[reps - 1]);
+    fflush(out);
+    if (csv) {
+        fprintf(csv, "%s,%d,%d,%d,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", name, size, reps, batch,
+                samples[0], p50, p90, p99, samples[reps - 1], total / reps);
+        fflush(csv);
+    }
+    free(samples);
+}
+
+static int selected(const char* name) {
+    return !filter || strstr(name, filter) != NULL;
+}
+
+// MARK: LinkedList and Queue
+
+typedef struct {
+    struct LinkedList list;
+    struct Queue queue;
+    int size;
+} ListContext;
+
+static int compare_int(void* a, void* b) {
+    int x = *(int*)a, y = *(int*)b;
+    return (x > y) - (x < y);
+}
+
+// Fill a list with 0..size-1 in order
+static void list_fill(struct LinkedList* list, int size) {
+    for (int i = 0; i < size; i++) {
+        list->append(list, &i, sizeof(int));
+    }
+}
+
+// Put the list back to its nominal size after inserts
+static void list_trim(void* arg, int batch) {
+    ListContext* ctx = arg;
+    (void)batch;
+    while (ctx->list.length > ctx->size) {
+        ctx->list.remove(&ctx->list, 0);
+    }
+}
+
+// Scramble the values so every sort starts from random order
+static void list_shuffle(void* arg, int batch) {
+    ListContext* ctx = arg;
+    (void)batch;
+    for (struct Node* node = ctx->list.head; node; node = node->next) {
+        *(int*)node->data = (int)(rng() % (unsigned)ctx->size);
+    }
+}
+
+static void op_list_insert_head(void* arg, int i) {
+    ListContext* ctx = arg;
+    ctx->list.insert(&ctx->list, 0, &i, sizeof(int));
+}
+
+// O(N) operations are paired with an O(1) one that restores the size, so
+// every call in a batch sees a list of the nominal size
+static void op_list_insert_middle(void* arg, int i) {
+    ListContext* ctx = arg;
+    ctx->list.insert(&ctx->list, ctx->list.length / 2, &i, sizeof(int));
+    ctx->list.remove(&ctx->list, 0);
+}
+
+static void op_list_append(void* arg, int i) {
+    ListContext* ctx = arg;
+    ctx->list.append(&ctx->list, &i, sizeof(int));
+}
+
+static void op_list_retrieve(void* arg, int i) {
+    ListContext* ctx = arg;
+    (void)i;
+    sink += *(int*)ctx->list.retrieve(&ctx->list, (int)(rng() % (unsigned)ctx->list.length));
+}
+
+static void op_list_remove_middle(void* arg, int i) {
+    ListContext* ctx = arg;
+    ctx->list.remove(&ctx->list, ctx->list.length / 2);
+    ctx->list.insert(&ctx->list, 0, &i, sizeof(int));
+}
+
+static void op_list_sort(void* arg, int i) {
+    ListContext* ctx = arg;
+    (void)i;
+    ctx->list.sort(&ctx->list, compare_int);
+}
+
+static void op_list_search(void* arg, int i) {
+    ListContext* ctx = arg;
+    (void)i;
+    int key = (int)(rng() % (unsigned)ctx->size);
+    sink += ctx->list.search(&ctx->list, &key, compare_int);
+}
+
+static void op_queue_push_pop(void* arg, int i) {
+    ListContext* ctx = arg;
+    ctx->queue.push(&ctx->queue, &i, sizeof(int));
+    sink += *(int*)ctx->queue.peek(&ctx->queue);
+    ctx->queue.pop(&ctx->queue);
+}
+
+// Run one list benchmark on a fresh list of size elements
+static void bench_list(const char* name, int size, op_fn op, prepare_fn prepare, int max_batch) {
+    if (!selected(name)) return;
+    ListContext ctx;
+    ctx.size = size;
+    ctx.list = linked_list_constructor();
+    list_fill(&ctx.list, size);
+    ctx.queue = queue_constructor();
+    list_fill(&ctx.queue.list, size);
+
+    measure(name, size, op, prepare, &ctx, max_batch);
+
+    linked_list_destructor(&ctx.list);
+    queue_destructor(&ctx.queue);
+}
+
+// MARK: Peer list and discovery
+
+typedef struct {
+    P2PPeerList* peers;
+    int size;
+    int added;                  // Fresh addresses handed out so far
+    long file_size;             // Peer file length with only the original peers
+    char (*addresses)[32];      // Address of every original peer
+    char peer_list_str[P2P_PEER_LIST_STR_SIZE];
+    DiscoveryMessage msg;
+    uint8_t frame[P2P_WIRE_MAX_DISCOVERY];
+    size_t frame_len;
+} PeerContext;
+
+// Address of peer i (distinct for every i below 2^24)
+static void peer_address(char* buf, size_t cap, int i) {
+    snprintf(buf, cap, "10.%d.%d.%d:%d", (i >> 16) & 255, (i >> 8) & 255, i & 255, 1024 + i % 60000);
+}
+
+static void peer_file_name(char* buf, size_t cap) {
+    snprintf(buf, cap, "%s_PeerList.txt", NODE_ID);
+}
+
+// Write a peer file of size peers and load it, as a restarted node would
+static P2PPeerList* peer_list_build(int size, long* file_size) {
+    char filename[64], address[64];
+    peer_file_name(filename, sizeof(filename));
+    FILE* file = fopen(filename, "w");
+    if (!file) return NULL;
+    for (int i = 0; i < size; i++) {
+        peer_address(address, sizeof(address), i);
+        fprintf(file, "%s\n", address);
+    }
+    *file_size = ftell(file);
+    fclose(file);
+
+    P2PPeerList* peers = p2p_peer_list_create();
+    if (peers) p2p_peer_list_load_from_file(peers, NODE_ID);
+    return peers;
+}
+
+// Drop the peers the last repetition added, from the list and the file
+static void peer_list_reset(void* arg, int batch) {
+    PeerContext* ctx = arg;
+    char address[64], filename[64];
+    (void)batch;
+    for (int i = ctx->size; i < ctx->size + ctx->added; i++) {
+        peer_address(address, sizeof(address), i);
+        p2p_peer_list_remove(ctx->peers, address);
+    }
+    ctx->added = 0;
+    peer_file_name(filename, sizeof(filename));
+    if (truncate(filename, ctx->file_size) < 0) {
+        fprintf(stderr, "Failed to reset %s\n", filename);
+    }
+}
+
+static void op_peer_add_new(void* arg, int i) {
+    PeerContext* ctx = arg;
+    char address[64];
+    (void)i;
+    peer_address(address, sizeof(address), ctx->size + ctx->added++);
+    sink += p2p_peer_list_add(ctx->peers, address, NODE_ID);
+}
+
+static void op_peer_add_known(void* arg, int i) {
+    PeerContext* ctx = arg;
+    (void)i;
+    sink += p2p_peer_list_add(ctx->peers, ctx->addresses[rng() % (unsigned)ctx->size], NODE_ID);
+}
+
+static void op_peer_find(void* arg, int i) {
+    PeerContext* ctx = arg;
+    (void)i;
+    sink += (size_t)p2p_peer_list_find(ctx->peers, ctx->addresses[rng() % (unsigned)ctx->size]);
+}
+
+static void op_peer_list_string(void* arg, int i) {
+    PeerContext* ctx = arg;
+    (void)i;
+    p2p_build_peer_list_string(ctx->peers, ctx->peer_list_str, sizeof(ctx->peer_list_str));
+    sink += (unsigned char)ctx->peer_list_str[0];
+}
+
+static void op_discovery_encode(void* arg, int i) {
+    PeerContext* ctx = arg;
+    (void)i;
+    sink += p2p_wire_encode_discovery(&ctx->msg, ctx->frame, sizeof(ctx->frame));
+}
+
+static void op_discovery_decode(void* arg, int i) {
+    PeerContext* ctx = arg;
+    DiscoveryMessage decoded;
+    P2PFrame parsed;
+    (void)i;
+    p2p_wire_parse_frame(ctx->frame, ctx->frame_len, &parsed);
+    sink += p2p_wire_decode_discovery(&parsed, &decoded);
+}
+
+// Peer-list benchmarks; max_batch 0 means a tenth of the list size
+typedef struct {
+    const char* name;
+    op_fn op;
+    prepare_fn prepare;
+    int max_batch;
+} PeerBenchmark;
+
+// Adds grow the list and the file they scan: they are undone between
+// repetitions, and a repetition grows the list by at most a tenth
+static const PeerBenchmark peer_benchmarks[] = {
+    { "peer_list_add_new", op_peer_add_new, peer_list_reset, 0 },
+    { "peer_list_add_known", op_peer_add_known, NULL, 1 << 20 },
+    { "peer_list_find", op_peer_find, NULL, 1 << 20 },
+    { "peer_list_string", op_peer_list_string, NULL, 1 << 20 },
+    { "discovery_encode", op_discovery_encode, NULL, 1 << 20 },
+    { "discovery_decode", op_discovery_decode, NULL, 1 << 20 },
+};
+#define PEER_BENCHMARKS (int)(sizeof(peer_benchmarks) / sizeof(peer_benchmarks[0]))
+
+// Run every selected peer-list benchmark against one list of size peers
+static void bench_peers(int size) {
+    int wanted = 0;
+    for (int b = 0; b < PEER_BENCHMARKS; b++) {
+        wanted += selected(peer_benchmarks[b].name);
+    }
+    if (!wanted) return;
+
+    PeerContext* ctx = calloc(1, sizeof(PeerContext));
+    ctx->size = size;
+    ctx->addresses = malloc((size_t)size * sizeof(*ctx->addresses));
+    for (int i = 0; i < size; i++) {
+        peer_address(ctx->addresses[i], sizeof(ctx->addresses[i]), i);
+    }
+    ctx->peers = peer_list_build(size, &ctx->file_size);
+    if (!ctx->peers) {
+        fprintf(stderr, "Failed to build a peer list of %d\n", size);
+        free(ctx->addresses);
+        free(ctx);
+        return;
+    }
+
+    // The discovery message a node of this size sends
+    p2p_build_peer_list_string(ctx->peers, ctx->peer_list_str, sizeof(ctx->peer_list_str));
+    strcpy(ctx->msg.type, "DISCOVERY");
+    strcpy(ctx->msg.sender, "192.168.100.200:1248");
+    ctx->msg.ttl = 3;
+    strcpy(ctx->msg.peer_list, ctx->peer_list_str);
+    ctx->frame_len = p2p_wire_encode_discovery(&ctx->msg, ctx->frame, sizeof(ctx->frame));
+
+    for (int b = 0; b < PEER_BENCHMARKS; b++) {
+        const PeerBenchmark* bench = &peer_benchmarks[b];
+        if (!selected(bench->name)) continue;
+        int max_batch = bench->max_batch ? bench->max_batch : (size >= 20 ? size / 10 : 2);
+        measure(bench->name, size, bench->op, bench->prepare, ctx, max_batch);
+    }
+
+    p2p_peer_list_free(ctx->peers);
+    char filename[64];
+    peer_file_name(filename, sizeof(filename));
+    unlink(filename);
+    free(ctx->addresses);
+    free(ctx);
+}
+
+// MARK: Main
+
+// Parse a comma-separated size list: the number of sizes
+static int parse_sizes(char* arg, int* sizes) {
+    int count = 0;
+    for (char* token = strtok(arg, ","); token && count < MAX_SIZES; token = strtok(NULL, ",")) {
+        int size = atoi(token);
+        if (size > 0) sizes[count++] = size;
+    }
+    return count;
+}
+
+int main(int argc, char* argv[]) {
+    int sizes[MAX_SIZES] = { 10, 100, 1000, 10000, 100000 };
+    int size_count = 5;
+    const char* csv_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            size_count = parse_sizes(argv[++i], sizes);
+        } else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--sizes 10,100,...] [--reps N] [--filter SUBSTRING] [--csv PATH|-]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (size_count == 0 || reps < 1) {
+        fprintf(stderr, "Need at least one size and one repetition\n");
+        return 1;
+    }
+
+    // Results go to the original stdout; the peer list's logging goes nowhere
+    out = fdopen(dup(STDOUT_FILENO), "w");
+    if (csv_path) {
+        csv = strcmp(csv_path, "-") == 0 ? out : fopen(csv_path, "w");
+        if (!csv) {
+            fprintf(stderr, "Failed to open %s\n", csv_path);
+            return 1;
+        }
+        fprintf(csv, "benchmark,size,reps,batch,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns\n");
+    }
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) {
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+    }
+
+    // The peer list persists to its working directory
+    char dir[] = "/tmp/bench_micro.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) < 0) {
+        fprintf(stderr, "Failed to create a working directory\n");
+        return 1;
+    }
+
+    if (csv != out) {
+        fprintf(out, "%-24s %8s %6s %12s %12s %12s %12s %12s\n", "benchmark", "size", "batch",
+                "min ns/op", "p50", "p90", "p99", "max");
+    }
+    for (int s = 0; s < size_count; s++) {
+        int size = sizes[s];
+        bench_list("list_insert_head", size, op_list_insert_head, list_trim, 1 << 20);
+        bench_list("list_insert_middle", size, op_list_insert_middle, NULL, 1 << 20);
+        bench_list("list_append", size, op_list_append, list_trim, 1 << 20);
+        bench_list("list_retrieve", size, op_list_retrieve, NULL, 1 << 20);
+        bench_list("list_remove_middle", size, op_list_remove_middle, NULL, 1 << 20);
+        bench_list("list_sort", size, op_list_sort, list_shuffle, 1);
+        bench_list("list_search", size, op_list_search, NULL, 1 << 20);
+        bench_list("queue_push_pop", size, op_queue_push_pop, NULL, 1 << 20);
+        bench_peers(size);
+    }
+
+    rmdir(dir);
+    if (csv && csv != out) fclose(csv);
+    return 0;
+}
@@ -0,0 +1,278 @@
+// Failure detection check in the simulator.
+// Starts N nodes with failure detection on, lets discovery give every node
+// the full membership, then cuts one node (the victim) off three times:
+//
+//   refute  heal as soon as any node suspects the victim; the victim must
+//           refute before anyone removes it
+//   dead    keep it cut off; every node must remove it, the first within
+//           suspect_periods periods of the first suspicion
+//   rejoin  heal and have the victim reconnect to its old peers; every node
+//           must list it again, and the membership must stay whole
+//
+// While cut off the victim suspects everyone else in turn, so after each
+// heal it may bury some of them before they refute; they come back by
+// refuting too. Every node must list every other as alive again within
+// suspect_periods + N + 4 periods of the heal.
+//
+//   bench_swim [--nodes N] [--seed S] [--latency-ms MS] [--loss P]
+//              [--period-ms MS] [--suspect-periods K]
+//
+// Times are virtual milliseconds since the cut. Exits 1 if a check fails.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include "p2p_network.h"
+#include "p2p_metrics.h"
+#include "p2p_log.h"
+#include "p2p_sim.h"
+
+// Virtual time the simulator advances between membership checks
+#define SIM_STEP_US 1000
+
+// Periods of slack for gossip to carry a change to every node
+#define SPREAD_PERIODS 4
+
+typedef struct {
+    int nodes;
+    unsigned seed;
+    P2PSimLinkConfig link;
+    P2PSwimConfig swim;
+} SwimBenchConfig;
+
+static int failures = 0;
+
+// Remove the directory the nodes ran in
+static void remove_directory(const char* path) {
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    struct dirent* entry;
+    char file[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+        unlink(file);
+    }
+    closedir(dir);
+    rmdir(path);
+}
+
+static void check(int ok, const char* what) {
+    printf("  %-58s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) failures++;
+}
+
+// State network holds for address, or -1 if it does not list it
+static int peer_state(P2PNetwork* network, const char* address) {
+    p2p_peer_list_lock(network->peer_list);
+    P2PPeer* peer = p2p_peer_list_find(network->peer_list, address);
+    int state = peer ? (int)peer->state : -1;
+    p2p_peer_list_unlock(network->peer_list);
+    return state;
+}
+
+// Nodes other than the victim whose view of it is state (-1 = not listed)
+static int count_viewing(P2PNetwork** networks, int count, int victim, int state) {
+    int viewing = 0;
+    for (int i = 0; i < count; i++) {
+        if (i != victim && peer_state(networks[i], networks[victim]->node_id) == state) viewing++;
+    }
+    return viewing;
+}
+
+// Whether every node lists every other one as alive
+static int membership_whole(P2PNetwork** networks, int count) {
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < count; j++) {
+            if (i != j && peer_state(networks[i], networks[j]->node_id) != P2P_PEER_ALIVE) return 0;
+        }
+    }
+    return 1;
+}
+
+// Milliseconds since start_us
+static long elapsed_ms(P2PSim* sim, long long start_us) {
+    return (long)((p2p_sim_now_us(sim) - start_us) / 1000);
+}
+
+// Run until done(networks) holds or limit_ms passes: whether it held
+static int run_until(P2PSim* sim, P2PNetwork** networks, int count, int (*done)(P2PNetwork**, int), long limit_ms) {
+    long long deadline_us = p2p_sim_now_us(sim) + limit_ms * 1000LL;
+    while (!done(networks, count)) {
+        if (p2p_sim_now_us(sim) >= deadline_us) return 0;
+        p2p_sim_run(sim, p2p_sim_now_us(sim) + SIM_STEP_US);
+    }
+    return 1;
+}
+
+// Longest a healed cluster may take to list everyone as alive again
+static long settle_ms(const SwimBenchConfig* config) {
+    return (long)(config->swim.suspect_periods + config->nodes + SPREAD_PERIODS) * config->swim.period_ms;
+}
+
+// Cut the victim off until a node suspects it, then heal
+static void run_refute(const SwimBenchConfig* config, P2PSim* sim, P2PNetwork** networks, int victim) {
+    uint64_t incarnation = networks[victim]->swim.incarnation;
+    long long start_us = p2p_sim_now_us(sim);
+
+    p2p_sim_partition(sim, networks[victim]->node_id, 1);
+    long limit_ms = (long)(config->nodes + SPREAD_PERIODS) * config->swim.period_ms;
+    while (count_viewing(networks, config->nodes, victim, P2P_PEER_SUSPECT) == 0 && elapsed_ms(sim, start_us) < limit_ms) {
+        p2p_sim_run(sim, p2p_sim_now_us(sim) + SIM_STEP_US);
+    }
+    long suspected_ms = elapsed_ms(sim, start_us);
+    p2p_sim_heal(sim);
+
+    // The victim must refute before its suspicion runs out anywhere
+    int removed = 0;
+    long long deadline_us = p2p_sim_now_us(sim) + settle_ms(config) * 1000LL;
+    while (!membership_whole(networks, config->nodes) && p2p_sim_now_us(sim) < deadline_us) {
+        p2p_sim_run(sim, p2p_sim_now_us(sim) + SIM_STEP_US);
+        if (count_viewing(networks, config->nodes, victim, -1) > 0) removed = 1;
+    }
+    long whole_ms = elapsed_ms(sim, start_us);
+
+    printf("refute: suspected after %ld ms, healed, membership whole after %ld ms\n", suspected_ms, whole_ms);
+    check(suspected_ms < limit_ms, "a node suspected the victim");
+    check(networks[victim]->swim.incarnation > incarnation, "the victim raised its incarnation");
+    check(!removed, "no node removed the victim");
+    check(membership_whole(networks, config->nodes), "every node lists every other as alive");
+}
+
+// Cut the victim off until every node has removed it
+static void run_dead(const SwimBenchConfig* config, P2PSim* sim, P2PNetwork** networks, int victim) {
+    int period = config->swim.period_ms;
+    int others = config->nodes - 1;
+    long long start_us = p2p_sim_now_us(sim);
+    long suspected_ms = -1, first_ms = -1, all_ms = -1;
+
+    p2p_sim_partition(sim, networks[victim]->node_id, 1);
+    long limit_ms = (long)(config->nodes + config->swim.suspect_periods + 2 * SPREAD_PERIODS) * period;
+    while (all_ms < 0 && elapsed_ms(sim, start_us) < limit_ms) {
+        p2p_sim_run(sim, p2p_sim_now_us(sim) + SIM_STEP_US);
+        long now_ms = elapsed_ms(sim, start_us);
+        int removed = count_viewing(networks, config->nodes, victim, -1);
+        if (suspected_ms < 0 && (removed > 0 || count_viewing(networks, config->nodes, victim, P2P_PEER_SUSPECT) > 0)) {
+            suspected_ms = now_ms;
+        }
+        if (first_ms < 0 && removed > 0) first_ms = now_ms;
+        if (removed == others) all_ms = now_ms;
+    }
+
+    int tombstoned = 0;
+    for (int i = 0; i < config->nodes; i++) {
+        if (i != victim && p2p_swim_is_dead(&networks[i]->swim, networks[victim]->node_id)) tombstoned++;
+    }
+    printf("dead: suspected after %ld ms, first removal %ld ms, removed everywhere %ld ms\n", suspected_ms, first_ms,
+           all_ms);
+    check(suspected_ms >= 0, "a node suspected the victim");
+    check(first_ms >= 0 && first_ms - suspected_ms <= (long)(config->swim.suspect_periods + 1) * period,
+          "first removal within suspect_periods of the suspicion");
+    check(all_ms >= 0 && all_ms - first_ms <= (long)SPREAD_PERIODS * period, "every node removed the victim");
+    check(tombstoned == others, "every node remembers the victim as dead");
+}
+
+// Heal and have the victim reconnect to every node it knew
+static void run_rejoin(const SwimBenchConfig* config, P2PSim* sim, P2PNetwork** networks, int victim) {
+    int period = config->swim.period_ms;
+    long long start_us = p2p_sim_now_us(sim);
+
+    p2p_sim_heal(sim);
+    for (int i = 0; i < config->nodes; i++) {
+        if (i != victim) p2p_network_connect(networks[victim], networks[i]->node_id);
+    }
+    int whole = run_until(sim, networks, config->nodes, membership_whole, settle_ms(config));
+    long rejoined_ms = elapsed_ms(sim, start_us);
+    // Stale gossip from the cut must not bury anyone once it is back
+    uint64_t failed = p2p_metrics_counter(P2P_COUNTER_PEERS_FAILED);
+    p2p_sim_run(sim, p2p_sim_now_us(sim) + (long long)(config->swim.suspect_periods + SPREAD_PERIODS) * period * 1000);
+
+    printf("rejoin: membership whole after %ld ms\n", rejoined_ms);
+    check(whole, "every node lists every other as alive again");
+    check(membership_whole(networks, config->nodes), "the membership stays whole");
+    check(p2p_metrics_counter(P2P_COUNTER_PEERS_FAILED) == failed, "nobody was removed afterwards");
+}
+
+// Whether every node has found every other one
+static int discovered(P2PNetwork** networks, int count) {
+    for (int i = 0; i < count; i++) {
+        if (p2p_peer_list_count(networks[i]->peer_list) < count - 1) return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    SwimBenchConfig config = { 8, 1, { 2000, 500, 0, 0.0 }, { 0 } };
+    p2p_swim_defaults(&config.swim);
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc) {
+            config.nodes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config.seed = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--latency-ms") == 0 && i + 1 < argc) {
+            config.link.latency_us = (long)(atof(argv[++i]) * 1000);
+        } else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+            config.link.loss = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--period-ms") == 0 && i + 1 < argc) {
+            config.swim.period_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--suspect-periods") == 0 && i + 1 < argc) {
+            config.swim.suspect_periods = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--nodes N] [--seed S] [--latency-ms MS] [--loss P]\n"
+                    "       [--period-ms MS] [--suspect-periods K]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (config.nodes < 3 || config.swim.period_ms < 1 || config.swim.suspect_periods < 1) {
+        fprintf(stderr, "Need at least 3 nodes, and a positive period and suspect periods\n");
+        return 1;
+    }
+    if (config.swim.ping_timeout_ms >= config.swim.period_ms) config.swim.ping_timeout_ms = config.swim.period_ms / 3;
+
+    // Nodes keep their peer lists in the working directory; start from none
+    char dir[] = "/tmp/bench_swim.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) < 0) {
+        fprintf(stderr, "Failed to create a working directory\n");
+        return 1;
+    }
+    p2p_log_set_level(P2P_LOG_ERROR);
+
+    P2PSim* sim = p2p_sim_create(config.seed, &config.link);
+    P2PNetwork** networks = calloc(config.nodes, sizeof(P2PNetwork*));
+    if (!sim || !networks) return 1;
+    char address[64];
+    for (int i = 0; i < config.nodes; i++) {
+        snprintf(address, sizeof(address), "127.0.0.1:%d", 9800 + i);
+        networks[i] = p2p_network_create(9800 + i, address, NULL);
+        if (!networks[i]) return 1;
+        p2p_network_set_failure_detection(networks[i], &config.swim);
+        p2p_sim_attach(sim, networks[i]);
+        if (p2p_network_start(networks[i]) < 0) return 1;
+    }
+    for (int i = 1; i < config.nodes; i++) {
+        p2p_network_connect(networks[i], networks[0]->node_id);
+    }
+
+    printf("Failure detection in the simulator: %d nodes, period %d ms, ping timeout %d ms, suspect after %d periods\n",
+           config.nodes, config.swim.period_ms, config.swim.ping_timeout_ms, config.swim.suspect_periods);
+    if (!run_until(sim, networks, config.nodes, discovered, 10L * config.swim.period_ms)) {
+        printf("discovery did not converge\n");
+        failures++;
+    } else {
+        int victim = config.nodes - 1;
+        run_refute(&config, sim, networks, victim);
+        run_dead(&config, sim, networks, victim);
+        run_rejoin(&config, sim, networks, victim);
+    }
+
+    p2p_sim_destroy(sim);
+    for (int i = 0; i < config.nodes; i++) {
+        p2p_network_free(networks[i]);
+    }
+    free(networks);
+    remove_directory(dir);
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+// Encode/decode benchmark for the wire format.
+// Compares bytes on the wire against the old raw-struct encoding and
+// reports CPU cost per message for each codec.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "p2p_wire.h"
+
+#define ITERATIONS 2000000
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Keep the optimizer from discarding benchmark results
+static volatile size_t sink;
+
+static void bench_message(const char* label, const char* type, const char* data) {
+    P2PMessage msg, out;
+    memset(&msg, 0, sizeof(msg));
+    strcpy(msg.type, type);
+    strcpy(msg.sender, "192.168.100.200:1248");
+    p2p_message_set_data(&msg, data, strlen(data));
+
+    uint8_t frame[P2P_WIRE_MAX_MESSAGE];
+    size_t len = 0;
+
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        len = p2p_wire_encode_message(&msg, frame, sizeof(frame));
+        sink += len;
+    }
+    double encode_ns = (now_ns() - start) / ITERATIONS;
+
+    P2PFrame parsed;
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        p2p_wire_parse_frame(frame, len, &parsed);
+        sink += p2p_wire_decode_message(&parsed, &out);
+    }
+    double decode_ns = (now_ns() - start) / ITERATIONS;
+
+    printf("%-22s %8zu %8zu %7.1f%% %10.1f %10.1f\n", label, sizeof(P2PMessage), len,
+           100.0 * len / sizeof(P2PMessage), encode_ns, decode_ns);
+}
+
+// Same message sent by interned type id (the TYPE_DEF is paid once per connection)
+static void bench_typed_message(const char* label, const char* data) {
+    P2PMessage msg, out;
+    memset(&msg, 0, sizeof(msg));
+    strcpy(msg.type, "CHAT");
+    strcpy(msg.sender, "192.168.100.200:1248");
+    p2p_message_set_data(&msg, data, strlen(data));
+    msg.type_id = 3;
+
+    uint8_t frame[P2P_WIRE_MAX_MESSAGE];
+    size_t len = 0;
+
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        len = p2p_wire_encode_typed_message(&msg, frame, sizeof(frame));
+        sink += len;
+    }
+    double encode_ns = (now_ns() - start) / ITERATIONS;
+
+    P2PFrame parsed;
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        p2p_wire_parse_frame(frame, len, &parsed);
+        sink += p2p_wire_decode_typed_message(&parsed, &out);
+    }
+    double decode_ns = (now_ns() - start) / ITERATIONS;
+
+    printf("%-22s %8zu %8zu %7.1f%% %10.1f %10.1f\n", label, sizeof(P2PMessage), len,
+           100.0 * len / sizeof(P2PMessage), encode_ns, decode_ns);
+}
+
+static void bench_discovery(const char* label, int peers) {
+    DiscoveryMessage msg, out;
+    memset(&msg, 0, sizeof(msg));
+    strcpy(msg.type, "DISCOVERY");
+    strcpy(msg.sender, "192.168.100.200:1248");
+    msg.ttl = 3;
+    for (int i = 0; i < peers; i++) {
+        char addr[32];
+        snprintf(addr, sizeof(addr), "%s10.0.%d.%d:%d", i ? "," : "", i / 250, i % 250 + 1, 1248 + i);
+        strncat(msg.peer_list, addr, sizeof(msg.peer_list) - strlen(msg.peer_list) - 1);
+    }
+
+    uint8_t frame[P2P_WIRE_MAX_DISCOVERY];
+    size_t len = 0;
+
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        len = p2p_wire_encode_discovery(&msg, frame, sizeof(frame));
+        sink += len;
+    }
+    double encode_ns = (now_ns() - start) / ITERATIONS;
+
+    P2PFrame parsed;
+    start = now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        p2p_wire_parse_frame(frame, len, &parsed);
+        sink += p2p_wire_decode_discovery(&parsed, &out);
+    }
+    double decode_ns = (now_ns() - start) / ITERATIONS;
+
+    printf("%-22s %8zu %8zu %7.1f%% %10.1f %10.1f\n", label, sizeof(DiscoveryMessage), len,
+           100.0 * len / sizeof(DiscoveryMessage), encode_ns, decode_ns);
+}
+
+int main(void) {
+    printf("%-22s %8s %8s %8s %10s %10s\n", "message", "struct", "wire", "ratio", "enc ns", "dec ns");
+    bench_message("message/short", "CHAT", "hello");
+    bench_message("message/128B", "CHAT", "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod "
+                                          "tempor incididunt ut labore et dolore magna aliqua. Ut enim");
+    bench_typed_message("typed/short", "hello");
+    bench_discovery("discovery/1 peer", 1);
+    bench_discovery("discovery/8 peers", 8);
+    bench_discovery("discovery/40 peers", 40);
+    return 0;
+}
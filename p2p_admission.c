@@ -0,0 +1,91 @@
+#include "p2p_admission.h"
+
+// FNV-1a over the key
+static uint32_t p2p_admission_hash(const char* key) {
+    uint32_t hash = 2166136261u;
+    for (const char* c = key; *c; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void p2p_rate_table_init(P2PRateTable* table, P2PRateLimit limit) {
+    table->limit = limit;
+    memset(table->slots, 0, sizeof(table->slots));
+}
+
+// Fill config with the default limits
+void p2p_admission_defaults(P2PAdmissionConfig* config) {
+    config->connections.rate = P2P_ADMISSION_DEFAULT_CONNECT_RATE;
+    config->connections.burst = P2P_ADMISSION_DEFAULT_CONNECT_BURST;
+    config->frames.rate = P2P_ADMISSION_DEFAULT_FRAME_RATE;
+    config->frames.burst = P2P_ADMISSION_DEFAULT_FRAME_BURST;
+    config->discovery.rate = P2P_ADMISSION_DEFAULT_DISCOVERY_RATE;
+    config->discovery.burst = P2P_ADMISSION_DEFAULT_DISCOVERY_BURST;
+    config->max_inflight = P2P_ADMISSION_DEFAULT_MAX_INFLIGHT;
+}
+
+// Allocate admission state for config
+P2PAdmission* p2p_admission_create(const P2PAdmissionConfig* config) {
+    P2PAdmission* admission = malloc(sizeof(P2PAdmission));
+    if (!admission) return NULL;
+    admission->config = *config;
+    p2p_rate_table_init(&admission->connections, config->connections);
+    p2p_rate_table_init(&admission->frames, config->frames);
+    p2p_rate_table_init(&admission->discovery, config->discovery);
+    atomic_init(&admission->inflight, 0);
+    return admission;
+}
+
+// Take one token from key's bucket
+int p2p_rate_table_admit(P2PRateTable* table, const char* key, uint64_t now_ns) {
+    if (table->limit.rate <= 0) return 1;
+
+    // Find key's bucket, or the slot to give it: a free one, else the one
+    // idle longest (an idle bucket has refilled, so reusing it loses little)
+    uint32_t start = p2p_admission_hash(key);
+    P2PTokenBucket* bucket = NULL;
+    P2PTokenBucket* oldest = NULL;
+    for (int i = 0; i < P2P_ADMISSION_PROBE; i++) {
+        P2PTokenBucket* slot = &table->slots[(start + i) & (P2P_ADMISSION_SLOTS - 1)];
+        if (slot->key[0] == '\0' || strcmp(slot->key, key) == 0) {
+            bucket = slot;
+            break;
+        }
+        if (!oldest || slot->last_ns < oldest->last_ns) oldest = slot;
+    }
+    if (!bucket || bucket->key[0] == '\0') {
+        if (!bucket) bucket = oldest;
+        snprintf(bucket->key, sizeof(bucket->key), "%s", key);
+        bucket->tokens = table->limit.burst;
+        bucket->last_ns = now_ns;
+    }
+
+    // Refill for the time since the last visit, up to the burst
+    if (now_ns > bucket->last_ns) {
+        bucket->tokens += (now_ns - bucket->last_ns) * table->limit.rate / 1e9;
+        if (bucket->tokens > table->limit.burst) bucket->tokens = table->limit.burst;
+        bucket->last_ns = now_ns;
+    }
+    if (bucket->tokens < 1.0) return 0;
+    bucket->tokens -= 1.0;
+    return 1;
+}
+
+// Reserve bytes of the in-flight cap
+int p2p_admission_reserve(P2PAdmission* admission, size_t bytes) {
+    size_t before = atomic_fetch_add_explicit(&admission->inflight, bytes, memory_order_relaxed);
+    if (admission->config.max_inflight == 0 || before + bytes <= admission->config.max_inflight) return 1;
+    atomic_fetch_sub_explicit(&admission->inflight, bytes, memory_order_relaxed);
+    return 0;
+}
+
+void p2p_admission_release(P2PAdmission* admission, size_t bytes) {
+    atomic_fetch_sub_explicit(&admission->inflight, bytes, memory_order_relaxed);
+}
+
+// Count bytes without checking the cap
+void p2p_admission_charge(P2PAdmission* admission, size_t bytes) {
+    atomic_fetch_add_explicit(&admission->inflight, bytes, memory_order_relaxed);
+}
@@ -0,0 +1,92 @@
+#ifndef P2P_ADMISSION_H
+#define P2P_ADMISSION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Inbound admission control.
+//
+// Token buckets keyed by source IP limit how fast one host may open
+// connections and send frames, and buckets keyed by the sender a DISCOVERY
+// message names limit discovery, the one message that makes this node
+// connect out and forward to every peer it knows. A cap on bulk bytes
+// waiting for handlers bounds the queue every sender shares. Traffic over
+// a limit is shed where it is read, before it is copied or queued:
+// connections are closed at once, frames are dropped (bulk frames are still
+// credited back to the sender and requests are answered P2P_RPC_BUSY).
+// Type definitions are never shed: the sender counts the type as defined
+// once it has written one, so losing it would lose every later message of
+// that type on the connection. Nor are SWIM frames: a shed probe or ack
+// would make a busy (or NAT-shared) source look dead.
+
+// Buckets per table (power of two). A source that finds no free slot among
+// P2P_ADMISSION_PROBE takes over the longest idle one.
+#define P2P_ADMISSION_SLOTS 1024
+#define P2P_ADMISSION_PROBE 8
+
+// Defaults used by p2p_main
+#define P2P_ADMISSION_DEFAULT_CONNECT_RATE 50.0
+#define P2P_ADMISSION_DEFAULT_CONNECT_BURST 200.0
+#define P2P_ADMISSION_DEFAULT_FRAME_RATE 100000.0
+#define P2P_ADMISSION_DEFAULT_FRAME_BURST 200000.0
+#define P2P_ADMISSION_DEFAULT_DISCOVERY_RATE 10.0
+#define P2P_ADMISSION_DEFAULT_DISCOVERY_BURST 50.0
+#define P2P_ADMISSION_DEFAULT_MAX_INFLIGHT (8 * 1024 * 1024)
+
+// Sustained rate per second and burst size (rate 0 = unlimited)
+typedef struct {
+    double rate;
+    double burst;
+} P2PRateLimit;
+
+typedef struct {
+    P2PRateLimit connections;   // Accepted connections per source IP
+    P2PRateLimit frames;        // Frames per source IP
+    P2PRateLimit discovery;     // DISCOVERY messages per named sender
+    size_t max_inflight;        // Bulk bytes waiting for handlers across the network (0 = unlimited)
+} P2PAdmissionConfig;
+
+typedef struct {
+    char key[64];               // Empty = free
+    double tokens;
+    uint64_t last_ns;
+} P2PTokenBucket;
+
+// Buckets for one limit, keyed by string (one thread only)
+typedef struct {
+    P2PRateLimit limit;
+    P2PTokenBucket slots[P2P_ADMISSION_SLOTS];
+} P2PRateTable;
+
+// Admission state of one network. The tables are used on the thread that
+// reads the network's connections.
+typedef struct {
+    P2PAdmissionConfig config;
+    P2PRateTable connections;
+    P2PRateTable frames;
+    P2PRateTable discovery;
+    atomic_size_t inflight;     // Bulk bytes queued for the worker
+} P2PAdmission;
+
+// Fill config with the P2P_ADMISSION_DEFAULT_* limits
+void p2p_admission_defaults(P2PAdmissionConfig* config);
+
+// Allocate admission state for config (NULL on failure)
+P2PAdmission* p2p_admission_create(const P2PAdmissionConfig* config);
+
+// Take one token from key's bucket at now_ns: 1 if admitted, 0 to shed
+int p2p_rate_table_admit(P2PRateTable* table, const char* key, uint64_t now_ns);
+
+// Reserve bytes of the in-flight cap: 1 if admitted, 0 to shed. Admitted
+// bytes are returned with p2p_admission_release once handled.
+int p2p_admission_reserve(P2PAdmission* admission, size_t bytes);
+void p2p_admission_release(P2PAdmission* admission, size_t bytes);
+
+// Count bytes against the cap without checking it, for frames that cannot
+// be shed; returned with p2p_admission_release like reserved bytes
+void p2p_admission_charge(P2PAdmission* admission, size_t bytes);
+
+#endif
@@ -0,0 +1,84 @@
+#include "p2p_arena.h"
+
+#define P2P_ARENA_ALIGN 16
+#define P2P_ARENA_HEADER ((sizeof(P2PArenaChunk) + P2P_ARENA_ALIGN - 1) & ~(size_t)(P2P_ARENA_ALIGN - 1))
+
+// Initialize arena (no memory is allocated until first use)
+void p2p_arena_init(P2PArena* arena, size_t chunk_size) {
+    arena->head = NULL;
+    arena->current = NULL;
+    arena->chunk_size = chunk_size > 0 ? chunk_size : P2P_ARENA_CHUNK_SIZE;
+}
+
+// Allocate a chunk with room for at least min_size bytes
+static P2PArenaChunk* p2p_arena_new_chunk(P2PArena* arena, size_t min_size) {
+    size_t size = arena->chunk_size;
+    while (size < min_size) size *= 2;
+
+    P2PArenaChunk* chunk = malloc(P2P_ARENA_HEADER + size);
+    if (!chunk) return NULL;
+
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+// Allocate size bytes (16-byte aligned), NULL if out of memory
+void* p2p_arena_alloc(P2PArena* arena, size_t size) {
+    size = (size + P2P_ARENA_ALIGN - 1) & ~(size_t)(P2P_ARENA_ALIGN - 1);
+    if (size == 0) size = P2P_ARENA_ALIGN;
+
+    if (arena->current == NULL) {
+        if (arena->head == NULL) {
+            arena->head = p2p_arena_new_chunk(arena, size);
+            if (!arena->head) return NULL;
+        }
+        arena->current = arena->head;
+    }
+
+    // Move on to the next retained chunk (or grow) until one has room
+    while (arena->current->size - arena->current->used < size) {
+        if (arena->current->next == NULL) {
+            P2PArenaChunk* chunk = p2p_arena_new_chunk(arena, size);
+            if (!chunk) return NULL;
+            arena->current->next = chunk;
+        }
+        arena->current = arena->current->next;
+        arena->current->used = 0;
+    }
+
+    void* ptr = (char*)arena->current + P2P_ARENA_HEADER + arena->current->used;
+    arena->current->used += size;
+    return ptr;
+}
+
+// Copy a string into the arena
+char* p2p_arena_strdup(P2PArena* arena, const char* str) {
+    size_t len = strlen(str);
+    char* copy = p2p_arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+
+    memcpy(copy, str, len + 1);
+    return copy;
+}
+
+// Reclaim every allocation, keeping chunks for reuse
+void p2p_arena_reset(P2PArena* arena) {
+    if (arena->head) {
+        arena->head->used = 0;
+    }
+    arena->current = arena->head;
+}
+
+// Release all chunks
+void p2p_arena_destroy(P2PArena* arena) {
+    P2PArenaChunk* chunk = arena->head;
+    while (chunk != NULL) {
+        P2PArenaChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->current = NULL;
+}
@@ -0,0 +1,43 @@
+#ifndef P2P_ARENA_H
+#define P2P_ARENA_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Default size of an arena's first chunk
+#define P2P_ARENA_CHUNK_SIZE 8192
+
+// Arena chunk (chained when a request outgrows the first one)
+typedef struct P2PArenaChunk {
+    struct P2PArenaChunk* next;
+    size_t size;
+    size_t used;
+    // Chunk memory follows the header
+} P2PArenaChunk;
+
+// Bump allocator for per-connection / per-request scratch memory.
+// Allocations are never freed individually; p2p_arena_reset reclaims
+// everything at once and keeps the chunks for the next request.
+typedef struct {
+    P2PArenaChunk* head;     // First chunk
+    P2PArenaChunk* current;  // Chunk currently being carved
+    size_t chunk_size;
+} P2PArena;
+
+// Initialize arena (no memory is allocated until first use)
+void p2p_arena_init(P2PArena* arena, size_t chunk_size);
+
+// Allocate size bytes (16-byte aligned), NULL if out of memory
+void* p2p_arena_alloc(P2PArena* arena, size_t size);
+
+// Copy a string into the arena
+char* p2p_arena_strdup(P2PArena* arena, const char* str);
+
+// Reclaim every allocation, keeping chunks for reuse
+void p2p_arena_reset(P2PArena* arena);
+
+// Release all chunks
+void p2p_arena_destroy(P2PArena* arena);
+
+#endif
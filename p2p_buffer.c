@@ -0,0 +1,24 @@
+#include "p2p_buffer.h"
+
+// Allocate a buffer with room for cap bytes, holding one reference
+P2PBuffer* p2p_buffer_create(size_t cap) {
+    P2PBuffer* buffer = malloc(sizeof(P2PBuffer) + cap);
+    if (!buffer) return NULL;
+    atomic_init(&buffer->refs, 1);
+    buffer->len = 0;
+    buffer->cap = cap;
+    return buffer;
+}
+
+// Take another reference
+P2PBuffer* p2p_buffer_retain(P2PBuffer* buffer) {
+    atomic_fetch_add_explicit(&buffer->refs, 1, memory_order_relaxed);
+    return buffer;
+}
+
+// Drop a reference, freeing the buffer with the last one
+void p2p_buffer_release(P2PBuffer* buffer) {
+    if (buffer && atomic_fetch_sub_explicit(&buffer->refs, 1, memory_order_acq_rel) == 1) {
+        free(buffer);
+    }
+}
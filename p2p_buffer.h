@@ -0,0 +1,30 @@
+#ifndef P2P_BUFFER_H
+#define P2P_BUFFER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Reference-counted byte buffer for encoded frames. A frame sequence is
+// encoded once into a buffer, which is then treated as immutable and
+// shared by every send that carries it (one reference per queued send);
+// the last release frees it.
+typedef struct {
+    atomic_int refs;
+    size_t len;         // Bytes in use
+    size_t cap;
+    uint8_t data[];
+} P2PBuffer;
+
+// Allocate a buffer with room for cap bytes, holding one reference
+P2PBuffer* p2p_buffer_create(size_t cap);
+
+// Take another reference; returns buffer
+P2PBuffer* p2p_buffer_retain(P2PBuffer* buffer);
+
+// Drop a reference, freeing the buffer with the last one (NULL is ignored)
+void p2p_buffer_release(P2PBuffer* buffer);
+
+#endif
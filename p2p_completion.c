@@ -0,0 +1,87 @@
+#include "p2p_completion.h"
+#include "p2p_log.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Initialize an empty queue
+int p2p_completion_queue_init(P2PCompletionQueue* queue) {
+    queue->items = malloc(P2P_COMPLETION_QUEUE_SIZE * sizeof(P2PSendCompletion));
+    if (!queue->items) return -1;
+    queue->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->fd < 0) {
+        free(queue->items);
+        return -1;
+    }
+    queue->head = 0;
+    queue->count = 0;
+    queue->cap = P2P_COMPLETION_QUEUE_SIZE;
+    pthread_mutex_init(&queue->lock, NULL);
+    return 0;
+}
+
+// Double the ring, unwrapping it (lock held)
+static int p2p_completion_queue_grow(P2PCompletionQueue* queue) {
+    P2PSendCompletion* items = malloc(queue->cap * 2 * sizeof(P2PSendCompletion));
+    if (!items) return -1;
+    for (size_t i = 0; i < queue->count; i++) {
+        items[i] = queue->items[(queue->head + i) % queue->cap];
+    }
+    free(queue->items);
+    queue->items = items;
+    queue->head = 0;
+    queue->cap *= 2;
+    return 0;
+}
+
+// Add a completion
+void p2p_completion_queue_push(P2PCompletionQueue* queue, void* context, int status) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->cap && p2p_completion_queue_grow(queue) < 0) {
+        pthread_mutex_unlock(&queue->lock);
+        P2P_ERROR("Completion queue full, dropping a send completion");
+        return;
+    }
+    P2PSendCompletion* item = &queue->items[(queue->head + queue->count) % queue->cap];
+    item->context = context;
+    item->status = status;
+    // The descriptor only has to change state when the queue stops being empty
+    if (queue->count++ == 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(queue->fd, &one, sizeof(one));
+        (void)ignored;
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Move up to max completions into out
+int p2p_completion_queue_poll(P2PCompletionQueue* queue, P2PSendCompletion* out, int max, int timeout_ms) {
+    if (timeout_ms != 0) {
+        struct pollfd pfd = { queue->fd, POLLIN, 0 };
+        while (poll(&pfd, 1, timeout_ms) < 0 && errno == EINTR);
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    int moved = 0;
+    while (moved < max && queue->count > 0) {
+        out[moved++] = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->cap;
+        queue->count--;
+    }
+    if (moved > 0 && queue->count == 0) {
+        uint64_t value;
+        ssize_t ignored = read(queue->fd, &value, sizeof(value));
+        (void)ignored;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return moved;
+}
+
+// Free the queue
+void p2p_completion_queue_destroy(P2PCompletionQueue* queue) {
+    close(queue->fd);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->items);
+}
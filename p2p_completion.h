@@ -0,0 +1,44 @@
+#ifndef P2P_COMPLETION_H
+#define P2P_COMPLETION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// Initial room for completions; the queue grows as needed
+#define P2P_COMPLETION_QUEUE_SIZE 256
+
+// Outcome of one asynchronous send
+typedef struct {
+    void* context;              // As passed to the send
+    int status;                 // As for send_callback_t
+} P2PSendCompletion;
+
+// Completions waiting for their submitter. Any thread may push; the
+// submitter collects them in batches, waiting on the queue or polling fd
+// alongside its own descriptors.
+typedef struct {
+    P2PSendCompletion* items;   // Ring of cap entries
+    size_t head;
+    size_t count;
+    size_t cap;
+    pthread_mutex_t lock;
+    int fd;                     // eventfd, readable while count > 0
+} P2PCompletionQueue;
+
+// Initialize an empty queue: -1 on failure
+int p2p_completion_queue_init(P2PCompletionQueue* queue);
+
+// Add a completion
+void p2p_completion_queue_push(P2PCompletionQueue* queue, void* context, int status);
+
+// Move up to max completions into out, oldest first, waiting up to
+// timeout_ms for the first one (0 returns at once, -1 waits for ever).
+// Returns how many were moved.
+int p2p_completion_queue_poll(P2PCompletionQueue* queue, P2PSendCompletion* out, int max, int timeout_ms);
+
+// Free the queue (completions still in it are dropped)
+void p2p_completion_queue_destroy(P2PCompletionQueue* queue);
+
+#endif
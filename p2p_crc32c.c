@@ -0,0 +1,187 @@
+#include "p2p_crc32c.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define P2P_CRC32C_X86 1
+#elif defined(__aarch64__)
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#define P2P_CRC32C_ARM 1
+#endif
+
+// Reflected Castagnoli polynomial
+#define P2P_CRC32C_POLY 0x82f63b78u
+
+// Slicing-by-8 tables: table[k][b] is the CRC of byte b followed by k zero bytes
+static uint32_t crc32c_table[8][256];
+
+// Implementation chosen at startup
+static uint32_t (*crc32c_impl)(uint32_t crc, const void* data, size_t len) = p2p_crc32c_sw;
+static int crc32c_hw;
+
+// Portable slicing-by-8 implementation
+uint32_t p2p_crc32c_sw(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = data;
+    crc = ~crc;
+
+    // Byte at a time up to an 8-byte boundary
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+
+    // Eight bytes per step: one lookup per byte, all independent
+    while (len >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        crc = crc32c_table[7][lo & 0xff] ^
+              crc32c_table[6][(lo >> 8) & 0xff] ^
+              crc32c_table[5][(lo >> 16) & 0xff] ^
+              crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][p[4]] ^
+              crc32c_table[2][p[5]] ^
+              crc32c_table[1][p[6]] ^
+              crc32c_table[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+
+    while (len > 0) {
+        crc = crc32c_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+        len--;
+    }
+    return ~crc;
+}
+
+#if defined(P2P_CRC32C_X86)
+
+// SSE4.2 crc32 instruction, eight bytes at a time on 64-bit builds
+__attribute__((target("sse4.2")))
+static uint32_t p2p_crc32c_sse42(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = data;
+    uint32_t c = ~crc;
+
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        c = _mm_crc32_u8(c, *p++);
+        len--;
+    }
+#if defined(__x86_64__)
+    uint64_t c64 = c;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c64 = _mm_crc32_u64(c64, word);
+        p += 8;
+        len -= 8;
+    }
+    c = (uint32_t)c64;
+#endif
+    while (len >= 4) {
+        uint32_t word;
+        memcpy(&word, p, 4);
+        c = _mm_crc32_u32(c, word);
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0) {
+        c = _mm_crc32_u8(c, *p++);
+        len--;
+    }
+    return ~c;
+}
+
+#elif defined(P2P_CRC32C_ARM)
+
+// ARMv8 CRC32 extension, eight bytes at a time
+#if defined(__clang__)
+__attribute__((target("crc")))
+#else
+__attribute__((target("+crc")))
+#endif
+static uint32_t p2p_crc32c_armv8(uint32_t crc, const void* data, size_t len) {
+    const uint8_t* p = data;
+    uint32_t c = ~crc;
+
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        c = __crc32cb(c, *p++);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c = __crc32cd(c, word);
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0) {
+        c = __crc32cb(c, *p++);
+        len--;
+    }
+    return ~c;
+}
+
+#endif
+
+// Hardware implementation
+uint32_t p2p_crc32c_hw(uint32_t crc, const void* data, size_t len) {
+#if defined(P2P_CRC32C_X86)
+    return p2p_crc32c_sse42(crc, data, len);
+#elif defined(P2P_CRC32C_ARM)
+    return p2p_crc32c_armv8(crc, data, len);
+#else
+    return p2p_crc32c_sw(crc, data, len);
+#endif
+}
+
+// Build the tables and pick an implementation before main runs, so
+// p2p_crc32c never has to synchronize
+__attribute__((constructor))
+static void p2p_crc32c_init(void) {
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (P2P_CRC32C_POLY & (0u - (crc & 1)));
+        }
+        crc32c_table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t prev = crc32c_table[k - 1][b];
+            crc32c_table[k][b] = crc32c_table[0][prev & 0xff] ^ (prev >> 8);
+        }
+    }
+
+#if defined(P2P_CRC32C_X86)
+    __builtin_cpu_init();
+    crc32c_hw = __builtin_cpu_supports("sse4.2");
+#elif defined(P2P_CRC32C_ARM) && defined(__linux__) && defined(HWCAP_CRC32)
+    crc32c_hw = (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#elif defined(P2P_CRC32C_ARM) && defined(__ARM_FEATURE_CRC32)
+    crc32c_hw = 1;
+#endif
+    if (crc32c_hw) {
+        crc32c_impl = p2p_crc32c_hw;
+    }
+}
+
+// Checksum with the fastest implementation this CPU supports
+uint32_t p2p_crc32c(uint32_t crc, const void* data, size_t len) {
+    return crc32c_impl(crc, data, len);
+}
+
+// Non-zero if this CPU has a CRC-32C instruction
+int p2p_crc32c_hw_available(void) {
+    return crc32c_hw;
+}
+
+// Name of the implementation p2p_crc32c uses
+const char* p2p_crc32c_implementation(void) {
+    if (!crc32c_hw) return "slicing-by-8";
+#if defined(P2P_CRC32C_X86)
+    return "sse4.2";
+#else
+    return "armv8";
+#endif
+}
@@ -0,0 +1,31 @@
+#ifndef P2P_CRC32C_H
+#define P2P_CRC32C_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli), as used by iSCSI, SCTP and ext4. The implementation
+// is picked once at startup: the SSE4.2 crc32 instruction on x86, the
+// ARMv8 CRC32 extension on AArch64, or a portable slicing-by-8 table walk.
+//
+// crc is the value returned for the preceding bytes (0 to start), so a
+// buffer can be checksummed in pieces: crc(ab) == crc(crc(a), b).
+
+// Checksum with the fastest implementation this CPU supports
+uint32_t p2p_crc32c(uint32_t crc, const void* data, size_t len);
+
+// Portable slicing-by-8 implementation
+uint32_t p2p_crc32c_sw(uint32_t crc, const void* data, size_t len);
+
+// Hardware implementation; only valid when p2p_crc32c_hw_available()
+uint32_t p2p_crc32c_hw(uint32_t crc, const void* data, size_t len);
+
+// Non-zero if this CPU has a CRC-32C instruction
+int p2p_crc32c_hw_available(void);
+
+// Name of the implementation p2p_crc32c uses ("sse4.2", "armv8" or "slicing-by-8")
+const char* p2p_crc32c_implementation(void);
+
+#endif
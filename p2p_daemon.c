@@ -0,0 +1,646 @@
+#include "p2p_daemon.h"
+#include "p2p_buffer.h"
+#include "p2p_log.h"
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "DataStructures/Lists/RingQueue.h"
+
+// MESSAGE frames the writer hands to one writev
+#define P2P_DAEMON_WRITE_BATCH 64
+
+// Microseconds between retries of a send that met backpressure
+#define P2P_DAEMON_RETRY_US 100
+
+// Room for the fields around a SEND payload
+#define P2P_DAEMON_FRAME_OVERHEAD 256
+
+// One client connection. The reader thread owns the socket's read side and
+// the counters; the writer thread drains outbound.
+typedef struct P2PDaemonConn {
+    struct P2PDaemon* daemon;
+    int sock;
+    pthread_t writer;
+    struct RingQueue outbound;                  // P2PBuffer*; NULL stops the writer
+    char subscriptions[P2P_DAEMON_MAX_SUBSCRIPTIONS][32];  // Daemon lock
+    int subscription_count;
+    int all_types;                              // Subscribed with ""
+    atomic_ulong dropped;
+    uint64_t accepted;
+    uint64_t refused;
+    struct P2PDaemonConn* next;
+} P2PDaemonConn;
+
+struct P2PDaemon {
+    P2PNetwork* network;
+    char path[108];
+    int listener;
+    pthread_t thread;
+    pthread_mutex_t lock;           // Guards clients and their subscriptions
+    pthread_cond_t closed;          // Signalled as reader threads finish
+    P2PDaemonConn* clients;
+    int readers;                    // Reader threads that may still touch the daemon (lock)
+    atomic_int subscribers;         // Clients with at least one subscription
+    atomic_int stopping;
+};
+
+// Whether conn wants messages of type (daemon lock held)
+static int p2p_daemon_wants(P2PDaemonConn* conn, const char* type) {
+    if (conn->all_types) return 1;
+    for (int i = 0; i < conn->subscription_count; i++) {
+        if (strcmp(conn->subscriptions[i], type) == 0) return 1;
+    }
+    return 0;
+}
+
+// Encode msg as MESSAGE frames, split so each fits P2P_WIRE_MAX_FRAME: NULL on failure
+static P2PBuffer* p2p_daemon_encode_message(P2PMessage* msg) {
+    size_t chunks = msg->data_len / P2P_DAEMON_MAX_PAYLOAD + 1;
+    P2PBuffer* frames = p2p_buffer_create(msg->data_len + chunks * P2P_DAEMON_FRAME_OVERHEAD);
+    if (!frames) return NULL;
+
+    size_t offset = 0;
+    do {
+        size_t chunk = msg->data_len - offset;
+        if (chunk > P2P_DAEMON_MAX_PAYLOAD) chunk = P2P_DAEMON_MAX_PAYLOAD;
+        P2PWireWriter w;
+        p2p_wire_writer_init(&w, frames->data + frames->len, frames->cap - frames->len);
+        p2p_wire_begin_frame(&w, (P2PFrameKind)P2P_DAEMON_MESSAGE);
+        p2p_wire_put_string(&w, msg->type);
+        p2p_wire_put_string(&w, msg->sender);
+        p2p_wire_put_varint(&w, msg->data_len);
+        p2p_wire_put_varint(&w, offset);
+        p2p_wire_put_bytes(&w, (const uint8_t*)msg->payload + offset, chunk);
+        size_t len = p2p_wire_end_frame(&w);
+        if (len == 0) {
+            p2p_buffer_release(frames);
+            return NULL;
+        }
+        frames->len += len;
+        offset += chunk;
+    } while (offset < msg->data_len);
+    return frames;
+}
+
+// Network tap: copy the message to every subscriber that wants it. The
+// frames are encoded once and shared.
+static void p2p_daemon_tap(void* context, P2PMessage* msg) {
+    P2PDaemon* daemon = (P2PDaemon*)context;
+    if (atomic_load_explicit(&daemon->subscribers, memory_order_relaxed) == 0) return;
+
+    P2PBuffer* frames = NULL;
+    pthread_mutex_lock(&daemon->lock);
+    for (P2PDaemonConn* conn = daemon->clients; conn; conn = conn->next) {
+        if (!p2p_daemon_wants(conn, msg->type)) continue;
+        if (!frames) {
+            frames = p2p_daemon_encode_message(msg);
+            if (!frames) break;
+        }
+        P2PBuffer* ref = p2p_buffer_retain(frames);
+        if (!conn->outbound.try_push(&conn->outbound, &ref)) {
+            p2p_buffer_release(ref);
+            atomic_fetch_add(&conn->dropped, 1);
+        }
+    }
+    pthread_mutex_unlock(&daemon->lock);
+    p2p_buffer_release(frames);
+}
+
+// Writer thread: write queued frames in batches until the NULL that stops it
+static void* p2p_daemon_writer(void* arg) {
+    P2PDaemonConn* conn = (P2PDaemonConn*)arg;
+    P2PBuffer* batch[P2P_DAEMON_WRITE_BATCH];
+    struct iovec iov[P2P_DAEMON_WRITE_BATCH];
+    int failed = 0;
+    int stop = 0;
+
+    while (!stop) {
+        conn->outbound.pop(&conn->outbound, &batch[0]);
+        int count = batch[0] ? 1 : 0;
+        stop = batch[0] == NULL;
+        while (!stop && count < P2P_DAEMON_WRITE_BATCH && conn->outbound.try_pop(&conn->outbound, &batch[count])) {
+            if (batch[count] == NULL) {
+                stop = 1;
+                break;
+            }
+            count++;
+        }
+
+        // A client that stopped reading only loses what it would have read
+        int first = 0;
+        for (int i = 0; i < count; i++) {
+            iov[i].iov_base = batch[i]->data;
+            iov[i].iov_len = batch[i]->len;
+        }
+        while (!failed && first < count) {
+            // MSG_NOSIGNAL: a client that hung up must not kill the daemon
+            struct msghdr out = { .msg_iov = iov + first, .msg_iovlen = count - first };
+            ssize_t n = sendmsg(conn->sock, &out, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                failed = 1;
+                break;
+            }
+            while (first < count && (size_t)n >= iov[first].iov_len) {
+                n -= iov[first].iov_len;
+                first++;
+            }
+            if (first < count) {
+                iov[first].iov_base = (uint8_t*)iov[first].iov_base + n;
+                iov[first].iov_len -= n;
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            p2p_buffer_release(batch[i]);
+        }
+    }
+    return NULL;
+}
+
+// Queue a SYNC_REPLY behind the MESSAGE frames already queued
+static void p2p_daemon_reply_sync(P2PDaemonConn* conn, uint64_t id) {
+    P2PBuffer* frame = p2p_buffer_create(64);
+    if (!frame) return;
+    P2PWireWriter w;
+    p2p_wire_writer_init(&w, frame->data, frame->cap);
+    p2p_wire_begin_frame(&w, (P2PFrameKind)P2P_DAEMON_SYNC_REPLY);
+    p2p_wire_put_varint(&w, id);
+    p2p_wire_put_varint(&w, conn->accepted);
+    p2p_wire_put_varint(&w, conn->refused);
+    p2p_wire_put_varint(&w, atomic_load(&conn->dropped));
+    frame->len = p2p_wire_end_frame(&w);
+    conn->outbound.push(&conn->outbound, &frame);
+}
+
+// Hand one send to the network, waiting out backpressure unless the daemon is stopping
+static int p2p_daemon_send_bytes(P2PDaemon* daemon, const char* address, const char* type,
+                                 const void* data, size_t len) {
+    while (1) {
+        int result = p2p_network_send_bytes(daemon->network, address, type, data, len);
+        if (result != P2P_SEND_BACKPRESSURE) return result;
+        if (atomic_load(&daemon->stopping)) return -1;
+        struct timespec pause = { 0, P2P_DAEMON_RETRY_US * 1000 };
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Carry out one client frame: -1 if the connection should be dropped
+static int p2p_daemon_handle(P2PDaemonConn* conn, P2PFrame* frame, char* scratch) {
+    P2PNetwork* network = conn->daemon->network;
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, frame->body, frame->body_len);
+    char address[128];
+    char type[32];
+    size_t len;
+
+    switch (frame->kind) {
+    case P2P_DAEMON_SEND: {
+        p2p_wire_get_string(&r, address, sizeof(address));
+        p2p_wire_get_string(&r, type, sizeof(type));
+        const uint8_t* payload = p2p_wire_get_bytes(&r, &len);
+        if (r.error || p2p_daemon_send_bytes(conn->daemon, address, type, payload, len) < 0) {
+            conn->refused++;
+        } else {
+            conn->accepted++;
+        }
+        return 0;
+    }
+    case P2P_DAEMON_BROADCAST: {
+        p2p_wire_get_string(&r, type, sizeof(type));
+        const uint8_t* payload = p2p_wire_get_bytes(&r, &len);
+        if (r.error || len > P2P_DAEMON_MAX_PAYLOAD) {
+            conn->refused++;
+            return 0;
+        }
+        // Broadcasts carry text
+        memcpy(scratch, payload, len);
+        scratch[len] = '\0';
+        p2p_network_broadcast(network, type, scratch);
+        conn->accepted++;
+        return 0;
+    }
+    case P2P_DAEMON_SUBSCRIBE: {
+        p2p_wire_get_string(&r, type, sizeof(type));
+        if (r.error) return -1;
+        P2PDaemon* daemon = conn->daemon;
+        pthread_mutex_lock(&daemon->lock);
+        int first = !conn->all_types && conn->subscription_count == 0;
+        if (type[0] == '\0') {
+            conn->all_types = 1;
+        } else if (!p2p_daemon_wants(conn, type) && conn->subscription_count < P2P_DAEMON_MAX_SUBSCRIPTIONS) {
+            strcpy(conn->subscriptions[conn->subscription_count++], type);
+        }
+        if (first) atomic_fetch_add(&daemon->subscribers, 1);
+        pthread_mutex_unlock(&daemon->lock);
+        return 0;
+    }
+    case P2P_DAEMON_SYNC: {
+        uint64_t id = p2p_wire_get_varint(&r);
+        if (r.error) return -1;
+        p2p_daemon_reply_sync(conn, id);
+        return 0;
+    }
+    default:
+        P2P_DEBUG("Skipping daemon frame of unknown kind %d", frame->kind);
+        return 0;
+    }
+}
+
+// Reader thread: serve one client until it hangs up, then free it
+static void* p2p_daemon_reader(void* arg) {
+    P2PDaemonConn* conn = (P2PDaemonConn*)arg;
+    P2PDaemon* daemon = conn->daemon;
+    uint8_t* buf = malloc(P2P_DAEMON_BUFFER);
+    char* scratch = malloc(P2P_DAEMON_MAX_PAYLOAD + 1);
+
+    if (buf && scratch) {
+        P2PWireStream stream;
+        p2p_wire_stream_init(&stream, conn->sock, buf, P2P_DAEMON_BUFFER);
+        P2PFrame frame;
+        int status;
+        while ((status = p2p_wire_stream_next(&stream, &frame)) > 0) {
+            if (p2p_daemon_handle(conn, &frame, scratch) < 0) break;
+        }
+        if (status < 0) P2P_DEBUG("Dropping daemon client after a malformed frame");
+    }
+    free(buf);
+    free(scratch);
+
+    // Off the list first, so the tap stops queueing for it
+    pthread_mutex_lock(&daemon->lock);
+    for (P2PDaemonConn** link = &daemon->clients; *link; link = &(*link)->next) {
+        if (*link == conn) {
+            *link = conn->next;
+            break;
+        }
+    }
+    if (conn->all_types || conn->subscription_count > 0) atomic_fetch_sub(&daemon->subscribers, 1);
+    pthread_mutex_unlock(&daemon->lock);
+
+    P2PBuffer* stop = NULL;
+    conn->outbound.push(&conn->outbound, &stop);
+    pthread_join(conn->writer, NULL);
+    ring_queue_destructor(&conn->outbound);
+    close(conn->sock);
+    P2P_INFO("Daemon client disconnected (%llu sent, %llu refused)",
+             (unsigned long long)conn->accepted, (unsigned long long)conn->refused);
+    free(conn);
+
+    // Last touch of the daemon: p2p_daemon_free may free it once this unlocks
+    pthread_mutex_lock(&daemon->lock);
+    daemon->readers--;
+    pthread_cond_broadcast(&daemon->closed);
+    pthread_mutex_unlock(&daemon->lock);
+    return NULL;
+}
+
+// Accept loop
+static void* p2p_daemon_accept_thread(void* arg) {
+    P2PDaemon* daemon = (P2PDaemon*)arg;
+    while (!atomic_load(&daemon->stopping)) {
+        int sock = accept(daemon->listener, NULL, NULL);
+        if (sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+
+        P2PDaemonConn* conn = calloc(1, sizeof(P2PDaemonConn));
+        if (!conn) {
+            close(sock);
+            continue;
+        }
+        conn->daemon = daemon;
+        conn->sock = sock;
+        conn->outbound = ring_queue_constructor(P2P_DAEMON_CLIENT_QUEUE, sizeof(P2PBuffer*));
+        atomic_init(&conn->dropped, 0);
+        if (pthread_create(&conn->writer, NULL, p2p_daemon_writer, conn) != 0) {
+            ring_queue_destructor(&conn->outbound);
+            close(sock);
+            free(conn);
+            continue;
+        }
+
+        pthread_mutex_lock(&daemon->lock);
+        conn->next = daemon->clients;
+        daemon->clients = conn;
+        daemon->readers++;
+        pthread_mutex_unlock(&daemon->lock);
+
+        pthread_t reader;
+        if (pthread_create(&reader, NULL, p2p_daemon_reader, conn) != 0) {
+            // Hanging up makes the writer's next write fail; tidy up as the reader would
+            shutdown(sock, SHUT_RDWR);
+            p2p_daemon_reader(conn);
+            continue;
+        }
+        pthread_detach(reader);
+        P2P_INFO("Daemon client connected");
+    }
+    return NULL;
+}
+
+// Serve network on a UNIX socket at path
+P2PDaemon* p2p_daemon_serve(P2PNetwork* network, const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        P2P_ERROR("Daemon socket path too long: %s", path);
+        return NULL;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 16) < 0) {
+        P2P_ERROR("Failed to bind daemon socket %s", path);
+        if (listener >= 0) close(listener);
+        return NULL;
+    }
+
+    P2PDaemon* daemon = calloc(1, sizeof(P2PDaemon));
+    if (!daemon) {
+        close(listener);
+        return NULL;
+    }
+    daemon->network = network;
+    strcpy(daemon->path, path);
+    daemon->listener = listener;
+    pthread_mutex_init(&daemon->lock, NULL);
+    pthread_cond_init(&daemon->closed, NULL);
+    atomic_init(&daemon->subscribers, 0);
+    atomic_init(&daemon->stopping, 0);
+    p2p_network_set_tap(network, p2p_daemon_tap, daemon);
+
+    if (pthread_create(&daemon->thread, NULL, p2p_daemon_accept_thread, daemon) != 0) {
+        p2p_network_set_tap(network, NULL, NULL);
+        close(listener);
+        unlink(path);
+        pthread_cond_destroy(&daemon->closed);
+        pthread_mutex_destroy(&daemon->lock);
+        free(daemon);
+        return NULL;
+    }
+    P2P_INFO("Serving local clients on %s", path);
+    return daemon;
+}
+
+// Disconnect every client and free the daemon
+void p2p_daemon_free(P2PDaemon* daemon) {
+    // No delivery is inside the tap once this returns
+    p2p_network_set_tap(daemon->network, NULL, NULL);
+    atomic_store(&daemon->stopping, 1);
+    shutdown(daemon->listener, SHUT_RDWR);
+    pthread_join(daemon->thread, NULL);
+    close(daemon->listener);
+    unlink(daemon->path);
+
+    // Hang up on every client and wait for their threads to tidy up
+    pthread_mutex_lock(&daemon->lock);
+    for (P2PDaemonConn* conn = daemon->clients; conn; conn = conn->next) {
+        shutdown(conn->sock, SHUT_RDWR);
+    }
+    while (daemon->readers > 0) {
+        pthread_cond_wait(&daemon->closed, &daemon->lock);
+    }
+    pthread_mutex_unlock(&daemon->lock);
+
+    pthread_cond_destroy(&daemon->closed);
+    pthread_mutex_destroy(&daemon->lock);
+    free(daemon);
+}
+
+// Client
+
+P2PDaemonClient* p2p_daemon_connect(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) return NULL;
+    strcpy(addr.sun_path, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) return NULL;
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return NULL;
+    }
+
+    P2PDaemonClient* client = calloc(1, sizeof(P2PDaemonClient));
+    if (client) {
+        client->out = malloc(P2P_DAEMON_BUFFER);
+        client->in_buf = malloc(P2P_DAEMON_BUFFER);
+    }
+    if (!client || !client->out || !client->in_buf) {
+        if (client) {
+            free(client->out);
+            free(client->in_buf);
+            free(client);
+        }
+        close(sock);
+        return NULL;
+    }
+    client->sock = sock;
+    p2p_wire_stream_init(&client->in, sock, client->in_buf, P2P_DAEMON_BUFFER);
+    return client;
+}
+
+// Add one MESSAGE chunk to the message being reassembled
+static int p2p_daemon_take_message(P2PDaemonClient* client, P2PFrame* frame) {
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, frame->body, frame->body_len);
+    char type[32];
+    char sender[64];
+    p2p_wire_get_string(&r, type, sizeof(type));
+    p2p_wire_get_string(&r, sender, sizeof(sender));
+    uint64_t total = p2p_wire_get_varint(&r);
+    uint64_t offset = p2p_wire_get_varint(&r);
+    size_t len;
+    const uint8_t* chunk = p2p_wire_get_bytes(&r, &len);
+    if (r.error || offset + len > total) return -1;
+
+    P2PDaemonMessage* msg = client->partial;
+    if (offset == 0) {
+        p2p_daemon_message_free(msg);
+        msg = calloc(1, sizeof(P2PDaemonMessage));
+        if (msg) msg->data = malloc(total + 1);
+        if (!msg || !msg->data) {
+            free(msg);
+            client->partial = NULL;
+            return -1;
+        }
+        strcpy(msg->type, type);
+        strcpy(msg->sender, sender);
+        msg->len = total;
+        client->partial = msg;
+    } else if (!msg || msg->len != total) {
+        return -1;
+    }
+    memcpy(msg->data + offset, chunk, len);
+
+    if (offset + len == total) {
+        msg->data[total] = '\0';
+        client->partial = NULL;
+        if (client->tail) {
+            client->tail->next = msg;
+        } else {
+            client->head = msg;
+        }
+        client->tail = msg;
+    }
+    return 0;
+}
+
+// Wait up to timeout_ms for the socket, writing out from *written (if not
+// NULL) and reading whatever has arrived: -1 on error or EOF
+static int p2p_daemon_pump(P2PDaemonClient* client, size_t* written, int timeout_ms) {
+    struct pollfd pfd = { client->sock, POLLIN, 0 };
+    if (written) pfd.events |= POLLOUT;
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready < 0) return errno == EINTR ? 0 : -1;
+    if (ready == 0) return 0;
+
+    if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+        // Reading while writing keeps a subscriber from deadlocking with the daemon
+        int n = p2p_wire_stream_fill(&client->in);
+        if (n <= 0 && n != P2P_WIRE_AGAIN) return -1;
+        P2PFrame frame;
+        int status;
+        while ((status = p2p_wire_stream_take(&client->in, &frame)) > 0) {
+            if (frame.kind == P2P_DAEMON_MESSAGE) {
+                if (p2p_daemon_take_message(client, &frame) < 0) return -1;
+            } else if (frame.kind == P2P_DAEMON_SYNC_REPLY) {
+                P2PWireReader r;
+                p2p_wire_reader_init(&r, frame.body, frame.body_len);
+                uint64_t id = p2p_wire_get_varint(&r);
+                client->stats.accepted = p2p_wire_get_varint(&r);
+                client->stats.refused = p2p_wire_get_varint(&r);
+                client->stats.dropped = p2p_wire_get_varint(&r);
+                if (r.error) return -1;
+                client->synced = id;
+            }
+        }
+        if (status < 0) return -1;
+    }
+
+    if (written && (pfd.revents & POLLOUT)) {
+        ssize_t n = send(client->sock, client->out + *written, client->out_len - *written,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno != EAGAIN && errno != EINTR) return -1;
+        if (n > 0) *written += n;
+    }
+    return 0;
+}
+
+int p2p_daemon_flush(P2PDaemonClient* client) {
+    size_t written = 0;
+    while (written < client->out_len) {
+        if (p2p_daemon_pump(client, &written, -1) < 0) return -1;
+    }
+    client->out_len = 0;
+    return 0;
+}
+
+// Start a frame in the output buffer with room for need bytes, flushing
+// first if it is too full
+static int p2p_daemon_begin(P2PDaemonClient* client, P2PWireWriter* w, P2PDaemonFrameKind kind, size_t need) {
+    if (client->out_len + need > P2P_DAEMON_BUFFER && p2p_daemon_flush(client) < 0) return -1;
+    p2p_wire_writer_init(w, client->out + client->out_len, P2P_DAEMON_BUFFER - client->out_len);
+    p2p_wire_begin_frame(w, (P2PFrameKind)kind);
+    return 0;
+}
+
+static int p2p_daemon_end(P2PDaemonClient* client, P2PWireWriter* w) {
+    size_t len = p2p_wire_end_frame(w);
+    if (len == 0) return -1;
+    client->out_len += len;
+    return 0;
+}
+
+int p2p_daemon_send(P2PDaemonClient* client, const char* address, const char* type, const void* data, size_t len) {
+    if (len > P2P_DAEMON_MAX_PAYLOAD) return -1;
+    P2PWireWriter w;
+    if (p2p_daemon_begin(client, &w, P2P_DAEMON_SEND, len + P2P_DAEMON_FRAME_OVERHEAD) < 0) return -1;
+    p2p_wire_put_string(&w, address);
+    p2p_wire_put_string(&w, type);
+    p2p_wire_put_bytes(&w, data, len);
+    return p2p_daemon_end(client, &w);
+}
+
+int p2p_daemon_broadcast(P2PDaemonClient* client, const char* type, const char* data) {
+    size_t len = strlen(data);
+    if (len > P2P_DAEMON_MAX_PAYLOAD) return -1;
+    P2PWireWriter w;
+    if (p2p_daemon_begin(client, &w, P2P_DAEMON_BROADCAST, len + P2P_DAEMON_FRAME_OVERHEAD) < 0) return -1;
+    p2p_wire_put_string(&w, type);
+    p2p_wire_put_bytes(&w, data, len);
+    return p2p_daemon_end(client, &w);
+}
+
+int p2p_daemon_subscribe(P2PDaemonClient* client, const char* type) {
+    P2PWireWriter w;
+    if (p2p_daemon_begin(client, &w, P2P_DAEMON_SUBSCRIBE, P2P_DAEMON_FRAME_OVERHEAD) < 0) return -1;
+    p2p_wire_put_string(&w, type);
+    return p2p_daemon_end(client, &w);
+}
+
+int p2p_daemon_sync(P2PDaemonClient* client, P2PDaemonStats* stats) {
+    uint64_t id = ++client->next_sync;
+    P2PWireWriter w;
+    if (p2p_daemon_begin(client, &w, P2P_DAEMON_SYNC, P2P_DAEMON_FRAME_OVERHEAD) < 0) return -1;
+    p2p_wire_put_varint(&w, id);
+    if (p2p_daemon_end(client, &w) < 0 || p2p_daemon_flush(client) < 0) return -1;
+
+    while (client->synced < id) {
+        if (p2p_daemon_pump(client, NULL, -1) < 0) return -1;
+    }
+    if (stats) *stats = client->stats;
+    return 0;
+}
+
+P2PDaemonMessage* p2p_daemon_receive(P2PDaemonClient* client, int timeout_ms) {
+    if (client->out_len > 0 && p2p_daemon_flush(client) < 0) return NULL;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long deadline = (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000 + timeout_ms;
+    int wait = timeout_ms;
+    while (!client->head) {
+        if (wait < 0 && timeout_ms >= 0) return NULL;
+        if (p2p_daemon_pump(client, NULL, wait) < 0) return NULL;
+        if (timeout_ms >= 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long long left = deadline - ((long long)now.tv_sec * 1000 + now.tv_nsec / 1000000);
+            wait = left > 0 ? (int)left : -1;
+        }
+    }
+
+    P2PDaemonMessage* msg = client->head;
+    client->head = msg->next;
+    if (!client->head) client->tail = NULL;
+    msg->next = NULL;
+    return msg;
+}
+
+void p2p_daemon_message_free(P2PDaemonMessage* msg) {
+    if (!msg) return;
+    free(msg->data);
+    free(msg);
+}
+
+void p2p_daemon_close(P2PDaemonClient* client) {
+    p2p_daemon_flush(client);
+    close(client->sock);
+    while (client->head) {
+        P2PDaemonMessage* next = client->head->next;
+        p2p_daemon_message_free(client->head);
+        client->head = next;
+    }
+    p2p_daemon_message_free(client->partial);
+    free(client->out);
+    free(client->in_buf);
+    free(client);
+}
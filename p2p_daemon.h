@@ -0,0 +1,119 @@
+#ifndef P2P_DAEMON_H
+#define P2P_DAEMON_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "p2p_network.h"
+#include "p2p_wire.h"
+
+// Local application API.
+//
+// p2p_daemon_serve puts a network behind a UNIX stream socket. Clients
+// speak the frame format of p2p_wire.h with the kinds below, which never
+// travel between nodes. SEND and BROADCAST frames go back to back, as many
+// per write as the client likes; the daemon hands each to the network as
+// it parses it and sends nothing back. SYNC asks for a SYNC_REPLY once
+// everything before it has been handed over, with running counts for the
+// connection. Sends that meet backpressure are retried, which stops the
+// daemon reading from that client until the peer catches up.
+//
+// SUBSCRIBE copies inbound messages of one type (or of every type, for an
+// empty name) to the client as MESSAGE frames, large ones split into
+// chunks. Each subscriber has a queue of P2P_DAEMON_CLIENT_QUEUE frames; a
+// subscriber that falls that far behind loses messages (counted in
+// SYNC_REPLY) rather than holding up the node.
+
+// Largest SEND or BROADCAST payload (each travels in a single frame)
+#define P2P_DAEMON_MAX_PAYLOAD (P2P_WIRE_MAX_FRAME - 512)
+
+// MESSAGE frames waiting for one subscriber
+#define P2P_DAEMON_CLIENT_QUEUE 4096
+
+// Types one client can subscribe to
+#define P2P_DAEMON_MAX_SUBSCRIPTIONS 32
+
+// Bytes of frames read or written per system call, at most
+#define P2P_DAEMON_BUFFER (256 * 1024)
+
+typedef enum {
+    P2P_DAEMON_SEND = 64,           // Client: string address | string type | blob payload
+    P2P_DAEMON_BROADCAST = 65,      // Client: string type | blob payload (text)
+    P2P_DAEMON_SUBSCRIBE = 66,      // Client: string type ("" for every type)
+    P2P_DAEMON_SYNC = 67,           // Client: varint id
+    P2P_DAEMON_SYNC_REPLY = 68,     // Daemon: varint id | varint accepted | varint refused | varint dropped
+    P2P_DAEMON_MESSAGE = 69         // Daemon: string type | string sender | varint total_len | varint offset | blob chunk
+} P2PDaemonFrameKind;
+
+typedef struct P2PDaemon P2PDaemon;
+
+// Serve network on a UNIX socket at path (replacing any stale socket
+// file). Installs the network's tap, so call it before p2p_network_start.
+// NULL on failure.
+P2PDaemon* p2p_daemon_serve(P2PNetwork* network, const char* path);
+
+// Disconnect every client, remove the socket file and free the daemon.
+// Call before freeing the network (which may still be running).
+void p2p_daemon_free(P2PDaemon* daemon);
+
+// Counts for one client connection since it opened
+typedef struct {
+    uint64_t accepted;          // Sends and broadcasts the network took
+    uint64_t refused;           // Ones it failed (unknown address, malformed request)
+    uint64_t dropped;           // Inbound messages lost because the client fell behind
+} P2PDaemonStats;
+
+// A message received through a subscription
+typedef struct P2PDaemonMessage {
+    char type[32];
+    char sender[64];
+    uint8_t* data;              // len bytes, NUL terminated
+    size_t len;
+    struct P2PDaemonMessage* next;
+} P2PDaemonMessage;
+
+// Client end of a daemon connection (one thread at a time)
+typedef struct {
+    int sock;
+    uint8_t* out;               // Frames not yet written
+    size_t out_len;
+    uint8_t* in_buf;
+    P2PWireStream in;
+    uint64_t next_sync;
+    uint64_t synced;            // Id of the last SYNC_REPLY read
+    P2PDaemonStats stats;       // Counts it carried
+    P2PDaemonMessage* partial;  // Message being reassembled
+    P2PDaemonMessage* head;     // Complete messages not yet received
+    P2PDaemonMessage* tail;
+} P2PDaemonClient;
+
+// Connect to a daemon's socket: NULL on failure
+P2PDaemonClient* p2p_daemon_connect(const char* path);
+
+// Queue a send or broadcast; frames go out when the buffer fills or on
+// flush. 0 on success, -1 on error or an oversized payload.
+int p2p_daemon_send(P2PDaemonClient* client, const char* address, const char* type, const void* data, size_t len);
+int p2p_daemon_broadcast(P2PDaemonClient* client, const char* type, const char* data);
+
+// Ask for inbound messages of type ("" for every type)
+int p2p_daemon_subscribe(P2PDaemonClient* client, const char* type);
+
+// Write everything queued: 0 on success, -1 on error
+int p2p_daemon_flush(P2PDaemonClient* client);
+
+// Flush and wait until the daemon has handed everything to the network,
+// then fill stats (may be NULL). Messages arriving meanwhile are kept for
+// p2p_daemon_receive. 0 on success, -1 on error.
+int p2p_daemon_sync(P2PDaemonClient* client, P2PDaemonStats* stats);
+
+// Next subscribed message, waiting up to timeout_ms (-1 forever). NULL on
+// timeout or error; free it with p2p_daemon_message_free.
+P2PDaemonMessage* p2p_daemon_receive(P2PDaemonClient* client, int timeout_ms);
+void p2p_daemon_message_free(P2PDaemonMessage* msg);
+
+// Close the connection and free the client
+void p2p_daemon_close(P2PDaemonClient* client);
+
+#endif
@@ -0,0 +1,703 @@
+#include "p2p_link.h"
+#include "p2p_network.h"
+#include "p2p_log.h"
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+
+static long long p2p_link_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Microseconds between attempts of a timed submit to a full lane
+#define P2P_LINK_PUSH_RETRY_US 100
+
+// Completion state for p2p_link_send, shared with the operation so the
+// submitter can stop waiting before it completes
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int done;
+    int status;
+    int refs;       // The submitter's and the operation's (lock)
+} P2PSendWaiter;
+
+// Finish an operation: report the status and free it
+static void p2p_link_complete(P2PLink* link, P2PSendOp* op, int status) {
+    P2P_TRACE_EVENT(P2P_TRACE_SENT, op->trace_id, status);
+    if (status == 0) {
+        p2p_metrics_add(P2P_COUNTER_MESSAGES_SENT, 1);
+        p2p_metrics_record_since(P2P_HISTOGRAM_SEND, op->submitted_ns);
+    } else if (status == P2P_SEND_SPOOLED) {
+        p2p_metrics_add(P2P_COUNTER_MESSAGES_SPOOLED, 1);
+    } else {
+        p2p_metrics_add(P2P_COUNTER_SEND_FAILURES, 1);
+    }
+    if (op->lane == P2P_LANE_BULK) {
+        atomic_fetch_sub(&link->backlog, (long)(op->frames->len - op->sent));
+    }
+    if (op->callback) {
+        op->callback(op->context, status);
+    }
+    p2p_buffer_release(op->frames);
+    free(op);
+}
+
+// Results of writing the operation in progress, besides -1 for a failed connection
+#define P2P_LINK_DONE 0         // Written up to slice_end
+#define P2P_LINK_WAITING 1      // Waiting for the connect or for room in the socket
+
+// Drop the current connection (the next write reconnects with a full window)
+static void p2p_link_disconnect(P2PLink* link) {
+    if (link->sock >= 0) {
+        close(link->sock);
+        link->sock = -1;
+        p2p_metrics_gauge_add(P2P_GAUGE_SOCKETS, -1);
+    }
+    link->connecting = 0;
+    link->stalled_at = 0;
+    link->type_def_len = 0;
+    link->type_def_sent = 0;
+    atomic_store(&link->credit, P2P_WIRE_CREDIT_WINDOW);
+}
+
+// Read whatever the peer sent back without blocking: credit grants are
+// applied, anything else (discovery replies) is informational and skipped.
+// Returns -1 once the connection is gone.
+static int p2p_link_read(P2PLink* link) {
+    while (1) {
+        int n = p2p_wire_stream_fill(&link->replies);
+        if (n == P2P_WIRE_AGAIN) return 0;
+        if (n <= 0) return -1;
+
+        P2PFrame frame;
+        int status;
+        while ((status = p2p_wire_stream_take(&link->replies, &frame)) > 0) {
+            uint64_t bytes;
+            if (frame.kind == P2P_FRAME_CREDIT && p2p_wire_decode_credit(&frame, &bytes) == 0) {
+                atomic_fetch_add(&link->credit, (long)bytes);
+            }
+        }
+        if (status < 0) return -1;
+    }
+}
+
+// Start connecting: -1 if the peer cannot be reached at all
+static int p2p_link_connect(P2PLink* link) {
+    P2P_TRACE_EVENT(P2P_TRACE_CONNECT_BEGIN, 0, 0);
+    int pending;
+    link->sock = p2p_network_dial_nonblocking(link->address, &pending);
+    if (link->sock < 0) {
+        P2P_TRACE_EVENT(P2P_TRACE_CONNECT_END, 0, -1);
+        return -1;
+    }
+    if (!pending) P2P_TRACE_EVENT(P2P_TRACE_CONNECT_END, 0, 0);
+    p2p_metrics_gauge_add(P2P_GAUGE_SOCKETS, 1);
+    link->connecting = pending;
+    link->connect_ns = p2p_metrics_now_ns();
+    p2p_wire_stream_init(&link->replies, link->sock, link->reply_buf, sizeof(link->reply_buf));
+    memset(link->defined, 0, sizeof(link->defined));
+    atomic_store(&link->credit, P2P_WIRE_CREDIT_WINDOW);
+    return 0;
+}
+
+// Finish a connect the socket has reported on: -1 if it failed
+static int p2p_link_connected(P2PLink* link) {
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(link->sock, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0 || error != 0) {
+        P2P_TRACE_EVENT(P2P_TRACE_CONNECT_END, 0, -1);
+        p2p_metrics_add(P2P_COUNTER_CONNECT_FAILURES, 1);
+        return -1;
+    }
+    P2P_TRACE_EVENT(P2P_TRACE_CONNECT_END, 0, 0);
+    p2p_metrics_record_since(P2P_HISTOGRAM_CONNECT, link->connect_ns);
+    p2p_metrics_add(P2P_COUNTER_CONNECTS, 1);
+    link->connecting = 0;
+    return 0;
+}
+
+// Queue the operation's type definition ahead of it if the connection
+// does not know the type yet: -1 if it cannot be encoded
+static int p2p_link_define_type(P2PLink* link, int type_id) {
+    if (type_id < 0 || (link->defined[type_id / 8] & (1 << (type_id % 8)))) return 0;
+
+    const char* name = p2p_registry_name(link->types, type_id);
+    if (!name) return -1;
+    size_t frame_len = p2p_wire_encode_type_def(type_id, name, link->type_def, sizeof(link->type_def));
+    if (frame_len == 0) return -1;
+    link->type_def_len = frame_len;
+    link->type_def_sent = 0;
+
+    // Type definitions are bulk frames on the receiver, so they use credit too
+    atomic_fetch_sub(&link->credit, (long)frame_len);
+    link->defined[type_id / 8] |= 1 << (type_id % 8);
+    return 0;
+}
+
+// Write what the socket takes of buf: bytes written, 0 if it is full, -1
+// once the connection is gone
+static ssize_t p2p_link_send_some(P2PLink* link, const void* buf, size_t len) {
+    while (1) {
+        ssize_t n = send(link->sock, buf, len, MSG_NOSIGNAL);
+        if (n > 0) link->stalled_at = 0;
+        if (n >= 0) return n;
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+}
+
+// Write the operation in progress up to slice_end, connecting first if
+// there is no connection: P2P_LINK_DONE, P2P_LINK_WAITING or -1
+static int p2p_link_write_op(P2PLink* link, P2PSendOp* op) {
+    if (link->sock < 0) {
+        // Only an operation nothing was written of can move to a new connection
+        if (op->sent > 0 || p2p_link_connect(link) < 0) return -1;
+    }
+    if (link->connecting) return P2P_LINK_WAITING;
+    if (op->sent == 0 && p2p_link_define_type(link, op->type_id) < 0) return -1;
+
+    while (link->type_def_sent < link->type_def_len) {
+        ssize_t n = p2p_link_send_some(link, link->type_def + link->type_def_sent,
+                                       link->type_def_len - link->type_def_sent);
+        if (n <= 0) return n < 0 ? -1 : P2P_LINK_WAITING;
+        link->type_def_sent += n;
+    }
+    link->type_def_len = 0;
+    link->type_def_sent = 0;
+
+    while (op->sent < link->slice_end) {
+        ssize_t n = p2p_link_send_some(link, op->frames->data + op->sent, link->slice_end - op->sent);
+        if (n <= 0) return n < 0 ? -1 : P2P_LINK_WAITING;
+        op->sent += n;
+        p2p_metrics_add(P2P_COUNTER_BYTES_SENT, n);
+        if (op->lane == P2P_LANE_BULK) {
+            atomic_fetch_sub(&link->credit, (long)n);
+            atomic_fetch_sub(&link->backlog, (long)n);
+        }
+    }
+    return P2P_LINK_DONE;
+}
+
+// End of this turn's write of a bulk operation: the whole frames that
+// cover limit more bytes, so the lanes only ever switch between frames
+static size_t p2p_link_slice(P2PSendOp* op, size_t limit) {
+    size_t end = op->sent;
+    size_t len = op->frames->len;
+    while (end < len && end - op->sent < limit) {
+        size_t frame = p2p_wire_frame_size(op->frames->data + end, len - end);
+        if (frame == 0 || frame > len - end) return len;
+        end += frame;
+    }
+    return end;
+}
+
+// Make op the operation in progress, to be written up to slice_end
+static void p2p_link_start(P2PLink* link, P2PSendOp* op, size_t slice_end) {
+    // A connection the peer closed since the last write is noticed before
+    // anything more is written on it
+    if (link->sock >= 0 && !link->connecting && p2p_link_read(link) < 0) {
+        p2p_link_disconnect(link);
+    }
+    P2P_TRACE_EVENT(P2P_TRACE_WRITE_BEGIN, op->trace_id, 0);
+    link->writing = op;
+    link->slice_end = slice_end;
+    link->redialed = 0;
+}
+
+// Hold a bulk operation the peer could not take: 0 if it stays on the
+// link for the next reconnect attempt, -1 if it has to fail. Only
+// operations nothing was written of can be held; their submitters are told
+// the frames were spooled.
+static int p2p_link_hold(P2PLink* link, P2PSendOp* op, long long now) {
+    if (!link->spooling || op->sent > 0) return -1;
+
+    // Reported as spooled, so the spool's age limit applies from here on
+    if (op->callback) {
+        op->callback(op->context, P2P_SEND_SPOOLED);
+        op->callback = NULL;
+    }
+    op->deadline_ms = 0;
+    if (link->retry_delay == P2P_LINK_RETRY_MIN_MS) {
+        P2P_WARN("Peer %s unreachable, spooling messages", link->address);
+        p2p_metrics_add(P2P_COUNTER_MESSAGES_SPOOLED, 1);
+    }
+    link->retry_at = now + link->retry_delay;
+    link->retry_delay = link->retry_delay * 2 < P2P_LINK_RETRY_MAX_MS ? link->retry_delay * 2 : P2P_LINK_RETRY_MAX_MS;
+    return 0;
+}
+
+// The connection failed or could not be made: drop it and settle the
+// operation in progress. With retry set, one nothing was written of gets
+// a single fresh connection before it fails.
+static void p2p_link_broken(P2PLink* link, int retry, long long now) {
+    p2p_link_disconnect(link);
+    P2PSendOp* op = link->writing;
+    if (!op) return;
+    if (retry && op->sent == 0 && !link->redialed) {
+        link->redialed = 1;
+        return;
+    }
+
+    P2P_TRACE_EVENT(P2P_TRACE_WRITE_END, op->trace_id, -1);
+    link->writing = NULL;
+    if (op->lane == P2P_LANE_CONTROL) {
+        p2p_link_complete(link, op, -1);
+    } else if (p2p_link_hold(link, op, now) < 0) {
+        p2p_link_complete(link, op, -1);
+        link->bulk = NULL;
+    }
+}
+
+// Move everything waiting on the bulk lane into the spool, behind the held operation
+static void p2p_link_spool_lane(P2PLink* link) {
+    struct RingQueue* bulk_lane = &link->lanes[P2P_LANE_BULK];
+    P2PSendOp* op;
+    while (bulk_lane->try_pop(bulk_lane, &op)) {
+        if (p2p_spool_push(&link->spool, op->frames, op->type_id, op->queued_ms) == 0) {
+            p2p_link_complete(link, op, P2P_SEND_SPOOLED);
+        } else {
+            P2P_WARN("Spool for %s is full, dropping message", link->address);
+            p2p_link_complete(link, op, -1);
+        }
+    }
+}
+
+// Oldest spooled operation that has not expired: NULL if there is none
+static P2PSendOp* p2p_link_unspool(P2PLink* link, long long now) {
+    if (link->spool.count == 0) return NULL;
+
+    unsigned long expired = link->spool.expired;
+    int type_id;
+    long long queued_ms;
+    P2PBuffer* frames = p2p_spool_pop(&link->spool, now, &type_id, &queued_ms);
+    if (link->spool.expired != expired) {
+        P2P_WARN("Dropped %lu expired messages for %s", link->spool.expired - expired, link->address);
+    }
+
+    P2PSendOp* op = frames ? malloc(sizeof(P2PSendOp)) : NULL;
+    if (!op) {
+        p2p_buffer_release(frames);
+        return NULL;
+    }
+    memset(op, 0, sizeof(P2PSendOp));
+    op->frames = frames;
+    op->lane = P2P_LANE_BULK;
+    op->type_id = type_id;
+    op->queued_ms = queued_ms;
+    op->submitted_ns = (uint64_t)queued_ms * 1000000;
+    op->trace_id = P2P_TRACE_ID();
+    P2P_TRACE_EVENT(P2P_TRACE_SUBMIT, op->trace_id, P2P_LANE_BULK);
+    atomic_fetch_add(&link->backlog, (long)frames->len);
+    return op;
+}
+
+// Whether an operation has waited longer than the spool allows
+static int p2p_link_expired(P2PLink* link, P2PSendOp* op, long long now) {
+    return link->spooling && link->spool.config.max_age_ms > 0 &&
+           now - op->queued_ms > link->spool.config.max_age_ms;
+}
+
+// Whether an operation is past its submitter's deadline without a byte written
+static int p2p_link_timed_out(P2PSendOp* op) {
+    return op->deadline_ms > 0 && op->sent == 0 && p2p_link_now_ms() >= op->deadline_ms;
+}
+
+// Write until everything is sent or the link has to wait for the socket,
+// credit or a reconnect attempt: weighted round robin between the lanes,
+// bulk gated by credit
+static void p2p_link_pump(P2PLink* link) {
+    struct RingQueue* control = &link->lanes[P2P_LANE_CONTROL];
+    struct RingQueue* bulk_lane = &link->lanes[P2P_LANE_BULK];
+
+    while (1) {
+        long long now = p2p_link_now_ms();
+
+        // Finish the turn in progress before choosing another
+        if (link->writing) {
+            P2PSendOp* op = link->writing;
+            int status = p2p_link_write_op(link, op);
+            if (status == P2P_LINK_WAITING) {
+                if (!link->connecting && !link->stalled_at) link->stalled_at = now;
+                return;
+            }
+            if (status < 0) {
+                p2p_link_broken(link, link->sock >= 0, now);
+                continue;
+            }
+            P2P_TRACE_EVENT(P2P_TRACE_WRITE_END, op->trace_id, 0);
+            link->writing = NULL;
+            if (op->lane == P2P_LANE_BULK) {
+                link->retry_delay = P2P_LINK_RETRY_MIN_MS;
+                if (op->sent < op->frames->len) continue;
+                link->bulk = NULL;
+            }
+            p2p_link_complete(link, op, 0);
+            continue;
+        }
+
+        // While an unreachable peer is backed off, new bulk frames join the
+        // spool; afterwards the spool drains before anything newer
+        int backing_off = link->spooling && now < link->retry_at;
+        if (backing_off) {
+            p2p_link_spool_lane(link);
+        } else if (!link->bulk && link->spooling) {
+            link->bulk = p2p_link_unspool(link, now);
+        }
+
+        long credit = atomic_load(&link->credit);
+        int bulk_waiting = !backing_off && (link->bulk != NULL || bulk_lane->size(bulk_lane) > 0);
+        int bulk_ready = bulk_waiting && credit > 0;
+
+        // The next bulk operation is taken even without credit, so one
+        // stalled past its deadline times out instead of waiting on the peer
+        if (bulk_waiting && !link->bulk) {
+            bulk_lane->try_pop(bulk_lane, &link->bulk);
+        }
+        if (link->bulk && p2p_link_timed_out(link->bulk)) {
+            p2p_link_complete(link, link->bulk, P2P_SEND_TIMEOUT);
+            link->bulk = NULL;
+            continue;
+        }
+
+        // Control goes first unless it has had its share while bulk can run
+        P2PSendOp* op = NULL;
+        if ((link->control_streak < P2P_LINK_CONTROL_WEIGHT || !bulk_ready) && control->try_pop(control, &op)) {
+            link->control_streak++;
+            if (p2p_link_timed_out(op)) {
+                p2p_link_complete(link, op, P2P_SEND_TIMEOUT);
+            } else {
+                p2p_link_start(link, op, op->frames->len);
+            }
+            continue;
+        }
+
+        if (bulk_ready && link->bulk) {
+            link->control_streak = 0;
+            if (p2p_link_expired(link, link->bulk, now)) {
+                P2P_WARN("Dropped expired message for %s", link->address);
+                p2p_link_complete(link, link->bulk, -1);
+                link->bulk = NULL;
+                continue;
+            }
+            size_t limit = (size_t)credit < P2P_LINK_QUANTUM ? (size_t)credit : P2P_LINK_QUANTUM;
+            p2p_link_start(link, link->bulk, p2p_link_slice(link->bulk, limit));
+            continue;
+        }
+        return;
+    }
+}
+
+// Earlier of two wake times in the future (0 = none)
+static long long p2p_link_sooner(long long at, long long candidate, long long now) {
+    if (candidate <= now) return at;
+    return at == 0 || candidate < at ? candidate : at;
+}
+
+// When the link next has to act with nothing from the socket or a
+// submitter: a connect or write timing out, a reconnect attempt or a bulk
+// deadline (0 = never)
+static long long p2p_link_wake_at(P2PLink* link, long long now) {
+    long long at = 0;
+    if (link->connecting) {
+        at = p2p_link_sooner(at, (long long)(link->connect_ns / 1000000) + P2P_LINK_CONNECT_TIMEOUT_MS, now);
+    } else if (link->stalled_at) {
+        at = p2p_link_sooner(at, link->stalled_at + P2P_WIRE_WRITE_TIMEOUT, now);
+    }
+    if (link->spooling) {
+        at = p2p_link_sooner(at, link->retry_at, now);
+    }
+    if (link->bulk && link->bulk != link->writing && link->bulk->sent == 0) {
+        at = p2p_link_sooner(at, link->bulk->deadline_ms, now);
+    }
+    return at;
+}
+
+// Reactor callback: collect what the peer sent, settle a connect or a
+// stalled write, then write what can go out and poll for what is missing
+static int p2p_link_ready(P2PWatch* watch, short revents, P2PArena* arena) {
+    P2PLink* link = (P2PLink*)watch;
+    (void)arena;
+    if (atomic_load(&link->stopping)) return -1;
+
+    long long now = p2p_link_now_ms();
+    if (link->connecting) {
+        if (revents & (POLLOUT | POLLERR | POLLHUP)) {
+            if (p2p_link_connected(link) < 0) p2p_link_broken(link, 0, now);
+        } else if (p2p_metrics_now_ns() - link->connect_ns >= (uint64_t)P2P_LINK_CONNECT_TIMEOUT_MS * 1000000) {
+            P2P_TRACE_EVENT(P2P_TRACE_CONNECT_END, 0, -1);
+            p2p_metrics_add(P2P_COUNTER_CONNECT_FAILURES, 1);
+            p2p_link_broken(link, 0, now);
+        }
+    } else if (link->sock >= 0) {
+        // Credit grants and replies are read as they come, so the peer
+        // never blocks writing them
+        if ((revents & (POLLIN | POLLERR | POLLHUP)) && p2p_link_read(link) < 0) {
+            p2p_link_broken(link, 1, now);
+        } else if (link->stalled_at && now - link->stalled_at >= P2P_WIRE_WRITE_TIMEOUT) {
+            P2P_WARN("Peer %s stopped reading, reconnecting", link->address);
+            p2p_link_broken(link, 1, now);
+        }
+    }
+    p2p_link_pump(link);
+
+    watch->fd = link->sock;
+    watch->events = link->connecting ? POLLOUT : link->writing ? POLLIN | POLLOUT : POLLIN;
+    watch->wake_at = p2p_link_wake_at(link, p2p_link_now_ms());
+    return 0;
+}
+
+// Fail the operations still waiting in the lanes
+static void p2p_link_fail_queued(P2PLink* link) {
+    P2PSendOp* op;
+    for (int lane = 0; lane < P2P_LANE_COUNT; lane++) {
+        while (link->lanes[lane].try_pop(&link->lanes[lane], &op)) {
+            p2p_link_complete(link, op, -1);
+        }
+    }
+}
+
+// Fail whatever was not sent and drop the connection (reactor only; a
+// second call finds nothing left to do)
+static void p2p_link_close(P2PLink* link) {
+    if (link->writing && link->writing != link->bulk) p2p_link_complete(link, link->writing, -1);
+    link->writing = NULL;
+    if (link->bulk) p2p_link_complete(link, link->bulk, -1);
+    link->bulk = NULL;
+    p2p_link_fail_queued(link);
+    if (link->spool.count > 0) {
+        P2P_WARN("Dropping %zu spooled messages for %s", link->spool.count, link->address);
+    }
+    p2p_link_disconnect(link);
+}
+
+// Reactor callback once the link is off the reactor: fail whatever was
+// not sent and drop the reactor's reference
+static void p2p_link_unwatched(P2PWatch* watch) {
+    P2PLink* link = (P2PLink*)watch;
+    p2p_link_close(link);
+    p2p_link_release(link);
+}
+
+// Create a link and put it on the reactor
+P2PLink* p2p_link_create(P2PRuntime* runtime, const char* address, P2PTypeRegistry* types,
+                         const P2PSpoolConfig* spool) {
+    P2PLink* link = malloc(sizeof(P2PLink));
+    if (!link) return NULL;
+    memset(link, 0, sizeof(P2PLink));
+
+    link->runtime = runtime;
+    strncpy(link->address, address, sizeof(link->address) - 1);
+    link->types = types;
+    link->sock = -1;
+    atomic_init(&link->credit, P2P_WIRE_CREDIT_WINDOW);
+    atomic_init(&link->backlog, 0);
+    atomic_init(&link->stopping, 0);
+    atomic_init(&link->refs, 2);
+    if (spool) {
+        link->spooling = 1;
+        p2p_spool_init(&link->spool, spool);
+    }
+    link->retry_delay = P2P_LINK_RETRY_MIN_MS;
+    for (int lane = 0; lane < P2P_LANE_COUNT; lane++) {
+        link->lanes[lane] = ring_queue_constructor(P2P_LINK_QUEUE_DEPTH, sizeof(P2PSendOp*));
+    }
+
+    p2p_runtime_watch_init(&link->watch, -1, link, p2p_link_ready, p2p_link_unwatched);
+    p2p_runtime_watch(runtime, &link->watch);
+    return link;
+}
+
+// Queue an encoded frame sequence with a deadline (0 = none)
+static int p2p_link_enqueue(P2PLink* link, P2PLane lane, P2PBuffer* frames, int type_id, int wait,
+                            long long deadline_ms, send_callback_t callback, void* context) {
+    P2PSendOp* op = malloc(sizeof(P2PSendOp));
+    if (!op || atomic_load(&link->stopping)) {
+        p2p_buffer_release(frames);
+        free(op);
+        return -1;
+    }
+    op->frames = frames;
+    op->sent = 0;
+    op->lane = lane;
+    op->type_id = type_id;
+    op->submitted_ns = p2p_metrics_now_ns();
+    op->queued_ms = (long long)(op->submitted_ns / 1000000);
+    op->deadline_ms = deadline_ms;
+    op->callback = callback;
+    op->context = context;
+    op->trace_id = P2P_TRACE_ID();
+    P2P_TRACE_EVENT(P2P_TRACE_SUBMIT, op->trace_id, lane);
+
+    // Counted before the reactor can see the operation
+    if (lane == P2P_LANE_BULK) {
+        atomic_fetch_add(&link->backlog, (long)frames->len);
+    }
+    struct RingQueue* queue = &link->lanes[lane];
+    int status = 0;
+    if (wait && deadline_ms == 0) {
+        queue->push(queue, &op);
+    } else {
+        // A waiting submitter with a deadline keeps trying until then
+        while (!queue->try_push(queue, &op)) {
+            if (!wait) {
+                status = P2P_SEND_BACKPRESSURE;
+                break;
+            }
+            if (p2p_link_now_ms() >= deadline_ms) {
+                status = P2P_SEND_TIMEOUT;
+                break;
+            }
+            usleep(P2P_LINK_PUSH_RETRY_US);
+        }
+    }
+    if (status != 0) {
+        if (lane == P2P_LANE_BULK) {
+            atomic_fetch_sub(&link->backlog, (long)frames->len);
+        }
+        P2P_TRACE_EVENT(P2P_TRACE_SENT, op->trace_id, status);
+        p2p_buffer_release(frames);
+        free(op);
+        return status;
+    }
+
+    p2p_runtime_kick(link->runtime, &link->watch);
+    if (atomic_load(&link->stopping)) {
+        // The reactor may have closed the link before this operation was
+        // in a lane, so fail what is left rather than leave it waiting
+        p2p_link_fail_queued(link);
+    }
+    return 0;
+}
+
+// Queue an encoded frame sequence
+int p2p_link_submit(P2PLink* link, P2PLane lane, P2PBuffer* frames, int type_id, int wait,
+                    send_callback_t callback, void* context) {
+    return p2p_link_enqueue(link, lane, frames, type_id, wait, 0, callback, context);
+}
+
+// Queue without waiting, timing out if not started within timeout_ms
+int p2p_link_submit_timed(P2PLink* link, P2PLane lane, P2PBuffer* frames, int type_id, int timeout_ms,
+                          send_callback_t callback, void* context) {
+    long long deadline_ms = timeout_ms > 0 ? p2p_link_now_ms() + timeout_ms : 0;
+    return p2p_link_enqueue(link, lane, frames, type_id, 0, deadline_ms, callback, context);
+}
+
+// Drop one reference to a waiter, freeing it with the last
+static void p2p_link_waiter_release(P2PSendWaiter* waiter) {
+    pthread_mutex_lock(&waiter->lock);
+    int last = --waiter->refs == 0;
+    pthread_mutex_unlock(&waiter->lock);
+    if (last) {
+        pthread_cond_destroy(&waiter->cond);
+        pthread_mutex_destroy(&waiter->lock);
+        free(waiter);
+    }
+}
+
+// Callback that completes a P2PSendWaiter
+static void p2p_link_wake(void* context, int status) {
+    P2PSendWaiter* waiter = (P2PSendWaiter*)context;
+    pthread_mutex_lock(&waiter->lock);
+    waiter->status = status;
+    waiter->done = 1;
+    pthread_cond_signal(&waiter->cond);
+    pthread_mutex_unlock(&waiter->lock);
+    p2p_link_waiter_release(waiter);
+}
+
+// Submit and wait until the frames are written or timeout_ms passes.
+// The operation carries the same deadline, so unless writing had begun
+// by then the frames are dropped rather than sent after the submitter
+// was told they timed out.
+int p2p_link_send(P2PLink* link, P2PLane lane, P2PBuffer* frames, int type_id, int timeout_ms) {
+    P2PSendWaiter* waiter = malloc(sizeof(P2PSendWaiter));
+    if (!waiter) {
+        p2p_buffer_release(frames);
+        return -1;
+    }
+    pthread_mutex_init(&waiter->lock, NULL);
+    pthread_cond_init(&waiter->cond, NULL);
+    waiter->done = 0;
+    waiter->status = -1;
+    waiter->refs = 2;
+
+    long long deadline_ms = timeout_ms > 0 ? p2p_link_now_ms() + timeout_ms : 0;
+    int result = p2p_link_enqueue(link, lane, frames, type_id, 1, deadline_ms, p2p_link_wake, waiter);
+    if (result != 0) {
+        // The operation never existed, so its reference goes too
+        waiter->refs = 1;
+        p2p_link_waiter_release(waiter);
+        return result;
+    }
+
+    // Condition variables time out against the realtime clock
+    struct timespec until;
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_REALTIME, &until);
+        long long remaining = deadline_ms - p2p_link_now_ms();
+        if (remaining < 0) remaining = 0;
+        until.tv_sec += remaining / 1000;
+        until.tv_nsec += (remaining % 1000) * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec += 1;
+            until.tv_nsec -= 1000000000L;
+        }
+    }
+    pthread_mutex_lock(&waiter->lock);
+    while (!waiter->done) {
+        if (timeout_ms <= 0) {
+            pthread_cond_wait(&waiter->cond, &waiter->lock);
+        } else if (pthread_cond_timedwait(&waiter->cond, &waiter->lock, &until) == ETIMEDOUT) {
+            break;
+        }
+    }
+    result = waiter->done ? waiter->status : P2P_SEND_TIMEOUT;
+    pthread_mutex_unlock(&waiter->lock);
+    p2p_link_waiter_release(waiter);
+    return result;
+}
+
+// Bulk bytes that could be written right now without waiting for credit
+long p2p_link_capacity(P2PLink* link) {
+    return atomic_load(&link->credit) - atomic_load(&link->backlog);
+}
+
+// Keep a link alive while submitting to it
+void p2p_link_retain(P2PLink* link) {
+    atomic_fetch_add(&link->refs, 1);
+}
+
+// Drop a reference, freeing the link with the last one
+void p2p_link_release(P2PLink* link) {
+    if (atomic_fetch_sub(&link->refs, 1) != 1) return;
+    for (int lane = 0; lane < P2P_LANE_COUNT; lane++) {
+        ring_queue_destructor(&link->lanes[lane]);
+    }
+    if (link->spooling) p2p_spool_destroy(&link->spool);
+    free(link);
+}
+
+// Take the link off the reactor, fail anything still queued and drop the
+// creator's reference
+void p2p_link_destroy(P2PLink* link) {
+    atomic_store(&link->stopping, 1);
+    p2p_runtime_unwatch(link->runtime, link);
+    p2p_link_release(link);
+}
+
+// Close the link from the reactor: its watch is removed on the next pass
+void p2p_link_retire(P2PLink* link) {
+    atomic_store(&link->stopping, 1);
+    p2p_link_close(link);
+    if (link->spooling) {
+        p2p_spool_destroy(&link->spool);
+        link->spooling = 0;
+    }
+    p2p_runtime_kick(link->runtime, &link->watch);
+    p2p_link_release(link);
+}
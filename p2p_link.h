@@ -0,0 +1,180 @@
+#ifndef P2P_LINK_H
+#define P2P_LINK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "p2p_registry.h"
+#include "p2p_wire.h"
+#include "p2p_buffer.h"
+#include "p2p_spool.h"
+#include "p2p_metrics.h"
+#include "p2p_trace.h"
+#include "p2p_runtime.h"
+#include "DataStructures/Lists/RingQueue.h"
+
+// Operations each lane holds before submitters wait
+#define P2P_LINK_QUEUE_DEPTH 256
+
+// Control operations sent for every bulk operation while both lanes are busy
+#define P2P_LINK_CONTROL_WEIGHT 8
+
+// Bulk bytes written before the control lane gets another turn
+#define P2P_LINK_QUANTUM (16 * 1024)
+
+// Bulk bytes P2P_FLOW_QUEUE lets pile up on one link
+#define P2P_LINK_MAX_BACKLOG (4 * 1024 * 1024)
+
+// Room for the frames a peer sends back on a link (credit grants, discovery replies)
+#define P2P_LINK_REPLY_BUFFER 4096
+
+// Milliseconds a P2P_FLOW_BLOCK send waits for writing to start
+#define P2P_LINK_BLOCK_TIMEOUT_MS P2P_WIRE_WRITE_TIMEOUT
+
+// Milliseconds a connect may take before the peer counts as unreachable
+#define P2P_LINK_CONNECT_TIMEOUT_MS 5000
+
+// Milliseconds between reconnect attempts to an unreachable peer with a
+// spool (doubling from the minimum up to the maximum)
+#define P2P_LINK_RETRY_MIN_MS 100
+#define P2P_LINK_RETRY_MAX_MS 5000
+
+// Returned when a send would have to wait and the caller asked it not to
+#define P2P_SEND_BACKPRESSURE (-2)
+
+// Send status: the peer could not be reached and the frames were spooled
+// for delivery once it is back
+#define P2P_SEND_SPOOLED 1
+
+// Send status: writing had not started by the submitter's deadline
+#define P2P_SEND_TIMEOUT (-3)
+
+// Traffic classes. Control carries membership traffic (discovery and
+// anything else that must stay timely); bulk carries application data.
+typedef enum {
+    P2P_LANE_CONTROL = 0,
+    P2P_LANE_BULK = 1,
+    P2P_LANE_COUNT
+} P2PLane;
+
+// What a bulk send does when the peer has no credit left
+typedef enum {
+    P2P_FLOW_BLOCK = 0,     // Wait until the peer has consumed enough, up to P2P_LINK_BLOCK_TIMEOUT_MS
+    P2P_FLOW_FAIL,          // Return P2P_SEND_BACKPRESSURE unless it can be sent right away
+    P2P_FLOW_QUEUE          // Queue without waiting, up to P2P_LINK_MAX_BACKLOG bytes
+} P2PFlowPolicy;
+
+// Send completion callback: status is 0 once every byte was written,
+// P2P_SEND_SPOOLED if the frames are being held for an unreachable peer,
+// P2P_SEND_TIMEOUT if they were not started in time, -1 on failure
+typedef void (*send_callback_t)(void* context, int status);
+
+// One queued send: encoded frames, written in order
+typedef struct {
+    P2PBuffer* frames;          // One reference, dropped once the operation completes
+    size_t sent;                // Bytes already written
+    P2PLane lane;
+    int type_id;                // Type the frames use (TYPE_DEF is sent first if needed), -1 if none
+    uint64_t submitted_ns;      // When the frames were submitted (send latency)
+    long long queued_ms;        // When the frames were first submitted (for spool expiry)
+    long long deadline_ms;      // Time out if nothing is written by then (0 = no limit)
+    uint64_t trace_id;          // Message id in traces (0 when tracing is compiled out)
+    send_callback_t callback;   // Optional
+    void* context;
+} P2PSendOp;
+
+// Persistent outbound connection to one peer. Submitters queue encoded
+// frames on a lane and kick the link, a watch on a runtime's reactor that
+// owns the socket: it connects on demand and writes without blocking as
+// the socket drains, interleaving the lanes at frame boundaries so a long
+// bulk transfer delays a control frame by about one quantum. Bulk frames
+// are only started while the peer has granted credit, so a slow receiver
+// slows the sender down instead of buffering without bound; control
+// frames are never held back by credit.
+//
+// With a spool, bulk frames for a peer that cannot be reached are held
+// rather than failed: the oldest stays on the link while later ones queue
+// in the spool, and all of them go out in order once a reconnect attempt
+// succeeds.
+typedef struct {
+    P2PWatch watch;                             // On the runtime's reactor (first, so the watch is the link)
+    P2PRuntime* runtime;
+    char address[128];
+    P2PTypeRegistry* types;
+    int sock;                                   // -1 while disconnected (reactor only)
+    int connecting;                             // Connect still in progress on sock (reactor only)
+    uint64_t connect_ns;                        // When the connect began
+    long long stalled_at;                       // Since when a write has waited on a full socket (0 = not)
+    uint8_t defined[P2P_MAX_TYPES / 8];         // Types defined on the current connection (reactor only)
+    uint8_t type_def[P2P_WIRE_MAX_MESSAGE];     // TYPE_DEF going out ahead of the writing operation
+    size_t type_def_len;
+    size_t type_def_sent;
+    P2PWireStream replies;                      // Frames from the peer (reactor only)
+    uint8_t reply_buf[P2P_LINK_REPLY_BUFFER];
+    struct RingQueue lanes[P2P_LANE_COUNT];     // P2PSendOp*
+    P2PSendOp* writing;                         // Operation being written up to slice_end (reactor only)
+    size_t slice_end;                           // Where this turn of writing stops, always a frame boundary
+    int redialed;                               // The writing operation already lost one connection
+    P2PSendOp* bulk;                            // Bulk operation in progress (or held for a reconnect)
+    int control_streak;                         // Control operations sent since the last bulk turn
+    atomic_long credit;                         // Bulk bytes the peer will still accept
+    atomic_long backlog;                        // Bulk bytes submitted but not yet written
+    atomic_int stopping;
+    atomic_int refs;                            // The creator's, the reactor's and one per p2p_link_retain
+    int spooling;                               // Whether spool is in use
+    P2PSpool spool;                             // Bulk frames waiting for the peer (reactor only)
+    long long retry_at;                         // Next reconnect attempt while the peer is unreachable
+    long retry_delay;
+} P2PLink;
+
+// Create a link on runtime's reactor (connects on the first send). spool
+// is NULL to fail sends to an unreachable peer instead of holding them.
+// Completion callbacks run on the reactor (a send that races with the
+// link closing is failed on the submitting thread) and must not block.
+P2PLink* p2p_link_create(P2PRuntime* runtime, const char* address, P2PTypeRegistry* types,
+                         const P2PSpoolConfig* spool);
+
+// Queue an encoded frame sequence; the link takes over one reference to
+// frames (released on failure too), so one buffer can be submitted to many
+// links. With wait set this blocks while the lane is full, otherwise it
+// returns P2P_SEND_BACKPRESSURE. Returns -1 if the link is shutting down.
+// The callback runs only when 0 is returned.
+int p2p_link_submit(P2PLink* link, P2PLane lane, P2PBuffer* frames, int type_id, int wait,
+                    send_callback_t callback, void* context);
+
+// Queue without waiting, like p2p_link_submit, but complete the operation
+// with P2P_SEND_TIMEOUT if none of it is written within timeout_ms (0 = no
+// limit); once writing starts, the frames are always finished. Returns 0,
+// P2P_SEND_BACKPRESSURE if the lane is full, or -1.
+int p2p_link_submit_timed(P2PLink* link, P2PLane lane, P2PBuffer* frames, int type_id, int timeout_ms,
+                          send_callback_t callback, void* context);
+
+// Submit and wait until the frames are written: 0 on success,
+// P2P_SEND_TIMEOUT if they were not written within timeout_ms (0 = no
+// limit; frames already being written by then still go out, the rest are
+// dropped), -1 on failure. Not callable from the reactor thread.
+int p2p_link_send(P2PLink* link, P2PLane lane, P2PBuffer* frames, int type_id, int timeout_ms);
+
+// Bulk bytes that could be written right now without waiting for credit
+long p2p_link_capacity(P2PLink* link);
+
+// Keep a link alive while submitting to it from outside its owner
+void p2p_link_retain(P2PLink* link);
+
+// Drop a reference taken with p2p_link_retain
+void p2p_link_release(P2PLink* link);
+
+// Take the link off the reactor, fail anything still queued and drop the
+// creator's reference. No other thread may be submitting. Not callable
+// from the reactor thread.
+void p2p_link_destroy(P2PLink* link);
+
+// Close the link at once, failing anything queued and removing its
+// spool, then drop the creator's reference; it is freed once the last
+// holder releases it. Only callable from the reactor thread.
+void p2p_link_retire(P2PLink* link);
+
+#endif
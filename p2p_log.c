@@ -0,0 +1,461 @@
+#include "p2p_log.h"
+#include <stdarg.h>
+#include <strings.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "DataStructures/Lists/RingQueue.h"
+
+// Longest line written (longer ones are cut short)
+#define P2P_LOG_LINE_SIZE 1024
+
+// Milliseconds the writer waits for records before flushing
+#define P2P_LOG_FLUSH_MS 100
+
+// One log call: the format and its arguments as the caller passed them
+typedef struct {
+    const char* fmt;            // Must be a string literal (it outlives the call)
+    struct timespec time;
+    long tid;
+    uint16_t len;               // Bytes of args in use
+    uint8_t level;
+    uint8_t truncated;          // Some arguments did not fit
+    uint8_t args[P2P_LOG_ARGS_SIZE];
+} P2PLogRecord;
+
+// One conversion in a format
+typedef struct {
+    const char* start;          // The '%'
+    size_t len;                 // Through the conversion character
+    size_t prefix;              // Flags, width and precision: start + 1 up to the length modifier
+    int stars;                  // '*' widths and precisions, each an int argument
+    char length;                // 'H' for hh, 'q' for ll, else h l j z t L or 0
+    char conversion;
+} P2PLogSpec;
+
+atomic_int p2p_log_level = P2P_LOG_INFO;
+
+static const char* level_names[] = { "ERROR", "WARN", "INFO", "DEBUG" };
+
+static struct RingQueue queue;
+static pthread_t writer;
+static atomic_int running;                      // Records go to the writer thread
+static atomic_int stopping;
+static atomic_int pushing;                      // Threads between checking running and pushing
+static atomic_ulong dropped;
+static unsigned long dropped_reported;         // Writer thread, or p2p_log_stop once it has exited
+static FILE* output;                            // Log file, NULL for stdout
+static pthread_mutex_t control_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t exit_once = PTHREAD_ONCE_INIT;
+static __thread long thread_id;
+
+// Next conversion at or after *p (advancing past it): 0 at the end
+static int p2p_log_next_spec(const char** p, P2PLogSpec* spec) {
+    const char* s = strchr(*p, '%');
+    if (!s) return 0;
+
+    spec->start = s++;
+    spec->stars = 0;
+    spec->length = 0;
+    while (*s == '-' || *s == '+' || *s == ' ' || *s == '#' || *s == '0' || *s == '\'') s++;
+    if (*s == '*') {
+        spec->stars++;
+        s++;
+    }
+    while (*s >= '0' && *s <= '9') s++;
+    if (*s == '.') {
+        s++;
+        if (*s == '*') {
+            spec->stars++;
+            s++;
+        }
+        while (*s >= '0' && *s <= '9') s++;
+    }
+    spec->prefix = (size_t)(s - spec->start) - 1;
+
+    if (s[0] == 'h' && s[1] == 'h') {
+        spec->length = 'H';
+        s += 2;
+    } else if (s[0] == 'l' && s[1] == 'l') {
+        spec->length = 'q';
+        s += 2;
+    } else if (*s == 'h' || *s == 'l' || *s == 'j' || *s == 'z' || *s == 't' || *s == 'L') {
+        spec->length = *s++;
+    }
+    if (!*s) return 0;
+    spec->conversion = *s++;
+    spec->len = (size_t)(s - spec->start);
+    *p = s;
+    return 1;
+}
+
+// Append bytes to a record's arguments: 0 if they do not fit
+static int p2p_log_put(P2PLogRecord* record, const void* data, size_t len) {
+    if (record->len + len > P2P_LOG_ARGS_SIZE) {
+        record->truncated = 1;
+        return 0;
+    }
+    memcpy(record->args + record->len, data, len);
+    record->len += (uint16_t)len;
+    return 1;
+}
+
+// Read an integer argument as its length modifier says, narrowed the way
+// printf would narrow it
+static uint64_t p2p_log_arg_int(va_list* args, char length, int is_signed) {
+    switch (length) {
+    case 'l': return is_signed ? (uint64_t)va_arg(*args, long) : va_arg(*args, unsigned long);
+    case 'q': return is_signed ? (uint64_t)va_arg(*args, long long) : va_arg(*args, unsigned long long);
+    case 'j': return (uint64_t)va_arg(*args, intmax_t);
+    case 'z': return va_arg(*args, size_t);
+    case 't': return (uint64_t)va_arg(*args, ptrdiff_t);
+    case 'H': return is_signed ? (uint64_t)(signed char)va_arg(*args, int) : (unsigned char)va_arg(*args, int);
+    case 'h': return is_signed ? (uint64_t)(short)va_arg(*args, int) : (unsigned short)va_arg(*args, int);
+    default: return is_signed ? (uint64_t)va_arg(*args, int) : va_arg(*args, unsigned int);
+    }
+}
+
+// Copy every argument fmt consumes into the record
+static void p2p_log_capture(P2PLogRecord* record, const char* fmt, va_list* args) {
+    const char* p = fmt;
+    P2PLogSpec spec;
+    while (p2p_log_next_spec(&p, &spec)) {
+        for (int i = 0; i < spec.stars; i++) {
+            int star = va_arg(*args, int);
+            if (!p2p_log_put(record, &star, sizeof(star))) return;
+        }
+
+        switch (spec.conversion) {
+        case 'd': case 'i': {
+            uint64_t value = p2p_log_arg_int(args, spec.length, 1);
+            if (!p2p_log_put(record, &value, sizeof(value))) return;
+            break;
+        }
+        case 'u': case 'o': case 'x': case 'X': {
+            uint64_t value = p2p_log_arg_int(args, spec.length, 0);
+            if (!p2p_log_put(record, &value, sizeof(value))) return;
+            break;
+        }
+        case 'c': {
+            int value = va_arg(*args, int);
+            if (!p2p_log_put(record, &value, sizeof(value))) return;
+            break;
+        }
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A': {
+            double value = spec.length == 'L' ? (double)va_arg(*args, long double) : va_arg(*args, double);
+            if (!p2p_log_put(record, &value, sizeof(value))) return;
+            break;
+        }
+        case 'p': {
+            void* value = va_arg(*args, void*);
+            if (!p2p_log_put(record, &value, sizeof(value))) return;
+            break;
+        }
+        case 's': {
+            // Strings are copied (cut to what is left) since the caller's may not last
+            const char* value = va_arg(*args, const char*);
+            if (!value) value = "(null)";
+            size_t room = P2P_LOG_ARGS_SIZE - record->len;
+            if (room < 2) {
+                record->truncated = 1;
+                return;
+            }
+            size_t len = strlen(value);
+            if (len > room - 1) {
+                len = room - 1;
+                record->truncated = 1;
+            }
+            memcpy(record->args + record->len, value, len);
+            record->args[record->len + len] = '\0';
+            record->len += (uint16_t)(len + 1);
+            break;
+        }
+        }
+    }
+}
+
+// Take the next argument of a record: NULL if it was not captured
+static const void* p2p_log_take(const P2PLogRecord* record, size_t* offset, size_t len) {
+    if (*offset + len > record->len) return NULL;
+    const void* data = record->args + *offset;
+    *offset += len;
+    return data;
+}
+
+// printf one captured argument with the conversion rebuilt for the type it was stored as
+#define P2P_LOG_EMIT(out, room, spec_buf, stars, star, value) \
+    ((stars) == 0 ? snprintf((out), (room), (spec_buf), (value)) : \
+     (stars) == 1 ? snprintf((out), (room), (spec_buf), (star)[0], (value)) : \
+                    snprintf((out), (room), (spec_buf), (star)[0], (star)[1], (value)))
+
+// Format a record's message into out: the length written
+static size_t p2p_log_format(const P2PLogRecord* record, char* out, size_t cap) {
+    size_t pos = 0;
+    size_t offset = 0;
+    int cut = 0;
+    const char* p = record->fmt;
+    P2PLogSpec spec;
+
+    while (pos + 1 < cap) {
+        const char* literal = p;
+        int more = p2p_log_next_spec(&p, &spec);
+        size_t literal_len = more ? (size_t)(spec.start - literal) : strlen(literal);
+        if (literal_len > cap - 1 - pos) literal_len = cap - 1 - pos;
+        memcpy(out + pos, literal, literal_len);
+        pos += literal_len;
+        if (!more || pos + 1 >= cap) break;
+
+        if (spec.conversion == '%') {
+            out[pos++] = '%';
+            continue;
+        }
+
+        int star[2] = { 0, 0 };
+        int missing = 0;
+        for (int i = 0; i < spec.stars; i++) {
+            const void* data = p2p_log_take(record, &offset, sizeof(int));
+            if (!data) missing = 1;
+            else memcpy(&star[i], data, sizeof(int));
+        }
+
+        // Conversion with the length modifier replaced to match the stored type
+        char spec_buf[64];
+        char c = spec.conversion;
+        const char* length = (c == 'd' || c == 'i' || c == 'u' || c == 'o' || c == 'x' || c == 'X') ? "ll" : "";
+        if (spec.prefix > sizeof(spec_buf) - 8) break;
+        spec_buf[0] = '%';
+        memcpy(spec_buf + 1, spec.start + 1, spec.prefix);
+        snprintf(spec_buf + 1 + spec.prefix, sizeof(spec_buf) - 1 - spec.prefix, "%s%c", length, c);
+
+        size_t room = cap - pos;
+        int n = 0;
+        const void* data = NULL;
+        if (!missing) {
+            if (*length) {
+                if ((data = p2p_log_take(record, &offset, sizeof(uint64_t)))) {
+                    unsigned long long value;
+                    memcpy(&value, data, sizeof(value));
+                    n = P2P_LOG_EMIT(out + pos, room, spec_buf, spec.stars, star, value);
+                }
+            } else if (c == 'c') {
+                if ((data = p2p_log_take(record, &offset, sizeof(int)))) {
+                    int value;
+                    memcpy(&value, data, sizeof(value));
+                    n = P2P_LOG_EMIT(out + pos, room, spec_buf, spec.stars, star, value);
+                }
+            } else if (strchr("eEfFgGaA", c)) {
+                if ((data = p2p_log_take(record, &offset, sizeof(double)))) {
+                    double value;
+                    memcpy(&value, data, sizeof(value));
+                    n = P2P_LOG_EMIT(out + pos, room, spec_buf, spec.stars, star, value);
+                }
+            } else if (c == 'p') {
+                if ((data = p2p_log_take(record, &offset, sizeof(void*)))) {
+                    void* value;
+                    memcpy(&value, data, sizeof(value));
+                    n = P2P_LOG_EMIT(out + pos, room, spec_buf, spec.stars, star, value);
+                }
+            } else if (c == 's') {
+                if (offset < record->len) {
+                    const char* value = (const char*)record->args + offset;
+                    offset += strlen(value) + 1;
+                    data = value;
+                    n = P2P_LOG_EMIT(out + pos, room, spec_buf, spec.stars, star, value);
+                }
+            }
+        }
+        if (!data) {
+            // Arguments ran out of room in the record
+            n = snprintf(out + pos, room, "...");
+            pos += (size_t)n < room ? (size_t)n : room - 1;
+            cut = 1;
+            break;
+        }
+        if (n > 0) pos += (size_t)n < room ? (size_t)n : room - 1;
+    }
+    if (record->truncated && !cut && pos + 4 < cap) {
+        memcpy(out + pos, "...", 3);
+        pos += 3;
+    }
+    out[pos] = '\0';
+    return pos;
+}
+
+// Write a record as one line
+static void p2p_log_emit(const P2PLogRecord* record, FILE* file) {
+    char line[P2P_LOG_LINE_SIZE];
+    size_t len = 0;
+
+    if (file != stdout) {
+        struct tm tm;
+        localtime_r(&record->time.tv_sec, &tm);
+        len = strftime(line, sizeof(line), "%Y-%m-%d %H:%M:%S", &tm);
+        len += (size_t)snprintf(line + len, sizeof(line) - len, ".%06ld %-5s [%ld] ",
+                                record->time.tv_nsec / 1000, level_names[record->level], record->tid);
+    } else if (record->level != P2P_LOG_INFO) {
+        len = (size_t)snprintf(line, sizeof(line), "%s: ", level_names[record->level]);
+    }
+    len += p2p_log_format(record, line + len, sizeof(line) - len - 1);
+    line[len++] = '\n';
+    fwrite(line, 1, len, file);
+}
+
+// Write a line about records lost to a full queue since the last report
+static void p2p_log_report_dropped(FILE* file) {
+    unsigned long now = atomic_load(&dropped);
+    if (now == dropped_reported) return;
+
+    P2PLogRecord record;
+    memset(&record, 0, sizeof(record));
+    record.fmt = "Dropped %lu log messages (queue full)";
+    record.level = P2P_LOG_WARN;
+    clock_gettime(CLOCK_REALTIME, &record.time);
+    record.tid = thread_id;
+    uint64_t count = now - dropped_reported;
+    p2p_log_put(&record, &count, sizeof(count));
+    p2p_log_emit(&record, file);
+    dropped_reported = now;
+}
+
+// Writer thread: format and write records, flushing whenever it catches up
+static void* p2p_log_thread(void* arg) {
+    FILE* file = (FILE*)arg;
+    P2PLogRecord record;
+
+    while (!atomic_load(&stopping) || queue.size(&queue) > 0) {
+        if (!queue.timed_pop(&queue, &record, P2P_LOG_FLUSH_MS)) {
+            p2p_log_report_dropped(file);
+            fflush(file);
+            continue;
+        }
+        p2p_log_emit(&record, file);
+        if (queue.size(&queue) == 0) {
+            p2p_log_report_dropped(file);
+            fflush(file);
+        }
+    }
+    fflush(file);
+    return NULL;
+}
+
+// Log a message
+void p2p_log_write(P2PLogLevel level, const char* fmt, ...) {
+    P2PLogRecord record;
+    record.fmt = fmt;
+    record.len = 0;
+    record.level = (uint8_t)level;
+    record.truncated = 0;
+    clock_gettime(CLOCK_REALTIME, &record.time);
+    if (!thread_id) thread_id = (long)syscall(SYS_gettid);
+    record.tid = thread_id;
+
+    va_list args;
+    va_start(args, fmt);
+    p2p_log_capture(&record, fmt, &args);
+    va_end(args);
+
+    // Counted while it uses the queue, so p2p_log_stop can wait for it
+    // before freeing the queue (both sides sequentially consistent)
+    atomic_fetch_add(&pushing, 1);
+    if (atomic_load(&running)) {
+        if (!queue.try_push(&queue, &record)) {
+            atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+        }
+        atomic_fetch_sub(&pushing, 1);
+        return;
+    }
+    atomic_fetch_sub(&pushing, 1);
+    p2p_log_emit(&record, stdout);
+}
+
+// Set the most detailed level written
+void p2p_log_set_level(P2PLogLevel level) {
+    atomic_store(&p2p_log_level, (int)level);
+}
+
+// Level named by name
+int p2p_log_parse_level(const char* name) {
+    for (int level = P2P_LOG_ERROR; level <= P2P_LOG_DEBUG; level++) {
+        if (strcasecmp(name, level_names[level]) == 0) return level;
+    }
+    return -1;
+}
+
+static void p2p_log_register_exit(void) {
+    atexit(p2p_log_stop);
+}
+
+// Start the writer thread
+int p2p_log_start(const char* path) {
+    pthread_mutex_lock(&control_lock);
+    if (atomic_load(&running)) {
+        pthread_mutex_unlock(&control_lock);
+        return -1;
+    }
+
+    FILE* file = stdout;
+    if (path) {
+        file = fopen(path, "a");
+        if (!file) {
+            pthread_mutex_unlock(&control_lock);
+            printf("Failed to open log file %s\n", path);
+            return -1;
+        }
+    }
+
+    queue = ring_queue_constructor(P2P_LOG_QUEUE_DEPTH, sizeof(P2PLogRecord));
+    atomic_store(&stopping, 0);
+    if (pthread_create(&writer, NULL, p2p_log_thread, file) != 0) {
+        ring_queue_destructor(&queue);
+        if (path) fclose(file);
+        pthread_mutex_unlock(&control_lock);
+        return -1;
+    }
+    output = path ? file : NULL;
+    atomic_store_explicit(&running, 1, memory_order_release);
+    pthread_mutex_unlock(&control_lock);
+
+    // Whatever is still queued is written when the process exits
+    pthread_once(&exit_once, p2p_log_register_exit);
+    return 0;
+}
+
+// Write everything queued and stop the writer thread
+void p2p_log_stop(void) {
+    pthread_mutex_lock(&control_lock);
+    if (!atomic_load(&running)) {
+        pthread_mutex_unlock(&control_lock);
+        return;
+    }
+
+    // New records are written directly from here on; wait out the threads
+    // that saw the writer running and may still be pushing
+    atomic_store(&running, 0);
+    while (atomic_load(&pushing) > 0) {
+        sched_yield();
+    }
+    atomic_store(&stopping, 1);
+    pthread_join(writer, NULL);
+
+    // Records pushed while the writer was exiting
+    FILE* file = output ? output : stdout;
+    P2PLogRecord record;
+    while (queue.try_pop(&queue, &record)) {
+        p2p_log_emit(&record, file);
+    }
+    p2p_log_report_dropped(file);
+    fflush(file);
+    if (output) fclose(output);
+    output = NULL;
+    ring_queue_destructor(&queue);
+    pthread_mutex_unlock(&control_lock);
+}
+
+// Records dropped because the queue was full
+unsigned long p2p_log_dropped(void) {
+    return atomic_load(&dropped);
+}
@@ -0,0 +1,80 @@
+#ifndef P2P_LOG_H
+#define P2P_LOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+// Leveled logging with deferred formatting.
+//
+// A log call checks the level, then copies its arguments - strings by
+// value - into a fixed-size record without formatting anything. Once
+// p2p_log_start has run, records go onto a lock-free queue and a
+// background thread formats and writes them, so a call on the message
+// path costs a level check and a copy. Before that (and after
+// p2p_log_stop) records are formatted and written on the calling thread.
+// If the queue is full the record is dropped and counted rather than
+// holding up the caller.
+//
+// Messages below P2P_LOG_COMPILE_LEVEL are compiled out entirely;
+// p2p_log_set_level filters the rest at run time. Formats use printf
+// conversions; %n is not supported, and arguments that do not fit in one
+// record are cut short.
+
+typedef enum {
+    P2P_LOG_ERROR = 0,
+    P2P_LOG_WARN,
+    P2P_LOG_INFO,
+    P2P_LOG_DEBUG
+} P2PLogLevel;
+
+// Most detailed level built in (e.g. -DP2P_LOG_COMPILE_LEVEL=P2P_LOG_INFO)
+#ifndef P2P_LOG_COMPILE_LEVEL
+#define P2P_LOG_COMPILE_LEVEL P2P_LOG_DEBUG
+#endif
+
+// Records the writer thread can fall behind by
+#define P2P_LOG_QUEUE_DEPTH 4096
+
+// Bytes of copied arguments one record holds
+#define P2P_LOG_ARGS_SIZE 224
+
+// Most detailed level written at run time (use the functions below)
+extern atomic_int p2p_log_level;
+
+static inline int p2p_log_enabled(P2PLogLevel level) {
+    return (int)level <= atomic_load_explicit(&p2p_log_level, memory_order_relaxed);
+}
+
+// Log a message (no trailing newline needed)
+void p2p_log_write(P2PLogLevel level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define P2P_LOG(level, ...) \
+    do { \
+        if ((level) <= P2P_LOG_COMPILE_LEVEL && p2p_log_enabled(level)) p2p_log_write((level), __VA_ARGS__); \
+    } while (0)
+
+#define P2P_ERROR(...) P2P_LOG(P2P_LOG_ERROR, __VA_ARGS__)
+#define P2P_WARN(...) P2P_LOG(P2P_LOG_WARN, __VA_ARGS__)
+#define P2P_INFO(...) P2P_LOG(P2P_LOG_INFO, __VA_ARGS__)
+#define P2P_DEBUG(...) P2P_LOG(P2P_LOG_DEBUG, __VA_ARGS__)
+
+// Set the most detailed level written (P2P_LOG_INFO by default)
+void p2p_log_set_level(P2PLogLevel level);
+
+// Level named by "error", "warn", "info" or "debug": -1 if unknown
+int p2p_log_parse_level(const char* name);
+
+// Start the writer thread, appending to path (NULL for stdout). Lines in a
+// file carry a timestamp, level and thread id; on stdout only levels other
+// than INFO are tagged. Returns 0 once running.
+int p2p_log_start(const char* path);
+
+// Write everything queued, stop the writer thread and close the file
+void p2p_log_stop(void);
+
+// Records dropped because the queue was full
+unsigned long p2p_log_dropped(void);
+
+#endif
@@ -4,10 +4,80 @@
 #include "p2p_message.h"
 #include "p2p_peer.h"
 #include "p2p_network.h"
+#include "p2p_rpc.h"
+#include "p2p_metrics.h"
+#include "p2p_trace.h"
+#include "p2p_log.h"
+#include "p2p_daemon.h"
+#include <signal.h>
+
+// Read a whole file into memory (binary safe)
+static void* read_file(const char* path, size_t* len) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < 0) {
+        fclose(file);
+        return NULL;
+    }
+    
+    void* data = malloc(size > 0 ? size : 1);
+    if (data && fread(data, 1, size, file) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *len = size;
+    return data;
+}
+
+// RPC handler that answers with the request payload
+static int echo_handler(P2PMessage* request, P2PRpcReply* reply) {
+    size_t len = request->data_len < reply->cap ? request->data_len : reply->cap;
+    memcpy(reply->data, request->payload, len);
+    reply->len = len;
+    return P2P_RPC_OK;
+}
+
+// Network the load echo answers on (message handlers take no context)
+static P2PNetwork* load_network;
+
+// Answer a bench_load ping with the same payload
+static void load_ping_handler(P2PMessage* msg) {
+    p2p_network_send_bytes(load_network, msg->sender, "LOAD_PONG", msg->payload, msg->data_len);
+}
+
+// Issue one RPC and print the response
+static void call_peer(P2PNetwork* network, const char* address, const char* type, const char* data) {
+    P2PRpcClient* client = p2p_rpc_connect(network, address);
+    if (!client) return;
+    
+    char response[P2P_MESSAGE_DATA_MAX + 1];
+    size_t len = 0;
+    int status = p2p_rpc_call(client, type, data, strlen(data), response, sizeof(response) - 1, &len, 0);
+    if (status == P2P_RPC_OK) {
+        if (len > sizeof(response) - 1) len = sizeof(response) - 1;
+        response[len] = '\0';
+        printf("Response from %s: %s\n", address, response);
+    } else {
+        printf("Call %s to %s failed with status %d\n", type, address, status);
+    }
+    p2p_rpc_close(client);
+}
 
 int main(int argc, char* argv[]) {
     char* node_address = "127.0.0.1:1248";  // Default
     char* connect_to = NULL;
+    char* spool_dir = NULL;
+    char* metrics_endpoint = NULL;
+    char* trace_path = NULL;
+    char* log_file = NULL;
+    char* daemon_path = NULL;
+    int admission = 1;
+    int failure_detection = 1;
     
     // Parse arguments
     for (int i = 1; i < argc; i++) {
@@ -17,6 +87,35 @@ int main(int argc, char* argv[]) {
         else if (strcmp(argv[i], "--connect-to") == 0 && i + 1 < argc) {
             connect_to = argv[++i];
         }
+        else if (strcmp(argv[i], "--spool") == 0 && i + 1 < argc) {
+            spool_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics_endpoint = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            int level = p2p_log_parse_level(argv[++i]);
+            if (level < 0) {
+                printf("Error: Log level must be error, warn, info or debug\n");
+                return 1;
+            }
+            p2p_log_set_level(level);
+        }
+        else if (strcmp(argv[i], "--log-file") == 0 && i + 1 < argc) {
+            log_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc) {
+            daemon_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--no-admission") == 0) {
+            admission = 0;
+        }
+        else if (strcmp(argv[i], "--no-swim") == 0) {
+            failure_detection = 0;
+        }
     }
     
     printf("Starting P2P node on %s\n", node_address);
@@ -29,6 +128,26 @@ int main(int argc, char* argv[]) {
     }
     int port = atoi(colon + 1);
     
+    // A daemon waits for SIGINT or SIGTERM; block them before any thread starts so only main takes them
+    sigset_t shutdown_signals;
+    sigemptyset(&shutdown_signals);
+    if (daemon_path) {
+        sigaddset(&shutdown_signals, SIGINT);
+        sigaddset(&shutdown_signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &shutdown_signals, NULL);
+    }
+    
+    // Dump traces on SIGUSR1 (before any thread starts, so all of them leave it to the dumper)
+    if (trace_path) {
+        p2p_trace_dump_on_signal(SIGUSR1, trace_path);
+    }
+    P2P_TRACE_THREAD("main");
+    
+    // Log lines are formatted and written off the message path
+    if (p2p_log_start(log_file) != 0) {
+        return 1;
+    }
+    
     // Create network
     P2PNetwork* network = p2p_network_create(port, node_address, p2p_message_default_handler);
     if (!network) {
@@ -36,20 +155,76 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    p2p_network_register_rpc_handler(network, "ECHO", echo_handler);
+    load_network = network;
+    p2p_network_register_handler(network, "LOAD_PING", load_ping_handler);
+    
+    // Shed floods from any one host before they reach the handlers
+    if (admission) {
+        P2PAdmissionConfig config;
+        p2p_admission_defaults(&config);
+        p2p_network_set_admission(network, &config);
+    }
+    
+    // Probe peers and drop the ones that stop answering
+    if (failure_detection) {
+        P2PSwimConfig config;
+        p2p_swim_defaults(&config);
+        p2p_network_set_failure_detection(network, &config);
+    }
+    
+    // Hold messages for peers that are down instead of dropping them
+    if (spool_dir) {
+        p2p_network_set_store_forward(network, spool_dir, P2P_SPOOL_DEFAULT_MEMORY,
+                                      P2P_SPOOL_DEFAULT_DISK, P2P_SPOOL_DEFAULT_MAX_AGE_MS);
+    }
+    
+    // Serve local applications; their sends queue rather than block the socket they came in on
+    P2PDaemon* daemon = NULL;
+    if (daemon_path) {
+        p2p_network_set_flow_policy(network, P2P_FLOW_QUEUE);
+        daemon = p2p_daemon_serve(network, daemon_path);
+        if (!daemon) {
+            p2p_network_free(network);
+            return 1;
+        }
+    }
+    
     // Start network
     if (p2p_network_start(network) != 0) {
         printf("Failed to start P2P network\n");
+        if (daemon) p2p_daemon_free(daemon);
         p2p_network_free(network);
         return 1;
     }
     
+    // Export metrics for scrapers (a UNIX socket path or a loopback port)
+    if (metrics_endpoint) {
+        p2p_metrics_serve(metrics_endpoint);
+    }
+    
     // Connect if specified
     if (connect_to) {
         p2p_network_connect(network, connect_to);
     }
     
+    // Headless: no command loop, run until told to stop
+    if (daemon) {
+        printf("P2P Node ready (daemon on %s).\n", daemon_path);
+        fflush(stdout);
+        int signo;
+        sigwait(&shutdown_signals, &signo);
+        P2P_INFO("Shutting down on signal %d", signo);
+        // Nothing new arrives for the daemon's subscribers once the network stops
+        p2p_network_stop(network);
+        p2p_daemon_free(daemon);
+        p2p_network_free(network);
+        p2p_log_stop();
+        return 0;
+    }
+    
     printf("P2P Node ready.\n");
-    printf("Commands: 'send <address> <type> <data>', 'broadcast <type> <data>', 'list', 'quit'\n");
+    printf("Commands: 'send <address> <type> <data>', 'sendfile <address> <type> <path>', 'broadcast <type> <data>', 'call <address> <type> <data>', 'list', 'stats', 'log <level>', 'trace <path>', 'quit'\n");
     
     // Command loop
     char command[256];
@@ -65,6 +240,25 @@ int main(int argc, char* argv[]) {
         else if (strcmp(command, "list") == 0) {
             p2p_peer_list_print(network->peer_list);
         }
+        else if (strcmp(command, "stats") == 0) {
+            p2p_metrics_print();
+        }
+        else if (strncmp(command, "log ", 4) == 0) {
+            int level = p2p_log_parse_level(command + 4);
+            if (level >= 0) {
+                p2p_log_set_level(level);
+            } else {
+                printf("Usage: log error|warn|info|debug\n");
+            }
+        }
+        else if (strncmp(command, "trace", 5) == 0 && (command[5] == ' ' || command[5] == '\0')) {
+            char* path = command[5] ? command + 6 : trace_path;
+            if (path && *path) {
+                if (p2p_trace_dump(path) == 0) printf("Trace written to %s\n", path);
+            } else {
+                printf("Usage: trace <path>\n");
+            }
+        }
         else if (strncmp(command, "send ", 5) == 0) {
             char* args = command + 5;
             char* address = strtok(args, " ");
@@ -77,6 +271,25 @@ int main(int argc, char* argv[]) {
                 printf("Usage: send <address> <type> <data>\n");
             }
         }
+        else if (strncmp(command, "sendfile ", 9) == 0) {
+            char* args = command + 9;
+            char* address = strtok(args, " ");
+            char* type = strtok(NULL, " ");
+            char* path = strtok(NULL, "");
+            
+            if (address && type && path) {
+                size_t len = 0;
+                void* data = read_file(path, &len);
+                if (data) {
+                    p2p_network_send_bytes(network, address, type, data, len);
+                    free(data);
+                } else {
+                    printf("Could not read %s\n", path);
+                }
+            } else {
+                printf("Usage: sendfile <address> <type> <path>\n");
+            }
+        }
         else if (strncmp(command, "broadcast ", 10) == 0) {
             char* args = command + 10;
             char* type = strtok(args, " ");
@@ -88,11 +301,24 @@ int main(int argc, char* argv[]) {
                 printf("Usage: broadcast <type> <data>\n");
             }
         }
+        else if (strncmp(command, "call ", 5) == 0) {
+            char* args = command + 5;
+            char* address = strtok(args, " ");
+            char* type = strtok(NULL, " ");
+            char* data = strtok(NULL, "");
+            
+            if (address && type && data) {
+                call_peer(network, address, type, data);
+            } else {
+                printf("Usage: call <address> <type> <data>\n");
+            }
+        }
         else {
-            printf("Unknown command. Try 'send <address> <type> <data>', 'broadcast <type> <data>', 'list', or 'quit'\n");
+            printf("Unknown command. Try 'send <address> <type> <data>', 'sendfile <address> <type> <path>', 'broadcast <type> <data>', 'call <address> <type> <data>', 'list', 'stats', 'log <level>', 'trace <path>', or 'quit'\n");
         }
     }
     
     p2p_network_free(network);
+    p2p_log_stop();
     return 0;
 }
@@ -1,26 +1,118 @@
 #include "p2p_message.h"
+#include "p2p_log.h"
+#include "DataStructures/Common/Pool.h"
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Per-thread message pool. Blocks freed by their owning thread go straight
+// back on the local free list; blocks freed elsewhere are pushed onto the
+// owner's lock-free remote list and reclaimed on its next allocation, so
+// memory always returns to the pool it came from. Pools live for the life
+// of the process because messages may outlive the thread that made them.
+typedef struct P2PMessagePool P2PMessagePool;
+
+typedef struct P2PMessageBlock {
+    P2PMessagePool* owner;
+    struct P2PMessageBlock* next;
+    P2PMessage msg;
+} P2PMessageBlock;
+
+struct P2PMessagePool {
+    struct Pool slabs;
+    P2PMessageBlock* free_list;
+    _Atomic(P2PMessageBlock*) remote_free;
+};
+
+static __thread P2PMessagePool* tls_message_pool = NULL;
+
+#define P2P_MESSAGE_BLOCK(msg) \
+    ((P2PMessageBlock*)((char*)(msg) - offsetof(P2PMessageBlock, msg)))
+
+// Get (or lazily create) the calling thread's pool
+static P2PMessagePool* p2p_message_pool(void) {
+    if (tls_message_pool == NULL) {
+        P2PMessagePool* pool = malloc(sizeof(P2PMessagePool));
+        if (!pool) return NULL;
+
+        pool->slabs = pool_constructor(sizeof(P2PMessageBlock), P2P_MESSAGE_POOL_SLAB);
+        pool->free_list = NULL;
+        atomic_init(&pool->remote_free, NULL);
+        tls_message_pool = pool;
+    }
+    return tls_message_pool;
+}
+
+// Take an uninitialized message from the calling thread's pool
+P2PMessage* p2p_message_alloc(void) {
+    P2PMessagePool* pool = p2p_message_pool();
+    if (!pool) return NULL;
+
+    // Reclaim everything other threads have handed back in one swap
+    if (pool->free_list == NULL) {
+        pool->free_list = atomic_exchange_explicit(&pool->remote_free, NULL, memory_order_acquire);
+    }
+
+    P2PMessageBlock* block = pool->free_list;
+    if (block) {
+        pool->free_list = block->next;
+    } else {
+        block = pool->slabs.allocate(&pool->slabs);
+        if (!block) return NULL;
+        block->owner = pool;
+    }
+    return &block->msg;
+}
 
 // Create a new message
 P2PMessage* p2p_message_create(const char* type, const char* sender, const char* data) {
-    P2PMessage* msg = malloc(sizeof(P2PMessage));
+    P2PMessage* msg = p2p_message_alloc();
     if (!msg) return NULL;
     
     strncpy(msg->type, type, 31);
     msg->type[31] = '\0';
     strncpy(msg->sender, sender, 63);
     msg->sender[63] = '\0';
-    strncpy(msg->data, data, 255);
-    msg->data[255] = '\0';
+    p2p_message_set_data(msg, data, strlen(data));
+    msg->type_id = -1;
     
     return msg;
 }
 
+// Set the payload (binary safe)
+void p2p_message_set_data(P2PMessage* msg, const void* data, size_t len) {
+    size_t inline_len = len < P2P_MESSAGE_DATA_MAX ? len : P2P_MESSAGE_DATA_MAX;
+    memcpy(msg->data, data, inline_len);
+    msg->data[inline_len] = '\0';
+    msg->data_len = len;
+    msg->payload = len <= P2P_MESSAGE_DATA_MAX ? msg->data : data;
+}
+
 // Default message handler
 void p2p_message_default_handler(P2PMessage* msg) {
-    printf("Received %s from %s: %s\n", msg->type, msg->sender, msg->data);
+    if (msg->data_len > P2P_MESSAGE_DATA_MAX) {
+        P2P_INFO("Received %s from %s: %zu bytes", msg->type, msg->sender, msg->data_len);
+        return;
+    }
+    P2P_INFO("Received %s from %s: %s", msg->type, msg->sender, msg->data);
 }
 
-// Free message
+// Free message (returns it to the pool of the thread that allocated it)
 void p2p_message_free(P2PMessage* msg) {
-    free(msg);
+    if (!msg) return;
+
+    P2PMessageBlock* block = P2P_MESSAGE_BLOCK(msg);
+    P2PMessagePool* owner = block->owner;
+
+    if (owner == tls_message_pool) {
+        block->next = owner->free_list;
+        owner->free_list = block;
+        return;
+    }
+
+    // Foreign thread: push onto the owner's remote list
+    P2PMessageBlock* head = atomic_load_explicit(&owner->remote_free, memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote_free, &head, block,
+                                                    memory_order_release, memory_order_relaxed));
 }
@@ -6,11 +6,20 @@
 #include <string.h>
 #include <time.h>
 
+// Number of messages carved from each pool slab
+#define P2P_MESSAGE_POOL_SLAB 64
+
+// Largest payload carried inline in P2PMessage.data
+#define P2P_MESSAGE_DATA_MAX 255
+
 // Basic message structure
 typedef struct {
     char type[32];
     char sender[64];
-    char data[256];
+    char data[256];         // Inline payload, NUL terminated (the first 255 bytes of larger payloads)
+    size_t data_len;        // Full payload length
+    const void* payload;    // Full payload: data itself, or a reassembled buffer valid during the handler call
+    int type_id;            // Interned id of type in the receiving network's registry (-1 if not interned)
 } P2PMessage;
 
 // Discovery message structure
@@ -24,13 +33,40 @@ typedef struct {
 // Message handler function type
 typedef void (*message_handler_t)(P2PMessage* msg);
 
+// RPC statuses produced by the transport (handlers return 0 or positive codes)
+#define P2P_RPC_OK 0
+#define P2P_RPC_TIMEOUT (-1)        // No response within the caller's timeout
+#define P2P_RPC_NO_HANDLER (-2)     // Receiver has no RPC handler for the type
+#define P2P_RPC_CLOSED (-3)         // Connection lost before the response arrived
+#define P2P_RPC_ERROR (-4)          // Request could not be encoded or sent
+#define P2P_RPC_BUSY (-5)           // Receiver shed the request under load
+
+// Response buffer handed to an RPC handler (owned by the server)
+typedef struct {
+    void* data;         // Write the response payload here
+    size_t cap;
+    size_t len;         // Set to the number of bytes written
+} P2PRpcReply;
+
+// RPC handler function type: answers the request in reply and returns a
+// status (0 = OK, positive values are application errors)
+typedef int (*rpc_handler_t)(P2PMessage* request, P2PRpcReply* reply);
+
 // Create a new message
 P2PMessage* p2p_message_create(const char* type, const char* sender, const char* data);
 
+// Set the payload (binary safe). Payloads that fit are copied into data;
+// larger ones are referenced, so they must outlive the message.
+void p2p_message_set_data(P2PMessage* msg, const void* data, size_t len);
+
+// Take an uninitialized message from the calling thread's pool
+P2PMessage* p2p_message_alloc(void);
+
 // Default message handler
 void p2p_message_default_handler(P2PMessage* msg);
 
-// Free message
+// Free message (returns it to the pool of the thread that allocated it;
+// any thread may free)
 void p2p_message_free(P2PMessage* msg);
 
 #endif
@@ -0,0 +1,389 @@
+#include "p2p_metrics.h"
+#include "p2p_log.h"
+#include <stdarg.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+// Histogram layout: values below P2P_METRICS_SUB get a bucket each, every
+// power of two above that is split into P2P_METRICS_SUB buckets
+#define P2P_METRICS_SUB_BITS 4
+#define P2P_METRICS_SUB (1 << P2P_METRICS_SUB_BITS)
+#define P2P_METRICS_MAX_EXPONENT 40
+#define P2P_METRICS_BUCKETS ((P2P_METRICS_MAX_EXPONENT - P2P_METRICS_SUB_BITS + 2) * P2P_METRICS_SUB)
+
+// Room for one export
+#define P2P_METRICS_EXPORT_SIZE 16384
+
+// Pause before accepting again when the process is out of descriptors
+#define P2P_METRICS_ACCEPT_BACKOFF_US 100000
+
+// One thread's metrics. Only the owning thread writes; atomics keep
+// concurrent reads well defined and compile to plain loads and stores.
+typedef struct P2PMetricsShard {
+    atomic_ulong counters[P2P_COUNTER_COUNT];
+    atomic_ulong buckets[P2P_HISTOGRAM_COUNT][P2P_METRICS_BUCKETS];
+    atomic_ulong sums[P2P_HISTOGRAM_COUNT];
+    atomic_ulong maxes[P2P_HISTOGRAM_COUNT];
+    struct P2PMetricsShard* next;
+} P2PMetricsShard;
+
+// Totals for one read of every shard
+typedef struct {
+    uint64_t counters[P2P_COUNTER_COUNT];
+    uint64_t buckets[P2P_HISTOGRAM_COUNT][P2P_METRICS_BUCKETS];
+    uint64_t counts[P2P_HISTOGRAM_COUNT];
+    uint64_t sums[P2P_HISTOGRAM_COUNT];
+    uint64_t maxes[P2P_HISTOGRAM_COUNT];
+} P2PMetricsSnapshot;
+
+static const char* counter_names[P2P_COUNTER_COUNT] = {
+    "messages_sent", "bytes_sent", "send_failures", "messages_spooled",
+    "messages_received", "bytes_received", "frames_rejected",
+    "connects", "connect_failures",
+    "discovery_received", "discovery_forwarded", "rpc_served",
+    "connections_shed", "frames_shed",
+    "probes", "peers_suspected", "peers_failed"
+};
+static const char* gauge_names[P2P_GAUGE_COUNT] = { "peers", "sockets" };
+static const char* histogram_names[P2P_HISTOGRAM_COUNT] = { "send", "connect", "handler", "discovery" };
+
+static pthread_mutex_t shards_lock = PTHREAD_MUTEX_INITIALIZER;
+static P2PMetricsShard* shards;             // Live threads
+static P2PMetricsShard retired;             // Threads that have exited (shards_lock)
+static pthread_key_t shard_key;
+static pthread_once_t shard_key_once = PTHREAD_ONCE_INIT;
+static __thread P2PMetricsShard* local_shard;
+static atomic_long gauges[P2P_GAUGE_COUNT];
+
+// Single-writer increment: no locked instruction needed
+static inline void p2p_metrics_bump(atomic_ulong* slot, uint64_t value) {
+    atomic_store_explicit(slot, atomic_load_explicit(slot, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+// Fold an exiting thread's shard into the retired totals
+static void p2p_metrics_retire(void* arg) {
+    P2PMetricsShard* shard = (P2PMetricsShard*)arg;
+    pthread_mutex_lock(&shards_lock);
+    for (P2PMetricsShard** link = &shards; *link; link = &(*link)->next) {
+        if (*link == shard) {
+            *link = shard->next;
+            break;
+        }
+    }
+    for (int c = 0; c < P2P_COUNTER_COUNT; c++) {
+        p2p_metrics_bump(&retired.counters[c], atomic_load(&shard->counters[c]));
+    }
+    for (int h = 0; h < P2P_HISTOGRAM_COUNT; h++) {
+        for (int b = 0; b < P2P_METRICS_BUCKETS; b++) {
+            p2p_metrics_bump(&retired.buckets[h][b], atomic_load(&shard->buckets[h][b]));
+        }
+        p2p_metrics_bump(&retired.sums[h], atomic_load(&shard->sums[h]));
+        if (atomic_load(&shard->maxes[h]) > atomic_load(&retired.maxes[h])) {
+            atomic_store(&retired.maxes[h], atomic_load(&shard->maxes[h]));
+        }
+    }
+    pthread_mutex_unlock(&shards_lock);
+    local_shard = NULL;
+    free(shard);
+}
+
+static void p2p_metrics_make_key(void) {
+    pthread_key_create(&shard_key, p2p_metrics_retire);
+}
+
+// The calling thread's shard, registered on first use (NULL if out of memory)
+static P2PMetricsShard* p2p_metrics_shard(void) {
+    if (local_shard) return local_shard;
+
+    P2PMetricsShard* shard = calloc(1, sizeof(P2PMetricsShard));
+    if (!shard) return NULL;
+    pthread_once(&shard_key_once, p2p_metrics_make_key);
+    pthread_setspecific(shard_key, shard);
+
+    pthread_mutex_lock(&shards_lock);
+    shard->next = shards;
+    shards = shard;
+    pthread_mutex_unlock(&shards_lock);
+    local_shard = shard;
+    return shard;
+}
+
+// Bucket holding value
+static int p2p_metrics_bucket(uint64_t value) {
+    if (value < P2P_METRICS_SUB) return (int)value;
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent > P2P_METRICS_MAX_EXPONENT) return P2P_METRICS_BUCKETS - 1;
+    return (exponent - P2P_METRICS_SUB_BITS + 1) * P2P_METRICS_SUB +
+           (int)((value >> (exponent - P2P_METRICS_SUB_BITS)) & (P2P_METRICS_SUB - 1));
+}
+
+// Value reported for a bucket (the middle of its range)
+static uint64_t p2p_metrics_bucket_value(int bucket) {
+    if (bucket < P2P_METRICS_SUB) return (uint64_t)bucket;
+    int shift = bucket / P2P_METRICS_SUB - 1;
+    uint64_t low = (uint64_t)(P2P_METRICS_SUB + bucket % P2P_METRICS_SUB) << shift;
+    return low + ((1ull << shift) >> 1);
+}
+
+// Add to a counter
+void p2p_metrics_add(P2PCounter counter, uint64_t value) {
+    P2PMetricsShard* shard = p2p_metrics_shard();
+    if (shard) p2p_metrics_bump(&shard->counters[counter], value);
+}
+
+// Record a latency in nanoseconds
+void p2p_metrics_record(P2PHistogram histogram, uint64_t ns) {
+    P2PMetricsShard* shard = p2p_metrics_shard();
+    if (!shard) return;
+    p2p_metrics_bump(&shard->buckets[histogram][p2p_metrics_bucket(ns)], 1);
+    p2p_metrics_bump(&shard->sums[histogram], ns);
+    if (ns > atomic_load_explicit(&shard->maxes[histogram], memory_order_relaxed)) {
+        atomic_store_explicit(&shard->maxes[histogram], ns, memory_order_relaxed);
+    }
+}
+
+// Move a gauge
+void p2p_metrics_gauge_add(P2PGauge gauge, long delta) {
+    atomic_fetch_add_explicit(&gauges[gauge], delta, memory_order_relaxed);
+}
+
+// Set a gauge
+void p2p_metrics_gauge_set(P2PGauge gauge, long value) {
+    atomic_store_explicit(&gauges[gauge], value, memory_order_relaxed);
+}
+
+// Sum a counter over every shard
+uint64_t p2p_metrics_counter(P2PCounter counter) {
+    pthread_mutex_lock(&shards_lock);
+    uint64_t total = atomic_load_explicit(&retired.counters[counter], memory_order_relaxed);
+    for (P2PMetricsShard* shard = shards; shard; shard = shard->next) {
+        total += atomic_load_explicit(&shard->counters[counter], memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&shards_lock);
+    return total;
+}
+
+// Read a gauge
+long p2p_metrics_gauge(P2PGauge gauge) {
+    return atomic_load_explicit(&gauges[gauge], memory_order_relaxed);
+}
+
+// Add one shard into a snapshot
+static void p2p_metrics_collect(P2PMetricsSnapshot* snap, P2PMetricsShard* shard) {
+    for (int c = 0; c < P2P_COUNTER_COUNT; c++) {
+        snap->counters[c] += atomic_load_explicit(&shard->counters[c], memory_order_relaxed);
+    }
+    for (int h = 0; h < P2P_HISTOGRAM_COUNT; h++) {
+        for (int b = 0; b < P2P_METRICS_BUCKETS; b++) {
+            uint64_t n = atomic_load_explicit(&shard->buckets[h][b], memory_order_relaxed);
+            snap->buckets[h][b] += n;
+            snap->counts[h] += n;
+        }
+        snap->sums[h] += atomic_load_explicit(&shard->sums[h], memory_order_relaxed);
+        uint64_t max = atomic_load_explicit(&shard->maxes[h], memory_order_relaxed);
+        if (max > snap->maxes[h]) snap->maxes[h] = max;
+    }
+}
+
+// Sum every shard: NULL if out of memory
+static P2PMetricsSnapshot* p2p_metrics_snapshot(void) {
+    P2PMetricsSnapshot* snap = calloc(1, sizeof(P2PMetricsSnapshot));
+    if (!snap) return NULL;
+    pthread_mutex_lock(&shards_lock);
+    p2p_metrics_collect(snap, &retired);
+    for (P2PMetricsShard* shard = shards; shard; shard = shard->next) {
+        p2p_metrics_collect(snap, shard);
+    }
+    pthread_mutex_unlock(&shards_lock);
+    return snap;
+}
+
+// Value at quantile q (0..1) of a histogram, in nanoseconds
+static uint64_t p2p_metrics_quantile(P2PMetricsSnapshot* snap, int histogram, double q) {
+    uint64_t count = snap->counts[histogram];
+    if (count == 0) return 0;
+    uint64_t rank = (uint64_t)(q * count);
+    if (rank >= count) rank = count - 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < P2P_METRICS_BUCKETS; b++) {
+        seen += snap->buckets[histogram][b];
+        if (seen > rank) {
+            uint64_t value = p2p_metrics_bucket_value(b);
+            return value < snap->maxes[histogram] ? value : snap->maxes[histogram];
+        }
+    }
+    return snap->maxes[histogram];
+}
+
+// Append to an export buffer, keeping track of the length
+static void p2p_metrics_append(char* buf, size_t cap, size_t* len, const char* fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static void p2p_metrics_append(char* buf, size_t cap, size_t* len, const char* fmt, ...) {
+    if (*len >= cap) return;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + *len, cap - *len, fmt, args);
+    va_end(args);
+    if (n > 0) *len = *len + (size_t)n < cap ? *len + (size_t)n : cap - 1;
+}
+
+// Write every metric in the Prometheus text format
+size_t p2p_metrics_export(char* buf, size_t cap) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    size_t len = 0;
+    if (cap == 0) return 0;
+    buf[0] = '\0';
+
+    P2PMetricsSnapshot* snap = p2p_metrics_snapshot();
+    if (!snap) return 0;
+
+    for (int c = 0; c < P2P_COUNTER_COUNT; c++) {
+        p2p_metrics_append(buf, cap, &len, "# TYPE p2p_%s_total counter\np2p_%s_total %llu\n",
+                           counter_names[c], counter_names[c], (unsigned long long)snap->counters[c]);
+    }
+    for (int g = 0; g < P2P_GAUGE_COUNT; g++) {
+        p2p_metrics_append(buf, cap, &len, "# TYPE p2p_%s gauge\np2p_%s %ld\n",
+                           gauge_names[g], gauge_names[g], atomic_load(&gauges[g]));
+    }
+    for (int h = 0; h < P2P_HISTOGRAM_COUNT; h++) {
+        const char* name = histogram_names[h];
+        p2p_metrics_append(buf, cap, &len, "# TYPE p2p_%s_seconds summary\n", name);
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+            p2p_metrics_append(buf, cap, &len, "p2p_%s_seconds{quantile=\"%g\"} %.9f\n", name, quantiles[q],
+                               p2p_metrics_quantile(snap, h, quantiles[q]) / 1e9);
+        }
+        p2p_metrics_append(buf, cap, &len, "p2p_%s_seconds_sum %.9f\np2p_%s_seconds_count %llu\n",
+                           name, snap->sums[h] / 1e9, name, (unsigned long long)snap->counts[h]);
+    }
+    free(snap);
+    return len;
+}
+
+// Print a human-readable summary to stdout
+void p2p_metrics_print(void) {
+    P2PMetricsSnapshot* snap = p2p_metrics_snapshot();
+    if (!snap) return;
+
+    printf("Counters:\n");
+    for (int c = 0; c < P2P_COUNTER_COUNT; c++) {
+        printf("  %-22s %llu\n", counter_names[c], (unsigned long long)snap->counters[c]);
+    }
+    printf("Gauges:\n");
+    for (int g = 0; g < P2P_GAUGE_COUNT; g++) {
+        printf("  %-22s %ld\n", gauge_names[g], atomic_load(&gauges[g]));
+    }
+    printf("Latency (us)   %10s %10s %10s %10s %10s %10s\n", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (int h = 0; h < P2P_HISTOGRAM_COUNT; h++) {
+        printf("  %-12s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", histogram_names[h],
+               (unsigned long long)snap->counts[h],
+               p2p_metrics_quantile(snap, h, 0.5) / 1e3, p2p_metrics_quantile(snap, h, 0.9) / 1e3,
+               p2p_metrics_quantile(snap, h, 0.99) / 1e3, p2p_metrics_quantile(snap, h, 0.999) / 1e3,
+               snap->maxes[h] / 1e3);
+    }
+    free(snap);
+}
+
+// Answer one scrape: the export, wrapped in HTTP if the client asked over HTTP
+static void p2p_metrics_answer(int client, char* text) {
+    // Give the client a moment to send a request line; plain readers send nothing
+    char request[512];
+    ssize_t n = 0;
+    struct pollfd pfd = { client, POLLIN, 0 };
+    if (poll(&pfd, 1, 100) > 0) {
+        n = recv(client, request, sizeof(request), 0);
+    }
+
+    size_t len = p2p_metrics_export(text, P2P_METRICS_EXPORT_SIZE);
+    if (n >= 4 && memcmp(request, "GET ", 4) == 0) {
+        char header[128];
+        int header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: %zu\r\n\r\n", len);
+        send(client, header, header_len, MSG_NOSIGNAL);
+    }
+    send(client, text, len, MSG_NOSIGNAL);
+}
+
+// Accept loop for p2p_metrics_serve
+static void* p2p_metrics_server_thread(void* arg) {
+    int listener = (int)(intptr_t)arg;
+    char* text = malloc(P2P_METRICS_EXPORT_SIZE);
+    if (!text) return NULL;
+
+    while (1) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            // The pending connection stays queued: give the process time
+            // to free descriptors rather than spin on it
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                usleep(P2P_METRICS_ACCEPT_BACKOFF_US);
+                continue;
+            }
+            P2P_ERROR("Metrics server stopped: %s", strerror(errno));
+            break;
+        }
+        p2p_metrics_answer(client, text);
+        close(client);
+    }
+    close(listener);
+    free(text);
+    return NULL;
+}
+
+// Serve the export on a UNIX socket path or a loopback port
+int p2p_metrics_serve(const char* endpoint) {
+    int listener;
+    if (endpoint[0] == '/' || endpoint[0] == '.') {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(endpoint) >= sizeof(addr.sun_path)) {
+            P2P_ERROR("Metrics socket path too long: %s", endpoint);
+            return -1;
+        }
+        strcpy(addr.sun_path, endpoint);
+        unlink(endpoint);
+
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0 || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            P2P_ERROR("Failed to bind metrics socket %s", endpoint);
+            if (listener >= 0) close(listener);
+            return -1;
+        }
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(atoi(endpoint));
+
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        int opt = 1;
+        if (listener >= 0) setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        if (listener < 0 || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            P2P_ERROR("Failed to bind metrics port %s", endpoint);
+            if (listener >= 0) close(listener);
+            return -1;
+        }
+    }
+
+    pthread_t thread;
+    if (listen(listener, 16) < 0 ||
+        pthread_create(&thread, NULL, p2p_metrics_server_thread, (void*)(intptr_t)listener) != 0) {
+        close(listener);
+        return -1;
+    }
+    pthread_detach(thread);
+    P2P_INFO("Serving metrics on %s", endpoint);
+    return 0;
+}
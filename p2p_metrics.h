@@ -0,0 +1,92 @@
+#ifndef P2P_METRICS_H
+#define P2P_METRICS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+// Process-wide counters, gauges and latency histograms.
+//
+// Counters and histograms are kept per thread: each thread writes only its
+// own shard with plain relaxed stores (no locked instructions, no shared
+// cache lines), and readers sum the shards. A thread's shard is folded into
+// a shared total when it exits. Histograms are log-linear (HDR style): 16
+// buckets per power of two, so a recorded value is within 6.25% of the
+// value reported for its bucket, from 1 ns to about 35 minutes.
+
+typedef enum {
+    P2P_COUNTER_MESSAGES_SENT = 0,      // Send operations fully written
+    P2P_COUNTER_BYTES_SENT,             // Frame bytes written by links
+    P2P_COUNTER_SEND_FAILURES,
+    P2P_COUNTER_MESSAGES_SPOOLED,
+    P2P_COUNTER_MESSAGES_RECEIVED,      // Messages handed to handlers
+    P2P_COUNTER_BYTES_RECEIVED,         // Frame bytes read by the server
+    P2P_COUNTER_FRAMES_REJECTED,        // Malformed frames, including checksum failures
+    P2P_COUNTER_CONNECTS,
+    P2P_COUNTER_CONNECT_FAILURES,
+    P2P_COUNTER_DISCOVERY_RECEIVED,
+    P2P_COUNTER_DISCOVERY_FORWARDED,    // Discovery fan-out
+    P2P_COUNTER_RPC_SERVED,
+    P2P_COUNTER_CONNECTIONS_SHED,       // Inbound connections closed by admission control
+    P2P_COUNTER_FRAMES_SHED,            // Inbound frames dropped by admission control
+    P2P_COUNTER_PROBES,                 // Failure detector probes started
+    P2P_COUNTER_PEERS_SUSPECTED,
+    P2P_COUNTER_PEERS_FAILED,           // Suspects confirmed dead and removed
+    P2P_COUNTER_COUNT
+} P2PCounter;
+
+typedef enum {
+    P2P_GAUGE_PEERS = 0,                // Known peers
+    P2P_GAUGE_SOCKETS,                  // Open connections, inbound and outbound
+    P2P_GAUGE_COUNT
+} P2PGauge;
+
+typedef enum {
+    P2P_HISTOGRAM_SEND = 0,             // Submit to fully written (includes queueing)
+    P2P_HISTOGRAM_CONNECT,              // TCP connect
+    P2P_HISTOGRAM_HANDLER,              // Message and RPC handlers
+    P2P_HISTOGRAM_DISCOVERY,            // Handling one discovery message
+    P2P_HISTOGRAM_COUNT
+} P2PHistogram;
+
+// Monotonic clock for latency measurements
+static inline uint64_t p2p_metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Add to a counter
+void p2p_metrics_add(P2PCounter counter, uint64_t value);
+
+// Record a latency in nanoseconds
+void p2p_metrics_record(P2PHistogram histogram, uint64_t ns);
+
+// Record the time elapsed since start_ns (from p2p_metrics_now_ns)
+static inline void p2p_metrics_record_since(P2PHistogram histogram, uint64_t start_ns) {
+    p2p_metrics_record(histogram, p2p_metrics_now_ns() - start_ns);
+}
+
+// Move or set a gauge
+void p2p_metrics_gauge_add(P2PGauge gauge, long delta);
+void p2p_metrics_gauge_set(P2PGauge gauge, long value);
+
+// Current value of a counter (summed over every thread) or a gauge
+uint64_t p2p_metrics_counter(P2PCounter counter);
+long p2p_metrics_gauge(P2PGauge gauge);
+
+// Write every metric in the Prometheus text format: bytes written (the
+// text is cut short if it does not fit)
+size_t p2p_metrics_export(char* buf, size_t cap);
+
+// Print a human-readable summary to stdout
+void p2p_metrics_print(void);
+
+// Serve p2p_metrics_export to anyone who connects to endpoint: a UNIX
+// socket path (starting with '/' or '.') or a port on 127.0.0.1. Clients
+// that send an HTTP GET get an HTTP response. Returns 0 once listening.
+int p2p_metrics_serve(const char* endpoint);
+
+#endif
@@ -1,18 +1,685 @@
 #include "p2p_network.h"
 #include "p2p_utils.h"
+#include "p2p_arena.h"
+#include "p2p_wire.h"
+#include "p2p_metrics.h"
+#include "p2p_trace.h"
+#include "p2p_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/timerfd.h>
 
-// Global network reference for callbacks
-static P2PNetwork* g_network = NULL;
+// Server-side state for one open connection. The reactor holds a reference
+// while the socket is open and every queued bulk frame holds another, so the
+// socket is closed only once the bulk worker is done answering on it.
+// Connections opened for a transport have no socket or read buffer.
+struct P2PConnection {
+    P2PWatch watch;                     // On the runtime's reactor (socket connections only)
+    P2PNetwork* network;
+    P2PWireStream stream;               // Buffered frames from the peer
+    atomic_int refs;
+    pthread_mutex_t write_lock;         // Guards out: replies come from the reactor and the bulk worker
+    uint8_t* out;                       // Replies the socket had no room for, written on POLLOUT
+    size_t out_len;
+    size_t out_cap;
+    int16_t type_map[P2P_MAX_TYPES];    // Sender type id -> our type id (bulk worker only)
+    size_t consumed;                    // Bulk bytes handled but not yet granted back (bulk worker only)
+    struct P2PInboundFrame* parked;     // Bulk frame waiting for room in the inbound queue
+    P2PTransport* transport;            // Carries replies when there is no socket
+    void* transport_context;
+    char source[INET_ADDRSTRLEN];       // Peer IP for admission control ("" on transports)
+    size_t shed;                        // Shed bulk bytes not yet granted back (reactor only)
+    uint8_t buf[];                      // P2P_WIRE_MAX_FRAME bytes for socket connections
+};
 
-// Server thread function
-void* p2p_server_thread(void* arg) {
-    P2PNetwork* network = (P2PNetwork*)arg;
+// Bulk frame copied out of a connection for the bulk worker
+typedef struct P2PInboundFrame {
+    P2PTask task;                       // Queued on the network's runtime worker
+    P2PConnection* conn;                // Holds a reference
+    uint64_t trace_id;                  // Message id in traces
+    P2PFrame frame;                     // body points at data
+    uint8_t data[];
+} P2PInboundFrame;
+
+static P2PBuffer* p2p_network_encode_discovery(P2PNetwork* network, int ttl, const char* peer_list);
+static int p2p_network_queue_discovery(P2PNetwork* network, const char* address, P2PBuffer* frame, int ttl);
+static void p2p_network_swim_send(void* context, const char* address, P2PBuffer* frame);
+static void p2p_network_swim_forget(void* context, const char* address);
+
+// Reply bytes a connection may hold for a peer that is not reading them
+// before it is dropped
+#define P2P_CONNECTION_OUT_LIMIT (1024 * 1024)
+
+// Write what the socket takes without blocking: bytes written, -1 if the
+// connection is broken
+static ssize_t p2p_connection_send(P2PConnection* conn, const void* buf, size_t len) {
+    while (1) {
+        ssize_t n = send(conn->stream.sock, buf, len, MSG_NOSIGNAL);
+        if (n >= 0) return n;
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+}
+
+// Write a reply on a connection without ever blocking: what the socket
+// has no room for waits in the connection until the reactor can write it.
+// Returns -1 if the connection is broken or its peer has stopped reading.
+static int p2p_connection_write(P2PConnection* conn, const void* buf, size_t len) {
+    if (conn->transport) {
+        return conn->transport->reply(conn->transport, conn->transport_context, buf, len);
+    }
+    pthread_mutex_lock(&conn->write_lock);
+    ssize_t written = 0;
+    if (conn->out_len == 0) {
+        // Nothing is waiting, so this can go out ahead of the reactor
+        written = p2p_connection_send(conn, buf, len);
+    }
+    int result = written < 0 ? -1 : 0;
+    int waiting = 0;
+    if (result == 0 && (size_t)written < len) {
+        size_t rest = len - written;
+        size_t needed = conn->out_len + rest;
+        if (needed > P2P_CONNECTION_OUT_LIMIT) {
+            result = -1;
+        } else if (needed > conn->out_cap) {
+            size_t cap = conn->out_cap ? conn->out_cap : P2P_WIRE_MAX_FRAME;
+            while (cap < needed) cap *= 2;
+            uint8_t* grown = realloc(conn->out, cap);
+            if (grown) {
+                conn->out = grown;
+                conn->out_cap = cap;
+            } else {
+                result = -1;
+            }
+        }
+        if (result == 0) {
+            memcpy(conn->out + conn->out_len, (const uint8_t*)buf + written, rest);
+            conn->out_len = needed;
+            waiting = 1;
+        }
+    }
+    pthread_mutex_unlock(&conn->write_lock);
     
+    // The reactor polls for room once it sees replies waiting
+    if (waiting) p2p_runtime_kick(conn->network->runtime, &conn->watch);
+    return result;
+}
+
+// Write what the socket takes of a connection's waiting replies: 1 if
+// some are still waiting, 0 if none are, -1 if the connection is broken
+static int p2p_connection_flush(P2PConnection* conn) {
+    pthread_mutex_lock(&conn->write_lock);
+    int result = 0;
+    if (conn->out_len > 0) {
+        ssize_t n = p2p_connection_send(conn, conn->out, conn->out_len);
+        if (n < 0) {
+            result = -1;
+        } else {
+            conn->out_len -= n;
+            memmove(conn->out, conn->out + n, conn->out_len);
+            result = conn->out_len > 0;
+        }
+    }
+    pthread_mutex_unlock(&conn->write_lock);
+    return result;
+}
+
+// Returned by p2p_handle_frame when the connection must wait for the bulk worker
+#define P2P_CONNECTION_PARKED 1
+
+// Consumed bulk bytes returned to the sender in one CREDIT frame
+#define P2P_CREDIT_GRANT (P2P_WIRE_CREDIT_WINDOW / 4)
+
+// Drop a reference; the last one closes the socket
+static void p2p_connection_release(P2PConnection* conn) {
+    if (atomic_fetch_sub(&conn->refs, 1) == 1) {
+        if (conn->stream.sock >= 0) {
+            close(conn->stream.sock);
+            p2p_metrics_gauge_add(P2P_GAUGE_SOCKETS, -1);
+        }
+        pthread_mutex_destroy(&conn->write_lock);
+        free(conn->out);
+        free(conn);
+    }
+}
+
+// Split a comma-separated peer list into arena-allocated tokens
+static char** p2p_split_peer_list(P2PArena* arena, const char* peer_list, int* count) {
+    char* copy = p2p_arena_strdup(arena, peer_list);
+    if (!copy) return NULL;
+    
+    int max_tokens = 1;
+    for (const char* c = copy; *c; c++) {
+        if (*c == ',') max_tokens++;
+    }
+    
+    char** tokens = p2p_arena_alloc(arena, max_tokens * sizeof(char*));
+    if (!tokens) return NULL;
+    
+    *count = 0;
+    char* start = copy;
+    while (1) {
+        char* comma = strchr(start, ',');
+        if (comma) *comma = '\0';
+        // Skip empty tokens
+        if (*start) tokens[(*count)++] = start;
+        if (!comma) break;
+        start = comma + 1;
+    }
+    return tokens;
+}
+
+// Reactor side of closing a connection: drop its parked frame and its reference
+static void p2p_connection_close(P2PConnection* conn) {
+    if (conn->parked) {
+        if (conn->network->admission) {
+            p2p_admission_release(conn->network->admission, conn->parked->frame.size);
+        }
+        free(conn->parked);
+        conn->parked = NULL;
+        p2p_connection_release(conn);
+    }
+    p2p_connection_release(conn);
+}
+
+// Clock the failure detector runs on: the transport's, if it has one
+static long long p2p_network_swim_now(P2PNetwork* network) {
+    P2PTransport* transport = network->transport;
+    return transport && transport->now_ms ? transport->now_ms(transport) : p2p_swim_now_ms();
+}
+
+// Handle a discovery message (everything it needs lives in the connection arena)
+static void p2p_handle_discovery(P2PNetwork* network, P2PConnection* conn, DiscoveryMessage* disc_msg, P2PArena* arena) {
+    P2P_DEBUG("Received DISCOVERY message from %s", disc_msg->sender);
+    // Add sender to peer list using the sender's address from the message
+    // (it just spoke to us, so it is no longer dead if it was)
+    p2p_peer_list_add(network->peer_list, disc_msg->sender, network->node_id);
+    p2p_swim_heard(&network->swim, disc_msg->sender);
+    
+    if (disc_msg->ttl <= 0) return;
+    
+    // Parse the received peer list once for both passes below
+    int token_count = 0;
+    char** tokens = p2p_split_peer_list(arena, disc_msg->peer_list, &token_count);
+    if (!tokens) return;
+    
+    // Add peers from the received peer list
+    for (int i = 0; i < token_count; i++) {
+        // Skip self, and peers found dead that others have not dropped yet
+        if (strcmp(tokens[i], network->node_id) != 0 && !p2p_swim_is_dead(&network->swim, tokens[i])) {
+            int added = p2p_peer_list_add(network->peer_list, tokens[i], network->node_id);
+            // If peer was newly added, automatically connect to it
+            if (added > 0) {
+                P2P_INFO("Auto-connecting to newly discovered peer: %s", tokens[i]);
+                p2p_network_connect(network, tokens[i]);
+            }
+        }
+    }
+    
+    // Send back our peer list with decremented TTL. The reply and every
+    // forward are the same frame, so it is encoded once and shared.
+    char* our_peer_list = p2p_arena_alloc(arena, P2P_PEER_LIST_STR_SIZE);
+    if (!our_peer_list) return;
+    p2p_build_peer_list_string(network->peer_list, our_peer_list, P2P_PEER_LIST_STR_SIZE);
+    
+    P2PBuffer* frame = p2p_network_encode_discovery(network, disc_msg->ttl - 1, our_peer_list);
+    if (!frame) return;
+    p2p_connection_write(conn, frame->data, frame->len);
+    
+    // Forward discovery to all other peers (propagation)
+    if (disc_msg->ttl > 1) {
+        P2P_DEBUG("Forwarding discovery with TTL=%d to other peers", disc_msg->ttl - 1);
+        struct Node* current = network->peer_list->peer_list.head;
+        while (current != NULL) {
+            P2PPeer* peer = (P2PPeer*)current->data;
+            // Don't send back to the original sender
+            if (strcmp(peer->address, disc_msg->sender) != 0) {
+                P2P_DEBUG("Forwarding to peer: %s", peer->address);
+                if (p2p_network_queue_discovery(network, peer->address, p2p_buffer_retain(frame), disc_msg->ttl - 1) == 0) {
+                    p2p_metrics_add(P2P_COUNTER_DISCOVERY_FORWARDED, 1);
+                }
+            }
+            current = current->next;
+        }
+    }
+    p2p_buffer_release(frame);
+    
+    // Also try to connect to peers from the original discovery
+    for (int i = 0; i < token_count; i++) {
+        if (strcmp(tokens[i], network->node_id) != 0 && !p2p_swim_is_dead(&network->swim, tokens[i])) {
+            // Check if we already know this peer
+            if (p2p_peer_list_find(network->peer_list, tokens[i]) == NULL) {
+                P2P_INFO("Auto-connecting to peer from discovery: %s", tokens[i]);
+                p2p_network_connect(network, tokens[i]);
+            }
+        }
+    }
+}
+
+// Deliver a message to the handler registered for its type (array index),
+// falling back to the network's default handler
+static void p2p_network_dispatch(P2PNetwork* network, P2PMessage* msg) {
+    if (msg->type_id < 0) {
+        msg->type_id = p2p_registry_intern(&network->types, msg->type);
+    }
+    
+    message_handler_t handler = p2p_registry_handler(&network->types, msg->type_id);
+    if (handler == NULL) {
+        handler = network->message_handler;
+    }
+    p2p_metrics_add(P2P_COUNTER_MESSAGES_RECEIVED, 1);
+    if (handler) {
+        uint64_t start = p2p_metrics_now_ns();
+        handler(msg);
+        p2p_metrics_record_since(P2P_HISTOGRAM_HANDLER, start);
+    }
+    // Counted before the tap is loaded, so p2p_network_set_tap can wait
+    // for this call to finish (both sides sequentially consistent)
+    atomic_fetch_add(&network->tap_calls, 1);
+    message_tap_t tap = atomic_load(&network->tap);
+    if (tap) {
+        tap(network->tap_context, msg);
+    }
+    atomic_fetch_sub(&network->tap_calls, 1);
+}
+
+// Reassembler callback for complete fragmented messages
+static void p2p_network_deliver(void* context, P2PMessage* msg) {
+    p2p_network_dispatch((P2PNetwork*)context, msg);
+}
+
+// Answer an RPC request on the connection it arrived on. The handler writes
+// its response straight into arena memory, which is reclaimed after the frame.
+static int p2p_handle_request(P2PNetwork* network, P2PConnection* conn, P2PRpcRequest* request, P2PArena* arena) {
+    P2PRpcResponse response;
+    response.call_id = request->call_id;
+    response.status = P2P_RPC_NO_HANDLER;
+    response.payload = NULL;
+    response.len = 0;
+    
+    int type_id = request->type_id < P2P_MAX_TYPES ? conn->type_map[request->type_id] : -1;
+    rpc_handler_t handler = p2p_registry_rpc_handler(&network->types, type_id);
+    if (handler) {
+        P2PMessage* msg = p2p_message_alloc();
+        P2PRpcReply reply;
+        reply.data = p2p_arena_alloc(arena, P2P_WIRE_MAX_RPC_PAYLOAD);
+        reply.cap = P2P_WIRE_MAX_RPC_PAYLOAD;
+        reply.len = 0;
+        if (!msg || !reply.data) {
+            if (msg) p2p_message_free(msg);
+            return -1;
+        }
+        
+        strcpy(msg->type, network->types.names[type_id]);
+        strcpy(msg->sender, request->sender);
+        p2p_message_set_data(msg, request->payload, request->len);
+        msg->type_id = type_id;
+        
+        uint64_t start = p2p_metrics_now_ns();
+        response.status = handler(msg, &reply);
+        p2p_metrics_record_since(P2P_HISTOGRAM_HANDLER, start);
+        p2p_metrics_add(P2P_COUNTER_RPC_SERVED, 1);
+        response.payload = reply.data;
+        response.len = reply.len < reply.cap ? reply.len : reply.cap;
+        p2p_message_free(msg);
+    }
+    
+    uint8_t* frame = p2p_arena_alloc(arena, P2P_WIRE_MAX_FRAME);
+    if (!frame) return -1;
+    size_t frame_len = p2p_wire_encode_response(&response, frame, P2P_WIRE_MAX_FRAME);
+    if (frame_len == 0) return -1;
+    return p2p_connection_write(conn, frame, frame_len);
+}
+
+// Handle one bulk frame on the bulk worker: -1 if the connection should be
+// dropped. Frames are decoded straight into their final home - regular
+// messages into a pooled P2PMessage, scratch into the worker's arena.
+static int p2p_handle_bulk_frame(P2PNetwork* network, P2PConnection* conn, P2PFrame* frame, P2PArena* arena) {
+    if (frame->kind == P2P_FRAME_TYPE_DEF) {
+        // Bind the sender's id for this type to ours for the rest of the connection
+        int remote_id;
+        char name[32];
+        int local_id = -1;
+        if (p2p_wire_decode_type_def(frame, &remote_id, name, sizeof(name)) == 0 && remote_id < P2P_MAX_TYPES) {
+            local_id = p2p_registry_intern(&network->types, name);
+        }
+        // The sender now counts the type as defined, so a definition we
+        // cannot bind would silently lose everything of that type: hang up
+        if (local_id < 0) {
+            P2P_WARN("Closing connection: malformed or unbindable type definition");
+            return -1;
+        }
+        conn->type_map[remote_id] = (int16_t)local_id;
+    } else if (frame->kind == P2P_FRAME_TYPED_MESSAGE) {
+        P2PMessage* msg = p2p_message_alloc();
+        if (!msg) return -1;
+        
+        if (p2p_wire_decode_typed_message(frame, msg) == 0 && msg->type_id < P2P_MAX_TYPES &&
+            conn->type_map[msg->type_id] >= 0) {
+            msg->type_id = conn->type_map[msg->type_id];
+            strcpy(msg->type, network->types.names[msg->type_id]);
+            p2p_network_dispatch(network, msg);
+        } else {
+            P2P_DEBUG("Dropping message with undefined or malformed type");
+        }
+        p2p_message_free(msg);
+    } else if (frame->kind == P2P_FRAME_MESSAGE) {
+        P2P_DEBUG("Handling as regular message");
+        P2PMessage* msg = p2p_message_alloc();
+        if (!msg) return -1;
+        
+        if (p2p_wire_decode_message(frame, msg) == 0) {
+            p2p_network_dispatch(network, msg);
+        } else {
+            P2P_DEBUG("Malformed regular message");
+        }
+        p2p_message_free(msg);
+    } else if (frame->kind == P2P_FRAME_FRAGMENT) {
+        P2PFragment fragment;
+        if (p2p_wire_decode_fragment(frame, &fragment) == 0) {
+            p2p_reassembler_feed(&network->reassembler, &fragment);
+        } else {
+            P2P_DEBUG("Malformed fragment");
+        }
+    } else if (frame->kind == P2P_FRAME_REQUEST) {
+        P2PRpcRequest request;
+        if (p2p_wire_decode_request(frame, &request) < 0) {
+            P2P_DEBUG("Malformed request");
+            return -1;
+        }
+        return p2p_handle_request(network, conn, &request, arena);
+    } else {
+        P2P_DEBUG("Skipping frame of unknown kind %d", frame->kind);
+    }
+    return 0;
+}
+
+// Handle a queued bulk frame on the network's runtime worker, so a slow
+// handler or a burst of data never delays the control frames the reactor
+// handles
+static void p2p_bulk_run(P2PTask* task, P2PArena* arena) {
+    P2PInboundFrame* item = (P2PInboundFrame*)task;
+    P2PConnection* conn = item->conn;
+    P2PNetwork* network = conn->network;
+    
+    P2P_TRACE_EVENT(P2P_TRACE_HANDLE_BEGIN, item->trace_id, item->frame.kind);
+    int status = p2p_handle_bulk_frame(network, conn, &item->frame, arena);
+    P2P_TRACE_EVENT(P2P_TRACE_HANDLE_END, item->trace_id, status);
+    if (network->admission) {
+        p2p_admission_release(network->admission, item->frame.size);
+    }
+    if (status < 0) {
+        // Stop reading from a peer that sent garbage
+        shutdown(conn->stream.sock, SHUT_RDWR);
+    }
+    
+    // Hand consumed bytes back in batches. Holding back less than a
+    // grant never stalls a sender, whose window is several grants.
+    conn->consumed += item->frame.size;
+    if (conn->consumed >= P2P_CREDIT_GRANT) {
+        uint8_t frame[16];
+        size_t frame_len = p2p_wire_encode_credit(conn->consumed, frame, sizeof(frame));
+        if (frame_len > 0 && p2p_connection_write(conn, frame, frame_len) == 0) {
+            conn->consumed = 0;
+        }
+    }
+    p2p_connection_release(conn);
+    free(item);
+}
+
+// Periodic work on the network's runtime worker
+static void p2p_bulk_tick(void* context) {
+    P2PNetwork* network = (P2PNetwork*)context;
+    p2p_reassembler_expire(&network->reassembler, time(NULL));
+}
+
+// Drop a frame admission control refused, as cheaply as the sender allows:
+// bulk bytes are still credited back so its window does not shrink, and a
+// request is answered P2P_RPC_BUSY rather than left to time out
+static int p2p_shed_frame(P2PConnection* conn, P2PFrame* frame) {
+    // Later frames depend on a type definition: without it the connection is useless
+    if (frame->kind == P2P_FRAME_TYPE_DEF) return -1;
+    p2p_metrics_add(P2P_COUNTER_FRAMES_SHED, 1);
+    if (frame->kind == P2P_FRAME_DISCOVERY) return 0;
+    
+    if (frame->kind == P2P_FRAME_REQUEST) {
+        P2PRpcRequest request;
+        if (p2p_wire_decode_request(frame, &request) < 0) return -1;
+        P2PRpcResponse response = { request.call_id, P2P_RPC_BUSY, NULL, 0 };
+        uint8_t reply[64];
+        size_t reply_len = p2p_wire_encode_response(&response, reply, sizeof(reply));
+        if (reply_len == 0 || p2p_connection_write(conn, reply, reply_len) < 0) return -1;
+    }
+    conn->shed += frame->size;
+    if (conn->shed >= P2P_CREDIT_GRANT) {
+        uint8_t credit[16];
+        size_t credit_len = p2p_wire_encode_credit(conn->shed, credit, sizeof(credit));
+        if (credit_len > 0 && p2p_connection_write(conn, credit, credit_len) == 0) {
+            conn->shed = 0;
+        }
+    }
+    return 0;
+}
+
+// Handle one frame on the reactor: control frames are handled inline,
+// everything else is copied to the bulk worker. Returns 0 when done,
+// P2P_CONNECTION_PARKED if the bulk worker is full, -1 to drop the connection.
+static int p2p_handle_frame(P2PNetwork* network, P2PConnection* conn, P2PFrame* frame, P2PArena* arena) {
+    P2P_DEBUG("Received frame kind %d (version %d)", frame->kind, frame->version);
+    
+    if (frame->kind == P2P_FRAME_CREDIT) {
+        // Credit flows back to links; the server side never sends bulk data
+        return 0;
+    }
+    uint64_t trace_id = P2P_TRACE_ID();
+    P2P_TRACE_EVENT(P2P_TRACE_READ, trace_id, frame->kind);
+    
+    P2PAdmission* admission = network->admission;
+    uint64_t now = admission ? p2p_metrics_now_ns() : 0;
+    // Failure detection must see probes from a busy source, or it would
+    // bury a peer for sending too much
+    int sheddable = frame->kind != P2P_FRAME_TYPE_DEF && frame->kind != P2P_FRAME_SWIM;
+    if (admission && sheddable && conn->source[0] &&
+        !p2p_rate_table_admit(&admission->frames, conn->source, now)) {
+        return p2p_shed_frame(conn, frame);
+    }
+    
+    if (frame->kind == P2P_FRAME_DISCOVERY) {
+        P2P_DEBUG("Handling as discovery message");
+        DiscoveryMessage* disc_msg = p2p_arena_alloc(arena, sizeof(DiscoveryMessage));
+        if (!disc_msg) return -1;
+        
+        if (p2p_wire_decode_discovery(frame, disc_msg) == 0) {
+            // Discovery makes this node connect and forward: limit it per sender
+            if (admission && !p2p_rate_table_admit(&admission->discovery, disc_msg->sender, now)) {
+                return p2p_shed_frame(conn, frame);
+            }
+            uint64_t start = p2p_metrics_now_ns();
+            p2p_metrics_add(P2P_COUNTER_DISCOVERY_RECEIVED, 1);
+            P2P_TRACE_EVENT(P2P_TRACE_HANDLE_BEGIN, trace_id, frame->kind);
+            p2p_peer_list_lock(network->peer_list);
+            p2p_handle_discovery(network, conn, disc_msg, arena);
+            p2p_peer_list_unlock(network->peer_list);
+            P2P_TRACE_EVENT(P2P_TRACE_HANDLE_END, trace_id, 0);
+            p2p_metrics_record_since(P2P_HISTOGRAM_DISCOVERY, start);
+        } else {
+            P2P_DEBUG("Malformed discovery message");
+        }
+        return 0;
+    }
+    
+    if (frame->kind == P2P_FRAME_SWIM) {
+        // Probes are answered here, so a busy worker never makes a peer look dead
+        P2PSwimFrame* swim_frame = p2p_arena_alloc(arena, sizeof(P2PSwimFrame));
+        if (!swim_frame) return -1;
+        if (p2p_wire_decode_swim(frame, swim_frame) == 0) {
+            p2p_swim_handle(&network->swim, swim_frame, p2p_network_swim_now(network));
+        } else {
+            P2P_DEBUG("Malformed SWIM frame");
+        }
+        return 0;
+    }
+    
+    if (admission && !sheddable) {
+        p2p_admission_charge(admission, frame->size);
+    } else if (admission && !p2p_admission_reserve(admission, frame->size)) {
+        return p2p_shed_frame(conn, frame);
+    }
+    P2PInboundFrame* item = malloc(sizeof(P2PInboundFrame) + frame->body_len);
+    if (!item) {
+        if (admission) p2p_admission_release(admission, frame->size);
+        return -1;
+    }
+    memcpy(item->data, frame->body, frame->body_len);
+    item->frame = *frame;
+    item->frame.body = item->data;
+    item->task.run = p2p_bulk_run;
+    item->conn = conn;
+    item->trace_id = trace_id;
+    atomic_fetch_add(&conn->refs, 1);
+    
+    // A full queue parks only this connection; the others keep being read
+    struct RingQueue* tasks = &network->worker.worker->tasks;
+    if (!tasks->try_push(tasks, &item)) {
+        conn->parked = item;
+        return P2P_CONNECTION_PARKED;
+    }
+    return 0;
+}
+
+// Handle the frames already buffered on a connection, stopping early if it
+// parks: -1 if the connection should be dropped
+static int p2p_drain_connection(P2PNetwork* network, P2PConnection* conn, P2PArena* arena) {
+    if (conn->parked) {
+        struct RingQueue* tasks = &network->worker.worker->tasks;
+        if (!tasks->try_push(tasks, &conn->parked)) return 0;
+        conn->parked = NULL;
+    }
+    
+    P2PFrame frame;
+    int status;
+    while ((status = p2p_wire_stream_take(&conn->stream, &frame)) > 0) {
+        int result = p2p_handle_frame(network, conn, &frame, arena);
+        p2p_arena_reset(arena);
+        if (result < 0) return -1;
+        if (result == P2P_CONNECTION_PARKED) return 0;
+    }
+    
+    if (status < 0) {
+        P2P_DEBUG("Failed to read frame, dropping connection");
+        p2p_metrics_add(P2P_COUNTER_FRAMES_REJECTED, 1);
+        return -1;
+    }
+    return 0;
+}
+
+// Read what a readable connection has and handle every complete frame:
+// -1 once the connection is closed or broken
+static int p2p_service_connection(P2PNetwork* network, P2PConnection* conn, P2PArena* arena) {
+    int n = p2p_wire_stream_fill(&conn->stream);
+    if (n == P2P_WIRE_AGAIN) return 0;
+    if (n <= 0) return -1;
+    p2p_metrics_add(P2P_COUNTER_BYTES_RECEIVED, n);
+    return p2p_drain_connection(network, conn, arena);
+}
+
+// Reactor callback for an inbound connection: read and handle what it
+// has, or retry handing its parked frame to the bulk worker, then write
+// the replies waiting for room
+static int p2p_connection_ready(P2PWatch* watch, short revents, P2PArena* arena) {
+    P2PConnection* conn = (P2PConnection*)watch;
+    int result = 0;
+    if (conn->parked) {
+        result = p2p_drain_connection(conn->network, conn, arena);
+    } else if (revents & (POLLIN | POLLERR | POLLHUP)) {
+        result = p2p_service_connection(conn->network, conn, arena);
+    }
+    int waiting = p2p_connection_flush(conn);
+    if (waiting < 0) return -1;
+    watch->events = waiting ? POLLIN | POLLOUT : POLLIN;
+    // Parked connections are not read until the bulk worker catches up
+    watch->paused = conn->parked != NULL;
+    return result;
+}
+
+// Reactor callback once an inbound connection is off the reactor
+static void p2p_connection_unwatched(P2PWatch* watch) {
+    P2PConnection* conn = (P2PConnection*)watch;
+    conn->network->connection_count--;
+    p2p_connection_close(conn);
+}
+
+// Reactor callback for the listening socket: accept everything waiting.
+// A peer may keep its connection open and pipeline requests on it.
+static int p2p_listener_ready(P2PWatch* watch, short revents, P2PArena* arena) {
+    P2PNetwork* network = (P2PNetwork*)watch->owner;
+    (void)revents;
+    (void)arena;
+    
+    while (1) {
+        struct sockaddr_in peer_addr;
+        socklen_t peer_len = sizeof(peer_addr);
+        int client_socket = accept(watch->fd, (struct sockaddr*)&peer_addr, &peer_len);
+        if (client_socket < 0) break;
+        
+        char source[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &peer_addr.sin_addr, source, sizeof(source));
+        if (network->admission &&
+            !p2p_rate_table_admit(&network->admission->connections, source, p2p_metrics_now_ns())) {
+            p2p_metrics_add(P2P_COUNTER_CONNECTIONS_SHED, 1);
+            close(client_socket);
+            continue;
+        }
+        
+        P2PConnection* conn = NULL;
+        if (network->connection_count < P2P_MAX_CONNECTIONS) {
+            conn = malloc(sizeof(P2PConnection) + P2P_WIRE_MAX_FRAME);
+        }
+        if (!conn) {
+            P2P_WARN("Connection limit reached, refusing connection");
+            close(client_socket);
+            continue;
+        }
+        
+        P2P_TRACE_EVENT(P2P_TRACE_ACCEPT, 0, client_socket);
+        fcntl(client_socket, F_SETFL, fcntl(client_socket, F_GETFL) | O_NONBLOCK);
+        p2p_runtime_watch_init(&conn->watch, client_socket, network, p2p_connection_ready, p2p_connection_unwatched);
+        conn->network = network;
+        p2p_wire_stream_init(&conn->stream, client_socket, conn->buf, P2P_WIRE_MAX_FRAME);
+        atomic_init(&conn->refs, 1);
+        conn->parked = NULL;
+        conn->consumed = 0;
+        pthread_mutex_init(&conn->write_lock, NULL);
+        conn->out = NULL;
+        conn->out_len = 0;
+        conn->out_cap = 0;
+        memset(conn->type_map, 0xff, sizeof(conn->type_map));
+        conn->transport = NULL;
+        conn->transport_context = NULL;
+        strcpy(conn->source, source);
+        conn->shed = 0;
+        network->connection_count++;
+        p2p_runtime_watch(network->runtime, &conn->watch);
+        p2p_metrics_gauge_add(P2P_GAUGE_SOCKETS, 1);
+    }
+    return 0;
+}
+
+// Reactor callback once the listening socket is off the reactor
+static void p2p_listener_unwatched(P2PWatch* watch) {
+    close(watch->fd);
+    watch->fd = -1;
+}
+
+// Open the listening socket: -1 if the port cannot be bound
+static int p2p_network_listen(P2PNetwork* network) {
     // Create server socket
     int server_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (server_socket < 0) {
-        printf("Failed to create server socket\n");
-        return NULL;
+        P2P_ERROR("Failed to create server socket");
+        return -1;
     }
     
     // Set socket options
@@ -21,275 +688,566 @@ void* p2p_server_thread(void* arg) {
     
     // Bind to port
     struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
     server_addr.sin_port = htons(network->port);
     
     if (bind(server_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        printf("Failed to bind to port %d\n", network->port);
+        P2P_ERROR("Failed to bind to port %d", network->port);
         close(server_socket);
-        return NULL;
+        return -1;
     }
     
     // Listen
-    if (listen(server_socket, 10) < 0) {
-        printf("Failed to listen\n");
+    if (listen(server_socket, 128) < 0) {
+        P2P_ERROR("Failed to listen");
         close(server_socket);
-        return NULL;
+        return -1;
     }
+    fcntl(server_socket, F_SETFL, fcntl(server_socket, F_GETFL) | O_NONBLOCK);
     
-    printf("Server running on port %d\n", network->port);
-    
-    while (1) {
-        struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-        int client_socket = accept(server_socket, (struct sockaddr*)&client_addr, &addr_len);
-        
-        if (client_socket < 0) continue;
-        
-        // Handle connection - read message type first
-        char msg_type[32];
-        int type_bytes = read(client_socket, msg_type, 32);
-        if (type_bytes == 32) {
-            msg_type[31] = '\0';  // Ensure null termination
-            printf("DEBUG: Received message type: '%s'\n", msg_type);
-            
-            if (strcmp(msg_type, "DISCOVERY") == 0) {
-                printf("DEBUG: Handling as discovery message\n");
-                // Read the rest of the discovery message
-                char disc_data[sizeof(DiscoveryMessage) - 32];
-                int disc_bytes = read(client_socket, disc_data, sizeof(DiscoveryMessage) - 32);
-                if (disc_bytes == sizeof(DiscoveryMessage) - 32) {
-                    // Reconstruct the full discovery message
-                    DiscoveryMessage disc_msg;
-                    memcpy(&disc_msg, msg_type, 32);
-                    memcpy(((char*)&disc_msg) + 32, disc_data, sizeof(DiscoveryMessage) - 32);
-                    
-                    printf("DEBUG: Received DISCOVERY message from %s\n", disc_msg.sender);
-                    // Add sender to peer list using the sender's address from the message
-                    p2p_peer_list_add(network->peer_list, disc_msg.sender, network->node_id);
-                    
-                    // Handle discovery message
-                    if (disc_msg.ttl > 0) {
-                        // Parse and add peers from the received peer list
-                        char* peer_list_copy = strdup(disc_msg.peer_list);
-                        char* token = strtok(peer_list_copy, ",");
-                        while (token != NULL) {
-                            // Skip empty tokens and self
-                            if (strlen(token) > 0 && strcmp(token, network->node_id) != 0) {
-                                int added = p2p_peer_list_add(network->peer_list, token, network->node_id);
-                                // If peer was newly added, automatically connect to it
-                                if (added > 0) {
-                                    printf("Auto-connecting to newly discovered peer: %s\n", token);
-                                    p2p_network_connect(network, token);
-                                }
-                            }
-                            token = strtok(NULL, ",");
-                        }
-                        free(peer_list_copy);
-                        
-                        // Send back our peer list with decremented TTL
-                        char our_peer_list[1024];
-                        p2p_build_peer_list_string(network->peer_list, our_peer_list, sizeof(our_peer_list));
-                        
-                        DiscoveryMessage response;
-                        strncpy(response.type, "DISCOVERY", 31);
-                        response.type[31] = '\0';
-                        strncpy(response.sender, network->node_id, 63);
-                        response.sender[63] = '\0';
-                        response.ttl = disc_msg.ttl - 1;
-                        strncpy(response.peer_list, our_peer_list, 1023);
-                        response.peer_list[1023] = '\0';
-                        
-                        write(client_socket, &response, sizeof(DiscoveryMessage));
-                        
-                        // Forward discovery to all other peers (propagation)
-                        if (disc_msg.ttl > 1) {
-                            printf("Forwarding discovery with TTL=%d to other peers\n", disc_msg.ttl - 1);
-                            struct Node* current = network->peer_list->peer_list.head;
-                            while (current != NULL) {
-                                P2PPeer* peer = (P2PPeer*)current->data;
-                                // Don't send back to the original sender
-                                if (strcmp(peer->address, disc_msg.sender) != 0) {
-                                    printf("Forwarding to peer: %s\n", peer->address);
-                                    p2p_network_send_discovery(network, peer->address, disc_msg.ttl - 1, our_peer_list);
-                                }
-                                current = current->next;
-                            }
-                        }
-                        
-                        // Also try to connect to peers from the original discovery
-                        char* original_peer_list = strdup(disc_msg.peer_list);
-                        char* discovery_token = strtok(original_peer_list, ",");
-                        while (discovery_token != NULL) {
-                            if (strlen(discovery_token) > 0 && strcmp(discovery_token, network->node_id) != 0) {
-                                // Check if we already know this peer
-                                int exists = 0;
-                                struct Node* check = network->peer_list->peer_list.head;
-                                while (check != NULL) {
-                                    P2PPeer* existing_peer = (P2PPeer*)check->data;
-                                    if (strcmp(existing_peer->address, discovery_token) == 0) {
-                                        exists = 1;
-                                        break;
-                                    }
-                                    check = check->next;
-                                }
-                                
-                                if (!exists) {
-                                    printf("Auto-connecting to peer from discovery: %s\n", discovery_token);
-                                    p2p_network_connect(network, discovery_token);
-                                }
-                            }
-                            discovery_token = strtok(NULL, ",");
-                        }
-                        free(original_peer_list);
-                    }
-                }
-            } else {
-                printf("DEBUG: Handling as regular message\n");
-                // Read the rest of the regular message
-                char msg_data[sizeof(P2PMessage) - 32];
-                int msg_bytes = read(client_socket, msg_data, sizeof(P2PMessage) - 32);
-                if (msg_bytes == sizeof(P2PMessage) - 32) {
-                    // Reconstruct the full regular message
-                    P2PMessage msg;
-                    memcpy(&msg, msg_type, 32);
-                    memcpy(((char*)&msg) + 32, msg_data, sizeof(P2PMessage) - 32);
-                    
-                    if (network->message_handler) {
-                        network->message_handler(&msg);
-                    }
-                } else {
-                    printf("DEBUG: Failed to read regular message (got %d bytes, expected %zu)\n", 
-                           msg_bytes, sizeof(P2PMessage) - 32);
-                }
-            }
-        } else {
-            printf("DEBUG: Failed to read message type (got %d bytes, expected 32)\n", type_bytes);
-        }
-        
-        close(client_socket);
+    p2p_runtime_watch_init(&network->listener, server_socket, network, p2p_listener_ready, p2p_listener_unwatched);
+    p2p_runtime_watch(network->runtime, &network->listener);
+    P2P_INFO("Server running on port %d", network->port);
+    return 0;
+}
+
+// Reactor callback for the failure detector's timer
+static int p2p_swim_timer_ready(P2PWatch* watch, short revents, P2PArena* arena) {
+    (void)arena;
+    P2PNetwork* network = (P2PNetwork*)watch->owner;
+    uint64_t expirations;
+    if (revents && read(watch->fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) return -1;
+    p2p_swim_tick(&network->swim, p2p_swim_now_ms());
+    return 0;
+}
+
+static void p2p_swim_timer_unwatched(P2PWatch* watch) {
+    close(watch->fd);
+    watch->fd = -1;
+}
+
+// Tick the failure detector on the reactor, where SWIM frames are handled
+static int p2p_network_watch_swim(P2PNetwork* network) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        P2P_ERROR("Failed to create failure detector timer");
+        return -1;
     }
+    int tick_ms = p2p_swim_tick_ms(&network->swim);
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = tick_ms / 1000;
+    spec.it_interval.tv_nsec = (tick_ms % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+    timerfd_settime(fd, 0, &spec, NULL);
     
-    return NULL;
+    p2p_runtime_watch_init(&network->swim_timer, fd, network, p2p_swim_timer_ready, p2p_swim_timer_unwatched);
+    p2p_runtime_watch(network->runtime, &network->swim_timer);
+    return 0;
+}
+
+// Order link index entries by address
+static int p2p_link_index_compare(void* a, void* b) {
+    return strcmp(((P2PLinkIndexEntry*)a)->address, ((P2PLinkIndexEntry*)b)->address);
 }
 
 // Create network
 P2PNetwork* p2p_network_create(int port, const char* node_id, message_handler_t handler) {
     P2PNetwork* network = malloc(sizeof(P2PNetwork));
     if (!network) return NULL;
+    if (p2p_completion_queue_init(&network->completions) < 0) {
+        free(network);
+        return NULL;
+    }
     
     network->port = port;
     strncpy(network->node_id, node_id, 63);
     network->node_id[63] = '\0';
     network->peer_list = p2p_peer_list_create();
     network->message_handler = handler;
+    network->flow_policy = P2P_FLOW_BLOCK;
+    network->store_forward = 0;
+    memset(&network->spool_config, 0, sizeof(network->spool_config));
+    network->transport = NULL;
+    atomic_init(&network->tap, NULL);
+    network->tap_context = NULL;
+    atomic_init(&network->tap_calls, 0);
+    network->admission = NULL;
+    p2p_swim_init(&network->swim, network->peer_list, network->node_id, p2p_network_swim_send,
+                  p2p_network_swim_forget, network);
+    network->swim_timer.fd = -1;
+    p2p_arena_init(&network->receive_arena, P2P_ARENA_CHUNK_SIZE);
+    p2p_registry_init(&network->types);
+    p2p_reassembler_init(&network->reassembler, p2p_network_deliver, network);
+    network->runtime = NULL;
+    network->owns_runtime = 0;
+    network->listener.fd = -1;
+    network->worker.tick = p2p_bulk_tick;
+    network->worker.context = network;
+    network->worker.worker = NULL;
+    network->connection_count = 0;
+    network->links = sorted_vector_constructor(sizeof(P2PLinkIndexEntry), p2p_link_index_compare);
+    pthread_mutex_init(&network->links_lock, NULL);
+    // Seed message ids from the clock so a restarted node doesn't reuse ids
+    // the receiver may still be reassembling
+    atomic_init(&network->next_msg_id, (unsigned long)time(NULL) << 20);
     
     // Load existing peers from file
     p2p_peer_list_load_from_file(network->peer_list, node_id);
+    return network;
+}
+
+// Make sure the network has a runtime, a private one unless a shared one
+// was set: -1 if it cannot be created. Caller holds links_lock.
+static int p2p_network_runtime(P2PNetwork* network) {
+    if (network->runtime) return 0;
+    network->runtime = p2p_runtime_create(1);
+    if (!network->runtime) return -1;
+    network->owns_runtime = 1;
+    return 0;
+}
+
+// Start network (listens on the runtime, a private one unless a shared one
+// was set, or starts the transport, then connects to saved peers)
+int p2p_network_start(P2PNetwork* network) {
+    if (network->transport) {
+        if (network->transport->start(network->transport, network) < 0) return -1;
+    } else {
+        // Sends before start may already have created it
+        pthread_mutex_lock(&network->links_lock);
+        int status = p2p_network_runtime(network);
+        pthread_mutex_unlock(&network->links_lock);
+        if (status < 0) return -1;
+        p2p_runtime_join(network->runtime, &network->worker);
+        if (p2p_network_listen(network) < 0) {
+            p2p_runtime_leave(network->runtime, &network->worker);
+            return -1;
+        }
+        if (network->swim.enabled) {
+            p2p_network_watch_swim(network);
+        }
+    }
     
-    // Bootstrap: automatically connect to loaded peers
+    // Bootstrap: automatically connect to loaded peers (after configuration,
+    // so their links pick up settings made between create and start)
+    p2p_peer_list_lock(network->peer_list);
     struct Node* current = network->peer_list->peer_list.head;
     while (current != NULL) {
         P2PPeer* peer = (P2PPeer*)current->data;
-        printf("Bootstrap: connecting to peer %s\n", peer->address);
+        P2P_INFO("Bootstrap: connecting to peer %s", peer->address);
         p2p_network_connect(network, peer->address);
         current = current->next;
     }
-    
-    g_network = network;
-    return network;
+    p2p_peer_list_unlock(network->peer_list);
+    return 0;
 }
 
-// Start network (starts server thread)
-int p2p_network_start(P2PNetwork* network) {
-    pthread_t server_tid;
-    if (pthread_create(&server_tid, NULL, p2p_server_thread, network) != 0) {
-        return -1;
-    }
-    pthread_detach(server_tid);
-    return 0;
+// Run on a shared runtime (before p2p_network_start)
+void p2p_network_set_runtime(P2PNetwork* network, P2PRuntime* runtime) {
+    network->runtime = runtime;
+    network->owns_runtime = 0;
 }
 
-// Send message to specific address
-int p2p_network_send(P2PNetwork* network, const char* address, const char* type, const char* data) {
-    // Parse address
-    char* colon = strrchr(address, ':');
-    if (!colon) return -1;
-    
+// Fill addr from an IP:PORT address: -1 if it has no port
+static int p2p_network_resolve(const char* address, struct sockaddr_in* addr) {
     // Make a copy to avoid modifying the original
     char address_copy[128];
     strncpy(address_copy, address, sizeof(address_copy) - 1);
     address_copy[sizeof(address_copy) - 1] = '\0';
     
     char* colon_copy = strrchr(address_copy, ':');
+    if (!colon_copy) return -1;
     *colon_copy = '\0';
     char* ip = address_copy;
     int port = atoi(colon_copy + 1);
     
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    inet_pton(AF_INET, ip, &addr->sin_addr);
+    return 0;
+}
+
+// Open a TCP connection to an IP:PORT address, -1 on failure
+int p2p_network_dial(const char* address) {
+    struct sockaddr_in server_addr;
+    if (p2p_network_resolve(address, &server_addr) < 0) return -1;
+    
     // Create client socket
     int client_socket = socket(AF_INET, SOCK_STREAM, 0);
     if (client_socket < 0) return -1;
     
     // Connect
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-    inet_pton(AF_INET, ip, &server_addr.sin_addr);
-    
+    uint64_t start = p2p_metrics_now_ns();
     if (connect(client_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
         close(client_socket);
+        p2p_metrics_add(P2P_COUNTER_CONNECT_FAILURES, 1);
         return -1;
     }
+    p2p_metrics_record_since(P2P_HISTOGRAM_CONNECT, start);
+    p2p_metrics_add(P2P_COUNTER_CONNECTS, 1);
+    
+    return client_socket;
+}
+
+// Start a non-blocking TCP connection to an IP:PORT address
+int p2p_network_dial_nonblocking(const char* address, int* pending) {
+    struct sockaddr_in server_addr;
+    if (p2p_network_resolve(address, &server_addr) < 0) return -1;
+    
+    int client_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (client_socket < 0) return -1;
+    fcntl(client_socket, F_SETFL, fcntl(client_socket, F_GETFL) | O_NONBLOCK);
+    
+    // Outcomes known now are counted here, the rest by the caller
+    uint64_t start = p2p_metrics_now_ns();
+    *pending = 0;
+    if (connect(client_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        if (errno != EINPROGRESS) {
+            close(client_socket);
+            p2p_metrics_add(P2P_COUNTER_CONNECT_FAILURES, 1);
+            return -1;
+        }
+        *pending = 1;
+    }
+    if (!*pending) {
+        p2p_metrics_record_since(P2P_HISTOGRAM_CONNECT, start);
+        p2p_metrics_add(P2P_COUNTER_CONNECTS, 1);
+    }
+    return client_socket;
+}
+
+// Find the outbound link to an address, creating it on first use. The
+// caller holds a reference until it calls p2p_link_release.
+static P2PLink* p2p_network_link(P2PNetwork* network, const char* address) {
+    P2PLinkIndexEntry key = { address, NULL };
+    P2PLink* link = NULL;
+    
+    pthread_mutex_lock(&network->links_lock);
+    int index = network->links.search(&network->links, &key);
+    if (index >= 0) {
+        link = ((P2PLinkIndexEntry*)network->links.retrieve(&network->links, index))->link;
+    } else {
+        P2PSpoolConfig spool;
+        int spooling = network->store_forward;
+        if (spooling) {
+            // One spool file per (node, peer) pair
+            spool = network->spool_config;
+            int len = snprintf(spool.path, sizeof(spool.path), "%s/%s-%s.spool", network->spool_config.path,
+                               network->node_id, address);
+            if (len < 0 || len >= (int)sizeof(spool.path)) {
+                P2P_WARN("Spool path for %s is too long, not spooling", address);
+                spooling = 0;
+            }
+            for (char* c = spool.path + strlen(network->spool_config.path) + 1; spooling && *c; c++) {
+                if (*c == ':' || *c == '/') *c = '_';
+            }
+        }
+        if (p2p_network_runtime(network) == 0) {
+            link = p2p_link_create(network->runtime, address, &network->types, spooling ? &spool : NULL);
+        }
+        if (link) {
+            P2PLinkIndexEntry entry = { link->address, link };
+            network->links.insert(&network->links, &entry);
+        }
+    }
+    if (link) p2p_link_retain(link);
+    pthread_mutex_unlock(&network->links_lock);
+    return link;
+}
+
+// Move this network's traffic onto a transport
+void p2p_network_set_transport(P2PNetwork* network, P2PTransport* transport) {
+    network->transport = transport;
+}
+
+// Open a connection for frames a transport delivers from one sender
+P2PConnection* p2p_network_open_connection(P2PNetwork* network, P2PTransport* transport, void* context) {
+    // No socket, so no read buffer and no place on a reactor either
+    P2PConnection* conn = malloc(sizeof(P2PConnection));
+    if (!conn) return NULL;
+    memset(&conn->watch, 0, sizeof(conn->watch));
+    conn->watch.fd = -1;
+    conn->network = network;
+    memset(&conn->stream, 0, sizeof(conn->stream));
+    conn->stream.sock = -1;
+    atomic_init(&conn->refs, 1);
+    conn->parked = NULL;
+    conn->consumed = 0;
+    pthread_mutex_init(&conn->write_lock, NULL);
+    conn->out = NULL;
+    conn->out_len = 0;
+    conn->out_cap = 0;
+    memset(conn->type_map, 0xff, sizeof(conn->type_map));
+    conn->transport = transport;
+    conn->transport_context = context;
+    conn->source[0] = '\0';
+    conn->shed = 0;
+    return conn;
+}
+
+// Handle whole frames from a transport connection on the caller's thread
+int p2p_network_receive(P2PNetwork* network, P2PConnection* conn, const void* data, size_t len) {
+    const uint8_t* bytes = data;
+    size_t offset = 0;
+    p2p_metrics_add(P2P_COUNTER_BYTES_RECEIVED, len);
+    
+    while (offset < len) {
+        P2PFrame frame;
+        ssize_t n = p2p_wire_parse_frame(bytes + offset, len - offset, &frame);
+        if (n <= 0) {
+            P2P_DEBUG("Failed to read frame from transport");
+            p2p_metrics_add(P2P_COUNTER_FRAMES_REJECTED, 1);
+            return -1;
+        }
+        offset += n;
+        
+        // Control frames as the reactor handles them, the rest as the bulk
+        // worker would, but right here: there is no queue in between
+        int result;
+        if (frame.kind == P2P_FRAME_DISCOVERY || frame.kind == P2P_FRAME_SWIM || frame.kind == P2P_FRAME_CREDIT) {
+            result = p2p_handle_frame(network, conn, &frame, &network->receive_arena);
+        } else {
+            result = p2p_handle_bulk_frame(network, conn, &frame, &network->receive_arena);
+        }
+        p2p_arena_reset(&network->receive_arena);
+        if (result < 0) return -1;
+    }
+    return 0;
+}
+
+// Close a transport connection
+void p2p_network_close_connection(P2PConnection* conn) {
+    p2p_connection_release(conn);
+}
+
+// Send message to specific address
+int p2p_network_send(P2PNetwork* network, const char* address, const char* type, const char* data) {
+    return p2p_network_send_bytes(network, address, type, data, strlen(data));
+}
+
+// Encode a payload as a sequence of fragment frames: NULL on failure
+static P2PBuffer* p2p_network_encode_fragments(P2PNetwork* network, const char* type,
+                                               const void* data, size_t len) {
+    size_t chunks = (len + P2P_STREAM_CHUNK_SIZE - 1) / P2P_STREAM_CHUNK_SIZE;
+    P2PBuffer* frames = p2p_buffer_create(len + chunks * 256);
+    if (!frames) return NULL;
     
-    // Send message
+    P2PFragment fragment;
+    fragment.msg_id = atomic_fetch_add(&network->next_msg_id, 1);
+    fragment.total_len = len;
+    strncpy(fragment.type, type, 31);
+    fragment.type[31] = '\0';
+    strncpy(fragment.sender, network->node_id, 63);
+    fragment.sender[63] = '\0';
+    
+    for (size_t offset = 0; offset < len; offset += P2P_STREAM_CHUNK_SIZE) {
+        fragment.offset = offset;
+        fragment.chunk = (const uint8_t*)data + offset;
+        fragment.chunk_len = len - offset < P2P_STREAM_CHUNK_SIZE ? len - offset : P2P_STREAM_CHUNK_SIZE;
+        
+        size_t frame_len = p2p_wire_encode_fragment(&fragment, frames->data + frames->len, frames->cap - frames->len);
+        if (frame_len == 0) {
+            p2p_buffer_release(frames);
+            return NULL;
+        }
+        frames->len += frame_len;
+    }
+    return frames;
+}
+
+// Encode a payload of any size into frames that can go to any peer: a
+// single message frame, or fragments for larger payloads. Sets *type_id to
+// the type the frames use (-1 if they name it inline). NULL on failure.
+static P2PBuffer* p2p_network_encode(P2PNetwork* network, const char* type, const void* data, size_t len, int* type_id) {
+    *type_id = -1;
+    if (len > P2P_MESSAGE_DATA_MAX) {
+        return p2p_network_encode_fragments(network, type, data, len);
+    }
+    
+    // Small payloads fit in a single message frame
     P2PMessage msg;
     strncpy(msg.type, type, 31);
     msg.type[31] = '\0';
     strncpy(msg.sender, network->node_id, 63);
     msg.sender[63] = '\0';
-    strncpy(msg.data, data, 255);
-    msg.data[255] = '\0';
-    
-    write(client_socket, &msg, sizeof(P2PMessage));
-    close(client_socket);
+    p2p_message_set_data(&msg, data, len);
+    msg.type_id = p2p_registry_intern(&network->types, msg.type);
     
-    printf("Sent %s to %s\n", type, address);
-    return 0;
+    P2PBuffer* frames = p2p_buffer_create(P2P_WIRE_MAX_MESSAGE);
+    if (!frames) return NULL;
+    if (msg.type_id >= 0) {
+        // Sent by id; each link defines the type once per connection
+        *type_id = msg.type_id;
+        frames->len = p2p_wire_encode_typed_message(&msg, frames->data, frames->cap);
+    } else {
+        // Type table full: name the type inline
+        frames->len = p2p_wire_encode_message(&msg, frames->data, frames->cap);
+    }
+    if (frames->len == 0) {
+        p2p_buffer_release(frames);
+        return NULL;
+    }
+    return frames;
 }
 
-// Send discovery message
-int p2p_network_send_discovery(P2PNetwork* network, const char* address, int ttl, const char* peer_list) {
-    // Parse address
-    char* colon = strrchr(address, ':');
-    if (!colon) return -1;
-    
-    // Make a copy to avoid modifying the original
-    char address_copy[128];
-    strncpy(address_copy, address, sizeof(address_copy) - 1);
-    address_copy[sizeof(address_copy) - 1] = '\0';
+// Send encoded frames to one address under the flow policy; takes over one
+// reference to frames. type and len only label the log line.
+static int p2p_network_send_frames(P2PNetwork* network, const char* address, P2PBuffer* frames, int type_id,
+                                   const char* type, size_t len) {
+    if (network->transport) {
+        // The transport has no credit window, so every policy sends right away
+        if (network->transport->send(network->transport, network, address, P2P_LANE_BULK, frames, type_id) < 0) {
+            return -1;
+        }
+        P2P_INFO("Sent %s to %s (%zu bytes)", type, address, len);
+        return 0;
+    }
     
-    char* colon_copy = strrchr(address_copy, ':');
-    *colon_copy = '\0';
-    char* ip = address_copy;
-    int port = atoi(colon_copy + 1);
+    P2PLink* link = p2p_network_link(network, address);
+    if (!link) {
+        p2p_buffer_release(frames);
+        return -1;
+    }
     
-    // Create client socket
-    int client_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (client_socket < 0) return -1;
+    if (network->flow_policy == P2P_FLOW_QUEUE) {
+        // Hand the frames to the link and return; only the link's limit applies
+        int result = P2P_SEND_BACKPRESSURE;
+        if (atomic_load(&link->backlog) + (long)frames->len > P2P_LINK_MAX_BACKLOG) {
+            p2p_buffer_release(frames);
+        } else {
+            result = p2p_link_submit(link, P2P_LANE_BULK, frames, type_id, 0, NULL, NULL);
+        }
+        p2p_link_release(link);
+        if (result == 0) {
+            P2P_INFO("Queued %s for %s (%zu bytes)", type, address, len);
+        }
+        return result;
+    }
     
-    // Connect
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-    inet_pton(AF_INET, ip, &server_addr.sin_addr);
+    if (network->flow_policy == P2P_FLOW_FAIL) {
+        // Refuse unless the peer can take it now (or a full window, for larger payloads)
+        long needed = frames->len < P2P_WIRE_CREDIT_WINDOW ? (long)frames->len : P2P_WIRE_CREDIT_WINDOW;
+        if (p2p_link_capacity(link) < needed) {
+            p2p_link_release(link);
+            p2p_buffer_release(frames);
+            return P2P_SEND_BACKPRESSURE;
+        }
+    }
     
-    if (connect(client_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        close(client_socket);
-        return -1;
+    // Bounded, so two nodes whose handlers send to each other cannot wait
+    // forever on credit neither worker is free to grant
+    int status = p2p_link_send(link, P2P_LANE_BULK, frames, type_id, P2P_LINK_BLOCK_TIMEOUT_MS);
+    p2p_link_release(link);
+    if (status == P2P_SEND_TIMEOUT) {
+        P2P_WARN("Timed out waiting for %s to take %s (%zu bytes)", address, type, len);
+        return P2P_SEND_TIMEOUT;
     }
+    if (status < 0) return -1;
     
-    // Send discovery message
+    if (status == P2P_SEND_SPOOLED) {
+        P2P_INFO("Spooled %s for %s until it is reachable (%zu bytes)", type, address, len);
+    } else {
+        P2P_INFO("Sent %s to %s (%zu bytes)", type, address, len);
+    }
+    return 0;
+}
+
+// Send a binary payload of any size to a specific address
+int p2p_network_send_bytes(P2PNetwork* network, const char* address, const char* type, const void* data, size_t len) {
+    int type_id;
+    P2PBuffer* frames = p2p_network_encode(network, type, data, len, &type_id);
+    if (!frames) return -1;
+    return p2p_network_send_frames(network, address, frames, type_id, type, len);
+}
+
+// Choose what sends do when a peer is out of credit
+void p2p_network_set_flow_policy(P2PNetwork* network, P2PFlowPolicy policy) {
+    network->flow_policy = policy;
+}
+
+// Hold bulk messages for unreachable peers (links created from now on)
+void p2p_network_set_store_forward(P2PNetwork* network, const char* directory, size_t memory_limit,
+                                   size_t disk_limit, long max_age_ms) {
+    pthread_mutex_lock(&network->links_lock);
+    network->spool_config.memory_limit = memory_limit;
+    network->spool_config.disk_limit = disk_limit;
+    network->spool_config.max_age_ms = max_age_ms;
+    strncpy(network->spool_config.path, directory, sizeof(network->spool_config.path) - 1);
+    network->spool_config.path[sizeof(network->spool_config.path) - 1] = '\0';
+    network->store_forward = 1;
+    pthread_mutex_unlock(&network->links_lock);
+}
+
+// Bulk bytes that can be sent to address right now without waiting
+long p2p_network_send_capacity(P2PNetwork* network, const char* address) {
+    if (network->transport) return P2P_WIRE_CREDIT_WINDOW;
+    P2PLink* link = p2p_network_link(network, address);
+    if (!link) return 0;
+    long capacity = p2p_link_capacity(link);
+    p2p_link_release(link);
+    return capacity;
+}
+
+// Observe every delivered message (safe while the network runs)
+void p2p_network_set_tap(P2PNetwork* network, message_tap_t tap, void* context) {
+    // Take the old tap out and wait for the calls still using it before
+    // the context changes under them
+    atomic_store(&network->tap, NULL);
+    while (atomic_load(&network->tap_calls) > 0) {
+        sched_yield();
+    }
+    network->tap_context = context;
+    atomic_store(&network->tap, tap);
+}
+
+// Shed inbound traffic over config's limits (NULL admits everything)
+int p2p_network_set_admission(P2PNetwork* network, const P2PAdmissionConfig* config) {
+    P2PAdmission* admission = NULL;
+    if (config) {
+        admission = p2p_admission_create(config);
+        if (!admission) return -1;
+    }
+    free(network->admission);
+    network->admission = admission;
+    return 0;
+}
+
+// Turn failure detection on or off (before p2p_network_start)
+void p2p_network_set_failure_detection(P2PNetwork* network, const P2PSwimConfig* config) {
+    if (config) {
+        p2p_swim_enable(&network->swim, config);
+    } else {
+        network->swim.enabled = 0;
+    }
+}
+
+// Register a handler for one message type
+int p2p_network_register_handler(P2PNetwork* network, const char* type, message_handler_t handler) {
+    return p2p_registry_set_handler(&network->types, type, handler);
+}
+
+// Register an RPC handler for one request type
+int p2p_network_register_rpc_handler(P2PNetwork* network, const char* type, rpc_handler_t handler) {
+    return p2p_registry_set_rpc_handler(&network->types, type, handler);
+}
+
+// Register a handler for chunks of fragmented messages
+void p2p_network_set_chunk_handler(P2PNetwork* network, chunk_handler_t handler, int reassemble) {
+    network->reassembler.chunk_handler = handler;
+    network->reassembler.reassemble = reassemble;
+}
+
+// Report discovery messages the link could not deliver
+static void p2p_network_discovery_sent(void* context, int status) {
+    if (status < 0) {
+        P2P_WARN("Failed to send DISCOVERY to %s", ((P2PLink*)context)->address);
+    }
+}
+
+// Encode a discovery message from this node: NULL on failure
+static P2PBuffer* p2p_network_encode_discovery(P2PNetwork* network, int ttl, const char* peer_list) {
     DiscoveryMessage msg;
     strncpy(msg.type, "DISCOVERY", 31);
     msg.type[31] = '\0';
@@ -299,66 +1257,295 @@ int p2p_network_send_discovery(P2PNetwork* network, const char* address, int ttl
     strncpy(msg.peer_list, peer_list, 1023);
     msg.peer_list[1023] = '\0';
     
-    write(client_socket, &msg, sizeof(DiscoveryMessage));
-    close(client_socket);
+    P2PBuffer* frame = p2p_buffer_create(P2P_WIRE_MAX_DISCOVERY);
+    if (!frame) return NULL;
+    frame->len = p2p_wire_encode_discovery(&msg, frame->data, frame->cap);
+    if (frame->len == 0) {
+        p2p_buffer_release(frame);
+        return NULL;
+    }
+    return frame;
+}
+
+// Queue an encoded discovery frame on the peer's control lane; takes over
+// one reference to frame
+static int p2p_network_queue_discovery(P2PNetwork* network, const char* address, P2PBuffer* frame, int ttl) {
+    if (network->transport) {
+        if (network->transport->send(network->transport, network, address, P2P_LANE_CONTROL, frame, -1) < 0) {
+            P2P_WARN("Failed to send DISCOVERY to %s", address);
+            return -1;
+        }
+        P2P_DEBUG("Queued DISCOVERY for %s with TTL=%d", address, ttl);
+        return 0;
+    }
+    
+    P2PLink* link = p2p_network_link(network, address);
+    if (!link) {
+        p2p_buffer_release(frame);
+        return -1;
+    }
+    
+    // Fire and forget: the reactor forwards discovery and must never wait on a peer
+    int result = p2p_link_submit(link, P2P_LANE_CONTROL, frame, -1, 0, p2p_network_discovery_sent, link);
+    p2p_link_release(link);
+    if (result < 0) return -1;
     
-    printf("Sent DISCOVERY to %s with TTL=%d\n", address, ttl);
+    P2P_DEBUG("Queued DISCOVERY for %s with TTL=%d", address, ttl);
     return 0;
 }
 
-// Broadcast message to all peers
-int p2p_network_broadcast(P2PNetwork* network, const char* type, const char* data) {
+// Queue a SWIM frame on the peer's control lane; a probe that never
+// arrives is what the detector is there to notice, so failures are ignored
+static void p2p_network_swim_send(void* context, const char* address, P2PBuffer* frame) {
+    P2PNetwork* network = (P2PNetwork*)context;
+    if (network->transport) {
+        network->transport->send(network->transport, network, address, P2P_LANE_CONTROL, frame, -1);
+        return;
+    }
+    P2PLink* link = p2p_network_link(network, address);
+    if (!link) {
+        p2p_buffer_release(frame);
+        return;
+    }
+    p2p_link_submit(link, P2P_LANE_CONTROL, frame, -1, 0, NULL, NULL);
+    p2p_link_release(link);
+}
+
+// Close the link to a peer found dead, with whatever it still held; a
+// later send opens a new one
+static void p2p_network_swim_forget(void* context, const char* address) {
+    P2PNetwork* network = (P2PNetwork*)context;
+    P2PLinkIndexEntry key = { address, NULL };
+    P2PLink* link = NULL;
+    
+    pthread_mutex_lock(&network->links_lock);
+    int index = network->links.search(&network->links, &key);
+    if (index >= 0) {
+        link = ((P2PLinkIndexEntry*)network->links.retrieve(&network->links, index))->link;
+        network->links.remove(&network->links, index);
+    }
+    pthread_mutex_unlock(&network->links_lock);
+    if (link) p2p_link_retire(link);
+}
+
+// Queue a discovery message on the peer's control lane
+int p2p_network_send_discovery(P2PNetwork* network, const char* address, int ttl, const char* peer_list) {
+    P2PBuffer* frame = p2p_network_encode_discovery(network, ttl, peer_list);
+    if (!frame) return -1;
+    return p2p_network_queue_discovery(network, address, frame, ttl);
+}
+
+// Copy the peers' addresses (NULL on allocation failure)
+static char (*p2p_network_peer_addresses(P2PNetwork* network, int* count))[128] {
+    p2p_peer_list_lock(network->peer_list);
+    *count = p2p_peer_list_count(network->peer_list);
+    char (*addresses)[128] = malloc(*count * sizeof(*addresses) + 1);
     struct Node* current = network->peer_list->peer_list.head;
-    int sent_count = 0;
+    for (int i = 0; addresses && i < *count && current; i++, current = current->next) {
+        strcpy(addresses[i], ((P2PPeer*)current->data)->address);
+    }
+    p2p_peer_list_unlock(network->peer_list);
+    return addresses;
+}
+
+// Broadcast message to all peers (encoded once, shared by every link)
+int p2p_network_broadcast(P2PNetwork* network, const char* type, const char* data) {
+    size_t len = strlen(data);
+    int type_id;
+    P2PBuffer* frames = p2p_network_encode(network, type, data, len, &type_id);
+    if (!frames) return 0;
     
-    while (current != NULL) {
-        P2PPeer* peer = (P2PPeer*)current->data;
-        if (p2p_network_send(network, peer->address, type, data) == 0) {
+    // Sends may wait for credit, so they go out from a copy of the addresses
+    // rather than with the peer list locked
+    int count;
+    char (*addresses)[128] = p2p_network_peer_addresses(network, &count);
+    if (!addresses) {
+        p2p_buffer_release(frames);
+        return 0;
+    }
+    
+    int sent_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (p2p_network_send_frames(network, addresses[i], p2p_buffer_retain(frames), type_id, type, len) == 0) {
             sent_count++;
         }
-        current = current->next;
     }
+    free(addresses);
+    p2p_buffer_release(frames);
     
-    printf("Broadcast %s to %d peers\n", type, sent_count);
+    P2P_INFO("Broadcast %s to %d peers", type, sent_count);
     return sent_count;
 }
 
+// Carries an async send's context to the completion queue
+typedef struct {
+    P2PNetwork* network;
+    void* context;
+} P2PAsyncSend;
+
+static void p2p_network_async_done(void* context, int status) {
+    P2PAsyncSend* send = (P2PAsyncSend*)context;
+    p2p_completion_queue_push(&send->network->completions, send->context, status);
+    free(send);
+}
+
+// Queue encoded frames for address without waiting; takes over one
+// reference to frames
+static int p2p_network_submit_async(P2PNetwork* network, const char* address, P2PBuffer* frames, int type_id,
+                                    int timeout_ms, send_callback_t callback, void* context) {
+    P2PAsyncSend* queued = NULL;
+    if (!callback) {
+        queued = malloc(sizeof(P2PAsyncSend));
+        if (!queued) {
+            p2p_buffer_release(frames);
+            return -1;
+        }
+        queued->network = network;
+        queued->context = context;
+        callback = p2p_network_async_done;
+        context = queued;
+    }
+    
+    if (network->transport) {
+        // The transport sends before returning, so the outcome is known now
+        int status = network->transport->send(network->transport, network, address, P2P_LANE_BULK, frames, type_id);
+        callback(context, status < 0 ? -1 : 0);
+        return 0;
+    }
+    
+    P2PLink* link = p2p_network_link(network, address);
+    int result = -1;
+    if (!link) {
+        p2p_buffer_release(frames);
+    } else if (atomic_load(&link->backlog) + (long)frames->len > P2P_LINK_MAX_BACKLOG) {
+        p2p_buffer_release(frames);
+        result = P2P_SEND_BACKPRESSURE;
+    } else {
+        result = p2p_link_submit_timed(link, P2P_LANE_BULK, frames, type_id, timeout_ms, callback, context);
+    }
+    if (link) p2p_link_release(link);
+    if (result != 0) free(queued);
+    return result;
+}
+
+// Queue a payload and return at once
+int p2p_network_send_async(P2PNetwork* network, const char* address, const char* type, const void* data,
+                           size_t len, int timeout_ms, send_callback_t callback, void* context) {
+    int type_id;
+    P2PBuffer* frames = p2p_network_encode(network, type, data, len, &type_id);
+    if (!frames) return -1;
+    int result = p2p_network_submit_async(network, address, frames, type_id, timeout_ms, callback, context);
+    if (result == 0) {
+        P2P_DEBUG("Queued %s for %s (%zu bytes)", type, address, len);
+    }
+    return result;
+}
+
+// Queue a payload for every peer and return at once
+int p2p_network_broadcast_async(P2PNetwork* network, const char* type, const void* data, size_t len,
+                                int timeout_ms, send_callback_t callback, void* context) {
+    int type_id;
+    P2PBuffer* frames = p2p_network_encode(network, type, data, len, &type_id);
+    if (!frames) return 0;
+    int count;
+    char (*addresses)[128] = p2p_network_peer_addresses(network, &count);
+    if (!addresses) {
+        p2p_buffer_release(frames);
+        return 0;
+    }
+    
+    int queued_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (p2p_network_submit_async(network, addresses[i], p2p_buffer_retain(frames), type_id, timeout_ms,
+                                     callback, context) == 0) {
+            queued_count++;
+        }
+    }
+    free(addresses);
+    p2p_buffer_release(frames);
+    
+    P2P_DEBUG("Queued broadcast of %s for %d peers", type, queued_count);
+    return queued_count;
+}
+
+// Collect completions of async sends made without a callback
+int p2p_network_poll_completions(P2PNetwork* network, P2PSendCompletion* out, int max, int timeout_ms) {
+    return p2p_completion_queue_poll(&network->completions, out, max, timeout_ms);
+}
+
+// Readable while completions are waiting
+int p2p_network_completion_fd(P2PNetwork* network) {
+    return network->completions.fd;
+}
+
 // Connect to a peer
 int p2p_network_connect(P2PNetwork* network, const char* address) {
-    printf("Connecting to: %s\n", address);
+    P2P_INFO("Connecting to: %s", address);
     
-    // Add target peer to our peer list
+    // Add target peer to our peer list; connecting on purpose overrides an
+    // old verdict, so stop gossiping it dead
+    p2p_peer_list_lock(network->peer_list);
     p2p_peer_list_add(network->peer_list, address, network->node_id);
+    p2p_swim_heard(&network->swim, address);
     
     // Build our peer list string
-    char peer_list_str[1024];
+    char peer_list_str[P2P_PEER_LIST_STR_SIZE];
     p2p_build_peer_list_string(network->peer_list, peer_list_str, sizeof(peer_list_str));
     
     // Send discovery message to all peers
+    P2PBuffer* frame = p2p_network_encode_discovery(network, 3, peer_list_str);
+    if (!frame) {
+        p2p_peer_list_unlock(network->peer_list);
+        return 0;
+    }
     struct Node* current = network->peer_list->peer_list.head;
     int sent_count = 0;
     
     while (current != NULL) {
         P2PPeer* peer = (P2PPeer*)current->data;
-        printf("Sending discovery to peer: %s\n", peer->address);
-        if (p2p_network_send_discovery(network, peer->address, 3, peer_list_str) == 0) {
+        P2P_DEBUG("Sending discovery to peer: %s", peer->address);
+        if (p2p_network_queue_discovery(network, peer->address, p2p_buffer_retain(frame), 3) == 0) {
             sent_count++;
         }
         current = current->next;
     }
+    p2p_peer_list_unlock(network->peer_list);
+    p2p_buffer_release(frame);
     
-    printf("Sent discovery to %d peers\n", sent_count);
+    P2P_INFO("Sent discovery to %d peers", sent_count);
     return sent_count;
 }
 
-// Stop network
+// Stop listening and close inbound connections
 void p2p_network_stop(P2PNetwork* network) {
-    (void)network;
-    // Implementation for graceful shutdown
+    if (network->runtime) {
+        p2p_runtime_unwatch(network->runtime, network);
+    }
 }
 
 // Free network
 void p2p_network_free(P2PNetwork* network) {
+    // Take the sockets off the reactor, let the worker finish the frames
+    // already queued for this network, then close the links it sent on
+    if (network->runtime) {
+        p2p_runtime_unwatch(network->runtime, network);
+        if (network->worker.worker) {
+            p2p_runtime_leave(network->runtime, &network->worker);
+        }
+    }
+    for (int i = 0; i < network->links.length; i++) {
+        p2p_link_destroy(((P2PLinkIndexEntry*)network->links.retrieve(&network->links, i))->link);
+    }
+    if (network->runtime && network->owns_runtime) {
+        p2p_runtime_free(network->runtime);
+    }
+    sorted_vector_destructor(&network->links);
+    pthread_mutex_destroy(&network->links_lock);
+    p2p_completion_queue_destroy(&network->completions);
+    p2p_reassembler_destroy(&network->reassembler);
+    p2p_registry_destroy(&network->types);
+    p2p_arena_destroy(&network->receive_arena);
+    free(network->admission);
     if (network->peer_list) {
         p2p_peer_list_free(network->peer_list);
     }
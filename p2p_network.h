@@ -9,27 +9,191 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include "p2p_message.h"
 #include "p2p_peer.h"
+#include "p2p_stream.h"
+#include "p2p_registry.h"
+#include "p2p_link.h"
+#include "p2p_arena.h"
+#include "p2p_transport.h"
+#include "p2p_runtime.h"
+#include "p2p_admission.h"
+#include "p2p_swim.h"
+#include "p2p_completion.h"
+#include "DataStructures/Lists/SortedVector.h"
+#include "DataStructures/Lists/RingQueue.h"
 
-// Network configuration
+// Inbound connections one network keeps open at once
+#define P2P_MAX_CONNECTIONS 1024
+
+// Address index entry for outbound links
 typedef struct {
+    const char* address;    // Points into the link
+    P2PLink* link;
+} P2PLinkIndexEntry;
+
+// Sees every message delivered to a network, after its handler
+typedef void (*message_tap_t)(void* context, P2PMessage* msg);
+
+// Receive state for one sender (opaque outside p2p_network.c)
+typedef struct P2PConnection P2PConnection;
+
+// Network configuration
+typedef struct P2PNetwork {
     int port;
     char node_id[64];
     P2PPeerList* peer_list;
-    message_handler_t message_handler;
+    message_handler_t message_handler;  // Default for types without a registered handler
+    P2PFlowPolicy flow_policy;          // What sends do when a peer is out of credit
+    P2PTypeRegistry types;              // Interned type names and per-type handlers
+    P2PReassembler reassembler;     // Incoming fragmented messages (bulk worker only)
+    atomic_ulong next_msg_id;       // Id of the next fragmented message we send
+    P2PRuntime* runtime;            // Reactor and worker this network's sockets and handlers run on
+    int owns_runtime;               // Created by p2p_network_start, freed with the network
+    P2PWatch listener;              // Listening socket on the reactor (fd -1 until started)
+    P2PWorkerClient worker;         // The runtime worker bulk frames go to (control frames never do)
+    int connection_count;           // Inbound connections open (reactor only)
+    struct SortedVector links;      // Outbound links by address (P2PLinkIndexEntry)
+    pthread_mutex_t links_lock;
+    int store_forward;              // Whether new links spool for unreachable peers
+    P2PSpoolConfig spool_config;    // path is the directory for spool files
+    P2PTransport* transport;        // NULL for sockets (links and the server reactor)
+    P2PArena receive_arena;         // Scratch for p2p_network_receive
+    _Atomic(message_tap_t) tap;     // Optional, called with every delivered message
+    void* tap_context;
+    atomic_int tap_calls;           // Deliveries that may be using the tap
+    P2PAdmission* admission;        // Inbound limits (NULL admits everything)
+    P2PSwim swim;                   // Failure detector (reactor only)
+    P2PWatch swim_timer;            // timerfd that ticks it (fd -1 unless detection is on)
+    P2PCompletionQueue completions; // Outcomes of async sends made without a callback
 } P2PNetwork;
 
 // Create network
 P2PNetwork* p2p_network_create(int port, const char* node_id, message_handler_t handler);
 
-// Start network (starts server thread)
+// Start network (starts listening on the network's runtime, then connects
+// to the peers saved from the last run). -1 if the port cannot be bound.
 int p2p_network_start(P2PNetwork* network);
 
-// Send message to specific address
+// Run this network on a shared runtime instead of a reactor and worker of
+// its own. Call before p2p_network_start and before anything is sent (a
+// send creates the private runtime); the runtime must outlive the network.
+void p2p_network_set_runtime(P2PNetwork* network, P2PRuntime* runtime);
+
+// Register a handler for one message type (replaces any previous one).
+// Returns the type's interned id, or -1 if the type table is full.
+int p2p_network_register_handler(P2PNetwork* network, const char* type, message_handler_t handler);
+
+// Register an RPC handler for one request type (replaces any previous one).
+// Returns the type's interned id, or -1 if the type table is full.
+int p2p_network_register_rpc_handler(P2PNetwork* network, const char* type, rpc_handler_t handler);
+
+// Call tap with every message delivered, whatever its type, after the
+// message's handler and on the same thread. May be called while the
+// network runs: once it returns, no call to the previous tap is still in
+// progress (so it must not be called from a tap).
+void p2p_network_set_tap(P2PNetwork* network, message_tap_t tap, void* context);
+
+// Shed inbound traffic over the limits in config (see p2p_admission.h);
+// NULL admits everything, the default. Call before p2p_network_start.
+// Returns -1 on allocation failure.
+int p2p_network_set_admission(P2PNetwork* network, const P2PAdmissionConfig* config);
+
+// Probe peers and remove the ones that fail (see p2p_swim.h); NULL turns
+// detection off, the default. Every network answers probes either way.
+// Call before p2p_network_start. Networks on a transport probe only if it
+// has a clock (see P2PTransport.now_ms), as the simulator does.
+void p2p_network_set_failure_detection(P2PNetwork* network, const P2PSwimConfig* config);
+
+// Open a TCP connection to an IP:PORT address, -1 on failure
+int p2p_network_dial(const char* address);
+
+// Start a non-blocking TCP connection to an IP:PORT address: the socket,
+// with *pending set while the connect is still in progress (wait for
+// POLLOUT, then check SO_ERROR), or -1 on failure
+int p2p_network_dial_nonblocking(const char* address, int* pending);
+
+// Move this network's traffic onto a transport instead of sockets. Call
+// before p2p_network_start.
+void p2p_network_set_transport(P2PNetwork* network, P2PTransport* transport);
+
+// Open a connection for the frames a transport delivers from one sender.
+// Replies written on it go to transport->reply with context.
+P2PConnection* p2p_network_open_connection(P2PNetwork* network, P2PTransport* transport, void* context);
+
+// Handle whole frames that arrived on a transport connection, in order and
+// on the caller's thread (handlers run before this returns). -1 if a frame
+// was malformed; the frames before it were handled.
+int p2p_network_receive(P2PNetwork* network, P2PConnection* conn, const void* data, size_t len);
+
+// Close a connection from p2p_network_open_connection
+void p2p_network_close_connection(P2PConnection* conn);
+
+// Send message to specific address. Application data travels on the bulk
+// lane of the peer's link; this returns once it has been written.
 int p2p_network_send(P2PNetwork* network, const char* address, const char* type, const char* data);
 
-// Send discovery message
+// Send a binary payload of any size to a specific address. Payloads larger
+// than P2P_MESSAGE_DATA_MAX are split into fragments and reassembled by the
+// receiver before they reach its message handler. Returns 0 on success, -1
+// on failure, P2P_SEND_BACKPRESSURE when the flow policy refused to wait,
+// or P2P_SEND_TIMEOUT when P2P_FLOW_BLOCK waited P2P_LINK_BLOCK_TIMEOUT_MS
+// for the peer to take it.
+//
+// Handlers must not send with P2P_FLOW_BLOCK: the receiver grants credit
+// only once its worker has handled the frames, so handlers blocking on
+// each other stall every network on both workers until the sends time out.
+// Use p2p_network_send_async from a handler instead.
+int p2p_network_send_bytes(P2PNetwork* network, const char* address, const char* type, const void* data, size_t len);
+
+// Queue a binary payload for address and return at once, whatever the flow
+// policy. The outcome is reported exactly once, with a send_callback_t
+// status (P2P_SEND_TIMEOUT if none of it was written within timeout_ms;
+// 0 = no limit): to callback(context, status) on the runtime's reactor,
+// which it must not block (on the calling thread, before this returns,
+// with a transport), or, with
+// callback NULL, as a completion for p2p_network_poll_completions. Returns
+// 0 if queued, P2P_SEND_BACKPRESSURE if the link already holds
+// P2P_LINK_MAX_BACKLOG bytes or its queue is full, -1 on failure; nothing
+// is reported unless 0 is returned.
+int p2p_network_send_async(P2PNetwork* network, const char* address, const char* type, const void* data,
+                           size_t len, int timeout_ms, send_callback_t callback, void* context);
+
+// p2p_network_send_async to every peer, encoded once. The outcome is
+// reported once per peer queued; returns how many were.
+int p2p_network_broadcast_async(P2PNetwork* network, const char* type, const void* data, size_t len,
+                                int timeout_ms, send_callback_t callback, void* context);
+
+// Collect up to max completions of async sends made without a callback,
+// waiting up to timeout_ms for the first (0 = don't wait, -1 = no limit).
+// Returns how many were written to out.
+int p2p_network_poll_completions(P2PNetwork* network, P2PSendCompletion* out, int max, int timeout_ms);
+
+// Descriptor that polls readable while completions are waiting
+int p2p_network_completion_fd(P2PNetwork* network);
+
+// Choose what sends do when a peer has no credit left (default P2P_FLOW_BLOCK)
+void p2p_network_set_flow_policy(P2PNetwork* network, P2PFlowPolicy policy);
+
+// Hold bulk messages for peers that cannot be reached instead of failing
+// them: up to memory_limit bytes per peer in memory, then disk_limit more
+// in a spool file under directory, each dropped after max_age_ms (0 keeps
+// them until sent). Applies to links created afterwards, so call it before
+// p2p_network_start. Sends that are spooled return 0.
+void p2p_network_set_store_forward(P2PNetwork* network, const char* directory, size_t memory_limit,
+                                   size_t disk_limit, long max_age_ms);
+
+// Bulk bytes that can be sent to address right now without waiting for the
+// peer. Negative once more is queued than the peer's window allows.
+long p2p_network_send_capacity(P2PNetwork* network, const char* address);
+
+// Register a handler that sees every chunk of a fragmented message as it
+// arrives. With reassemble == 0, whole messages are no longer buffered and
+// the chunk handler is the only consumer of large payloads.
+void p2p_network_set_chunk_handler(P2PNetwork* network, chunk_handler_t handler, int reassemble);
+
+// Queue a discovery message on the peer's control lane (does not wait)
 int p2p_network_send_discovery(P2PNetwork* network, const char* address, int ttl, const char* peer_list);
 
 // Broadcast message to all peers
@@ -38,7 +202,7 @@ int p2p_network_broadcast(P2PNetwork* network, const char* type, const char* dat
 // Connect to a peer
 int p2p_network_connect(P2PNetwork* network, const char* address);
 
-// Stop network
+// Stop listening and close inbound connections (outbound links stay up)
 void p2p_network_stop(P2PNetwork* network);
 
 // Free network
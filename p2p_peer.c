@@ -1,42 +1,83 @@
 #include "p2p_peer.h"
+#include "p2p_log.h"
+#include "p2p_metrics.h"
 #include <unistd.h>
 
+// Order index entries by address
+static int p2p_peer_index_compare(void* a, void* b) {
+    return strcmp(((P2PPeerIndexEntry*)a)->address, ((P2PPeerIndexEntry*)b)->address);
+}
+
+// Append a peer to the list and index it by address
+static P2PPeer* p2p_peer_list_append(P2PPeerList* list, const char* address) {
+    P2PPeer new_peer;
+    strncpy(new_peer.address, address, 127);
+    new_peer.address[127] = '\0';
+    new_peer.last_seen = time(NULL);
+    new_peer.state = P2P_PEER_ALIVE;
+    new_peer.incarnation = 0;
+    new_peer.state_ms = 0;
+    new_peer.transmits = 0;
+    
+    // The peer is copied inline into its pooled node
+    int length = list->peer_list.length;
+    list->peer_list.append(&list->peer_list, &new_peer, sizeof(P2PPeer));
+    if (list->peer_list.length == length) return NULL;
+    
+    P2PPeer* peer = (P2PPeer*)list->peer_list.tail->data;
+    P2PPeerIndexEntry entry = { peer->address, peer };
+    list->address_index.insert(&list->address_index, &entry);
+    p2p_metrics_gauge_add(P2P_GAUGE_PEERS, 1);
+    return peer;
+}
+
 // Create peer list
 P2PPeerList* p2p_peer_list_create() {
     P2PPeerList* list = malloc(sizeof(P2PPeerList));
     if (!list) return NULL;
     
     list->peer_list = linked_list_constructor();
+    list->peer_pool = pool_constructor(node_block_size(sizeof(P2PPeer)), P2P_PEER_POOL_SLAB);
+    list->peer_list.pool = &list->peer_pool;
+    list->address_index = sorted_vector_constructor(sizeof(P2PPeerIndexEntry), p2p_peer_index_compare);
+    list->persist = 1;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&list->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
     return list;
 }
 
+// Hold the list still
+void p2p_peer_list_lock(P2PPeerList* list) {
+    pthread_mutex_lock(&list->lock);
+}
+
+void p2p_peer_list_unlock(P2PPeerList* list) {
+    pthread_mutex_unlock(&list->lock);
+}
+
 // Add peer to list (with duplicate checking)
 int p2p_peer_list_add(P2PPeerList* list, const char* address, const char* node_id) {
-    // Check if peer already exists in file (source of truth)
-    if (p2p_peer_exists_in_file(address, node_id)) {
-        printf("Peer %s already exists in file, skipping\n", address);
-        return 0;  // Already exists
+    pthread_mutex_lock(&list->lock);
+    // Cheap in-memory check first
+    if (p2p_peer_list_find(list, address) != NULL) {
+        pthread_mutex_unlock(&list->lock);
+        return 0;  // Already exists in memory
     }
     
-    struct Node* current = list->peer_list.head;
-    while (current != NULL) {
-        P2PPeer* existing_peer = (P2PPeer*)current->data;
-        if (strcmp(existing_peer->address, address) == 0) {
-            return 0;  // Already exists in memory
-        }
-        current = current->next;
-    }
-    
-    // Create new peer
-    P2PPeer* new_peer = malloc(sizeof(P2PPeer));
-    if (!new_peer) return -1;
-    
-    strncpy(new_peer->address, address, 127);
-    new_peer->address[127] = '\0';
-    new_peer->last_seen = time(NULL);
+    // The file only needs the peer once; a peer removed as dead is still there
+    int in_file = list->persist && p2p_peer_exists_in_file(address, node_id);
     
     // Add to peer list
-    list->peer_list.insert(&list->peer_list, list->peer_list.length, new_peer, sizeof(P2PPeer));
+    P2PPeer* peer = p2p_peer_list_append(list, address);
+    pthread_mutex_unlock(&list->lock);
+    if (peer == NULL) return -1;
+    if (!list->persist || in_file) {
+        P2P_INFO("Added peer %s", address);
+        return 1;
+    }
     
     // Persist peer to file for bootstrapping
     char filename[64];
@@ -51,12 +92,12 @@ int p2p_peer_list_add(P2PPeerList* list, const char* address, const char* node_i
     if (peer_file != NULL) {
         fprintf(peer_file, "%s\n", address);
         fclose(peer_file);
-        printf("Persisted peer %s to file %s\n", address, filename);
+        P2P_DEBUG("Persisted peer %s to file %s", address, filename);
     } else {
-        printf("Error: Could not create or open %s file\n", filename);
+        P2P_ERROR("Error: Could not create or open %s file", filename);
     }
     
-    printf("Added peer %s\n", address);
+    P2P_INFO("Added peer %s", address);
     return 1;  // Successfully added
 }
 
@@ -67,7 +108,7 @@ int p2p_peer_list_load_from_file(P2PPeerList* list, const char* node_id) {
     
     FILE* peer_file = fopen(filename, "r");
     if (peer_file == NULL) {
-        printf("No existing peer file found: %s\n", filename);
+        P2P_INFO("No existing peer file found: %s", filename);
         return 0;  // No file to load from
     }
     
@@ -82,21 +123,13 @@ int p2p_peer_list_load_from_file(P2PPeerList* list, const char* node_id) {
         if (strlen(line) == 0) continue;
         
         // Add peer to in-memory list (without file persistence since it's already in file)
-        P2PPeer* new_peer = malloc(sizeof(P2PPeer));
-        if (!new_peer) continue;
-        
-        strncpy(new_peer->address, line, 127);
-        new_peer->address[127] = '\0';
-        new_peer->last_seen = time(NULL);
-        
-        // Add to peer list
-        list->peer_list.insert(&list->peer_list, list->peer_list.length, new_peer, sizeof(P2PPeer));
+        if (p2p_peer_list_append(list, line) == NULL) continue;
         loaded_count++;
-        printf("Loaded peer from file: %s\n", line);
+        P2P_DEBUG("Loaded peer from file: %s", line);
     }
     
     fclose(peer_file);
-    printf("Loaded %d peers from file %s\n", loaded_count, filename);
+    P2P_INFO("Loaded %d peers from file %s", loaded_count, filename);
     return loaded_count;
 }
 
@@ -127,49 +160,56 @@ int p2p_peer_exists_in_file(const char* address, const char* node_id) {
 
 // Remove peer from list
 int p2p_peer_list_remove(P2PPeerList* list, const char* address) {
+    pthread_mutex_lock(&list->lock);
     struct Node* current = list->peer_list.head;
     int index = 0;
     
     while (current != NULL) {
         P2PPeer* peer = (P2PPeer*)current->data;
         if (strcmp(peer->address, address) == 0) {
+            P2PPeerIndexEntry key = { address, NULL };
+            list->address_index.remove(&list->address_index, list->address_index.search(&list->address_index, &key));
+            // Removing the node also releases the peer stored in it
             list->peer_list.remove(&list->peer_list, index);
-            free(peer);
+            p2p_metrics_gauge_add(P2P_GAUGE_PEERS, -1);
+            pthread_mutex_unlock(&list->lock);
             return 1;  // Successfully removed
         }
         current = current->next;
         index++;
     }
     
+    pthread_mutex_unlock(&list->lock);
     return 0;  // Not found
 }
 
 // Find peer by address
 P2PPeer* p2p_peer_list_find(P2PPeerList* list, const char* address) {
-    struct Node* current = list->peer_list.head;
-    
-    while (current != NULL) {
-        P2PPeer* peer = (P2PPeer*)current->data;
-        if (strcmp(peer->address, address) == 0) {
-            return peer;
-        }
-        current = current->next;
+    P2PPeerIndexEntry key = { address, NULL };
+    pthread_mutex_lock(&list->lock);
+    int index = list->address_index.search(&list->address_index, &key);
+    P2PPeer* peer = NULL;
+    if (index >= 0) {
+        peer = ((P2PPeerIndexEntry*)list->address_index.retrieve(&list->address_index, index))->peer;
     }
-    
-    return NULL;  // Not found
+    pthread_mutex_unlock(&list->lock);
+    return peer;  // NULL if not found
 }
 
 // List all peers
 void p2p_peer_list_print(P2PPeerList* list) {
+    static const char* states[] = { "alive", "suspect", "dead" };
+    pthread_mutex_lock(&list->lock);
     printf("Known peers (%d):\n", list->peer_list.length);
     struct Node* current = list->peer_list.head;
     int index = 0;
     while (current != NULL) {
         P2PPeer* peer = (P2PPeer*)current->data;
-        printf("  %d: %s\n", index, peer->address);
+        printf("  %d: %s (%s)\n", index, peer->address, states[peer->state]);
         current = current->next;
         index++;
     }
+    pthread_mutex_unlock(&list->lock);
 }
 
 // Get peer count
@@ -179,13 +219,12 @@ int p2p_peer_list_count(P2PPeerList* list) {
 
 // Free peer list
 void p2p_peer_list_free(P2PPeerList* list) {
-    // Free all peers
-    struct Node* current = list->peer_list.head;
-    while (current != NULL) {
-        P2PPeer* peer = (P2PPeer*)current->data;
-        free(peer);
-        current = current->next;
-    }
+    // Free all peers, then the slabs that backed them
+    p2p_metrics_gauge_add(P2P_GAUGE_PEERS, -list->peer_list.length);
+    sorted_vector_destructor(&list->address_index);
+    linked_list_destructor(&list->peer_list);
+    pool_destructor(&list->peer_pool);
+    pthread_mutex_destroy(&list->lock);
     
     free(list);
 }
@@ -5,23 +5,57 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "DataStructures/Lists/LinkedList.h"
+#include "DataStructures/Lists/SortedVector.h"
+#include "DataStructures/Common/Pool.h"
+
+// Number of peer nodes carved from each pool slab
+#define P2P_PEER_POOL_SLAB 64
+
+// Failure detector state of a peer (peers confirmed dead leave the list)
+typedef enum {
+    P2P_PEER_ALIVE = 0,
+    P2P_PEER_SUSPECT,
+    P2P_PEER_DEAD
+} P2PPeerState;
 
 // Peer structure
 typedef struct {
     char address[128];  // IP:PORT
     time_t last_seen;   // Last time we heard from this peer
+    P2PPeerState state;
+    uint64_t incarnation;   // Highest incarnation heard for the peer (see p2p_swim.h)
+    long long state_ms;     // When state last changed (monotonic milliseconds)
+    int transmits;          // Times the current state has been gossiped
 } P2PPeer;
 
+// Address index entry (sorted by address for O(log N) lookups)
+typedef struct {
+    const char* address;
+    P2PPeer* peer;
+} P2PPeerIndexEntry;
+
 // Peer list structure
 typedef struct {
     struct LinkedList peer_list;
+    struct Pool peer_pool;              // Backs each node and its P2PPeer in one block
+    struct SortedVector address_index;  // P2PPeerIndexEntry for every peer in peer_list
+    int persist;                        // Whether adds check and extend the node's peer file (default 1)
+    pthread_mutex_t lock;               // Recursive; hold it to walk the list or keep a P2PPeer pointer
 } P2PPeerList;
 
 // Create peer list
 P2PPeerList* p2p_peer_list_create();
 
-// Add peer to list (with duplicate checking)
+// Hold the list still while walking it or using a peer it returned
+void p2p_peer_list_lock(P2PPeerList* list);
+void p2p_peer_list_unlock(P2PPeerList* list);
+
+// Add peer to list (with duplicate checking). Returns 1 if it was added,
+// 0 if it was already there; a peer in the file but no longer in memory
+// (removed as dead) comes back without being written twice.
 int p2p_peer_list_add(P2PPeerList* list, const char* address, const char* node_id);
 
 // Load peers from file into in-memory list
@@ -0,0 +1,85 @@
+#include "p2p_registry.h"
+
+// FNV-1a over the type name
+static uint32_t p2p_registry_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* c = (const unsigned char*)name; *c; c++) {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Initialize an empty registry
+void p2p_registry_init(P2PTypeRegistry* registry) {
+    memset(registry->names, 0, sizeof(registry->names));
+    memset(registry->handlers, 0, sizeof(registry->handlers));
+    memset(registry->rpc_handlers, 0, sizeof(registry->rpc_handlers));
+    registry->count = 0;
+    for (int i = 0; i < P2P_REGISTRY_SLOTS; i++) {
+        registry->slots[i] = -1;
+    }
+    pthread_mutex_init(&registry->lock, NULL);
+}
+
+// Probe for a name; returns its slot (holding the id, or -1 where it would go)
+static int p2p_registry_slot(P2PTypeRegistry* registry, const char* name) {
+    uint32_t slot = p2p_registry_hash(name) & (P2P_REGISTRY_SLOTS - 1);
+    while (registry->slots[slot] >= 0 && strcmp(registry->names[registry->slots[slot]], name) != 0) {
+        slot = (slot + 1) & (P2P_REGISTRY_SLOTS - 1);
+    }
+    return slot;
+}
+
+// Intern a type name: returns its id, or -1 if the registry is full
+int p2p_registry_intern(P2PTypeRegistry* registry, const char* name) {
+    if (name[0] == '\0' || strlen(name) > 31) return -1;
+
+    pthread_mutex_lock(&registry->lock);
+    int slot = p2p_registry_slot(registry, name);
+    int id = registry->slots[slot];
+    if (id < 0 && registry->count < P2P_MAX_TYPES) {
+        id = registry->count++;
+        strcpy(registry->names[id], name);
+        registry->slots[slot] = id;
+    }
+    pthread_mutex_unlock(&registry->lock);
+    return id;
+}
+
+// Look up an id without interning: -1 if the name is unknown
+int p2p_registry_find(P2PTypeRegistry* registry, const char* name) {
+    pthread_mutex_lock(&registry->lock);
+    int id = registry->slots[p2p_registry_slot(registry, name)];
+    pthread_mutex_unlock(&registry->lock);
+    return id;
+}
+
+// Name of an interned id (NULL if out of range)
+const char* p2p_registry_name(P2PTypeRegistry* registry, int id) {
+    if (id < 0 || id >= P2P_MAX_TYPES || registry->names[id][0] == '\0') return NULL;
+    return registry->names[id];
+}
+
+// Register a handler for a type name: returns the type id, -1 if full
+int p2p_registry_set_handler(P2PTypeRegistry* registry, const char* name, message_handler_t handler) {
+    int id = p2p_registry_intern(registry, name);
+    if (id >= 0) {
+        registry->handlers[id] = handler;
+    }
+    return id;
+}
+
+// Register an RPC handler for a type name: returns the type id, -1 if full
+int p2p_registry_set_rpc_handler(P2PTypeRegistry* registry, const char* name, rpc_handler_t handler) {
+    int id = p2p_registry_intern(registry, name);
+    if (id >= 0) {
+        registry->rpc_handlers[id] = handler;
+    }
+    return id;
+}
+
+// Destroy registry
+void p2p_registry_destroy(P2PTypeRegistry* registry) {
+    pthread_mutex_destroy(&registry->lock);
+}
@@ -0,0 +1,60 @@
+#ifndef P2P_REGISTRY_H
+#define P2P_REGISTRY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "p2p_message.h"
+
+// Maximum number of distinct message types per network
+#define P2P_MAX_TYPES 256
+
+// Hash slots for name lookups (power of two, at least twice P2P_MAX_TYPES)
+#define P2P_REGISTRY_SLOTS 512
+
+// Message type registry. Type names are interned to small integer ids
+// (0 .. P2P_MAX_TYPES-1) so the wire can carry an id instead of a string
+// and dispatch is an array index instead of a chain of strcmp calls.
+typedef struct {
+    char names[P2P_MAX_TYPES][32];
+    message_handler_t handlers[P2P_MAX_TYPES];  // NULL falls back to the network's default handler
+    rpc_handler_t rpc_handlers[P2P_MAX_TYPES];  // NULL answers requests with P2P_RPC_NO_HANDLER
+    int count;
+    int16_t slots[P2P_REGISTRY_SLOTS];          // Open-addressed name -> id table (-1 = empty)
+    pthread_mutex_t lock;                       // Serializes interning; lookups by id are lock-free
+} P2PTypeRegistry;
+
+// Initialize an empty registry
+void p2p_registry_init(P2PTypeRegistry* registry);
+
+// Intern a type name: returns its id, or -1 if the registry is full
+int p2p_registry_intern(P2PTypeRegistry* registry, const char* name);
+
+// Look up an id without interning: -1 if the name is unknown
+int p2p_registry_find(P2PTypeRegistry* registry, const char* name);
+
+// Name of an interned id (NULL if out of range)
+const char* p2p_registry_name(P2PTypeRegistry* registry, int id);
+
+// Register a handler for a type name: returns the type id, -1 if full
+int p2p_registry_set_handler(P2PTypeRegistry* registry, const char* name, message_handler_t handler);
+
+// Register an RPC handler for a type name: returns the type id, -1 if full
+int p2p_registry_set_rpc_handler(P2PTypeRegistry* registry, const char* name, rpc_handler_t handler);
+
+// Handler for an id (NULL if none was registered)
+static inline message_handler_t p2p_registry_handler(P2PTypeRegistry* registry, int id) {
+    return (id >= 0 && id < P2P_MAX_TYPES) ? registry->handlers[id] : NULL;
+}
+
+// RPC handler for an id (NULL if none was registered)
+static inline rpc_handler_t p2p_registry_rpc_handler(P2PTypeRegistry* registry, int id) {
+    return (id >= 0 && id < P2P_MAX_TYPES) ? registry->rpc_handlers[id] : NULL;
+}
+
+// Destroy registry
+void p2p_registry_destroy(P2PTypeRegistry* registry);
+
+#endif
@@ -0,0 +1,287 @@
+#include "p2p_rpc.h"
+#include "p2p_log.h"
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+// Longest the reader sleeps between timeout checks (milliseconds)
+#define P2P_RPC_POLL_INTERVAL 1000
+
+// Monotonic clock in milliseconds
+static long long p2p_rpc_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Remove a pending call and run its callback (no-op if it already completed)
+static void p2p_rpc_complete(P2PRpcClient* client, uint64_t call_id, int status, const void* data, size_t len) {
+    pthread_mutex_lock(&client->lock);
+    P2PRpcPending* slot = &client->pending[call_id & (P2P_RPC_MAX_PENDING - 1)];
+    if (call_id == 0 || slot->call_id != call_id) {
+        // Late response for a call that already timed out
+        pthread_mutex_unlock(&client->lock);
+        return;
+    }
+    rpc_callback_t callback = slot->callback;
+    void* context = slot->context;
+    slot->call_id = 0;
+    client->pending_count--;
+    pthread_mutex_unlock(&client->lock);
+
+    callback(context, status, data, len);
+}
+
+// Fail calls whose deadline has passed (every pending call when now < 0)
+static void p2p_rpc_expire(P2PRpcClient* client, long long now, int status) {
+    pthread_mutex_lock(&client->lock);
+    if (now >= 0 && now < client->next_expiry) {
+        pthread_mutex_unlock(&client->lock);
+        return;
+    }
+
+    long long next_expiry = LLONG_MAX;
+    for (int i = 0; i < P2P_RPC_MAX_PENDING; i++) {
+        P2PRpcPending* slot = &client->pending[i];
+        if (slot->call_id == 0) continue;
+        if (now >= 0 && slot->deadline > now) {
+            if (slot->deadline < next_expiry) next_expiry = slot->deadline;
+            continue;
+        }
+
+        // Callbacks run without the lock held
+        uint64_t call_id = slot->call_id;
+        pthread_mutex_unlock(&client->lock);
+        p2p_rpc_complete(client, call_id, status, NULL, 0);
+        pthread_mutex_lock(&client->lock);
+    }
+    client->next_expiry = next_expiry;
+    pthread_mutex_unlock(&client->lock);
+}
+
+// Reader thread: matches responses to pending calls and enforces timeouts
+static void* p2p_rpc_reader_thread(void* arg) {
+    P2PRpcClient* client = (P2PRpcClient*)arg;
+
+    uint8_t* buf = malloc(P2P_WIRE_MAX_FRAME);
+    if (!buf) {
+        p2p_rpc_expire(client, -1, P2P_RPC_CLOSED);
+        return NULL;
+    }
+    P2PWireStream stream;
+    p2p_wire_stream_init(&stream, client->sock, buf, P2P_WIRE_MAX_FRAME);
+
+    while (1) {
+        // Sleep until data arrives or the next call is due to time out
+        pthread_mutex_lock(&client->lock);
+        long long wait = client->next_expiry - p2p_rpc_now_ms();
+        int closed = client->closed;
+        pthread_mutex_unlock(&client->lock);
+        if (closed) break;
+        if (wait < 0) wait = 0;
+        if (wait > P2P_RPC_POLL_INTERVAL) wait = P2P_RPC_POLL_INTERVAL;
+
+        struct pollfd pfd = { client->sock, POLLIN, 0 };
+        int ready = poll(&pfd, 1, (int)wait);
+        if (ready < 0 && errno != EINTR) break;
+
+        if (ready > 0) {
+            if (p2p_wire_stream_fill(&stream) <= 0) break;
+
+            P2PFrame frame;
+            int status;
+            while ((status = p2p_wire_stream_take(&stream, &frame)) > 0) {
+                P2PRpcResponse response;
+                if (frame.kind == P2P_FRAME_RESPONSE && p2p_wire_decode_response(&frame, &response) == 0) {
+                    p2p_rpc_complete(client, response.call_id, response.status, response.payload, response.len);
+                }
+            }
+            if (status < 0) break;
+        }
+
+        p2p_rpc_expire(client, p2p_rpc_now_ms(), P2P_RPC_TIMEOUT);
+    }
+
+    // Connection gone: nothing outstanding can complete any more
+    pthread_mutex_lock(&client->lock);
+    client->closed = 1;
+    pthread_mutex_unlock(&client->lock);
+    p2p_rpc_expire(client, -1, P2P_RPC_CLOSED);
+    free(buf);
+    return NULL;
+}
+
+// Open a persistent RPC connection to address
+P2PRpcClient* p2p_rpc_connect(P2PNetwork* network, const char* address) {
+    P2PRpcClient* client = malloc(sizeof(P2PRpcClient));
+    if (!client) return NULL;
+    memset(client, 0, sizeof(P2PRpcClient));
+
+    client->network = network;
+    strncpy(client->address, address, sizeof(client->address) - 1);
+    client->next_call_id = 1;
+    client->next_expiry = LLONG_MAX;
+    pthread_mutex_init(&client->lock, NULL);
+    pthread_mutex_init(&client->write_lock, NULL);
+
+    client->sock = p2p_network_dial(address);
+    if (client->sock < 0) {
+        P2P_ERROR("Failed to open RPC connection to %s", address);
+        pthread_mutex_destroy(&client->lock);
+        pthread_mutex_destroy(&client->write_lock);
+        free(client);
+        return NULL;
+    }
+    p2p_metrics_gauge_add(P2P_GAUGE_SOCKETS, 1);
+
+    if (pthread_create(&client->reader, NULL, p2p_rpc_reader_thread, client) != 0) {
+        close(client->sock);
+        p2p_metrics_gauge_add(P2P_GAUGE_SOCKETS, -1);
+        pthread_mutex_destroy(&client->lock);
+        pthread_mutex_destroy(&client->write_lock);
+        free(client);
+        return NULL;
+    }
+    return client;
+}
+
+// Issue a call without waiting
+long long p2p_rpc_call_async(P2PRpcClient* client, const char* type, const void* data, size_t len,
+                             int timeout_ms, rpc_callback_t callback, void* context) {
+    if (len > P2P_WIRE_MAX_RPC_PAYLOAD) return -1;
+
+    int type_id = p2p_registry_intern(&client->network->types, type);
+    if (type_id < 0) return -1;
+    if (timeout_ms <= 0) timeout_ms = P2P_RPC_DEFAULT_TIMEOUT;
+
+    // Claim a slot; ids keep increasing so a late response never matches a newer call
+    pthread_mutex_lock(&client->lock);
+    if (client->closed || client->pending_count == P2P_RPC_MAX_PENDING) {
+        pthread_mutex_unlock(&client->lock);
+        return -1;
+    }
+    while (client->pending[client->next_call_id & (P2P_RPC_MAX_PENDING - 1)].call_id != 0) {
+        client->next_call_id++;
+    }
+    uint64_t call_id = client->next_call_id++;
+    P2PRpcPending* slot = &client->pending[call_id & (P2P_RPC_MAX_PENDING - 1)];
+    slot->call_id = call_id;
+    slot->callback = callback;
+    slot->context = context;
+    slot->deadline = p2p_rpc_now_ms() + timeout_ms;
+    if (slot->deadline < client->next_expiry) client->next_expiry = slot->deadline;
+    client->pending_count++;
+    pthread_mutex_unlock(&client->lock);
+
+    P2PRpcRequest request;
+    request.call_id = call_id;
+    request.type_id = type_id;
+    strncpy(request.sender, client->network->node_id, sizeof(request.sender) - 1);
+    request.sender[sizeof(request.sender) - 1] = '\0';
+    request.payload = data;
+    request.len = len;
+
+    uint8_t frame[P2P_WIRE_MAX_FRAME + P2P_WIRE_MAX_MESSAGE];
+    int result = -1;
+
+    pthread_mutex_lock(&client->write_lock);
+    // The first call of a type names it for the server, in the same write
+    size_t frame_len = 0;
+    int define = !(client->defined[type_id / 8] & (1 << (type_id % 8)));
+    if (define) {
+        frame_len = p2p_wire_encode_type_def(type_id, type, frame, sizeof(frame));
+    }
+    size_t request_len = (!define || frame_len) ? p2p_wire_encode_request(&request, frame + frame_len, sizeof(frame) - frame_len) : 0;
+    if (request_len > 0 && p2p_wire_write_all(client->sock, frame, frame_len + request_len) == 0) {
+        if (define) client->defined[type_id / 8] |= 1 << (type_id % 8);
+        result = 0;
+    }
+    pthread_mutex_unlock(&client->write_lock);
+
+    // The call is issued either way; a failed send completes it right here
+    if (result < 0) {
+        p2p_rpc_complete(client, call_id, P2P_RPC_ERROR, NULL, 0);
+    }
+    return (long long)call_id;
+}
+
+// Callback that completes a P2PRpcFuture
+static void p2p_rpc_future_callback(void* context, int status, const void* data, size_t len) {
+    P2PRpcFuture* future = (P2PRpcFuture*)context;
+    pthread_mutex_lock(&future->lock);
+    future->status = status;
+    future->len = len;
+    if (data) {
+        memcpy(future->data, data, len < future->cap ? len : future->cap);
+    }
+    future->done = 1;
+    pthread_cond_signal(&future->cond);
+    pthread_mutex_unlock(&future->lock);
+}
+
+// Issue a call that completes future
+int p2p_rpc_call_future(P2PRpcClient* client, const char* type, const void* data, size_t len,
+                        int timeout_ms, P2PRpcFuture* future, void* buf, size_t cap) {
+    pthread_mutex_init(&future->lock, NULL);
+    pthread_cond_init(&future->cond, NULL);
+    future->done = 0;
+    future->status = P2P_RPC_ERROR;
+    future->data = buf;
+    future->cap = cap;
+    future->len = 0;
+
+    if (p2p_rpc_call_async(client, type, data, len, timeout_ms, p2p_rpc_future_callback, future) < 0) {
+        // Never issued: complete it with the error so waiting still works
+        future->done = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// Wait for a future
+int p2p_rpc_future_wait(P2PRpcFuture* future) {
+    pthread_mutex_lock(&future->lock);
+    while (!future->done) {
+        pthread_cond_wait(&future->cond, &future->lock);
+    }
+    int status = future->status;
+    pthread_mutex_unlock(&future->lock);
+    return status;
+}
+
+// Release a completed future
+void p2p_rpc_future_destroy(P2PRpcFuture* future) {
+    pthread_cond_destroy(&future->cond);
+    pthread_mutex_destroy(&future->lock);
+}
+
+// Blocking call
+int p2p_rpc_call(P2PRpcClient* client, const char* type, const void* data, size_t len,
+                 void* buf, size_t cap, size_t* response_len, int timeout_ms) {
+    P2PRpcFuture future;
+    p2p_rpc_call_future(client, type, data, len, timeout_ms, &future, buf, cap);
+    int status = p2p_rpc_future_wait(&future);
+    if (response_len) *response_len = future.len;
+    p2p_rpc_future_destroy(&future);
+    return status;
+}
+
+// Close the connection
+void p2p_rpc_close(P2PRpcClient* client) {
+    pthread_mutex_lock(&client->lock);
+    client->closed = 1;
+    pthread_mutex_unlock(&client->lock);
+
+    // Wakes the reader, which fails whatever is still outstanding
+    shutdown(client->sock, SHUT_RDWR);
+    pthread_join(client->reader, NULL);
+
+    close(client->sock);
+    p2p_metrics_gauge_add(P2P_GAUGE_SOCKETS, -1);
+    pthread_mutex_destroy(&client->write_lock);
+    pthread_mutex_destroy(&client->lock);
+    free(client);
+}
@@ -0,0 +1,87 @@
+#ifndef P2P_RPC_H
+#define P2P_RPC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "p2p_message.h"
+#include "p2p_network.h"
+#include "p2p_wire.h"
+
+// Outstanding calls per client (power of two)
+#define P2P_RPC_MAX_PENDING 1024
+
+// Timeout used when a call passes timeout_ms <= 0
+#define P2P_RPC_DEFAULT_TIMEOUT 5000
+
+// Completion callback for an asynchronous call. Runs exactly once, on the
+// client's reader thread (or the calling thread if the send failed); data
+// is valid only during the callback.
+typedef void (*rpc_callback_t)(void* context, int status, const void* data, size_t len);
+
+// Completion slot for a caller that waits on the result
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int done;
+    int status;
+    void* data;             // Caller's response buffer
+    size_t cap;
+    size_t len;             // Full response length (only cap bytes are copied)
+} P2PRpcFuture;
+
+// An outstanding call
+typedef struct {
+    uint64_t call_id;       // 0 = free slot
+    rpc_callback_t callback;
+    void* context;
+    long long deadline;     // Monotonic milliseconds
+} P2PRpcPending;
+
+// Client end of a persistent RPC connection. Any number of threads may
+// issue calls at once: requests are pipelined on the one socket and each
+// response is matched to its caller by correlation id, in whatever order
+// the server answers.
+typedef struct {
+    P2PNetwork* network;
+    char address[128];
+    int sock;
+    pthread_t reader;
+    pthread_mutex_t lock;                           // Guards pending, next_call_id and closed
+    pthread_mutex_t write_lock;                     // Serializes frames on the socket
+    uint64_t next_call_id;
+    P2PRpcPending pending[P2P_RPC_MAX_PENDING];     // Slot call_id & (P2P_RPC_MAX_PENDING - 1)
+    int pending_count;
+    long long next_expiry;                          // Earliest deadline among pending calls
+    uint8_t defined[P2P_MAX_TYPES / 8];             // Types sent as TYPE_DEF (under write_lock)
+    int closed;
+} P2PRpcClient;
+
+// Open a persistent RPC connection to address: NULL on failure
+P2PRpcClient* p2p_rpc_connect(P2PNetwork* network, const char* address);
+
+// Issue a call without waiting. Returns the call id, or -1 if the call
+// could not be issued (the callback will then not run).
+long long p2p_rpc_call_async(P2PRpcClient* client, const char* type, const void* data, size_t len,
+                             int timeout_ms, rpc_callback_t callback, void* context);
+
+// Issue a call that completes future; the response is copied into buf
+int p2p_rpc_call_future(P2PRpcClient* client, const char* type, const void* data, size_t len,
+                        int timeout_ms, P2PRpcFuture* future, void* buf, size_t cap);
+
+// Wait for a future: returns the call's status
+int p2p_rpc_future_wait(P2PRpcFuture* future);
+
+// Release a completed future
+void p2p_rpc_future_destroy(P2PRpcFuture* future);
+
+// Blocking call: returns the status, with the response in buf / *len
+int p2p_rpc_call(P2PRpcClient* client, const char* type, const void* data, size_t len,
+                 void* buf, size_t cap, size_t* response_len, int timeout_ms);
+
+// Close the connection; outstanding calls complete with P2P_RPC_CLOSED
+void p2p_rpc_close(P2PRpcClient* client);
+
+#endif
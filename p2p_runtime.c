@@ -0,0 +1,368 @@
+#include "p2p_runtime.h"
+#include "p2p_trace.h"
+#include "p2p_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+
+static long long p2p_runtime_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Wake the reactor out of poll
+static void p2p_runtime_wake(P2PRuntime* runtime) {
+    ssize_t ignored = write(runtime->wake[1], "", 1);
+    (void)ignored;
+}
+
+// Reactor thread: one poll() over the wake pipe and every watch
+static void* p2p_runtime_reactor(void* arg) {
+    P2PRuntime* runtime = (P2PRuntime*)arg;
+    P2P_TRACE_THREAD("reactor");
+
+    // Scratch memory for one callback, reclaimed after it returns
+    P2PArena arena;
+    p2p_arena_init(&arena, P2P_ARENA_CHUNK_SIZE);
+
+    int cap = 64;
+    int count = 0;
+    P2PWatch** watches = malloc(cap * sizeof(P2PWatch*));
+    struct pollfd* fds = malloc((cap + 1) * sizeof(struct pollfd));   // fds[i + 1] polls watches[i]
+    if (!watches || !fds) {
+        P2P_ERROR("Out of memory for the reactor");
+        cap = 0;
+    }
+
+    while (1) {
+        // Take on new watches and honor a removal request
+        pthread_mutex_lock(&runtime->lock);
+        if (runtime->stopping || cap == 0) {
+            pthread_mutex_unlock(&runtime->lock);
+            break;
+        }
+        while (runtime->pending) {
+            P2PWatch* watch = runtime->pending;
+            runtime->pending = watch->next;
+            if (count == cap) {
+                int grown_cap = cap * 2;
+                P2PWatch** grown = realloc(watches, grown_cap * sizeof(P2PWatch*));
+                struct pollfd* grown_fds = realloc(fds, (grown_cap + 1) * sizeof(struct pollfd));
+                if (grown) watches = grown;
+                if (grown_fds) fds = grown_fds;
+                if (!grown || !grown_fds) {
+                    P2P_ERROR("Out of memory for a new watch");
+                    watch->close(watch);
+                    continue;
+                }
+                cap = grown_cap;
+            }
+            watches[count++] = watch;
+        }
+        if (runtime->unwatching) {
+            for (int i = count - 1; i >= 0; i--) {
+                if (watches[i]->owner != runtime->unwatching) continue;
+                P2PWatch* watch = watches[i];
+                watches[i] = watches[--count];
+                watch->close(watch);
+            }
+            runtime->unwatching = NULL;
+            pthread_cond_broadcast(&runtime->removed);
+        }
+        pthread_mutex_unlock(&runtime->lock);
+
+        // Paused watches are not polled but retried shortly, and the
+        // earliest timer bounds the wait
+        long long now = p2p_runtime_now_ms();
+        int timeout = 1000;
+        fds[0].fd = runtime->wake[0];
+        fds[0].events = POLLIN;
+        for (int i = 0; i < count; i++) {
+            P2PWatch* watch = watches[i];
+            fds[i + 1].fd = watch->fd;
+            fds[i + 1].events = watch->paused ? 0 : watch->events;
+            fds[i + 1].revents = 0;
+            if (watch->paused && timeout > P2P_RUNTIME_RETRY_MS) timeout = P2P_RUNTIME_RETRY_MS;
+            // Kicked while it was still pending, so its wakeup is already spent
+            if (atomic_load(&watch->kicked)) timeout = 0;
+            if (watch->wake_at > 0 && watch->wake_at - now < timeout) {
+                timeout = watch->wake_at > now ? (int)(watch->wake_at - now) : 0;
+            }
+        }
+
+        int ready = poll(fds, count + 1, timeout);
+        if (ready < 0 && errno != EINTR) {
+            P2P_ERROR("Reactor poll failed");
+            break;
+        }
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            char scratch[64];
+            while (read(runtime->wake[0], scratch, sizeof(scratch)) > 0);
+        }
+
+        // Walk backwards so a closed watch can be replaced by the last one
+        now = p2p_runtime_now_ms();
+        for (int i = count - 1; i >= 0; i--) {
+            P2PWatch* watch = watches[i];
+            short revents = ready > 0 ? fds[i + 1].revents : 0;
+            int kicked = atomic_exchange(&watch->kicked, 0);
+            int due = watch->wake_at > 0 && now >= watch->wake_at;
+            if (!revents && !kicked && !due && !watch->paused) continue;
+            int result = watch->ready(watch, revents, &arena);
+            p2p_arena_reset(&arena);
+            if (result < 0) {
+                watches[i] = watches[--count];
+                watch->close(watch);
+            }
+        }
+    }
+
+    // Close everything, including watches added from now on
+    pthread_mutex_lock(&runtime->lock);
+    runtime->exited = 1;
+    for (int i = 0; i < count; i++) {
+        watches[i]->close(watches[i]);
+    }
+    while (runtime->pending) {
+        P2PWatch* watch = runtime->pending;
+        runtime->pending = watch->next;
+        watch->close(watch);
+    }
+    runtime->unwatching = NULL;
+    pthread_cond_broadcast(&runtime->removed);
+    pthread_mutex_unlock(&runtime->lock);
+    free(watches);
+    free(fds);
+    p2p_arena_destroy(&arena);
+    return NULL;
+}
+
+// Worker thread: runs its queue's tasks and ticks its clients
+static void* p2p_runtime_worker(void* arg) {
+    P2PWorker* worker = (P2PWorker*)arg;
+    char name[32];
+    snprintf(name, sizeof(name), "worker %d", worker->index);
+    P2P_TRACE_THREAD(name);
+
+    // Scratch memory for one task, reclaimed in bulk after it runs
+    P2PArena arena;
+    p2p_arena_init(&arena, P2P_ARENA_CHUNK_SIZE);
+
+    long long next_tick = p2p_runtime_now_ms() + P2P_RUNTIME_TICK_MS;
+    while (1) {
+        P2PTask* task;
+        if (worker->tasks.timed_pop(&worker->tasks, &task, P2P_RUNTIME_TICK_MS)) {
+            if (task == NULL) break;
+            task->run(task, &arena);
+            p2p_arena_reset(&arena);
+        }
+
+        long long now = p2p_runtime_now_ms();
+        if (now >= next_tick) {
+            pthread_mutex_lock(&worker->clients_lock);
+            for (P2PWorkerClient* client = worker->client_list; client; client = client->next) {
+                client->tick(client->context);
+            }
+            pthread_mutex_unlock(&worker->clients_lock);
+            next_tick = now + P2P_RUNTIME_TICK_MS;
+        }
+    }
+
+    p2p_arena_destroy(&arena);
+    return NULL;
+}
+
+// Create a runtime and start its threads
+P2PRuntime* p2p_runtime_create(int workers) {
+    if (workers < 1) return NULL;
+    P2PRuntime* runtime = calloc(1, sizeof(P2PRuntime));
+    if (!runtime) return NULL;
+    runtime->workers = calloc(workers, sizeof(P2PWorker));
+    if (!runtime->workers || pipe(runtime->wake) < 0) {
+        free(runtime->workers);
+        free(runtime);
+        return NULL;
+    }
+    fcntl(runtime->wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(runtime->wake[1], F_SETFL, O_NONBLOCK);
+    pthread_mutex_init(&runtime->lock, NULL);
+    pthread_cond_init(&runtime->removed, NULL);
+
+    int started = 0;
+    for (; started < workers; started++) {
+        P2PWorker* worker = &runtime->workers[started];
+        worker->index = started;
+        worker->tasks = ring_queue_constructor(P2P_RUNTIME_QUEUE_DEPTH, sizeof(P2PTask*));
+        pthread_mutex_init(&worker->clients_lock, NULL);
+        if (pthread_create(&worker->thread, NULL, p2p_runtime_worker, worker) != 0) {
+            ring_queue_destructor(&worker->tasks);
+            pthread_mutex_destroy(&worker->clients_lock);
+            break;
+        }
+    }
+    runtime->worker_count = started;
+    if (started == workers && pthread_create(&runtime->reactor, NULL, p2p_runtime_reactor, runtime) == 0) {
+        runtime->reactor_started = 1;
+    }
+    if (!runtime->reactor_started) {
+        p2p_runtime_free(runtime);
+        return NULL;
+    }
+    return runtime;
+}
+
+// Stop the threads and free the runtime
+void p2p_runtime_free(P2PRuntime* runtime) {
+    pthread_mutex_lock(&runtime->lock);
+    runtime->stopping = 1;
+    pthread_mutex_unlock(&runtime->lock);
+    if (runtime->reactor_started) {
+        p2p_runtime_wake(runtime);
+        pthread_join(runtime->reactor, NULL);
+    }
+
+    // A NULL task stops a worker
+    for (int i = 0; i < runtime->worker_count; i++) {
+        P2PTask* stop = NULL;
+        runtime->workers[i].tasks.push(&runtime->workers[i].tasks, &stop);
+    }
+    for (int i = 0; i < runtime->worker_count; i++) {
+        pthread_join(runtime->workers[i].thread, NULL);
+    }
+    for (int i = 0; i < runtime->worker_count; i++) {
+        ring_queue_destructor(&runtime->workers[i].tasks);
+        pthread_mutex_destroy(&runtime->workers[i].clients_lock);
+    }
+    close(runtime->wake[0]);
+    close(runtime->wake[1]);
+    pthread_cond_destroy(&runtime->removed);
+    pthread_mutex_destroy(&runtime->lock);
+    free(runtime->workers);
+    free(runtime);
+}
+
+// Set up a watch polling fd for POLLIN
+void p2p_runtime_watch_init(P2PWatch* watch, int fd, void* owner,
+                            int (*ready)(P2PWatch* watch, short revents, P2PArena* arena),
+                            void (*close)(P2PWatch* watch)) {
+    watch->fd = fd;
+    watch->events = POLLIN;
+    watch->paused = 0;
+    watch->wake_at = 0;
+    atomic_init(&watch->kicked, 0);
+    watch->owner = owner;
+    watch->ready = ready;
+    watch->close = close;
+    watch->next = NULL;
+}
+
+// Add a watch on the reactor's next pass
+void p2p_runtime_watch(P2PRuntime* runtime, P2PWatch* watch) {
+    pthread_mutex_lock(&runtime->lock);
+    if (runtime->exited) {
+        pthread_mutex_unlock(&runtime->lock);
+        watch->close(watch);
+        return;
+    }
+    watch->next = runtime->pending;
+    runtime->pending = watch;
+    pthread_mutex_unlock(&runtime->lock);
+    p2p_runtime_wake(runtime);
+}
+
+// Call a watch's ready on the reactor's next pass
+void p2p_runtime_kick(P2PRuntime* runtime, P2PWatch* watch) {
+    // Only the first kick since the last call needs to wake the reactor
+    if (atomic_exchange(&watch->kicked, 1) == 0) {
+        p2p_runtime_wake(runtime);
+    }
+}
+
+// Remove and close every watch of owner
+void p2p_runtime_unwatch(P2PRuntime* runtime, void* owner) {
+    pthread_mutex_lock(&runtime->lock);
+    // One request at a time
+    while (runtime->unwatching && !runtime->exited) {
+        pthread_cond_wait(&runtime->removed, &runtime->lock);
+    }
+    if (runtime->exited) {
+        pthread_mutex_unlock(&runtime->lock);
+        return;
+    }
+    runtime->unwatching = owner;
+    p2p_runtime_wake(runtime);
+    while (runtime->unwatching == owner && !runtime->exited) {
+        pthread_cond_wait(&runtime->removed, &runtime->lock);
+    }
+    pthread_mutex_unlock(&runtime->lock);
+}
+
+// Place a client on the least loaded worker
+void p2p_runtime_join(P2PRuntime* runtime, P2PWorkerClient* client) {
+    pthread_mutex_lock(&runtime->lock);
+    P2PWorker* worker = &runtime->workers[0];
+    for (int i = 1; i < runtime->worker_count; i++) {
+        if (runtime->workers[i].clients < worker->clients) worker = &runtime->workers[i];
+    }
+    worker->clients++;
+    pthread_mutex_unlock(&runtime->lock);
+
+    client->worker = worker;
+    pthread_mutex_lock(&worker->clients_lock);
+    client->next = worker->client_list;
+    worker->client_list = client;
+    pthread_mutex_unlock(&worker->clients_lock);
+}
+
+// Marks the point in a worker's queue that p2p_runtime_leave waits for
+typedef struct {
+    P2PTask task;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int done;
+} P2PWorkerFence;
+
+static void p2p_runtime_fence_run(P2PTask* task, P2PArena* arena) {
+    (void)arena;
+    P2PWorkerFence* fence = (P2PWorkerFence*)task;
+    pthread_mutex_lock(&fence->lock);
+    fence->done = 1;
+    pthread_cond_signal(&fence->cond);
+    pthread_mutex_unlock(&fence->lock);
+}
+
+// Stop ticking a client and drain what its worker already has queued
+void p2p_runtime_leave(P2PRuntime* runtime, P2PWorkerClient* client) {
+    P2PWorker* worker = client->worker;
+    pthread_mutex_lock(&worker->clients_lock);
+    for (P2PWorkerClient** link = &worker->client_list; *link; link = &(*link)->next) {
+        if (*link == client) {
+            *link = client->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&worker->clients_lock);
+
+    P2PWorkerFence fence;
+    fence.task.run = p2p_runtime_fence_run;
+    pthread_mutex_init(&fence.lock, NULL);
+    pthread_cond_init(&fence.cond, NULL);
+    fence.done = 0;
+    P2PTask* task = &fence.task;
+    worker->tasks.push(&worker->tasks, &task);
+    pthread_mutex_lock(&fence.lock);
+    while (!fence.done) {
+        pthread_cond_wait(&fence.cond, &fence.lock);
+    }
+    pthread_mutex_unlock(&fence.lock);
+    pthread_cond_destroy(&fence.cond);
+    pthread_mutex_destroy(&fence.lock);
+
+    pthread_mutex_lock(&runtime->lock);
+    worker->clients--;
+    pthread_mutex_unlock(&runtime->lock);
+    client->worker = NULL;
+}
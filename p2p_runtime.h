@@ -0,0 +1,120 @@
+#ifndef P2P_RUNTIME_H
+#define P2P_RUNTIME_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "p2p_arena.h"
+#include "DataStructures/Lists/RingQueue.h"
+
+// Shared I/O threads.
+//
+// A runtime is one reactor thread that polls every watched socket, plus a
+// fixed pool of workers that run queued tasks. Any number of networks can
+// register with one runtime: each network's sockets go on the reactor and
+// each network is pinned to one worker, so its tasks still run one at a
+// time and in order, as they would on a worker of its own. Outbound links
+// are watches too, writing without blocking as their sockets drain. Thread
+// count stays fixed however many networks and links share the runtime, but
+// networks on one worker wait for each other: a handler that blocks, for
+// instance on a send waiting for credit from a network on the same worker,
+// stalls them all.
+
+// Tasks each worker holds before producers see it as full
+#define P2P_RUNTIME_QUEUE_DEPTH 1024
+
+// Milliseconds between retries of paused watches
+#define P2P_RUNTIME_RETRY_MS 10
+
+// Milliseconds between calls to each worker client's tick
+#define P2P_RUNTIME_TICK_MS 1000
+
+// One socket on the reactor. Watches are only touched on the reactor
+// thread once added, except through p2p_runtime_kick. arena is the
+// reactor's scratch memory, reset after every call.
+typedef struct P2PWatch {
+    int fd;                     // -1 to poll nothing (timers and kicks still apply)
+    short events;               // What fd is polled for (POLLIN, POLLOUT)
+    int paused;                 // Not polled; ready(watch, 0) is retried every P2P_RUNTIME_RETRY_MS instead
+    long long wake_at;          // Also call ready(watch, 0) once the monotonic clock reaches this (ms, 0 = never)
+    atomic_int kicked;          // Set by p2p_runtime_kick until the reactor calls ready
+    void* owner;                // What p2p_runtime_unwatch removes it with
+    // Called when fd has events (revents), on a retry, timer or kick (0): -1 to stop watching
+    int (*ready)(struct P2PWatch* watch, short revents, P2PArena* arena);
+    // Called once the watch is removed; may free it
+    void (*close)(struct P2PWatch* watch);
+    struct P2PWatch* next;      // Pending additions (runtime only)
+} P2PWatch;
+
+// Work queued to a worker. run owns the task from then on; arena is the
+// worker's scratch memory, reset after every task.
+typedef struct P2PTask {
+    void (*run)(struct P2PTask* task, P2PArena* arena);
+} P2PTask;
+
+// Periodic callback on the worker a client was placed on
+typedef struct P2PWorkerClient {
+    void (*tick)(void* context);
+    void* context;
+    struct P2PWorker* worker;   // Set by p2p_runtime_join
+    struct P2PWorkerClient* next;
+} P2PWorkerClient;
+
+typedef struct P2PWorker {
+    struct RingQueue tasks;     // P2PTask*; NULL stops the worker
+    pthread_t thread;
+    int index;
+    int clients;                // Clients placed here (runtime lock)
+    P2PWorkerClient* client_list;
+    pthread_mutex_t clients_lock;
+} P2PWorker;
+
+typedef struct P2PRuntime {
+    pthread_t reactor;
+    int wake[2];                // Pipe that wakes the reactor
+    P2PWorker* workers;
+    int worker_count;
+    pthread_mutex_t lock;
+    pthread_cond_t removed;
+    P2PWatch* pending;          // Watches waiting to be added by the reactor
+    void* unwatching;           // Owner whose watches the reactor is asked to remove
+    int stopping;
+    int exited;                 // The reactor is gone and closes new watches at once
+    int reactor_started;
+} P2PRuntime;
+
+// Create a runtime and start its reactor and worker threads (NULL on failure)
+P2PRuntime* p2p_runtime_create(int workers);
+
+// Stop the threads and free the runtime. Every watch and client must have
+// been removed.
+void p2p_runtime_free(P2PRuntime* runtime);
+
+// Set up a watch polling fd for POLLIN, with no timer
+void p2p_runtime_watch_init(P2PWatch* watch, int fd, void* owner,
+                            int (*ready)(P2PWatch* watch, short revents, P2PArena* arena),
+                            void (*close)(P2PWatch* watch));
+
+// Add a watch; the reactor picks it up on its next pass. Safe from any
+// thread, including from a ready callback.
+void p2p_runtime_watch(P2PRuntime* runtime, P2PWatch* watch);
+
+// Have the reactor call ready(watch, 0) on its next pass. Safe from any
+// thread while the watch is on the runtime; kicks before the call runs
+// are folded into one.
+void p2p_runtime_kick(P2PRuntime* runtime, P2PWatch* watch);
+
+// Remove and close every watch of owner, returning once they are closed.
+// Not callable from the reactor thread.
+void p2p_runtime_unwatch(P2PRuntime* runtime, void* owner);
+
+// Place a client on the worker with the fewest clients and start ticking it
+void p2p_runtime_join(P2PRuntime* runtime, P2PWorkerClient* client);
+
+// Stop ticking a client and wait until every task queued on its worker so
+// far has run. Not callable from a worker thread.
+void p2p_runtime_leave(P2PRuntime* runtime, P2PWorkerClient* client);
+
+#endif
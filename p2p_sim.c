@@ -0,0 +1,394 @@
+#include "p2p_sim.h"
+#include "p2p_log.h"
+#include "p2p_wire.h"
+#include "p2p_metrics.h"
+
+// Links table starts with this many slots and doubles at half full
+#define P2P_SIM_LINKS_INITIAL 1024
+
+struct P2PSimNode {
+    P2PNetwork* network;
+    const char* address;        // The network's node id
+    uint32_t index;             // Registration order, part of link keys
+    int group;                  // Partition group
+};
+
+struct P2PSimLink {
+    uint64_t key;               // from index << 32 | to index
+    P2PSimNode* from;
+    P2PSimNode* to;
+    P2PSimLinkConfig config;
+    long long busy_until_us;    // When the sender finishes putting the last frames on the wire
+    long long last_arrival_us;  // Keeps deliveries in order despite jitter
+    P2PConnection* conn;        // The receiver's connection for this link, opened on first delivery
+    uint8_t defined[P2P_MAX_TYPES / 8];  // Types already defined for the receiver
+};
+
+struct P2PSimEvent {
+    long long time_us;
+    uint64_t seq;
+    P2PSimLink* link;
+    P2PBuffer* frames;          // One reference
+    P2PSimNode* node;           // Failure detector to tick instead (link and frames NULL)
+};
+
+// MARK: Random numbers
+
+// xorshift64*: fast, and the same sequence for the same seed everywhere
+static uint64_t p2p_sim_random(P2PSim* sim) {
+    sim->rng ^= sim->rng >> 12;
+    sim->rng ^= sim->rng << 25;
+    sim->rng ^= sim->rng >> 27;
+    return sim->rng * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform in [0, 1)
+static double p2p_sim_uniform(P2PSim* sim) {
+    return (p2p_sim_random(sim) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// MARK: Nodes and links
+
+// Order nodes by address
+static int p2p_sim_node_compare(void* a, void* b) {
+    return strcmp((*(P2PSimNode**)a)->address, (*(P2PSimNode**)b)->address);
+}
+
+// Node registered under address: NULL if there is none
+static P2PSimNode* p2p_sim_node(P2PSim* sim, const char* address) {
+    P2PSimNode key_node = { NULL, address, 0, 0 };
+    P2PSimNode* key = &key_node;
+    int index = sim->nodes.search(&sim->nodes, &key);
+    return index < 0 ? NULL : *(P2PSimNode**)sim->nodes.retrieve(&sim->nodes, index);
+}
+
+static size_t p2p_sim_slot(uint64_t key, size_t cap) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t)key & (cap - 1);
+}
+
+// Double the links table
+static int p2p_sim_grow_links(P2PSim* sim) {
+    size_t cap = sim->link_cap ? sim->link_cap * 2 : P2P_SIM_LINKS_INITIAL;
+    P2PSimLink** links = calloc(cap, sizeof(P2PSimLink*));
+    if (!links) return -1;
+    for (size_t i = 0; i < sim->link_cap; i++) {
+        P2PSimLink* link = sim->links[i];
+        if (!link) continue;
+        size_t slot = p2p_sim_slot(link->key, cap);
+        while (links[slot]) slot = (slot + 1) & (cap - 1);
+        links[slot] = link;
+    }
+    free(sim->links);
+    sim->links = links;
+    sim->link_cap = cap;
+    return 0;
+}
+
+// The link from one node to another, created with the default
+// configuration on first use: NULL if out of memory
+static P2PSimLink* p2p_sim_link(P2PSim* sim, P2PSimNode* from, P2PSimNode* to) {
+    uint64_t key = (uint64_t)from->index << 32 | to->index;
+    if (sim->link_cap) {
+        for (size_t slot = p2p_sim_slot(key, sim->link_cap); sim->links[slot]; slot = (slot + 1) & (sim->link_cap - 1)) {
+            if (sim->links[slot]->key == key) return sim->links[slot];
+        }
+    }
+
+    if ((sim->stats.links + 1) * 2 > sim->link_cap && p2p_sim_grow_links(sim) < 0) return NULL;
+    P2PSimLink* link = calloc(1, sizeof(P2PSimLink));
+    if (!link) return NULL;
+    link->key = key;
+    link->from = from;
+    link->to = to;
+    link->config = sim->defaults;
+
+    size_t slot = p2p_sim_slot(key, sim->link_cap);
+    while (sim->links[slot]) slot = (slot + 1) & (sim->link_cap - 1);
+    sim->links[slot] = link;
+    sim->stats.links++;
+    return link;
+}
+
+// MARK: Event queue
+
+static int p2p_sim_before(const P2PSimEvent* a, const P2PSimEvent* b) {
+    return a->time_us < b->time_us || (a->time_us == b->time_us && a->seq < b->seq);
+}
+
+// Schedule a delivery on link, or a tick of node's failure detector: 0 on
+// success, -1 if out of memory
+static int p2p_sim_schedule(P2PSim* sim, long long time_us, P2PSimLink* link, P2PBuffer* frames,
+                            P2PSimNode* node) {
+    if (sim->event_count == sim->event_cap) {
+        size_t cap = sim->event_cap ? sim->event_cap * 2 : 1024;
+        P2PSimEvent* events = realloc(sim->events, cap * sizeof(P2PSimEvent));
+        if (!events) return -1;
+        sim->events = events;
+        sim->event_cap = cap;
+    }
+
+    P2PSimEvent event = { time_us, sim->next_seq++, link, frames, node };
+    if (node) sim->timers++;
+    size_t i = sim->event_count++;
+    while (i > 0 && p2p_sim_before(&event, &sim->events[(i - 1) / 2])) {
+        sim->events[i] = sim->events[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    sim->events[i] = event;
+    return 0;
+}
+
+// Remove the earliest event
+static P2PSimEvent p2p_sim_pop(P2PSim* sim) {
+    P2PSimEvent first = sim->events[0];
+    P2PSimEvent last = sim->events[--sim->event_count];
+    if (first.node) sim->timers--;
+    size_t i = 0;
+    while (1) {
+        size_t child = 2 * i + 1;
+        if (child >= sim->event_count) break;
+        if (child + 1 < sim->event_count && p2p_sim_before(&sim->events[child + 1], &sim->events[child])) child++;
+        if (!p2p_sim_before(&sim->events[child], &last)) break;
+        sim->events[i] = sim->events[child];
+        i = child;
+    }
+    if (sim->event_count > 0) sim->events[i] = last;
+    return first;
+}
+
+// MARK: Transport
+
+// Register a network under its node id
+static int p2p_sim_start(P2PTransport* transport, P2PNetwork* network) {
+    P2PSim* sim = transport->context;
+    if (p2p_sim_node(sim, network->node_id)) {
+        P2P_ERROR("Simulated node %s already exists", network->node_id);
+        return -1;
+    }
+    P2PSimNode* node = malloc(sizeof(P2PSimNode));
+    if (!node) return -1;
+    node->network = network;
+    node->address = network->node_id;
+    node->index = (uint32_t)sim->nodes.length;
+    node->group = 0;
+    if (sim->nodes.insert(&sim->nodes, &node) < 0) {
+        free(node);
+        return -1;
+    }
+    if (network->swim.enabled) {
+        // Seeded from the simulator, so runs replay
+        network->swim.seed = (unsigned int)p2p_sim_random(sim);
+        network->swim.next_index = (int)(p2p_sim_random(sim) >> 33);
+        p2p_sim_schedule(sim, sim->now_us + p2p_swim_tick_ms(&network->swim) * 1000LL, NULL, NULL, node);
+    }
+    return 0;
+}
+
+// Frames with the type definition the receiver still needs in front: a new
+// buffer, or frames itself if none is needed (NULL if out of memory)
+static P2PBuffer* p2p_sim_define_type(P2PSimLink* link, P2PNetwork* network, P2PBuffer* frames, int type_id) {
+    if (type_id < 0 || (link->defined[type_id / 8] & (1 << (type_id % 8)))) return frames;
+
+    const char* name = p2p_registry_name(&network->types, type_id);
+    P2PBuffer* defined = name ? p2p_buffer_create(P2P_WIRE_MAX_MESSAGE + frames->len) : NULL;
+    if (!defined) return NULL;
+    defined->len = p2p_wire_encode_type_def(type_id, name, defined->data, P2P_WIRE_MAX_MESSAGE);
+    if (defined->len == 0) {
+        p2p_buffer_release(defined);
+        return NULL;
+    }
+    memcpy(defined->data + defined->len, frames->data, frames->len);
+    defined->len += frames->len;
+    return defined;
+}
+
+// Put frames on the link from network to address
+static int p2p_sim_send(P2PTransport* transport, P2PNetwork* network, const char* address,
+                        int lane, P2PBuffer* frames, int type_id) {
+    P2PSim* sim = transport->context;
+    (void)lane;
+    P2PSimNode* from = p2p_sim_node(sim, network->node_id);
+    P2PSimNode* to = p2p_sim_node(sim, address);
+    P2PSimLink* link = (from && to && from->group == to->group) ? p2p_sim_link(sim, from, to) : NULL;
+    if (!link) {
+        sim->stats.refused++;
+        p2p_buffer_release(frames);
+        return -1;
+    }
+
+    P2PBuffer* wire = p2p_sim_define_type(link, network, frames, type_id);
+    if (wire != frames) {
+        p2p_buffer_release(frames);
+        if (!wire) return -1;
+    }
+    sim->stats.sent++;
+    p2p_metrics_add(P2P_COUNTER_MESSAGES_SENT, 1);
+    p2p_metrics_add(P2P_COUNTER_BYTES_SENT, wire->len);
+
+    // The frames occupy the link for their transmission time whether or not they arrive
+    long long start = sim->now_us > link->busy_until_us ? sim->now_us : link->busy_until_us;
+    if (link->config.bandwidth > 0) {
+        link->busy_until_us = start + (long long)wire->len * 1000000 / link->config.bandwidth;
+    } else {
+        link->busy_until_us = start;
+    }
+    if (link->config.loss > 0 && p2p_sim_uniform(sim) < link->config.loss) {
+        sim->stats.lost++;
+        p2p_buffer_release(wire);
+        return 0;
+    }
+    if (type_id >= 0) link->defined[type_id / 8] |= 1 << (type_id % 8);
+
+    long long arrival = link->busy_until_us + link->config.latency_us;
+    if (link->config.jitter_us > 0) {
+        arrival += (long long)(p2p_sim_random(sim) % (uint64_t)link->config.jitter_us);
+    }
+    if (arrival < link->last_arrival_us) arrival = link->last_arrival_us;
+    link->last_arrival_us = arrival;
+
+    if (p2p_sim_schedule(sim, arrival, link, wire, NULL) < 0) {
+        p2p_buffer_release(wire);
+        return -1;
+    }
+    return 0;
+}
+
+// Count what a receiver writes back on a connection
+static int p2p_sim_reply(P2PTransport* transport, void* context, const void* data, size_t len) {
+    P2PSim* sim = transport->context;
+    (void)context;
+    (void)data;
+    sim->stats.replies++;
+    sim->stats.reply_bytes += len;
+    return 0;
+}
+
+// Failure detectors run on virtual time
+static long long p2p_sim_clock(P2PTransport* transport) {
+    P2PSim* sim = transport->context;
+    return sim->now_us / 1000;
+}
+
+// MARK: Simulator
+
+// Create a simulator
+P2PSim* p2p_sim_create(uint64_t seed, const P2PSimLinkConfig* defaults) {
+    P2PSim* sim = calloc(1, sizeof(P2PSim));
+    if (!sim) return NULL;
+    sim->transport.start = p2p_sim_start;
+    sim->transport.send = p2p_sim_send;
+    sim->transport.reply = p2p_sim_reply;
+    sim->transport.now_ms = p2p_sim_clock;
+    sim->transport.context = sim;
+    sim->defaults = *defaults;
+    sim->nodes = sorted_vector_constructor(sizeof(P2PSimNode*), p2p_sim_node_compare);
+
+    // splitmix64 spreads any seed (including 0) into a usable xorshift state
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    sim->rng = (z ^ (z >> 31)) | 1;
+    return sim;
+}
+
+// Run a network on the simulator
+void p2p_sim_attach(P2PSim* sim, P2PNetwork* network) {
+    p2p_network_set_transport(network, &sim->transport);
+    network->peer_list->persist = 0;
+}
+
+// Configure one directed link
+int p2p_sim_set_link(P2PSim* sim, const char* from, const char* to, const P2PSimLinkConfig* config) {
+    P2PSimNode* from_node = p2p_sim_node(sim, from);
+    P2PSimNode* to_node = p2p_sim_node(sim, to);
+    P2PSimLink* link = (from_node && to_node) ? p2p_sim_link(sim, from_node, to_node) : NULL;
+    if (!link) return -1;
+    link->config = *config;
+    return 0;
+}
+
+// Move a node to a partition group
+int p2p_sim_partition(P2PSim* sim, const char* address, int group) {
+    P2PSimNode* node = p2p_sim_node(sim, address);
+    if (!node) return -1;
+    node->group = group;
+    return 0;
+}
+
+// Reunite every node
+void p2p_sim_heal(P2PSim* sim) {
+    for (int i = 0; i < sim->nodes.length; i++) {
+        (*(P2PSimNode**)sim->nodes.retrieve(&sim->nodes, i))->group = 0;
+    }
+}
+
+// Deliver frames in time order up to until_us
+long p2p_sim_run(P2PSim* sim, long long until_us) {
+    long delivered = 0;
+    while (until_us < 0 ? sim->event_count > sim->timers
+                        : sim->event_count > 0 && sim->events[0].time_us <= until_us) {
+        P2PSimEvent event = p2p_sim_pop(sim);
+        sim->now_us = event.time_us;
+        if (event.node) {
+            P2PSwim* swim = &event.node->network->swim;
+            p2p_swim_tick(swim, sim->now_us / 1000);
+            p2p_sim_schedule(sim, sim->now_us + p2p_swim_tick_ms(swim) * 1000LL, NULL, NULL, event.node);
+            continue;
+        }
+        P2PSimLink* link = event.link;
+
+        if (link->from->group != link->to->group) {
+            sim->stats.lost++;
+        } else {
+            if (!link->conn) {
+                link->conn = p2p_network_open_connection(link->to->network, &sim->transport, link);
+            }
+            if (link->conn) {
+                p2p_network_receive(link->to->network, link->conn, event.frames->data, event.frames->len);
+                sim->stats.delivered++;
+                sim->stats.bytes_delivered += event.frames->len;
+                delivered++;
+            }
+        }
+        p2p_buffer_release(event.frames);
+    }
+    if (until_us > sim->now_us) sim->now_us = until_us;
+    return delivered;
+}
+
+// Current virtual time
+long long p2p_sim_now_us(P2PSim* sim) {
+    return sim->now_us;
+}
+
+// Traffic totals
+P2PSimStats p2p_sim_stats(P2PSim* sim) {
+    P2PSimStats stats = sim->stats;
+    stats.pending = sim->event_count - sim->timers;
+    return stats;
+}
+
+// Free the simulator
+void p2p_sim_destroy(P2PSim* sim) {
+    for (size_t i = 0; i < sim->event_count; i++) {
+        if (sim->events[i].frames) p2p_buffer_release(sim->events[i].frames);
+    }
+    free(sim->events);
+
+    for (size_t i = 0; i < sim->link_cap; i++) {
+        P2PSimLink* link = sim->links[i];
+        if (!link) continue;
+        if (link->conn) p2p_network_close_connection(link->conn);
+        free(link);
+    }
+    free(sim->links);
+
+    for (int i = 0; i < sim->nodes.length; i++) {
+        free(*(P2PSimNode**)sim->nodes.retrieve(&sim->nodes, i));
+    }
+    sorted_vector_destructor(&sim->nodes);
+    free(sim);
+}
@@ -0,0 +1,98 @@
+#ifndef P2P_SIM_H
+#define P2P_SIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "p2p_network.h"
+#include "p2p_transport.h"
+#include "DataStructures/Lists/SortedVector.h"
+
+// Deterministic in-memory network for protocol experiments.
+//
+// Networks attached to a simulator exchange frames through it instead of
+// sockets and run no threads of their own: p2p_sim_run delivers frames in
+// virtual-time order on the calling thread, and the handlers it triggers
+// schedule further deliveries. With the same seed and the same calls, a
+// run replays identically. Each ordered pair of nodes is a FIFO link with
+// its own latency, jitter, bandwidth and loss; both lanes share it.
+// Frames written back on a connection (discovery replies, credit) are
+// counted but not delivered, since links only read credit from them and
+// the simulator has no flow control. Failure detection runs on the
+// virtual clock: the simulator ticks the detector of every node started
+// with it on, interleaved with the deliveries.
+
+// Behavior of one directed link
+typedef struct {
+    long latency_us;        // One-way propagation delay
+    long jitter_us;         // Extra delay drawn uniformly from [0, jitter_us)
+    long bandwidth;         // Bytes per second (0 for unlimited)
+    double loss;            // Probability that a send is dropped
+} P2PSimLinkConfig;
+
+typedef struct {
+    unsigned long sent;             // Sends accepted
+    unsigned long delivered;
+    unsigned long lost;             // Dropped for loss, or by a partition while in flight
+    unsigned long refused;          // Sends to unknown or partitioned nodes
+    unsigned long replies;          // Writes back on a connection (counted, not delivered)
+    unsigned long long bytes_delivered;
+    unsigned long long reply_bytes;
+    size_t links;                   // Directed links that carried traffic
+    size_t pending;                 // Deliveries scheduled but not yet made
+} P2PSimStats;
+
+typedef struct P2PSimNode P2PSimNode;
+typedef struct P2PSimLink P2PSimLink;
+typedef struct P2PSimEvent P2PSimEvent;
+
+typedef struct {
+    P2PTransport transport;         // context points back here
+    P2PSimLinkConfig defaults;      // For links without their own configuration
+    long long now_us;               // Virtual clock
+    uint64_t rng;                   // xorshift64* state
+    uint64_t next_seq;              // Breaks ties between events at the same time
+    struct SortedVector nodes;      // P2PSimNode* by address
+    P2PSimLink** links;             // Open-addressed by (from, to)
+    size_t link_cap;
+    P2PSimEvent* events;            // Binary min-heap by (time, seq)
+    size_t event_count;
+    size_t event_cap;
+    size_t timers;                  // Events that tick a failure detector rather than deliver
+    P2PSimStats stats;
+} P2PSim;
+
+// Create a simulator whose links default to defaults
+P2PSim* p2p_sim_create(uint64_t seed, const P2PSimLinkConfig* defaults);
+
+// Run a network on the simulator (call before p2p_network_start, which
+// registers it under its node id). Its peers are not saved to a file.
+void p2p_sim_attach(P2PSim* sim, P2PNetwork* network);
+
+// Configure the link from one address to another (either direction is separate)
+int p2p_sim_set_link(P2PSim* sim, const char* from, const char* to, const P2PSimLinkConfig* config);
+
+// Put a node in a partition group: nodes in different groups cannot reach
+// each other and frames between them in flight are lost. Every node starts
+// in group 0.
+int p2p_sim_partition(P2PSim* sim, const char* address, int group);
+
+// Put every node back in group 0
+void p2p_sim_heal(P2PSim* sim);
+
+// Deliver every frame due by until_us and advance the clock to it (until_us
+// < 0 runs until no frames are left, which never happens while a node
+// probes). Returns the deliveries made.
+long p2p_sim_run(P2PSim* sim, long long until_us);
+
+// Current virtual time
+long long p2p_sim_now_us(P2PSim* sim);
+
+// Traffic totals
+P2PSimStats p2p_sim_stats(P2PSim* sim);
+
+// Drop pending frames and close every connection (before freeing the networks)
+void p2p_sim_destroy(P2PSim* sim);
+
+#endif
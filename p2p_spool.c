@@ -0,0 +1,179 @@
+#include "p2p_spool.h"
+#include "p2p_log.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Record length that marks the rest of the file as unused (the ring wrapped)
+#define P2P_SPOOL_WRAP UINT32_MAX
+
+// Header of a record in the ring file; the frames follow, padded to 8 bytes
+typedef struct {
+    uint32_t len;
+    int32_t type_id;
+    int64_t enqueued_ms;
+} P2PSpoolRecord;
+
+// Bytes a record of len frame bytes takes in the ring
+static size_t p2p_spool_record_size(size_t len) {
+    return (sizeof(P2PSpoolRecord) + len + 7) & ~(size_t)7;
+}
+
+// Initialize an empty spool
+void p2p_spool_init(P2PSpool* spool, const P2PSpoolConfig* config) {
+    memset(spool, 0, sizeof(P2PSpool));
+    spool->config = *config;
+    spool->config.disk_limit &= ~(size_t)7;
+    spool->memory = queue_constructor();
+    spool->fd = -1;
+}
+
+// Create and map the ring file: 0 on success, -1 on failure
+static int p2p_spool_open(P2PSpool* spool) {
+    int fd = open(spool->config.path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        P2P_ERROR("Failed to create spool file %s", spool->config.path);
+        return -1;
+    }
+    if (ftruncate(fd, spool->config.disk_limit) < 0) {
+        P2P_ERROR("Failed to size spool file %s", spool->config.path);
+        close(fd);
+        unlink(spool->config.path);
+        return -1;
+    }
+    void* ring = mmap(NULL, spool->config.disk_limit, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        P2P_ERROR("Failed to map spool file %s", spool->config.path);
+        close(fd);
+        unlink(spool->config.path);
+        return -1;
+    }
+    spool->fd = fd;
+    spool->ring = ring;
+    return 0;
+}
+
+// Find room for size bytes at the tail of the ring: the offset, or -1 if full
+static long p2p_spool_reserve(P2PSpool* spool, size_t size) {
+    size_t cap = spool->config.disk_limit;
+    if (spool->disk_count == 0) {
+        spool->head = 0;
+        spool->tail = 0;
+    }
+
+    // Records run from head to tail: use the end of the file, else wrap
+    // around to the space the head has already freed
+    if (spool->disk_count == 0 || spool->tail > spool->head) {
+        if (cap - spool->tail >= size) return (long)spool->tail;
+        if (size > spool->head) return -1;
+        if (cap - spool->tail >= sizeof(P2PSpoolRecord)) {
+            ((P2PSpoolRecord*)(spool->ring + spool->tail))->len = P2P_SPOOL_WRAP;
+        }
+        spool->tail = 0;
+        return 0;
+    }
+
+    // Wrapped: the free space lies between tail and head
+    if (spool->head - spool->tail >= size) return (long)spool->tail;
+    return -1;
+}
+
+// Copy frames into the ring file: 0 on success, -1 if it does not fit
+static int p2p_spool_spill(P2PSpool* spool, P2PBuffer* frames, int type_id, long long enqueued_ms) {
+    size_t size = p2p_spool_record_size(frames->len);
+    if (spool->config.disk_limit == 0 || size > spool->config.disk_limit) return -1;
+    if (!spool->ring && p2p_spool_open(spool) < 0) return -1;
+
+    long offset = p2p_spool_reserve(spool, size);
+    if (offset < 0) return -1;
+
+    P2PSpoolRecord* record = (P2PSpoolRecord*)(spool->ring + offset);
+    record->len = (uint32_t)frames->len;
+    record->type_id = type_id;
+    record->enqueued_ms = enqueued_ms;
+    memcpy(record + 1, frames->data, frames->len);
+    spool->tail = (size_t)offset + size;
+    spool->disk_count++;
+    return 0;
+}
+
+// Append frames: 0 on success, -1 if the spool is full
+int p2p_spool_push(P2PSpool* spool, P2PBuffer* frames, int type_id, long long enqueued_ms) {
+    // Memory holds the oldest records, so it only takes new ones while the disk is empty
+    if (spool->disk_count == 0 && spool->memory_bytes + frames->len <= spool->config.memory_limit) {
+        P2PSpoolEntry entry = { p2p_buffer_retain(frames), type_id, enqueued_ms };
+        spool->memory.push(&spool->memory, &entry, sizeof(entry));
+        spool->memory_bytes += frames->len;
+    } else if (p2p_spool_spill(spool, frames, type_id, enqueued_ms) < 0) {
+        return -1;
+    }
+    spool->count++;
+    return 0;
+}
+
+// Remove the oldest record regardless of age: NULL if the spool is empty
+static P2PBuffer* p2p_spool_take(P2PSpool* spool, int* type_id, long long* enqueued_ms) {
+    P2PSpoolEntry* entry = spool->memory.peek(&spool->memory);
+    if (entry) {
+        P2PBuffer* frames = entry->frames;
+        *type_id = entry->type_id;
+        *enqueued_ms = entry->enqueued_ms;
+        spool->memory_bytes -= frames->len;
+        spool->memory.pop(&spool->memory);
+        spool->count--;
+        return frames;
+    }
+    if (spool->disk_count == 0) return NULL;
+
+    P2PSpoolRecord* record = (P2PSpoolRecord*)(spool->ring + spool->head);
+    if (spool->config.disk_limit - spool->head < sizeof(P2PSpoolRecord) || record->len == P2P_SPOOL_WRAP) {
+        spool->head = 0;
+        record = (P2PSpoolRecord*)spool->ring;
+    }
+
+    // Records leave the ring as a copy: their space is reused once the head moves on
+    P2PBuffer* frames = p2p_buffer_create(record->len);
+    if (!frames) return NULL;
+    memcpy(frames->data, record + 1, record->len);
+    frames->len = record->len;
+    *type_id = record->type_id;
+    *enqueued_ms = record->enqueued_ms;
+
+    spool->head += p2p_spool_record_size(record->len);
+    spool->disk_count--;
+    spool->count--;
+    return frames;
+}
+
+// Remove the oldest record that has not expired
+P2PBuffer* p2p_spool_pop(P2PSpool* spool, long long now_ms, int* type_id, long long* enqueued_ms) {
+    P2PBuffer* frames;
+    while ((frames = p2p_spool_take(spool, type_id, enqueued_ms)) != NULL) {
+        if (spool->config.max_age_ms <= 0 || now_ms - *enqueued_ms <= spool->config.max_age_ms) {
+            return frames;
+        }
+        spool->expired++;
+        p2p_buffer_release(frames);
+    }
+    return NULL;
+}
+
+// Drop every record and remove the ring file
+void p2p_spool_destroy(P2PSpool* spool) {
+    P2PSpoolEntry* entry;
+    while ((entry = spool->memory.peek(&spool->memory)) != NULL) {
+        p2p_buffer_release(entry->frames);
+        spool->memory.pop(&spool->memory);
+    }
+    queue_destructor(&spool->memory);
+
+    if (spool->ring) {
+        munmap(spool->ring, spool->config.disk_limit);
+        close(spool->fd);
+        unlink(spool->config.path);
+        spool->ring = NULL;
+        spool->fd = -1;
+    }
+    spool->disk_count = 0;
+    spool->count = 0;
+}
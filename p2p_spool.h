@@ -0,0 +1,67 @@
+#ifndef P2P_SPOOL_H
+#define P2P_SPOOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "p2p_buffer.h"
+#include "DataStructures/Lists/Queue.h"
+
+// Defaults used by p2p_main's --spool option
+#define P2P_SPOOL_DEFAULT_MEMORY (1024 * 1024)
+#define P2P_SPOOL_DEFAULT_DISK (64 * 1024 * 1024)
+#define P2P_SPOOL_DEFAULT_MAX_AGE_MS (10 * 60 * 1000)
+
+// Store-and-forward limits for one peer
+typedef struct {
+    size_t memory_limit;    // Frame bytes held in memory before spilling to disk
+    size_t disk_limit;      // Size of the ring file (0 keeps everything in memory)
+    long max_age_ms;        // Records older than this are dropped unsent (0 never expires)
+    char path[256];         // Ring file, created on the first spill
+} P2PSpoolConfig;
+
+// Frames held in memory
+typedef struct {
+    P2PBuffer* frames;      // One reference
+    int type_id;
+    long long enqueued_ms;
+} P2PSpoolEntry;
+
+// Ordered queue of encoded frame sequences for a peer that cannot be
+// reached. Records stay in memory (by reference, no copy) up to the memory
+// limit; beyond that they are copied into a ring file mapped with mmap, and
+// once anything is on disk new records follow it there so the queue drains
+// in submission order. The file is spill space for this process only: it
+// is truncated when created and removed with the spool, since type ids in
+// the frames are only meaningful to the connection that defines them.
+//
+// A spool belongs to one thread; it does no locking.
+typedef struct {
+    P2PSpoolConfig config;
+    struct Queue memory;    // P2PSpoolEntry, oldest first (older than anything on disk)
+    size_t memory_bytes;
+    int fd;                 // Ring file, -1 until the first spill
+    uint8_t* ring;
+    size_t head;            // Oldest record on disk
+    size_t tail;            // Where the next record is written
+    size_t disk_count;
+    size_t count;           // Records held (memory and disk)
+    unsigned long expired;  // Records dropped for age
+} P2PSpool;
+
+// Initialize an empty spool (nothing is allocated until the first push)
+void p2p_spool_init(P2PSpool* spool, const P2PSpoolConfig* config);
+
+// Append frames queued at enqueued_ms (takes its own reference): 0 on
+// success, -1 if the spool is full
+int p2p_spool_push(P2PSpool* spool, P2PBuffer* frames, int type_id, long long enqueued_ms);
+
+// Remove the oldest record that has not expired by now_ms: NULL if none is
+// left. The caller gets a reference to the frames.
+P2PBuffer* p2p_spool_pop(P2PSpool* spool, long long now_ms, int* type_id, long long* enqueued_ms);
+
+// Drop every record and remove the ring file
+void p2p_spool_destroy(P2PSpool* spool);
+
+#endif
@@ -0,0 +1,138 @@
+#include "p2p_stream.h"
+#include "p2p_log.h"
+
+// Initialize reassembler with the default limits
+void p2p_reassembler_init(P2PReassembler* reassembler, void (*deliver)(void* context, P2PMessage* msg), void* context) {
+    reassembler->entries = linked_list_constructor();
+    reassembler->buffered_bytes = 0;
+    reassembler->max_message_size = P2P_STREAM_MAX_MESSAGE;
+    reassembler->max_buffered_bytes = P2P_STREAM_MAX_BUFFERED;
+    reassembler->timeout_seconds = P2P_STREAM_TIMEOUT;
+    reassembler->reassemble = 1;
+    reassembler->deliver = deliver;
+    reassembler->context = context;
+    reassembler->chunk_handler = NULL;
+}
+
+// Find the in-progress entry for a sender's message
+static P2PStreamEntry* p2p_reassembler_find(P2PReassembler* reassembler, const char* sender,
+                                            uint64_t msg_id, int* index) {
+    int i = 0;
+    for (struct Node* current = reassembler->entries.head; current != NULL; current = current->next, i++) {
+        P2PStreamEntry* entry = (P2PStreamEntry*)current->data;
+        if (entry->msg_id == msg_id && strcmp(entry->sender, sender) == 0) {
+            *index = i;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Release an entry and its buffer
+static void p2p_reassembler_drop(P2PReassembler* reassembler, P2PStreamEntry* entry, int index) {
+    if (entry->buffer) {
+        reassembler->buffered_bytes -= entry->total_len;
+        free(entry->buffer);
+    }
+    reassembler->entries.remove(&reassembler->entries, index);
+}
+
+// Feed one fragment
+int p2p_reassembler_feed(P2PReassembler* reassembler, const P2PFragment* fragment) {
+    int index = -1;
+    P2PStreamEntry* entry;
+
+    if (fragment->offset == 0) {
+        if (fragment->total_len > reassembler->max_message_size) {
+            P2P_WARN("Dropping %llu byte message from %s: over the size limit",
+                     (unsigned long long)fragment->total_len, fragment->sender);
+            return -1;
+        }
+
+        P2PStreamEntry new_entry;
+        memset(&new_entry, 0, sizeof(new_entry));
+        snprintf(new_entry.type, sizeof(new_entry.type), "%s", fragment->type);
+        snprintf(new_entry.sender, sizeof(new_entry.sender), "%s", fragment->sender);
+        new_entry.msg_id = fragment->msg_id;
+        new_entry.total_len = fragment->total_len;
+        new_entry.last_activity = time(NULL);
+
+        // Only buffer when someone wants the whole message
+        if (reassembler->reassemble) {
+            if (reassembler->buffered_bytes + fragment->total_len > reassembler->max_buffered_bytes) {
+                P2P_WARN("Dropping message from %s: reassembly memory exhausted", fragment->sender);
+                return -1;
+            }
+            new_entry.buffer = malloc(fragment->total_len ? fragment->total_len : 1);
+            if (!new_entry.buffer) return -1;
+            reassembler->buffered_bytes += fragment->total_len;
+        }
+
+        reassembler->entries.append(&reassembler->entries, &new_entry, sizeof(new_entry));
+        index = reassembler->entries.length - 1;
+        entry = (P2PStreamEntry*)reassembler->entries.tail->data;
+    } else {
+        entry = p2p_reassembler_find(reassembler, fragment->sender, fragment->msg_id, &index);
+        if (!entry) return -1;
+    }
+
+    if (fragment->offset != entry->received || fragment->total_len != entry->total_len) {
+        P2P_WARN("Dropping message %llu from %s: fragment out of order",
+                 (unsigned long long)entry->msg_id, entry->sender);
+        p2p_reassembler_drop(reassembler, entry, index);
+        return -1;
+    }
+
+    if (entry->buffer) {
+        memcpy(entry->buffer + fragment->offset, fragment->chunk, fragment->chunk_len);
+    }
+    entry->received += fragment->chunk_len;
+    entry->last_activity = time(NULL);
+
+    if (reassembler->chunk_handler) {
+        P2PChunk chunk = { entry->type, entry->sender, entry->msg_id, fragment->offset,
+                           entry->total_len, fragment->chunk, fragment->chunk_len };
+        reassembler->chunk_handler(&chunk);
+    }
+
+    if (entry->received < entry->total_len) return 0;
+
+    // Complete: hand the whole payload on
+    if (entry->buffer && reassembler->deliver) {
+        P2PMessage* msg = p2p_message_alloc();
+        if (msg) {
+            strcpy(msg->type, entry->type);
+            strcpy(msg->sender, entry->sender);
+            p2p_message_set_data(msg, entry->buffer, entry->total_len);
+            msg->type_id = -1;
+            reassembler->deliver(reassembler->context, msg);
+            p2p_message_free(msg);
+        }
+    }
+    p2p_reassembler_drop(reassembler, entry, index);
+    return 1;
+}
+
+// Drop incomplete messages idle for longer than the timeout
+void p2p_reassembler_expire(P2PReassembler* reassembler, time_t now) {
+    struct Node* current = reassembler->entries.head;
+    int index = 0;
+    while (current != NULL) {
+        P2PStreamEntry* entry = (P2PStreamEntry*)current->data;
+        current = current->next;
+        if (now - entry->last_activity > reassembler->timeout_seconds) {
+            P2P_WARN("Dropping incomplete message %llu from %s after %d seconds",
+                     (unsigned long long)entry->msg_id, entry->sender, reassembler->timeout_seconds);
+            p2p_reassembler_drop(reassembler, entry, index);
+        } else {
+            index++;
+        }
+    }
+}
+
+// Free all incomplete messages
+void p2p_reassembler_destroy(P2PReassembler* reassembler) {
+    while (reassembler->entries.length > 0) {
+        p2p_reassembler_drop(reassembler, (P2PStreamEntry*)reassembler->entries.head->data, 0);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef P2P_STREAM_H
+#define P2P_STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "p2p_message.h"
+#include "p2p_wire.h"
+#include "DataStructures/Lists/LinkedList.h"
+
+// Payload bytes carried by each fragment
+#define P2P_STREAM_CHUNK_SIZE 8192
+
+// Reassembly limits
+#define P2P_STREAM_MAX_MESSAGE (64 * 1024 * 1024)    // Largest payload accepted
+#define P2P_STREAM_MAX_BUFFERED (256 * 1024 * 1024)  // Total bytes held across incomplete messages
+#define P2P_STREAM_TIMEOUT 30                        // Seconds an incomplete message may sit idle
+
+// A chunk of a large message, as handed to a chunk handler
+typedef struct {
+    const char* type;
+    const char* sender;
+    uint64_t msg_id;
+    uint64_t offset;        // Position of data in the full payload
+    uint64_t total_len;     // Full payload length
+    const void* data;       // Valid only during the callback
+    size_t len;
+} P2PChunk;
+
+// Chunk handler function type
+typedef void (*chunk_handler_t)(const P2PChunk* chunk);
+
+// Incomplete message being reassembled
+typedef struct {
+    char type[32];
+    char sender[64];
+    uint64_t msg_id;
+    uint64_t total_len;
+    uint64_t received;
+    uint8_t* buffer;        // NULL when only chunks are delivered
+    time_t last_activity;
+} P2PStreamEntry;
+
+// Reassembles fragments into whole messages with bounded memory. Not
+// thread safe - fragments are fed from the thread that reads them.
+typedef struct {
+    struct LinkedList entries;          // P2PStreamEntry
+    size_t buffered_bytes;
+    size_t max_message_size;
+    size_t max_buffered_bytes;
+    int timeout_seconds;
+    int reassemble;                     // Buffer whole messages for deliver
+    void (*deliver)(void* context, P2PMessage* msg);  // Receives each complete message
+    void* context;
+    chunk_handler_t chunk_handler;      // Optional, receives every chunk as it arrives
+} P2PReassembler;
+
+// Initialize reassembler with the default limits
+void p2p_reassembler_init(P2PReassembler* reassembler, void (*deliver)(void* context, P2PMessage* msg), void* context);
+
+// Feed one fragment: 1 if it completed a message, 0 if more are expected,
+// -1 if it was dropped (unknown stream, out of order or over a limit)
+int p2p_reassembler_feed(P2PReassembler* reassembler, const P2PFragment* fragment);
+
+// Drop incomplete messages idle for longer than the timeout
+void p2p_reassembler_expire(P2PReassembler* reassembler, time_t now);
+
+// Free all incomplete messages
+void p2p_reassembler_destroy(P2PReassembler* reassembler);
+
+#endif
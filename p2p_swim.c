@@ -0,0 +1,396 @@
+#include "p2p_swim.h"
+#include "p2p_log.h"
+#include "p2p_metrics.h"
+#include <time.h>
+
+// Fill config with the defaults
+void p2p_swim_defaults(P2PSwimConfig* config) {
+    config->period_ms = P2P_SWIM_PERIOD_MS;
+    config->ping_timeout_ms = P2P_SWIM_PING_TIMEOUT_MS;
+    config->indirect_probes = P2P_SWIM_INDIRECT_PROBES;
+    config->suspect_periods = P2P_SWIM_SUSPECT_PERIODS;
+}
+
+// Monotonic clock in milliseconds
+long long p2p_swim_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// Initialize a detector that only answers
+void p2p_swim_init(P2PSwim* swim, P2PPeerList* peers, const char* self, swim_send_t send, swim_forget_t forget,
+                   void* context) {
+    memset(swim, 0, sizeof(P2PSwim));
+    p2p_swim_defaults(&swim->config);
+    swim->peers = peers;
+    snprintf(swim->self, sizeof(swim->self), "%s", self);
+    swim->send = send;
+    swim->forget = forget;
+    swim->context = context;
+    // Nodes start their round robin at different places
+    swim->seed = (unsigned int)time(NULL);
+    for (const char* c = self; *c; c++) {
+        swim->seed = swim->seed * 31 + (unsigned char)*c;
+    }
+    swim->next_index = rand_r(&swim->seed);
+}
+
+// Start probing
+void p2p_swim_enable(P2PSwim* swim, const P2PSwimConfig* config) {
+    swim->config = *config;
+    swim->enabled = 1;
+}
+
+// Tick often enough to notice a ping timeout promptly
+int p2p_swim_tick_ms(const P2PSwim* swim) {
+    int tick = swim->config.ping_timeout_ms / 4;
+    return tick < 5 ? 5 : tick;
+}
+
+static P2PSwimTombstone* p2p_swim_tombstone(P2PSwim* swim, const char* address) {
+    for (int i = 0; i < P2P_SWIM_TOMBSTONES; i++) {
+        if (strcmp(swim->tombstones[i].address, address) == 0) return &swim->tombstones[i];
+    }
+    return NULL;
+}
+
+// Whether address was confirmed dead recently
+int p2p_swim_is_dead(P2PSwim* swim, const char* address) {
+    return address[0] && p2p_swim_tombstone(swim, address) != NULL;
+}
+
+// Forget that address was dead, keeping the incarnation it was buried at
+// so older news of its death stays ignored
+void p2p_swim_heard(P2PSwim* swim, const char* address) {
+    p2p_peer_list_lock(swim->peers);
+    P2PSwimTombstone* tombstone = address[0] ? p2p_swim_tombstone(swim, address) : NULL;
+    if (tombstone) {
+        tombstone->address[0] = '\0';
+        P2PPeer* peer = p2p_peer_list_find(swim->peers, address);
+        if (peer && peer->incarnation < tombstone->incarnation) peer->incarnation = tombstone->incarnation;
+    }
+    p2p_peer_list_unlock(swim->peers);
+}
+
+// Times an update is gossiped: P2P_SWIM_RETRANSMIT_MULT * ceil(log2(n + 1))
+static int p2p_swim_retransmit_limit(P2PSwim* swim) {
+    int n = p2p_peer_list_count(swim->peers) + 1;
+    int log = 1;
+    while ((1 << log) < n) log++;
+    return P2P_SWIM_RETRANSMIT_MULT * log;
+}
+
+// Add an update if there is room
+static void p2p_swim_put_update(P2PSwimFrame* frame, const char* address, int state, uint64_t incarnation) {
+    if (frame->update_count == P2P_WIRE_MAX_SWIM_UPDATES) return;
+    P2PSwimUpdate* update = &frame->updates[frame->update_count++];
+    snprintf(update->address, sizeof(update->address), "%s", address);
+    update->state = (uint8_t)state;
+    update->incarnation = incarnation;
+}
+
+// Piggyback updates on a frame for to: news about to itself first, so it
+// can refute, then our own ALIVE, then the least gossiped of the rest
+static void p2p_swim_gossip(P2PSwim* swim, P2PSwimFrame* frame, const char* to) {
+    int limit = p2p_swim_retransmit_limit(swim);
+    P2PPeer* recipient = p2p_peer_list_find(swim->peers, to);
+    P2PSwimTombstone* buried = p2p_swim_tombstone(swim, to);
+    if (recipient && recipient->state == P2P_PEER_SUSPECT) {
+        p2p_swim_put_update(frame, to, P2P_PEER_SUSPECT, recipient->incarnation);
+    }
+    if (buried) {
+        p2p_swim_put_update(frame, to, P2P_PEER_DEAD, buried->incarnation);
+    }
+    if (swim->self_transmits < limit) {
+        p2p_swim_put_update(frame, swim->self, P2P_PEER_ALIVE, swim->incarnation);
+        swim->self_transmits++;
+    }
+
+    // Keep the room's worth of candidates with the fewest transmits
+    int room = P2P_WIRE_MAX_SWIM_UPDATES - frame->update_count;
+    int* picked[P2P_WIRE_MAX_SWIM_UPDATES];
+    const char* addresses[P2P_WIRE_MAX_SWIM_UPDATES];
+    int states[P2P_WIRE_MAX_SWIM_UPDATES];
+    uint64_t incarnations[P2P_WIRE_MAX_SWIM_UPDATES];
+    int count = 0;
+    struct Node* current = swim->peers->peer_list.head;
+    int tombstone = 0;
+    while (room > 0) {
+        int* transmits;
+        const char* address;
+        int state;
+        uint64_t incarnation;
+        if (current) {
+            P2PPeer* peer = (P2PPeer*)current->data;
+            current = current->next;
+            if (peer == recipient) continue;
+            transmits = &peer->transmits;
+            address = peer->address;
+            state = peer->state;
+            incarnation = peer->incarnation;
+        } else if (tombstone < P2P_SWIM_TOMBSTONES) {
+            P2PSwimTombstone* dead = &swim->tombstones[tombstone++];
+            if (dead->address[0] == '\0' || dead == buried) continue;
+            transmits = &dead->transmits;
+            address = dead->address;
+            state = P2P_PEER_DEAD;
+            incarnation = dead->incarnation;
+        } else {
+            break;
+        }
+        if (*transmits >= limit) continue;
+
+        // Insertion into the short list, ordered by transmits
+        int i = count < room ? count++ : room;
+        if (i == room && *picked[room - 1] <= *transmits) continue;
+        if (i == room) i--;
+        while (i > 0 && *picked[i - 1] > *transmits) {
+            picked[i] = picked[i - 1];
+            addresses[i] = addresses[i - 1];
+            states[i] = states[i - 1];
+            incarnations[i] = incarnations[i - 1];
+            i--;
+        }
+        picked[i] = transmits;
+        addresses[i] = address;
+        states[i] = state;
+        incarnations[i] = incarnation;
+    }
+    for (int i = 0; i < count; i++) {
+        p2p_swim_put_update(frame, addresses[i], states[i], incarnations[i]);
+        (*picked[i])++;
+    }
+}
+
+// Encode and send one frame to address
+static void p2p_swim_send(P2PSwim* swim, const char* address, int kind, uint64_t seq,
+                          const char* target, const char* origin) {
+    P2PSwimFrame frame;
+    frame.kind = (uint8_t)kind;
+    frame.seq = seq;
+    snprintf(frame.from, sizeof(frame.from), "%s", swim->self);
+    snprintf(frame.target, sizeof(frame.target), "%s", target);
+    snprintf(frame.origin, sizeof(frame.origin), "%s", origin);
+    frame.update_count = 0;
+    p2p_swim_gossip(swim, &frame, address);
+
+    P2PBuffer* buffer = p2p_buffer_create(P2P_WIRE_MAX_SWIM);
+    if (!buffer) return;
+    buffer->len = p2p_wire_encode_swim(&frame, buffer->data, buffer->cap);
+    if (buffer->len == 0) {
+        p2p_buffer_release(buffer);
+        return;
+    }
+    swim->send(swim->context, address, buffer);
+}
+
+// Mark a peer suspect
+static void p2p_swim_suspect(P2PPeer* peer, uint64_t incarnation, long long now_ms) {
+    P2P_INFO("Suspecting peer %s (incarnation %llu)", peer->address, (unsigned long long)incarnation);
+    peer->state = P2P_PEER_SUSPECT;
+    peer->incarnation = incarnation;
+    peer->state_ms = now_ms;
+    peer->transmits = 0;
+    p2p_metrics_add(P2P_COUNTER_PEERS_SUSPECTED, 1);
+}
+
+// Confirm a peer dead: bury it, take it out of the peer list and drop
+// its connection
+static void p2p_swim_bury(P2PSwim* swim, const char* address, uint64_t incarnation, long long now_ms) {
+    P2PSwimTombstone* tombstone = p2p_swim_tombstone(swim, address);
+    if (!tombstone) {
+        // Reuse a free slot, else the one closest to expiring
+        tombstone = &swim->tombstones[0];
+        for (int i = 0; i < P2P_SWIM_TOMBSTONES; i++) {
+            if (swim->tombstones[i].address[0] == '\0') {
+                tombstone = &swim->tombstones[i];
+                break;
+            }
+            if (swim->tombstones[i].until_ms < tombstone->until_ms) tombstone = &swim->tombstones[i];
+        }
+        snprintf(tombstone->address, sizeof(tombstone->address), "%s", address);
+    }
+    tombstone->incarnation = incarnation;
+    tombstone->until_ms = now_ms + (long long)P2P_SWIM_TOMBSTONE_PERIODS * swim->config.period_ms;
+    tombstone->transmits = 0;
+
+    if (p2p_peer_list_remove(swim->peers, address)) {
+        P2P_WARN("Peer %s failed, removed from the peer list", address);
+        p2p_metrics_add(P2P_COUNTER_PEERS_FAILED, 1);
+        swim->forget(swim->context, address);
+    }
+    if (strcmp(swim->target, address) == 0) swim->target[0] = '\0';
+}
+
+// Apply one gossiped update
+static void p2p_swim_apply(P2PSwim* swim, const P2PSwimUpdate* update, long long now_ms) {
+    if (update->address[0] == '\0' || update->state > P2P_PEER_DEAD) return;
+
+    // Refute news of our own failure
+    if (strcmp(update->address, swim->self) == 0) {
+        if (update->state != P2P_PEER_ALIVE && update->incarnation >= swim->incarnation) {
+            swim->incarnation = update->incarnation + 1;
+            swim->self_transmits = 0;
+            P2P_INFO("Refuting suspicion with incarnation %llu", (unsigned long long)swim->incarnation);
+        }
+        return;
+    }
+
+    // Only a newer ALIVE brings a dead peer back: it refuted after all, and
+    // having been a member it is no address discovery did not vouch for
+    P2PSwimTombstone* tombstone = p2p_swim_tombstone(swim, update->address);
+    if (tombstone) {
+        if (update->state != P2P_PEER_ALIVE || update->incarnation <= tombstone->incarnation) return;
+        tombstone->address[0] = '\0';
+        if (p2p_peer_list_add(swim->peers, update->address, swim->self) > 0) {
+            P2P_INFO("Peer %s refuted its death, back in the peer list", update->address);
+        }
+    }
+
+    // Members only come from discovery
+    P2PPeer* peer = p2p_peer_list_find(swim->peers, update->address);
+    if (!peer) return;
+    // Stale news of a death does not outrank a later refutation
+    if (update->state == P2P_PEER_DEAD) {
+        if (update->incarnation >= peer->incarnation) p2p_swim_bury(swim, update->address, update->incarnation, now_ms);
+        return;
+    }
+
+    if (update->state == P2P_PEER_ALIVE) {
+        if (update->incarnation > peer->incarnation) {
+            if (peer->state == P2P_PEER_SUSPECT) P2P_INFO("Peer %s refuted suspicion", peer->address);
+            peer->state = P2P_PEER_ALIVE;
+            peer->incarnation = update->incarnation;
+            peer->state_ms = now_ms;
+            peer->transmits = 0;
+        }
+    } else if ((peer->state == P2P_PEER_ALIVE && update->incarnation >= peer->incarnation) ||
+               (peer->state == P2P_PEER_SUSPECT && update->incarnation > peer->incarnation)) {
+        p2p_swim_suspect(peer, update->incarnation, now_ms);
+    }
+}
+
+// Peer at the round-robin position, NULL if the list is empty
+static P2PPeer* p2p_swim_next_target(P2PSwim* swim) {
+    int count = p2p_peer_list_count(swim->peers);
+    if (count == 0) return NULL;
+    int index = (int)((unsigned int)swim->next_index++ % (unsigned int)count);
+    struct Node* current = swim->peers->peer_list.head;
+    while (index-- > 0 && current) current = current->next;
+    return current ? (P2PPeer*)current->data : NULL;
+}
+
+// Ask up to indirect_probes random other peers to probe the target
+static void p2p_swim_probe_indirectly(P2PSwim* swim) {
+    int count = p2p_peer_list_count(swim->peers);
+    int asked[P2P_WIRE_MAX_SWIM_UPDATES];
+    int asked_count = 0;
+    int wanted = swim->config.indirect_probes < P2P_WIRE_MAX_SWIM_UPDATES ? swim->config.indirect_probes
+                                                                           : P2P_WIRE_MAX_SWIM_UPDATES;
+    for (int attempt = 0; attempt < wanted * 3 && asked_count < wanted && count > 1; attempt++) {
+        int index = rand_r(&swim->seed) % count;
+        int repeat = 0;
+        for (int i = 0; i < asked_count; i++) {
+            if (asked[i] == index) repeat = 1;
+        }
+        if (repeat) continue;
+        struct Node* current = swim->peers->peer_list.head;
+        for (int i = 0; i < index && current; i++) current = current->next;
+        P2PPeer* peer = current ? (P2PPeer*)current->data : NULL;
+        if (!peer || strcmp(peer->address, swim->target) == 0 || peer->state != P2P_PEER_ALIVE) continue;
+        asked[asked_count++] = index;
+        p2p_swim_send(swim, peer->address, P2P_SWIM_PING_REQ, swim->seq, swim->target, "");
+    }
+}
+
+// Advance the protocol
+void p2p_swim_tick(P2PSwim* swim, long long now_ms) {
+    if (!swim->enabled) return;
+    p2p_peer_list_lock(swim->peers);
+
+    // The probe of this period: indirect probes after the ping timeout,
+    // suspicion once the period is over without an ack
+    if (swim->target[0]) {
+        if (!swim->indirect && now_ms - swim->probe_ms >= swim->config.ping_timeout_ms) {
+            swim->indirect = 1;
+            p2p_swim_probe_indirectly(swim);
+        }
+        if (now_ms - swim->probe_ms >= swim->config.period_ms) {
+            P2PPeer* peer = p2p_peer_list_find(swim->peers, swim->target);
+            if (peer && peer->state == P2P_PEER_ALIVE) p2p_swim_suspect(peer, peer->incarnation, now_ms);
+            swim->target[0] = '\0';
+        }
+    }
+
+    // Suspects that did not refute in time are dead
+    const char* expired[P2P_SWIM_MAX_EXPIRED];
+    uint64_t incarnations[P2P_SWIM_MAX_EXPIRED];
+    int expired_count = 0;
+    long long suspect_ms = (long long)swim->config.suspect_periods * swim->config.period_ms;
+    for (struct Node* current = swim->peers->peer_list.head; current && expired_count < P2P_SWIM_MAX_EXPIRED;
+         current = current->next) {
+        P2PPeer* peer = (P2PPeer*)current->data;
+        if (peer->state == P2P_PEER_SUSPECT && now_ms - peer->state_ms >= suspect_ms) {
+            incarnations[expired_count] = peer->incarnation;
+            expired[expired_count++] = peer->address;
+        }
+    }
+    // Bury from the end: removing a peer frees the node its address is in
+    for (int i = expired_count - 1; i >= 0; i--) {
+        char address[64];
+        snprintf(address, sizeof(address), "%s", expired[i]);
+        p2p_swim_bury(swim, address, incarnations[i], now_ms);
+    }
+
+    for (int i = 0; i < P2P_SWIM_TOMBSTONES; i++) {
+        if (swim->tombstones[i].address[0] && swim->tombstones[i].until_ms <= now_ms) {
+            swim->tombstones[i].address[0] = '\0';
+        }
+    }
+
+    // Start the next period's probe
+    if (now_ms >= swim->next_period_ms) {
+        swim->next_period_ms = now_ms + swim->config.period_ms;
+        P2PPeer* peer = p2p_swim_next_target(swim);
+        if (peer) {
+            snprintf(swim->target, sizeof(swim->target), "%.63s", peer->address);
+            swim->seq++;
+            swim->probe_ms = now_ms;
+            swim->indirect = 0;
+            p2p_metrics_add(P2P_COUNTER_PROBES, 1);
+            p2p_swim_send(swim, swim->target, P2P_SWIM_PING, swim->seq, swim->target, "");
+        }
+    }
+    p2p_peer_list_unlock(swim->peers);
+}
+
+// Handle a frame another node sent
+void p2p_swim_handle(P2PSwim* swim, const P2PSwimFrame* frame, long long now_ms) {
+    p2p_peer_list_lock(swim->peers);
+    for (int i = 0; i < frame->update_count; i++) {
+        p2p_swim_apply(swim, &frame->updates[i], now_ms);
+    }
+    P2PPeer* sender = p2p_peer_list_find(swim->peers, frame->from);
+    if (sender) sender->last_seen = time(NULL);
+
+    // Replies and relayed probes only ever go to members, so a forged
+    // address never makes this node connect anywhere
+    if (frame->kind == P2P_SWIM_PING) {
+        // Answer to whoever sent it, naming the node an indirect probe is for.
+        // A member we buried is answered too: the ack tells it so it can refute.
+        if (sender || p2p_swim_tombstone(swim, frame->from)) p2p_swim_send(swim, frame->from, P2P_SWIM_ACK, frame->seq, swim->self, frame->origin);
+    } else if (frame->kind == P2P_SWIM_PING_REQ) {
+        if (sender && p2p_peer_list_find(swim->peers, frame->target)) {
+            p2p_swim_send(swim, frame->target, P2P_SWIM_PING, frame->seq, frame->target, frame->from);
+        }
+    } else if (frame->origin[0] && strcmp(frame->origin, swim->self) != 0) {
+        // Ack for a probe we made on another node's behalf: pass it on
+        if (p2p_peer_list_find(swim->peers, frame->origin)) {
+            p2p_swim_send(swim, frame->origin, P2P_SWIM_ACK, frame->seq, frame->target, "");
+        }
+    } else if (swim->target[0] && frame->seq == swim->seq && strcmp(frame->target, swim->target) == 0) {
+        swim->target[0] = '\0';
+    }
+    p2p_peer_list_unlock(swim->peers);
+}
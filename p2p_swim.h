@@ -0,0 +1,129 @@
+#ifndef P2P_SWIM_H
+#define P2P_SWIM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "p2p_peer.h"
+#include "p2p_wire.h"
+#include "p2p_buffer.h"
+
+// SWIM failure detection.
+//
+// Every protocol period a node pings the next peer of its list, in round
+// robin from a random start, so each peer is probed within one pass of the
+// list. A peer that has not acked within the ping timeout is probed again
+// through indirect_probes other peers (PING_REQ), which rules out
+// a bad path between the two; one that still has not acked by the end of
+// the period becomes SUSPECT. A suspect that does not refute within
+// suspect_periods periods is confirmed DEAD and removed from the peer list.
+//
+// State changes travel piggybacked on the probe traffic itself: every
+// SWIM frame carries up to P2P_WIRE_MAX_SWIM_UPDATES updates, the least
+// gossiped first, and each update is sent about P2P_SWIM_RETRANSMIT_MULT *
+// log2(n) times. A node that hears it is suspected or dead raises its
+// incarnation and gossips ALIVE, which overrides the older news. Probe load
+// per node and detection time do not grow with the cluster.
+//
+// Dead peers are remembered for P2P_SWIM_TOMBSTONE_PERIODS periods so
+// discovery does not bring them straight back. One that talks to us
+// directly comes back; so does one that refutes, which a buried node that
+// still probes us learns from our ack, and news of a death never overrides
+// a newer incarnation. After a partition heals, the nodes each side buried
+// return this way.
+//
+// Nothing in a SWIM frame is authenticated, so the detector only acts for
+// peers it knows: members are added by discovery, or brought back by a
+// buried member's refutation, updates about other addresses are ignored,
+// and only members get answers (buried ones too, so they learn to refute),
+// have their PING_REQs carried out or their acks relayed.
+
+// Defaults
+#define P2P_SWIM_PERIOD_MS 1000
+#define P2P_SWIM_PING_TIMEOUT_MS 300
+#define P2P_SWIM_INDIRECT_PROBES 3
+#define P2P_SWIM_SUSPECT_PERIODS 5
+
+// Gossip each update this many times log2(n)
+#define P2P_SWIM_RETRANSMIT_MULT 3
+
+// Dead peers remembered at once, and for how many periods
+#define P2P_SWIM_TOMBSTONES 64
+#define P2P_SWIM_TOMBSTONE_PERIODS 60
+
+// Suspects confirmed dead in one tick, at most
+#define P2P_SWIM_MAX_EXPIRED 16
+
+typedef struct {
+    int period_ms;
+    int ping_timeout_ms;        // Before asking for indirect probes
+    int indirect_probes;
+    int suspect_periods;        // Before a suspect is confirmed dead
+} P2PSwimConfig;
+
+// Hands an encoded frame to address (takes over one reference to frame)
+typedef void (*swim_send_t)(void* context, const char* address, P2PBuffer* frame);
+
+// Drops what the owner keeps for a member confirmed dead (its connection)
+typedef void (*swim_forget_t)(void* context, const char* address);
+
+typedef struct {
+    char address[64];           // "" = free
+    uint64_t incarnation;
+    long long until_ms;
+    int transmits;
+} P2PSwimTombstone;
+
+// Detector state of one network. Used on the thread that reads the
+// network's connections (the reactor), with the peer list locked.
+typedef struct {
+    P2PSwimConfig config;
+    int enabled;                // Whether this node probes (every node answers)
+    P2PPeerList* peers;
+    char self[64];
+    uint64_t incarnation;       // Ours, raised to refute suspicion
+    int self_transmits;
+    swim_send_t send;
+    swim_forget_t forget;
+    void* context;
+    char target[64];            // Peer probed this period ("" once acked or given up)
+    uint64_t seq;
+    long long probe_ms;
+    int indirect;               // Whether PING_REQs went out for this probe
+    long long next_period_ms;
+    int next_index;             // Round-robin position in the peer list
+    unsigned int seed;
+    P2PSwimTombstone tombstones[P2P_SWIM_TOMBSTONES];
+} P2PSwim;
+
+// Fill config with the defaults
+void p2p_swim_defaults(P2PSwimConfig* config);
+
+// Initialize a detector that answers probes but does not send any
+void p2p_swim_init(P2PSwim* swim, P2PPeerList* peers, const char* self, swim_send_t send, swim_forget_t forget,
+                   void* context);
+
+// Start probing with config on the next tick
+void p2p_swim_enable(P2PSwim* swim, const P2PSwimConfig* config);
+
+// Milliseconds between calls to p2p_swim_tick
+int p2p_swim_tick_ms(const P2PSwim* swim);
+
+// Advance the protocol to now_ms (monotonic)
+void p2p_swim_tick(P2PSwim* swim, long long now_ms);
+
+// Handle a frame another node sent
+void p2p_swim_handle(P2PSwim* swim, const P2PSwimFrame* frame, long long now_ms);
+
+// Whether address was confirmed dead recently
+int p2p_swim_is_dead(P2PSwim* swim, const char* address);
+
+// address spoke to us directly (call once it is in the peer list): forget
+// that it was dead
+void p2p_swim_heard(P2PSwim* swim, const char* address);
+
+// Monotonic clock in milliseconds
+long long p2p_swim_now_ms(void);
+
+#endif
@@ -0,0 +1,283 @@
+#include "p2p_trace.h"
+#include <signal.h>
+#include <pthread.h>
+
+#ifdef P2P_TRACE
+
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define P2P_TRACE_TSC 1
+#endif
+
+#define P2P_TRACE_MASK (P2P_TRACE_RING_EVENTS - 1)
+
+// Shortest span the clock is calibrated over
+#define P2P_TRACE_CALIBRATE_NS 10000000ull
+
+// One event. Only the owning thread writes; atomics keep the dump's
+// concurrent reads well defined and compile to plain loads and stores.
+typedef struct {
+    atomic_ulong time;          // p2p_trace_clock ticks
+    atomic_ulong id;
+    atomic_ulong stage_value;   // stage << 32 | (uint32_t)value
+} P2PTraceEvent;
+
+// An event copied out of a ring for a dump
+typedef struct {
+    uint64_t time;
+    uint64_t id;
+    uint64_t stage_value;
+} P2PTraceSample;
+
+// One thread's events. Rings of exited threads are kept so their events
+// still appear in later dumps.
+typedef struct P2PTraceRing {
+    atomic_ulong head;          // Events ever recorded
+    uint64_t next_id;           // Owner only
+    uint64_t serial;            // Registration order (high bits of ids)
+    long tid;
+    char name[32];
+    struct P2PTraceRing* next;
+    P2PTraceEvent events[P2P_TRACE_RING_EVENTS];
+} P2PTraceRing;
+
+// How a dump draws each stage: a slice or instant on the thread, plus an
+// optional async span shared by every event with the same id
+static const struct {
+    const char* name;
+    char phase;
+    const char* span;
+    char span_phase;
+} stages[P2P_TRACE_STAGE_COUNT] = {
+    [P2P_TRACE_SUBMIT] = { "submit", 'i', "send", 'b' },
+    [P2P_TRACE_CONNECT_BEGIN] = { "connect", 'B', NULL, 0 },
+    [P2P_TRACE_CONNECT_END] = { "connect", 'E', NULL, 0 },
+    [P2P_TRACE_WRITE_BEGIN] = { "write", 'B', NULL, 0 },
+    [P2P_TRACE_WRITE_END] = { "write", 'E', NULL, 0 },
+    [P2P_TRACE_SENT] = { "sent", 'i', "send", 'e' },
+    [P2P_TRACE_ACCEPT] = { "accept", 'i', NULL, 0 },
+    [P2P_TRACE_READ] = { "read", 'i', "receive", 'b' },
+    [P2P_TRACE_HANDLE_BEGIN] = { "handle", 'B', NULL, 0 },
+    [P2P_TRACE_HANDLE_END] = { "handle", 'E', "receive", 'e' },
+};
+
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static P2PTraceRing* rings;
+static uint64_t ring_count;
+static __thread P2PTraceRing* local_ring;
+
+// Clock reading paired with p2p_trace_clock at the first registration
+static uint64_t base_ticks;
+static uint64_t base_ns;
+
+static uint64_t p2p_trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Cheapest monotonic clock: the invariant TSC where there is one
+static inline uint64_t p2p_trace_clock(void) {
+#ifdef P2P_TRACE_TSC
+    return __rdtsc();
+#else
+    return p2p_trace_now_ns();
+#endif
+}
+
+// The calling thread's ring, registered on first use (NULL if out of memory)
+static P2PTraceRing* p2p_trace_ring(void) {
+    if (local_ring) return local_ring;
+
+    P2PTraceRing* ring = calloc(1, sizeof(P2PTraceRing));
+    if (!ring) return NULL;
+    ring->tid = (long)syscall(SYS_gettid);
+    snprintf(ring->name, sizeof(ring->name), "thread %ld", ring->tid);
+
+    pthread_mutex_lock(&rings_lock);
+    if (ring_count == 0) {
+        base_ns = p2p_trace_now_ns();
+        base_ticks = p2p_trace_clock();
+    }
+    ring->serial = ++ring_count;
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_lock);
+    local_ring = ring;
+    return ring;
+}
+
+// Record an event on the calling thread
+void p2p_trace_record(P2PTraceStage stage, uint64_t id, int32_t value) {
+    P2PTraceRing* ring = p2p_trace_ring();
+    if (!ring) return;
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    P2PTraceEvent* event = &ring->events[head & P2P_TRACE_MASK];
+    atomic_store_explicit(&event->time, p2p_trace_clock(), memory_order_relaxed);
+    atomic_store_explicit(&event->id, id, memory_order_relaxed);
+    atomic_store_explicit(&event->stage_value, (uint64_t)stage << 32 | (uint32_t)value, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// New message id: the ring's serial above a per-thread count, so no
+// thread ever waits for another
+uint64_t p2p_trace_next_id(void) {
+    P2PTraceRing* ring = p2p_trace_ring();
+    if (!ring) return 0;
+    return ring->serial << 40 | ++ring->next_id;
+}
+
+// Name the calling thread in dumps
+void p2p_trace_name_thread(const char* name) {
+    P2PTraceRing* ring = p2p_trace_ring();
+    if (!ring) return;
+    pthread_mutex_lock(&rings_lock);
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+    pthread_mutex_unlock(&rings_lock);
+}
+
+// Write one ring's surviving events; copy has room for a whole ring
+static void p2p_trace_write_ring(FILE* file, P2PTraceRing* ring, P2PTraceSample* copy, double ns_per_tick, int pid) {
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%ld,\"args\":{\"name\":\"%s\"}},\n",
+            pid, ring->tid, ring->name);
+
+    // Copy first, then keep only what the owner cannot have overwritten
+    // during the copy: it may have been writing the slot of head - RING
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t start = head > P2P_TRACE_RING_EVENTS ? head - P2P_TRACE_RING_EVENTS : 0;
+    for (uint64_t i = start; i < head; i++) {
+        P2PTraceEvent* event = &ring->events[i & P2P_TRACE_MASK];
+        P2PTraceSample* sample = &copy[i & P2P_TRACE_MASK];
+        sample->time = atomic_load_explicit(&event->time, memory_order_relaxed);
+        sample->id = atomic_load_explicit(&event->id, memory_order_relaxed);
+        sample->stage_value = atomic_load_explicit(&event->stage_value, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t now_head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (now_head >= P2P_TRACE_RING_EVENTS && now_head - P2P_TRACE_RING_EVENTS + 1 > start) {
+        start = now_head - P2P_TRACE_RING_EVENTS + 1;
+    }
+
+    for (uint64_t i = start; i < head; i++) {
+        P2PTraceSample* sample = &copy[i & P2P_TRACE_MASK];
+        int stage = (int)(sample->stage_value >> 32);
+        if (stage < 0 || stage >= P2P_TRACE_STAGE_COUNT) continue;
+        int32_t value = (int32_t)(uint32_t)sample->stage_value;
+        unsigned long long id = sample->id;
+        double ts = (double)(sample->time - base_ticks) * ns_per_tick / 1000.0;
+
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%ld,%s\"args\":{\"id\":%llu,\"value\":%d}},\n",
+                stages[stage].name, stages[stage].phase, ts, pid, ring->tid,
+                stages[stage].phase == 'i' ? "\"s\":\"t\"," : "", id, value);
+        if (stages[stage].span && id != 0) {
+            fprintf(file, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"id\":\"0x%llx\",\"ts\":%.3f,\"pid\":%d,\"tid\":%ld},\n",
+                    stages[stage].span, stages[stage].span, stages[stage].span_phase, id, ts, pid, ring->tid);
+        }
+    }
+}
+
+// Write every thread's events to path as Chrome trace JSON
+int p2p_trace_dump(const char* path) {
+    FILE* file = fopen(path, "w");
+    P2PTraceSample* copy = malloc(sizeof(P2PTraceSample) * P2P_TRACE_RING_EVENTS);
+    if (!file || !copy) {
+        printf("Failed to write trace to %s\n", path);
+        if (file) fclose(file);
+        free(copy);
+        return -1;
+    }
+
+    pthread_mutex_lock(&rings_lock);
+    // Calibrate ticks against the monotonic clock over at least a few ms
+    double ns_per_tick = 1.0;
+    if (ring_count > 0) {
+        uint64_t elapsed = p2p_trace_now_ns() - base_ns;
+        if (elapsed < P2P_TRACE_CALIBRATE_NS) {
+            struct timespec pause = { 0, (long)(P2P_TRACE_CALIBRATE_NS - elapsed) };
+            nanosleep(&pause, NULL);
+        }
+        uint64_t ticks = p2p_trace_clock();
+        uint64_t ns = p2p_trace_now_ns();
+        if (ticks > base_ticks) ns_per_tick = (double)(ns - base_ns) / (double)(ticks - base_ticks);
+    }
+
+    int pid = (int)getpid();
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (P2PTraceRing* ring = rings; ring; ring = ring->next) {
+        p2p_trace_write_ring(file, ring, copy, ns_per_tick, pid);
+    }
+    pthread_mutex_unlock(&rings_lock);
+    // Metadata closes the list so every event above can end with a comma
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"p2p %d\"}}\n]}\n", pid, pid);
+
+    free(copy);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// What the signal thread waits for
+typedef struct {
+    int signo;
+    char path[256];
+} P2PTraceSignal;
+
+// Dump each time the signal arrives
+static void* p2p_trace_signal_thread(void* arg) {
+    P2PTraceSignal* trigger = (P2PTraceSignal*)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, trigger->signo);
+
+    int signo;
+    while (sigwait(&set, &signo) == 0) {
+        if (p2p_trace_dump(trigger->path) == 0) {
+            printf("Trace written to %s\n", trigger->path);
+        }
+    }
+    return NULL;
+}
+
+// Dump to path each time signo arrives
+int p2p_trace_dump_on_signal(int signo, const char* path) {
+    P2PTraceSignal* trigger = malloc(sizeof(P2PTraceSignal));
+    if (!trigger) return -1;
+    trigger->signo = signo;
+    snprintf(trigger->path, sizeof(trigger->path), "%s", path);
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, signo);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, p2p_trace_signal_thread, trigger) != 0) {
+        free(trigger);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+#else
+
+// Write every thread's events to path
+int p2p_trace_dump(const char* path) {
+    (void)path;
+    printf("Tracing is not compiled in (build with make TRACE=1)\n");
+    return -1;
+}
+
+// Dump to path each time signo arrives
+int p2p_trace_dump_on_signal(int signo, const char* path) {
+    (void)signo;
+    (void)path;
+    printf("Tracing is not compiled in (build with make TRACE=1)\n");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef P2P_TRACE_H
+#define P2P_TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Message lifecycle tracing.
+//
+// Built with -DP2P_TRACE (make TRACE=1), each thread records fixed-size
+// events - a cycle-counter timestamp, a message id and a stage - into its
+// own ring of P2P_TRACE_RING_EVENTS, overwriting the oldest. Recording is
+// a thread-local lookup and three relaxed stores, with no locks and no
+// shared cache lines. p2p_trace_dump writes every ring as Chrome trace
+// JSON (chrome://tracing, ui.perfetto.dev): connects, writes and handlers
+// are slices on their threads, and each message's send (submit to fully
+// written) and receive (read to handled) are async spans keyed by its id.
+// Ids are local to the process: the wire carries none, so a send is not
+// linked to the receive on the other node.
+//
+// Without P2P_TRACE the recording macros compile to nothing and the dump
+// functions report that tracing is unavailable.
+
+// Events each thread keeps (a power of two)
+#define P2P_TRACE_RING_EVENTS 16384
+
+typedef enum {
+    P2P_TRACE_SUBMIT = 0,       // Frames queued on a link (starts the send span)
+    P2P_TRACE_CONNECT_BEGIN,    // Link dialing its peer
+    P2P_TRACE_CONNECT_END,      // value: 0 connected, -1 failed
+    P2P_TRACE_WRITE_BEGIN,      // Link writing an operation (or one quantum of it)
+    P2P_TRACE_WRITE_END,        // value: 0 or -1
+    P2P_TRACE_SENT,             // Send completed (ends the send span); value: send status
+    P2P_TRACE_ACCEPT,           // Inbound connection accepted; value: socket
+    P2P_TRACE_READ,             // Frame read off a connection (starts the receive span); value: frame kind
+    P2P_TRACE_HANDLE_BEGIN,     // Frame handed to its handler
+    P2P_TRACE_HANDLE_END,       // Handler done (ends the receive span)
+    P2P_TRACE_STAGE_COUNT
+} P2PTraceStage;
+
+#ifdef P2P_TRACE
+
+// Record an event on the calling thread
+void p2p_trace_record(P2PTraceStage stage, uint64_t id, int32_t value);
+
+// New message id, unique in the process
+uint64_t p2p_trace_next_id(void);
+
+// Name the calling thread in dumps
+void p2p_trace_name_thread(const char* name);
+
+#define P2P_TRACE_EVENT(stage, id, value) p2p_trace_record((stage), (id), (value))
+#define P2P_TRACE_ID() p2p_trace_next_id()
+#define P2P_TRACE_THREAD(name) p2p_trace_name_thread(name)
+
+#else
+
+#define P2P_TRACE_EVENT(stage, id, value) ((void)0)
+#define P2P_TRACE_ID() ((uint64_t)0)
+#define P2P_TRACE_THREAD(name) ((void)0)
+
+#endif
+
+// Write every thread's events to path as Chrome trace JSON: 0 on success,
+// -1 on error or when tracing is compiled out. Threads keep recording
+// while the dump runs; events overwritten meanwhile are left out.
+int p2p_trace_dump(const char* path);
+
+// Dump to path each time signo arrives, from a dedicated thread. Blocks
+// signo in the calling thread, so call it before starting other threads
+// (they inherit the mask). Returns 0 once installed.
+int p2p_trace_dump_on_signal(int signo, const char* path);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef P2P_TRANSPORT_H
+#define P2P_TRANSPORT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "p2p_buffer.h"
+
+struct P2PNetwork;
+
+// Carries encoded frames between networks in place of sockets. A network
+// without one uses its links and server reactor; with one, every send,
+// discovery message and incoming frame goes through the transport instead,
+// which hands frames back to the receiving network with p2p_network_receive
+// on whatever thread it likes.
+typedef struct P2PTransport {
+    // Start receiving for a network (called by p2p_network_start in place
+    // of listening on a runtime): 0 on success
+    int (*start)(struct P2PTransport* transport, struct P2PNetwork* network);
+    // Carry frames from network to address on a lane (P2PLane); takes over
+    // one reference to frames. type_id is the interned type the frames use
+    // (-1 if none): the transport must define it for the receiver before the
+    // first frames that use it, as a link does. 0 once accepted, -1 if the
+    // address cannot be reached.
+    int (*send)(struct P2PTransport* transport, struct P2PNetwork* network, const char* address,
+                int lane, P2PBuffer* frames, int type_id);
+    // Carry frames the receiver wrote back on a connection the transport
+    // opened (discovery replies, RPC responses, credit grants): 0 on success
+    int (*reply)(struct P2PTransport* transport, void* context, const void* data, size_t len);
+    // Clock the network's failure detector runs on, in milliseconds (NULL
+    // for the monotonic clock). A transport with its own clock also ticks
+    // the detector of every network it starts with failure detection on.
+    long long (*now_ms)(struct P2PTransport* transport);
+    void* context;
+} P2PTransport;
+
+#endif
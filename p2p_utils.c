@@ -6,6 +6,7 @@ void p2p_build_peer_list_string(void* peer_list, char* peer_list_str, size_t str
     peer_list_str[0] = '\0';
     
     P2PPeerList* pl = (P2PPeerList*)peer_list;
+    p2p_peer_list_lock(pl);
     struct Node* current = pl->peer_list.head;
     int first = 1;
     
@@ -20,4 +21,5 @@ void p2p_build_peer_list_string(void* peer_list, char* peer_list_str, size_t str
         first = 0;
         current = current->next;
     }
+    p2p_peer_list_unlock(pl);
 }
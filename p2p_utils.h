@@ -5,6 +5,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+// Size of a peer list string buffer (matches DiscoveryMessage.peer_list)
+#define P2P_PEER_LIST_STR_SIZE 1024
+
 // Build peer list string from peer list
 void p2p_build_peer_list_string(void* peer_list, char* peer_list_str, size_t str_size);
 
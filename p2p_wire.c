@@ -0,0 +1,518 @@
+#include "p2p_wire.h"
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+// Room reserved in front of a frame body for its varint length
+#define P2P_WIRE_PREFIX_MAX 5
+
+// Initialize writer over buf
+void p2p_wire_writer_init(P2PWireWriter* w, void* buf, size_t cap) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->overflow = 0;
+}
+
+void p2p_wire_put_u8(P2PWireWriter* w, uint8_t value) {
+    if (w->len + 1 > w->cap) {
+        w->overflow = 1;
+        return;
+    }
+    w->buf[w->len++] = value;
+}
+
+void p2p_wire_put_u32(P2PWireWriter* w, uint32_t value) {
+    if (w->len + 4 > w->cap) {
+        w->overflow = 1;
+        return;
+    }
+    w->buf[w->len++] = (uint8_t)value;
+    w->buf[w->len++] = (uint8_t)(value >> 8);
+    w->buf[w->len++] = (uint8_t)(value >> 16);
+    w->buf[w->len++] = (uint8_t)(value >> 24);
+}
+
+void p2p_wire_put_varint(P2PWireWriter* w, uint64_t value) {
+    while (value >= 0x80) {
+        p2p_wire_put_u8(w, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    p2p_wire_put_u8(w, (uint8_t)value);
+}
+
+void p2p_wire_put_svarint(P2PWireWriter* w, int64_t value) {
+    // Zigzag keeps small negative numbers small
+    p2p_wire_put_varint(w, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void p2p_wire_put_bytes(P2PWireWriter* w, const void* data, size_t len) {
+    p2p_wire_put_varint(w, len);
+    if (w->len + len > w->cap) {
+        w->overflow = 1;
+        return;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+void p2p_wire_put_string(P2PWireWriter* w, const char* str) {
+    p2p_wire_put_bytes(w, str, strlen(str));
+}
+
+// Initialize reader over a received body
+void p2p_wire_reader_init(P2PWireReader* r, const void* buf, size_t len) {
+    r->buf = buf;
+    r->len = len;
+    r->pos = 0;
+    r->error = 0;
+}
+
+uint8_t p2p_wire_get_u8(P2PWireReader* r) {
+    if (r->pos + 1 > r->len) {
+        r->error = 1;
+        return 0;
+    }
+    return r->buf[r->pos++];
+}
+
+uint32_t p2p_wire_get_u32(P2PWireReader* r) {
+    if (r->pos + 4 > r->len) {
+        r->error = 1;
+        return 0;
+    }
+    const uint8_t* p = r->buf + r->pos;
+    r->pos += 4;
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint64_t p2p_wire_get_varint(P2PWireReader* r) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t byte = p2p_wire_get_u8(r);
+        if (r->error) return 0;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    // More than ten bytes can't be a valid varint
+    r->error = 1;
+    return 0;
+}
+
+int64_t p2p_wire_get_svarint(P2PWireReader* r) {
+    uint64_t value = p2p_wire_get_varint(r);
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+const uint8_t* p2p_wire_get_bytes(P2PWireReader* r, size_t* len) {
+    uint64_t n = p2p_wire_get_varint(r);
+    if (r->error || n > r->len - r->pos) {
+        r->error = 1;
+        return NULL;
+    }
+    const uint8_t* data = r->buf + r->pos;
+    r->pos += n;
+    *len = n;
+    return data;
+}
+
+void p2p_wire_get_string(P2PWireReader* r, char* dst, size_t dst_size) {
+    size_t len = 0;
+    const uint8_t* data = p2p_wire_get_bytes(r, &len);
+    if (!data || len >= dst_size) {
+        r->error = 1;
+        dst[0] = '\0';
+        return;
+    }
+    memcpy(dst, data, len);
+    dst[len] = '\0';
+}
+
+// Start a frame of the given kind (reserves room for the length prefix)
+void p2p_wire_begin_frame(P2PWireWriter* w, P2PFrameKind kind) {
+    w->len = P2P_WIRE_PREFIX_MAX;
+    if (w->len > w->cap) w->overflow = 1;
+    p2p_wire_put_u8(w, P2P_WIRE_VERSION);
+    p2p_wire_put_u8(w, (uint8_t)kind);
+}
+
+// Finish the frame (appends the checksum); returns its total length, 0 on overflow
+size_t p2p_wire_end_frame(P2PWireWriter* w) {
+    if (w->overflow) return 0;
+    p2p_wire_put_u32(w, p2p_crc32c(0, w->buf + P2P_WIRE_PREFIX_MAX, w->len - P2P_WIRE_PREFIX_MAX));
+    if (w->overflow) return 0;
+
+    size_t body_len = w->len - P2P_WIRE_PREFIX_MAX;
+    uint8_t prefix[P2P_WIRE_PREFIX_MAX];
+    P2PWireWriter pw;
+    p2p_wire_writer_init(&pw, prefix, sizeof(prefix));
+    p2p_wire_put_varint(&pw, body_len);
+
+    // Slide the body down so the frame starts at the beginning of the buffer
+    memmove(w->buf + pw.len, w->buf + P2P_WIRE_PREFIX_MAX, body_len);
+    memcpy(w->buf, prefix, pw.len);
+    w->len = pw.len + body_len;
+    return w->len;
+}
+
+// Size of the frame at the start of buf, read from its length prefix
+size_t p2p_wire_frame_size(const void* buf, size_t len) {
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, buf, len < P2P_WIRE_PREFIX_MAX ? len : P2P_WIRE_PREFIX_MAX);
+    uint64_t body_len = p2p_wire_get_varint(&r);
+    if (r.error || body_len == 0 || r.pos + body_len > P2P_WIRE_MAX_FRAME) return 0;
+    return r.pos + body_len;
+}
+
+// Parse one frame from buf: returns bytes consumed, 0 if incomplete, -1 if malformed
+ssize_t p2p_wire_parse_frame(const void* buf, size_t len, P2PFrame* frame) {
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, buf, len < P2P_WIRE_PREFIX_MAX ? len : P2P_WIRE_PREFIX_MAX);
+    uint64_t body_len = p2p_wire_get_varint(&r);
+    if (r.error) {
+        // Either the prefix is cut short or it is longer than any valid one
+        return len < P2P_WIRE_PREFIX_MAX ? 0 : -1;
+    }
+    if (body_len < 2 + P2P_WIRE_CHECKSUM_LEN || r.pos + body_len > P2P_WIRE_MAX_FRAME) return -1;
+    if (r.pos + body_len > len) return 0;
+
+    // Verify before anything looks at the contents
+    const uint8_t* body = (const uint8_t*)buf + r.pos;
+    size_t checked = body_len - P2P_WIRE_CHECKSUM_LEN;
+    uint32_t expected = (uint32_t)body[checked] | (uint32_t)body[checked + 1] << 8 |
+                        (uint32_t)body[checked + 2] << 16 | (uint32_t)body[checked + 3] << 24;
+    if (body[0] < P2P_WIRE_MIN_VERSION || p2p_crc32c(0, body, checked) != expected) return -1;
+
+    frame->version = body[0];
+    frame->kind = body[1];
+    frame->body = body + 2;
+    frame->body_len = checked - 2;
+    frame->size = r.pos + body_len;
+    return r.pos + body_len;
+}
+
+// Encode a P2PMessage frame
+size_t p2p_wire_encode_message(const P2PMessage* msg, void* buf, size_t cap) {
+    P2PWireWriter w;
+    p2p_wire_writer_init(&w, buf, cap);
+    p2p_wire_begin_frame(&w, P2P_FRAME_MESSAGE);
+    p2p_wire_put_string(&w, msg->type);
+    p2p_wire_put_string(&w, msg->sender);
+    p2p_wire_put_bytes(&w, msg->payload, msg->data_len);
+    return p2p_wire_end_frame(&w);
+}
+
+// Encode a DiscoveryMessage frame (the type is implied by the kind)
+size_t p2p_wire_encode_discovery(const DiscoveryMessage* msg, void* buf, size_t cap) {
+    P2PWireWriter w;
+    p2p_wire_writer_init(&w, buf, cap);
+    p2p_wire_begin_frame(&w, P2P_FRAME_DISCOVERY);
+    p2p_wire_put_string(&w, msg->sender);
+    p2p_wire_put_svarint(&w, msg->ttl);
+    p2p_wire_put_string(&w, msg->peer_list);
+    return p2p_wire_end_frame(&w);
+}
+
+// Decode a P2PMessage frame: 0 on success, -1 if malformed
+int p2p_wire_decode_message(const P2PFrame* frame, P2PMessage* msg) {
+    if (frame->kind != P2P_FRAME_MESSAGE) return -1;
+
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, frame->body, frame->body_len);
+    p2p_wire_get_string(&r, msg->type, sizeof(msg->type));
+    p2p_wire_get_string(&r, msg->sender, sizeof(msg->sender));
+    size_t len = 0;
+    const uint8_t* data = p2p_wire_get_bytes(&r, &len);
+    if (r.error || len > P2P_MESSAGE_DATA_MAX) return -1;
+    p2p_message_set_data(msg, data, len);
+    msg->type_id = -1;
+    return 0;
+}
+
+// Encode a type definition frame
+size_t p2p_wire_encode_type_def(int type_id, const char* name, void* buf, size_t cap) {
+    P2PWireWriter w;
+    p2p_wire_writer_init(&w, buf, cap);
+    p2p_wire_begin_frame(&w, P2P_FRAME_TYPE_DEF);
+    p2p_wire_put_varint(&w, (uint64_t)type_id);
+    p2p_wire_put_string(&w, name);
+    return p2p_wire_end_frame(&w);
+}
+
+// Decode a type definition frame: 0 on success, -1 if malformed
+int p2p_wire_decode_type_def(const P2PFrame* frame, int* type_id, char* name, size_t name_size) {
+    if (frame->kind != P2P_FRAME_TYPE_DEF) return -1;
+
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, frame->body, frame->body_len);
+    uint64_t id = p2p_wire_get_varint(&r);
+    p2p_wire_get_string(&r, name, name_size);
+    if (r.error || id >= 65536) return -1;
+    *type_id = (int)id;
+    return 0;
+}
+
+// Encode a typed message frame
+size_t p2p_wire_encode_typed_message(const P2PMessage* msg, void* buf, size_t cap) {
+    P2PWireWriter w;
+    p2p_wire_writer_init(&w, buf, cap);
+    p2p_wire_begin_frame(&w, P2P_FRAME_TYPED_MESSAGE);
+    p2p_wire_put_varint(&w, (uint64_t)msg->type_id);
+    p2p_wire_put_string(&w, msg->sender);
+    p2p_wire_put_bytes(&w, msg->payload, msg->data_len);
+    return p2p_wire_end_frame(&w);
+}
+
+// Decode a typed message frame: 0 on success, -1 if malformed
+int p2p_wire_decode_typed_message(const P2PFrame* frame, P2PMessage* msg) {
+    if (frame->kind != P2P_FRAME_TYPED_MESSAGE) return -1;
+
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, frame->body, frame->body_len);
+    uint64_t id = p2p_wire_get_varint(&r);
+    p2p_wire_get_string(&r, msg->sender, sizeof(msg->sender));
+    size_t len = 0;
+    const uint8_t* data = p2p_wire_get_bytes(&r, &len);
+    if (r.error || id >= 65536 || len > P2P_MESSAGE_DATA_MAX) return -1;
+    msg->type[0] = '\0';
+    msg->type_id = (int)id;
+    p2p_message_set_data(msg, data, len);
+    return 0;
+}
+
+// Encode an RPC request frame
+size_t p2p_wire_encode_request(const P2PRpcRequest* request, void* buf, size_t cap) {
+    P2PWireWriter w;
+    p2p_wire_writer_init(&w, buf, cap);
+    p2p_wire_begin_frame(&w, P2P_FRAME_REQUEST);
+    p2p_wire_put_varint(&w, request->call_id);
+    p2p_wire_put_varint(&w, (uint64_t)request->type_id);
+    p2p_wire_put_string(&w, request->sender);
+    p2p_wire_put_bytes(&w, request->payload, request->len);
+    return p2p_wire_end_frame(&w);
+}
+
+// Decode an RPC request frame: 0 on success, -1 if malformed
+int p2p_wire_decode_request(const P2PFrame* frame, P2PRpcRequest* request) {
+    if (frame->kind != P2P_FRAME_REQUEST) return -1;
+
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, frame->body, frame->body_len);
+    request->call_id = p2p_wire_get_varint(&r);
+    uint64_t id = p2p_wire_get_varint(&r);
+    p2p_wire_get_string(&r, request->sender, sizeof(request->sender));
+    request->payload = p2p_wire_get_bytes(&r, &request->len);
+    if (r.error || id >= 65536) return -1;
+    request->type_id = (int)id;
+    return 0;
+}
+
+// Encode an RPC response frame
+size_t p2p_wire_encode_response(const P2PRpcResponse* response, void* buf, size_t cap) {
+    P2PWireWriter w;
+    p2p_wire_writer_init(&w, buf, cap);
+    p2p_wire_begin_frame(&w, P2P_FRAME_RESPONSE);
+    p2p_wire_put_varint(&w, response->call_id);
+    p2p_wire_put_svarint(&w, response->status);
+    p2p_wire_put_bytes(&w, response->payload, response->len);
+    return p2p_wire_end_frame(&w);
+}
+
+// Decode an RPC response frame: 0 on success, -1 if malformed
+int p2p_wire_decode_response(const P2PFrame* frame, P2PRpcResponse* response) {
+    if (frame->kind != P2P_FRAME_RESPONSE) return -1;
+
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, frame->body, frame->body_len);
+    response->call_id = p2p_wire_get_varint(&r);
+    int64_t status = p2p_wire_get_svarint(&r);
+    response->payload = p2p_wire_get_bytes(&r, &response->len);
+    if (r.error || status < INT32_MIN || status > INT32_MAX) return -1;
+    response->status = (int)status;
+    return 0;
+}
+
+// Encode a credit grant frame
+size_t p2p_wire_encode_credit(uint64_t bytes, void* buf, size_t cap) {
+    P2PWireWriter w;
+    p2p_wire_writer_init(&w, buf, cap);
+    p2p_wire_begin_frame(&w, P2P_FRAME_CREDIT);
+    p2p_wire_put_varint(&w, bytes);
+    return p2p_wire_end_frame(&w);
+}
+
+// Decode a credit grant frame: 0 on success, -1 if malformed
+int p2p_wire_decode_credit(const P2PFrame* frame, uint64_t* bytes) {
+    if (frame->kind != P2P_FRAME_CREDIT) return -1;
+
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, frame->body, frame->body_len);
+    *bytes = p2p_wire_get_varint(&r);
+    return r.error ? -1 : 0;
+}
+
+// Encode a SWIM frame
+size_t p2p_wire_encode_swim(const P2PSwimFrame* swim, void* buf, size_t cap) {
+    P2PWireWriter w;
+    p2p_wire_writer_init(&w, buf, cap);
+    p2p_wire_begin_frame(&w, P2P_FRAME_SWIM);
+    p2p_wire_put_u8(&w, swim->kind);
+    p2p_wire_put_varint(&w, swim->seq);
+    p2p_wire_put_string(&w, swim->from);
+    p2p_wire_put_string(&w, swim->target);
+    p2p_wire_put_string(&w, swim->origin);
+    p2p_wire_put_varint(&w, swim->update_count);
+    for (int i = 0; i < swim->update_count; i++) {
+        p2p_wire_put_string(&w, swim->updates[i].address);
+        p2p_wire_put_u8(&w, swim->updates[i].state);
+        p2p_wire_put_varint(&w, swim->updates[i].incarnation);
+    }
+    return p2p_wire_end_frame(&w);
+}
+
+// Decode a SWIM frame: 0 on success, -1 if malformed
+int p2p_wire_decode_swim(const P2PFrame* frame, P2PSwimFrame* swim) {
+    if (frame->kind != P2P_FRAME_SWIM) return -1;
+
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, frame->body, frame->body_len);
+    swim->kind = p2p_wire_get_u8(&r);
+    swim->seq = p2p_wire_get_varint(&r);
+    p2p_wire_get_string(&r, swim->from, sizeof(swim->from));
+    p2p_wire_get_string(&r, swim->target, sizeof(swim->target));
+    p2p_wire_get_string(&r, swim->origin, sizeof(swim->origin));
+    uint64_t count = p2p_wire_get_varint(&r);
+    if (count > P2P_WIRE_MAX_SWIM_UPDATES || swim->kind > P2P_SWIM_PING_REQ) r.error = 1;
+    swim->update_count = r.error ? 0 : (int)count;
+    for (int i = 0; i < swim->update_count; i++) {
+        p2p_wire_get_string(&r, swim->updates[i].address, sizeof(swim->updates[i].address));
+        swim->updates[i].state = p2p_wire_get_u8(&r);
+        swim->updates[i].incarnation = p2p_wire_get_varint(&r);
+    }
+    return r.error ? -1 : 0;
+}
+
+// Decode a DiscoveryMessage frame: 0 on success, -1 if malformed
+int p2p_wire_decode_discovery(const P2PFrame* frame, DiscoveryMessage* msg) {
+    if (frame->kind != P2P_FRAME_DISCOVERY) return -1;
+
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, frame->body, frame->body_len);
+    strcpy(msg->type, "DISCOVERY");
+    p2p_wire_get_string(&r, msg->sender, sizeof(msg->sender));
+    int64_t ttl = p2p_wire_get_svarint(&r);
+    p2p_wire_get_string(&r, msg->peer_list, sizeof(msg->peer_list));
+    if (ttl < -255 || ttl > 255) r.error = 1;
+    msg->ttl = (int)ttl;
+    return r.error ? -1 : 0;
+}
+
+// Encode a fragment frame
+size_t p2p_wire_encode_fragment(const P2PFragment* fragment, void* buf, size_t cap) {
+    P2PWireWriter w;
+    p2p_wire_writer_init(&w, buf, cap);
+    p2p_wire_begin_frame(&w, P2P_FRAME_FRAGMENT);
+    p2p_wire_put_varint(&w, fragment->msg_id);
+    p2p_wire_put_varint(&w, fragment->total_len);
+    p2p_wire_put_varint(&w, fragment->offset);
+    p2p_wire_put_string(&w, fragment->sender);
+    if (fragment->offset == 0) {
+        p2p_wire_put_string(&w, fragment->type);
+    }
+    p2p_wire_put_bytes(&w, fragment->chunk, fragment->chunk_len);
+    return p2p_wire_end_frame(&w);
+}
+
+// Decode a fragment frame: 0 on success, -1 if malformed
+int p2p_wire_decode_fragment(const P2PFrame* frame, P2PFragment* fragment) {
+    if (frame->kind != P2P_FRAME_FRAGMENT) return -1;
+
+    P2PWireReader r;
+    p2p_wire_reader_init(&r, frame->body, frame->body_len);
+    fragment->msg_id = p2p_wire_get_varint(&r);
+    fragment->total_len = p2p_wire_get_varint(&r);
+    fragment->offset = p2p_wire_get_varint(&r);
+    p2p_wire_get_string(&r, fragment->sender, sizeof(fragment->sender));
+    fragment->type[0] = '\0';
+    if (fragment->offset == 0) {
+        p2p_wire_get_string(&r, fragment->type, sizeof(fragment->type));
+    }
+    fragment->chunk = p2p_wire_get_bytes(&r, &fragment->chunk_len);
+    if (r.error) return -1;
+    if (fragment->offset > fragment->total_len ||
+        fragment->chunk_len > fragment->total_len - fragment->offset) return -1;
+    return 0;
+}
+
+// Initialize a buffered frame reader
+void p2p_wire_stream_init(P2PWireStream* stream, int sock, void* buf, size_t cap) {
+    stream->sock = sock;
+    stream->buf = buf;
+    stream->cap = cap;
+    stream->start = 0;
+    stream->end = 0;
+}
+
+// Take the next buffered frame without reading: 1 if one was complete,
+// 0 if more bytes are needed, -1 if the input is malformed
+int p2p_wire_stream_take(P2PWireStream* stream, P2PFrame* frame) {
+    ssize_t consumed = p2p_wire_parse_frame(stream->buf + stream->start,
+                                            stream->end - stream->start, frame);
+    if (consumed < 0) return -1;
+    if (consumed == 0) return 0;
+    stream->start += consumed;
+    return 1;
+}
+
+// Compact the buffer and read once: bytes read, 0 on EOF, -1 on error or a
+// full buffer, P2P_WIRE_AGAIN if a non-blocking socket has nothing to read
+int p2p_wire_stream_fill(P2PWireStream* stream) {
+    if (stream->start > 0) {
+        memmove(stream->buf, stream->buf + stream->start, stream->end - stream->start);
+        stream->end -= stream->start;
+        stream->start = 0;
+    }
+    if (stream->end == stream->cap) return -1;
+
+    while (1) {
+        ssize_t n = read(stream->sock, stream->buf + stream->end, stream->cap - stream->end);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return P2P_WIRE_AGAIN;
+        if (n < 0) return -1;
+        stream->end += n;
+        return (int)n;
+    }
+}
+
+// Read the next frame: 1 on success, 0 on clean EOF, -1 on error or malformed input
+int p2p_wire_stream_next(P2PWireStream* stream, P2PFrame* frame) {
+    while (1) {
+        int status = p2p_wire_stream_take(stream, frame);
+        if (status != 0) return status;
+
+        // Need more bytes
+        int n = p2p_wire_stream_fill(stream);
+        if (n == 0) return stream->end == stream->start ? 0 : -1;
+        if (n < 0) return -1;
+    }
+}
+
+// Write a whole buffer, retrying short writes: 0 on success, -1 on error.
+// On a non-blocking socket this waits up to P2P_WIRE_WRITE_TIMEOUT for room.
+int p2p_wire_write_all(int sock, const void* buf, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        // MSG_NOSIGNAL: a peer that hung up must not kill the process
+        ssize_t n = send(sock, (const char*)buf + total, len - total, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = { sock, POLLOUT, 0 };
+            if (poll(&pfd, 1, P2P_WIRE_WRITE_TIMEOUT) <= 0) return -1;
+            continue;
+        }
+        if (n <= 0) return -1;
+        total += n;
+    }
+    return 0;
+}
@@ -0,0 +1,237 @@
+#ifndef P2P_WIRE_H
+#define P2P_WIRE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "p2p_message.h"
+#include "p2p_crc32c.h"
+
+// Wire format
+//
+// Every frame is   varint body_length | body
+// and every body   u8 version | u8 kind | kind-specific fields | u32 crc32c
+//
+// Integers are LEB128 varints (signed values zigzag encoded first), fixed
+// width integers are little-endian, and strings/blobs are a varint length
+// followed by the raw bytes - nothing depends on host byte order or struct
+// layout. New fields are only ever appended to a kind's body: decoders skip
+// trailing bytes they do not understand, and frames of unknown kinds are
+// skipped whole using the length prefix. A decoder reads a field added in
+// version N only when frame->version >= N.
+//
+// The trailing CRC-32C covers everything in the body before it and is
+// checked before a frame is handed to any decoder; a frame that fails the
+// check is treated as malformed and drops the connection. Version 1 frames
+// carried no checksum and are rejected.
+
+#define P2P_WIRE_VERSION 2
+
+// Oldest version accepted (the first with a checksum)
+#define P2P_WIRE_MIN_VERSION 2
+
+// Bytes of checksum at the end of every body
+#define P2P_WIRE_CHECKSUM_LEN 4
+
+// Largest frame accepted from the network (prefix + body)
+#define P2P_WIRE_MAX_FRAME (16 * 1024)
+
+// Buffer large enough for any encoded P2PMessage / DiscoveryMessage
+#define P2P_WIRE_MAX_MESSAGE 512
+#define P2P_WIRE_MAX_DISCOVERY 1280
+
+// Returned by p2p_wire_stream_fill when a non-blocking read would block
+#define P2P_WIRE_AGAIN (-2)
+
+// Milliseconds p2p_wire_write_all waits for a full non-blocking socket to drain
+#define P2P_WIRE_WRITE_TIMEOUT 5000
+
+// Frame kinds
+typedef enum {
+    P2P_FRAME_MESSAGE = 1,
+    P2P_FRAME_DISCOVERY = 2,
+    P2P_FRAME_FRAGMENT = 3,
+    P2P_FRAME_TYPE_DEF = 4,         // Binds a sender-local type id to its name for this connection
+    P2P_FRAME_TYPED_MESSAGE = 5,    // P2PMessage carrying a type id instead of the name
+    P2P_FRAME_REQUEST = 6,          // RPC call, answered by a RESPONSE with the same call id
+    P2P_FRAME_RESPONSE = 7,
+    P2P_FRAME_CREDIT = 8,           // Receiver -> sender: bulk bytes consumed, may be sent again
+    P2P_FRAME_SWIM = 9              // Failure detector probe or ack with piggybacked membership updates
+} P2PFrameKind;
+
+// Flow control. A sender may have at most P2P_WIRE_CREDIT_WINDOW bytes of
+// bulk frames (everything except DISCOVERY, SWIM and CREDIT) unconsumed on one
+// connection; every connection starts with a full window and the receiver
+// returns bytes with CREDIT frames as its handlers consume them.
+#define P2P_WIRE_CREDIT_WINDOW (256 * 1024)
+
+// One piece of a large message. Fragments of a message travel in order on
+// one connection; only the first (offset 0) carries the type.
+typedef struct {
+    uint64_t msg_id;        // Unique per sender
+    uint64_t total_len;     // Full payload length
+    uint64_t offset;        // Position of this chunk in the payload
+    char type[32];
+    char sender[64];
+    const uint8_t* chunk;   // Points into the encode source / receive buffer
+    size_t chunk_len;
+} P2PFragment;
+
+// Largest RPC payload (requests and responses travel in a single frame)
+#define P2P_WIRE_MAX_RPC_PAYLOAD (P2P_WIRE_MAX_FRAME - 256)
+
+// RPC request. The type id is the caller's, bound by an earlier TYPE_DEF
+// on the same connection.
+typedef struct {
+    uint64_t call_id;       // Correlation id, unique per connection
+    int type_id;
+    char sender[64];
+    const uint8_t* payload; // Points into the encode source / receive buffer
+    size_t len;
+} P2PRpcRequest;
+
+// RPC response, matched to its request by call_id (may arrive in any order)
+typedef struct {
+    uint64_t call_id;
+    int status;             // 0 = OK, positive = handler error, negative = P2P_RPC_* error
+    const uint8_t* payload;
+    size_t len;
+} P2PRpcResponse;
+
+// Membership updates one SWIM frame carries at most
+#define P2P_WIRE_MAX_SWIM_UPDATES 8
+
+// Buffer large enough for any encoded SWIM frame
+#define P2P_WIRE_MAX_SWIM 2048
+
+typedef enum {
+    P2P_SWIM_PING = 0,          // Probe of target, answered with an ACK to from
+    P2P_SWIM_ACK = 1,
+    P2P_SWIM_PING_REQ = 2       // Ask from's neighbour to probe target on its behalf
+} P2PSwimKind;
+
+// Failure detector state of one member, as gossiped
+typedef struct {
+    char address[64];
+    uint8_t state;              // P2PPeerState
+    uint64_t incarnation;
+} P2PSwimUpdate;
+
+// SWIM frame. A PING sent for a PING_REQ names the node that asked in
+// origin, and so does the ACK that answers it, which the relaying node
+// then passes back to origin.
+typedef struct {
+    uint8_t kind;               // P2PSwimKind
+    uint64_t seq;               // Probe sequence number of the node that started the probe
+    char from[64];              // Sender's node id, where replies go
+    char target[64];            // Node being probed
+    char origin[64];            // Node an indirect probe is for ("" if direct)
+    int update_count;
+    P2PSwimUpdate updates[P2P_WIRE_MAX_SWIM_UPDATES];
+} P2PSwimFrame;
+
+// Encoding cursor over a caller-provided buffer
+typedef struct {
+    uint8_t* buf;
+    size_t cap;
+    size_t len;
+    int overflow;   // Set once a write did not fit
+} P2PWireWriter;
+
+// Decoding cursor over a received body
+typedef struct {
+    const uint8_t* buf;
+    size_t len;
+    size_t pos;
+    int error;      // Set once a read ran past the end or was malformed
+} P2PWireReader;
+
+// Parsed frame (body points into the receive buffer)
+typedef struct {
+    uint8_t version;
+    uint8_t kind;
+    const uint8_t* body;    // Fields after version and kind
+    size_t body_len;
+    size_t size;            // Whole frame on the wire, length prefix included
+} P2PFrame;
+
+// Buffered frame reader for a socket
+typedef struct {
+    int sock;
+    uint8_t* buf;
+    size_t cap;
+    size_t start;   // First unconsumed byte
+    size_t end;     // One past the last received byte
+} P2PWireStream;
+
+// Primitive encoders
+void p2p_wire_writer_init(P2PWireWriter* w, void* buf, size_t cap);
+void p2p_wire_put_u8(P2PWireWriter* w, uint8_t value);
+void p2p_wire_put_u32(P2PWireWriter* w, uint32_t value);
+void p2p_wire_put_varint(P2PWireWriter* w, uint64_t value);
+void p2p_wire_put_svarint(P2PWireWriter* w, int64_t value);
+void p2p_wire_put_bytes(P2PWireWriter* w, const void* data, size_t len);
+void p2p_wire_put_string(P2PWireWriter* w, const char* str);
+
+// Primitive decoders
+void p2p_wire_reader_init(P2PWireReader* r, const void* buf, size_t len);
+uint8_t p2p_wire_get_u8(P2PWireReader* r);
+uint32_t p2p_wire_get_u32(P2PWireReader* r);
+uint64_t p2p_wire_get_varint(P2PWireReader* r);
+int64_t p2p_wire_get_svarint(P2PWireReader* r);
+// Zero-copy view of a length-prefixed blob, NULL on error
+const uint8_t* p2p_wire_get_bytes(P2PWireReader* r, size_t* len);
+// Copy a length-prefixed string into dst (always terminated, error if it does not fit)
+void p2p_wire_get_string(P2PWireReader* r, char* dst, size_t dst_size);
+
+// Start a frame of the given kind (reserves room for the length prefix)
+void p2p_wire_begin_frame(P2PWireWriter* w, P2PFrameKind kind);
+// Finish the frame started at the beginning of w; returns its total length, 0 on overflow
+size_t p2p_wire_end_frame(P2PWireWriter* w);
+
+// Parse one frame from buf: returns bytes consumed, 0 if incomplete, -1 if
+// malformed (including a checksum mismatch or a version without one)
+ssize_t p2p_wire_parse_frame(const void* buf, size_t len, P2PFrame* frame);
+
+// Size of the frame buf starts with (prefix + body) from its prefix alone,
+// without checking the body: 0 if the prefix is incomplete or invalid
+size_t p2p_wire_frame_size(const void* buf, size_t len);
+
+// Message codecs (encoders return the frame length, 0 if it did not fit)
+size_t p2p_wire_encode_message(const P2PMessage* msg, void* buf, size_t cap);
+size_t p2p_wire_encode_discovery(const DiscoveryMessage* msg, void* buf, size_t cap);
+int p2p_wire_decode_message(const P2PFrame* frame, P2PMessage* msg);
+int p2p_wire_decode_discovery(const P2PFrame* frame, DiscoveryMessage* msg);
+size_t p2p_wire_encode_type_def(int type_id, const char* name, void* buf, size_t cap);
+int p2p_wire_decode_type_def(const P2PFrame* frame, int* type_id, char* name, size_t name_size);
+// Typed messages use msg->type_id; decoding leaves the sender's id in type_id and type empty
+size_t p2p_wire_encode_typed_message(const P2PMessage* msg, void* buf, size_t cap);
+int p2p_wire_decode_typed_message(const P2PFrame* frame, P2PMessage* msg);
+size_t p2p_wire_encode_fragment(const P2PFragment* fragment, void* buf, size_t cap);
+int p2p_wire_decode_fragment(const P2PFrame* frame, P2PFragment* fragment);
+size_t p2p_wire_encode_request(const P2PRpcRequest* request, void* buf, size_t cap);
+int p2p_wire_decode_request(const P2PFrame* frame, P2PRpcRequest* request);
+size_t p2p_wire_encode_response(const P2PRpcResponse* response, void* buf, size_t cap);
+int p2p_wire_decode_response(const P2PFrame* frame, P2PRpcResponse* response);
+size_t p2p_wire_encode_credit(uint64_t bytes, void* buf, size_t cap);
+int p2p_wire_decode_credit(const P2PFrame* frame, uint64_t* bytes);
+size_t p2p_wire_encode_swim(const P2PSwimFrame* swim, void* buf, size_t cap);
+int p2p_wire_decode_swim(const P2PFrame* frame, P2PSwimFrame* swim);
+
+// Socket framing
+void p2p_wire_stream_init(P2PWireStream* stream, int sock, void* buf, size_t cap);
+// Take the next buffered frame without reading: 1 if one was complete,
+// 0 if more bytes are needed, -1 if the input is malformed
+int p2p_wire_stream_take(P2PWireStream* stream, P2PFrame* frame);
+// Compact the buffer and read once: bytes read, 0 on EOF, -1 on error or a
+// full buffer, P2P_WIRE_AGAIN if a non-blocking socket has nothing to read
+int p2p_wire_stream_fill(P2PWireStream* stream);
+// Read the next frame: 1 on success, 0 on clean EOF, -1 on error or malformed input
+int p2p_wire_stream_next(P2PWireStream* stream, P2PFrame* frame);
+// Write a whole buffer, retrying short writes: 0 on success, -1 on error.
+// On a non-blocking socket this waits up to P2P_WIRE_WRITE_TIMEOUT for room.
+int p2p_wire_write_all(int sock, const void* buf, size_t len);
+
+#endif